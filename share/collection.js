@@ -27,7 +27,15 @@ var c4 =
   config:
   {
     width: 324,
-    height: 200
+    height: 200,
+    /* One of "avg", "lttb", "minmax" and "m4". Rickshaw expects all series
+     * of a graph to have the same number of values, which only "avg"
+     * guarantees. */
+    downsample: "avg",
+    /* One of "json", "binary" and "binary32". */
+    format: "json",
+    /* Maximum number of instances fetched with one request. */
+    batch_size: 64
   }
 };
 
@@ -264,7 +272,10 @@ function metric_def_to_rickshaw_series (metric_def, metric_data)
 
   for (i = 0; i < metric_data.data.length; i++)
   {
-    var x = metric_data.first_value_time + (i * metric_data.interval);
+    /* Selected values are not equidistant and come with their times. */
+    var x = metric_data.time
+      ? metric_data.time[i]
+      : metric_data.first_value_time + (i * metric_data.interval);
     var y = metric_data.data[i];
 
     series.data.push ({'x': x, 'y': y});
@@ -341,6 +352,38 @@ function inst_redraw (inst, graph_def, graph_data) /* {{{ */
     return; /* TODO: Insert new data into the graph */
 } /* }}} function inst_redraw */
 
+/* Requests data in the configured format and passes the decoded document to
+ * "callback". */
+function data_fetch (params, callback) /* {{{ */
+{
+  params.resolution = (params.end - params.begin) / c4.config.width;
+  params.downsample = c4.config.downsample;
+  params.format = c4.config.format;
+
+  if (params.format == "json")
+  {
+    $.getJSON ("collection.fcgi", params, callback);
+    return;
+  }
+
+  /* jQuery can't handle binary responses. */
+  var xhr = new XMLHttpRequest ();
+  xhr.open ("GET", "collection.fcgi?" + $.param (params), true);
+  xhr.responseType = "arraybuffer";
+  xhr.onload = function ()
+  {
+    var data;
+
+    if (xhr.status != 200)
+      return;
+
+    data = instance_data_decode (xhr.response);
+    if (data)
+      callback (data);
+  };
+  xhr.send ();
+} /* }}} data_fetch */
+
 function inst_fetch_data (inst, begin, end) /* {{{ */
 {
   var graph_def;
@@ -354,15 +397,141 @@ function inst_fetch_data (inst, begin, end) /* {{{ */
   params.action = "instance_data_json";
   params.begin = begin || inst.begin;
   params.end = end || inst.end;
-  params.resolution = (params.end - params.begin) / c4.config.width;
 
-  $.getJSON ("collection.fcgi", params,
-      function (data)
-      {
-        inst_redraw (inst, graph_def, data);
-      }); /* getJSON */
+  data_fetch (params, function (data)
+  {
+    inst_redraw (inst, graph_def, data);
+  });
 } /* }}} inst_fetch_data */
 
+/* Fetches the data of several instances with one request per time span and
+ * "c4.config.batch_size" instances. */
+function insts_fetch_data (insts) /* {{{ */
+{
+  var batches = {};
+  var key;
+  var i;
+
+  for (i = 0; i < insts.length; i++)
+  {
+    var batch;
+
+    if (!inst_get_defs (insts[i]))
+      continue;
+
+    key = insts[i].begin + "-" + insts[i].end;
+    if (!batches[key])
+      batches[key] = [[]];
+
+    batch = batches[key][batches[key].length - 1];
+    if (batch.length >= c4.config.batch_size)
+    {
+      batch = [];
+      batches[key].push (batch);
+    }
+    batch.push (insts[i]);
+  }
+
+  $.each (batches, function (key, batch_list)
+  {
+    $.each (batch_list, function (index, batch)
+    {
+      var params = {
+        action: "instances_data_json",
+        begin: batch[0].begin,
+        end: batch[0].end
+      };
+      var j;
+
+      for (j = 0; j < batch.length; j++)
+        params["inst" + j] = $.param (instance_get_params (batch[j]));
+
+      data_fetch (params, function (data)
+      {
+        var k;
+
+        for (k = 0; (k < batch.length) && (k < data.length); k++)
+        {
+          if (data[k])
+            inst_redraw (batch[k], inst_get_defs (batch[k]), data[k]);
+        }
+      });
+    });
+  });
+} /* }}} insts_fetch_data */
+
+/* Decodes the binary format of "instance_data_json" and "instances_data_json"
+ * into the structure the JSON format returns. See
+ * "src/action_instance_data_json.c". */
+function instance_data_decode (buffer) /* {{{ */
+{
+  var view = new DataView (buffer);
+  var header_length;
+  var value_size;
+  var columns_offset;
+  var header_bytes;
+  var header;
+
+  function decode_column (column, size)
+  {
+    var ret = new Array (column.length);
+    var offset = columns_offset + column.offset;
+    var value;
+    var j;
+
+    for (j = 0; j < column.length; j++)
+    {
+      if (size == 4)
+        value = view.getFloat32 (offset + (4 * j), /* little endian = */ true);
+      else
+        value = view.getFloat64 (offset + (8 * j), /* little endian = */ true);
+      ret[j] = isNaN (value) ? null : value;
+    }
+    return (ret);
+  }
+
+  if ((buffer.byteLength < 16)
+      || (String.fromCharCode (view.getUint8 (0), view.getUint8 (1),
+          view.getUint8 (2), view.getUint8 (3)) != "C4DB")
+      || (view.getUint32 (4, true) != 1))
+    return;
+
+  header_length = view.getUint32 (8, true);
+  value_size = view.getUint32 (12, true);
+  columns_offset = 16 + header_length;
+
+  header_bytes = new Uint8Array (buffer, 16, header_length);
+  if (window.TextDecoder)
+    header = JSON.parse (new TextDecoder ("utf-8").decode (header_bytes));
+  else
+    header = JSON.parse (decodeURIComponent (escape (
+            String.fromCharCode.apply (null, header_bytes))));
+
+  /* "instances_data_json" returns one array (or null) per instance. */
+  function decode_list (list)
+  {
+    var j;
+
+    for (j = 0; j < list.length; j++)
+    {
+      if (!list[j])
+        continue;
+      else if (list[j] instanceof Array)
+        decode_list (list[j]);
+      else
+      {
+        list[j].data = decode_column (list[j].data, value_size);
+        if (list[j].time)
+          list[j].time = decode_column (list[j].time, 8);
+      }
+    }
+  }
+
+  decode_list (header);
+
+  return (header);
+} /* }}} instance_data_decode */
+
 function json_graph_update (index) /* {{{ */
 {
   var inst;
@@ -651,8 +820,10 @@ $(document).ready(function() {
     var i;
     for (i = 0; i < c4.instances.length; i++)
     {
-      json_graph_update (i);
+      if (!c4.instances[i].container)
+        c4.instances[i].container = "c4-graph" + i;
     }
+    insts_fetch_data (c4.instances);
 });
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -32,6 +32,7 @@
 #include <dirent.h> /* for PATH_MAX */
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <rrd.h>
 
@@ -40,6 +41,8 @@
 #include "graph.h"
 #include "graph_instance.h"
 #include "graph_list.h"
+#include "graph_config.h"
+#include "render_cache.h"
 #include "utils_cgi.h"
 #include "utils_array.h"
 
@@ -52,72 +55,67 @@ struct graph_data_s
   rrd_info_t *info;
   time_t mtime;
   time_t expires;
+  char etag[64];
   long now;
   long begin;
   long end;
 };
 typedef struct graph_data_s graph_data_t;
 
+/* rrd_graph_v() parses its arguments with getopt(3), which uses global
+ * variables. Only one thread may call it at a time. */
+static pthread_mutex_t graph_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void emulate_graph (int argc, char **argv) /* {{{ */
 {
   int i;
 
-  printf ("rrdtool \\\n");
+  cgi_printf ("rrdtool \\\n");
   for (i = 0; i < argc; i++)
   {
     if (i < (argc - 1))
-      printf ("  \"%s\" \\\n", argv[i]);
+      cgi_printf ("  \"%s\" \\\n", argv[i]);
     else
-      printf ("  \"%s\"\n", argv[i]);
+      cgi_printf ("  \"%s\"\n", argv[i]);
   }
 } /* }}} void emulate_graph */
 
 static int ag_info_print (rrd_info_t *info) /* {{{ */
 {
   if (info->type == RD_I_VAL)
-    printf ("[info] %s = %g;\n", info->key, info->value.u_val);
+    cgi_printf ("[info] %s = %g;\n", info->key, info->value.u_val);
   else if (info->type == RD_I_CNT)
-    printf ("[info] %s = %lu;\n", info->key, info->value.u_cnt);
+    cgi_printf ("[info] %s = %lu;\n", info->key, info->value.u_cnt);
   else if (info->type == RD_I_STR)
-    printf ("[info] %s = %s;\n", info->key, info->value.u_str);
+    cgi_printf ("[info] %s = %s;\n", info->key, info->value.u_str);
   else if (info->type == RD_I_INT)
-    printf ("[info] %s = %i;\n", info->key, info->value.u_int);
+    cgi_printf ("[info] %s = %i;\n", info->key, info->value.u_int);
   else if (info->type == RD_I_BLO)
-    printf ("[info] %s = [blob, %lu bytes];\n", info->key, info->value.u_blo.size);
+    cgi_printf ("[info] %s = [blob, %lu bytes];\n", info->key, info->value.u_blo.size);
   else
-    printf ("[info] %s = [unknown type %#x];\n", info->key, info->type);
+    cgi_printf ("[info] %s = [unknown type %#x];\n", info->key, info->type);
 
   return (0);
 } /* }}} int ag_info_print */
 
-static int output_graph (graph_data_t *data) /* {{{ */
+static rrd_info_t *ag_find_image (rrd_info_t *info) /* {{{ */
 {
   rrd_info_t *img;
-  char time_buffer[256];
-  time_t expires;
-  int status;
 
-  for (img = data->info; img != NULL; img = img->next)
+  for (img = info; img != NULL; img = img->next)
     if ((strcmp ("image", img->key) == 0)
         && (img->type == RD_I_BLO))
       break;
 
-  if (img == NULL)
-    return (ENOENT);
+  return (img);
+} /* }}} rrd_info_t *ag_find_image */
 
-  printf ("Content-Type: image/png\n"
-      "Content-Length: %lu\n",
-      img->value.u_blo.size);
-  if (data->mtime > 0)
-  {
-    int status;
-    
-    status = time_to_rfc1123 (data->mtime, time_buffer, sizeof (time_buffer));
-    if (status == 0)
-      printf ("Last-Modified: %s\n", time_buffer);
-  }
+static time_t ag_expires (const graph_data_t *data) /* {{{ */
+{
+  /* The time span has been rounded, see "ag_round_time_span". */
+  if (data->expires > 0)
+    return (data->expires);
 
-  /* Print Expires header. */
   if (data->end >= data->now)
   {
     /* The end of the timespan can be seen. */
@@ -126,28 +124,84 @@ static int output_graph (graph_data_t *data) /* {{{ */
     /* FIXME: Handle graphs with width != 400. */
     secs_per_pixel = (data->end - data->begin) / 400;
 
-    expires = (time_t) (data->now + secs_per_pixel);
+    return ((time_t) (data->now + secs_per_pixel));
   }
   else /* if (data->end < data->now) */
   {
-    expires = (time_t) (data->now + 86400);
+    return ((time_t) (data->now + 86400));
   }
-  status = time_to_rfc1123 (expires, time_buffer, sizeof (time_buffer));
+} /* }}} time_t ag_expires */
+
+static int output_graph (graph_data_t *data, /* {{{ */
+    const void *img, size_t img_size)
+{
+  char time_buffer[256];
+  int status;
+
+  if (img == NULL)
+    return (ENOENT);
+
+  cgi_printf ("Content-Type: image/png\n"
+      "Content-Length: %lu\n",
+      (unsigned long) img_size);
+  cgi_print_validators (data->etag, data->mtime);
+
+  status = time_to_rfc1123 (ag_expires (data),
+      time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n", time_buffer);
+    cgi_printf ("Expires: %s\n", time_buffer);
 
-  printf ("X-Generator: "PACKAGE_STRING"\n");
-  printf ("\n");
+  cgi_printf ("X-Generator: "PACKAGE_STRING"\n");
+  cgi_printf ("\n");
 
-  fwrite (img->value.u_blo.ptr, img->value.u_blo.size,
-      /* nmemb = */ 1, stdout);
+  cgi_write (img, img_size);
 
   return (0);
 } /* }}} int output_graph */
 
+/* Rounds time spans relative to now, e.g. "the last day", down to a multiple
+ * of the time one pixel represents, or "RenderCacheQuantum" if that is
+ * longer. Requests made at slightly different times then produce identical
+ * arguments and share a cache entry. Sets "data->expires" to the time at
+ * which the next time span starts. */
+static void ag_round_time_span (graph_data_t *data) /* {{{ */
+{
+  long quantum;
+  long shift;
+
+  data->expires = 0;
+
+  if (!time_arg_is_relative ("end"))
+    return;
+
+  /* FIXME: Handle graphs with width != 400. */
+  quantum = (data->end - data->begin) / 400;
+  if (quantum < (long) graph_config_get_render_cache_quantum ())
+    quantum = (long) graph_config_get_render_cache_quantum ();
+  if (quantum < 1)
+    return;
+
+  shift = data->end % quantum;
+  data->end -= shift;
+  if (time_arg_is_relative ("begin"))
+    data->begin -= shift;
+
+  data->expires = (time_t) (data->end + quantum);
+} /* }}} void ag_round_time_span */
+
+/* Returns the cached image for "key" in "ret_img". Images of absolute time
+ * spans are validated against "data->mtime", the modification time of the
+ * instance's files. */
+static int ag_cache_lookup (graph_data_t *data, /* {{{ */
+    const char *key, void **ret_img, size_t *ret_img_size)
+{
+  return (rc_get (key, (time_t) data->now, data->mtime,
+        ret_img, ret_img_size, &data->mtime));
+} /* }}} int ag_cache_lookup */
+
 #define OUTPUT_ERROR(...) do {             \
-  printf ("Content-Type: text/plain\n\n"); \
-  printf (__VA_ARGS__);                    \
+  cgi_printf ("Content-Type: text/plain\n\n"); \
+  cgi_printf (__VA_ARGS__);                    \
   return (0);                              \
 } while (0)
 
@@ -156,6 +210,10 @@ int action_graph (void) /* {{{ */
   graph_data_t data;
   graph_config_t *cfg;
   graph_instance_t *inst;
+  rrd_info_t *img;
+  void *cached_img = NULL;
+  size_t cached_img_size = 0;
+  char *key;
   int status;
 
   int argc;
@@ -169,6 +227,7 @@ int action_graph (void) /* {{{ */
   if (inst == NULL)
     OUTPUT_ERROR ("inst_get_selected (%p) failed.\n", (void *) cfg);
 
+  memset (&data, 0, sizeof (data));
   data.args = ra_create ();
   if (data.args == NULL)
     return (ENOMEM);
@@ -181,6 +240,8 @@ int action_graph (void) /* {{{ */
   status = get_time_args (&data.begin, &data.end, &data.now);
   if (status == 0)
   {
+    ag_round_time_span (&data);
+
     array_append (data.args->options, "-s");
     array_append_format (data.args->options, "%li", data.begin);
     array_append (data.args->options, "-e");
@@ -202,38 +263,101 @@ int action_graph (void) /* {{{ */
     return (-1);
   }
 
+  /* Images of relative time spans are identified by the rounded time span
+   * alone. Checking the modification time of their files is not necessary
+   * and would defeat caching. */
+  if (data.expires == 0)
+    data.mtime = inst_get_mtime (inst);
+  snprintf (data.etag, sizeof (data.etag), "\"%"PRIu64"-%li-%li\"",
+      gl_get_generation (), data.end, (long) data.mtime);
+
+  if (cgi_not_modified (data.etag, (data.expires == 0) ? data.mtime : 0))
+  {
+    cgi_print_not_modified (data.etag, data.mtime, ag_expires (&data));
+    ra_argv_free (argv);
+    ra_destroy (data.args);
+    return (0);
+  }
+
+  key = rc_key (argc, argv);
+  if (key != NULL)
+  {
+    status = ag_cache_lookup (&data, key, &cached_img, &cached_img_size);
+    if (status == 0)
+    {
+      output_graph (&data, cached_img, cached_img_size);
+
+      free (cached_img);
+      free (key);
+      ra_argv_free (argv);
+      ra_destroy (data.args);
+      return (0);
+    }
+  }
+
+  /* If another thread is rendering, it may be rendering this very graph.
+   * Check the cache again once it's done. */
+  if (pthread_mutex_trylock (&graph_lock) != 0)
+  {
+    pthread_mutex_lock (&graph_lock);
+    if ((key != NULL)
+        && (ag_cache_lookup (&data, key,
+            &cached_img, &cached_img_size) == 0))
+    {
+      pthread_mutex_unlock (&graph_lock);
+      output_graph (&data, cached_img, cached_img_size);
+
+      free (cached_img);
+      free (key);
+      ra_argv_free (argv);
+      ra_destroy (data.args);
+      return (0);
+    }
+  }
   rrd_clear_error ();
   data.info = rrd_graph_v (argc, argv);
+
+  img = NULL;
+  if ((data.info != NULL) && !rrd_test_error ())
+  {
+    if (data.expires != 0)
+      data.mtime = inst_get_mtime (inst);
+
+    img = ag_find_image (data.info);
+    if ((img != NULL) && (key != NULL))
+      rc_put (key, img->value.u_blo.ptr, (size_t) img->value.u_blo.size,
+          data.mtime, data.expires);
+  }
+  pthread_mutex_unlock (&graph_lock);
+
   if ((data.info == NULL) || rrd_test_error ())
   {
-    printf ("Content-Type: text/plain\n\n");
-    printf ("rrd_graph_v failed: %s\n", rrd_get_error ());
+    cgi_printf ("Content-Type: text/plain\n\n");
+    cgi_printf ("rrd_graph_v failed: %s\n", rrd_get_error ());
     emulate_graph (argc, argv);
   }
-  else
+  else if (img == NULL)
   {
-    int status;
+    rrd_info_t *ptr;
 
-    data.mtime = inst_get_mtime (inst);
+    cgi_printf ("Content-Type: text/plain\n\n");
+    cgi_printf ("output_graph failed. Maybe the \"image\" info was not found?\n\n");
 
-    status = output_graph (&data);
-    if (status != 0)
+    for (ptr = data.info; ptr != NULL; ptr = ptr->next)
     {
-      rrd_info_t *ptr;
-
-      printf ("Content-Type: text/plain\n\n");
-      printf ("output_graph failed. Maybe the \"image\" info was not found?\n\n");
-
-      for (ptr = data.info; ptr != NULL; ptr = ptr->next)
-      {
-        ag_info_print (ptr);
-      }
+      ag_info_print (ptr);
     }
   }
+  else
+  {
+    output_graph (&data, img->value.u_blo.ptr,
+        (size_t) img->value.u_blo.size);
+  }
 
   if (data.info != NULL)
     rrd_info_free (data.info);
 
+  free (key);
   ra_argv_free (argv);
   ra_destroy (data.args);
   data.args = NULL;
@@ -35,6 +35,7 @@
 #include "graph_instance.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -42,21 +43,21 @@
 /* Expire data after one day. */
 #define EXPIRES_SECS 86400
 
-static void write_callback (__attribute__((unused)) void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
 {
-  fwrite ((void *) str, /* size = */ len, /* nmemb = */ 1, stdout);
-} /* }}} void write_callback */
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
 
 int action_graph_def_json (void) /* {{{ */
 {
   graph_config_t *cfg;
   graph_instance_t *inst;
 
-  yajl_gen_config handler_config;
-  yajl_gen handler;
+  json_writer_t *handler;
 
   time_t now;
+  char etag[64];
   char time_buffer[128];
   int status;
 
@@ -68,30 +69,34 @@ int action_graph_def_json (void) /* {{{ */
   if (inst == NULL)
     return (EINVAL);
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 1;
-  handler_config.indentString = "  ";
-
-  handler = yajl_gen_alloc2 (write_callback,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
+  /* The response only depends on the graph list and the request
+   * parameters. */
+  now = time (NULL);
+  snprintf (etag, sizeof (etag), "\"%"PRIu64"\"", gl_get_generation ());
+  if (cgi_not_modified (etag, /* mtime = */ 0))
+  {
+    cgi_print_not_modified (etag, /* mtime = */ 0, now + EXPIRES_SECS);
+    return (0);
+  }
+
+  handler = json_writer_create (write_callback, /* user_data = */ NULL,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
     return (-1);
 
-  printf ("Content-Type: application/json\n");
+  cgi_printf ("Content-Type: application/json\n");
+  cgi_print_validators (etag, /* mtime = */ 0);
 
-  now = time (NULL);
   status = time_to_rfc1123 (now + EXPIRES_SECS, time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n"
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
+  cgi_printf ("\n");
 
   status = graph_def_to_json (cfg, inst, handler);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
 
   return (status);
 } /* }}} int action_graph_def_json */
@@ -21,9 +21,11 @@
  *   Florian octo Forster <ff at octo.it>
  **/
 
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include <stdint.h>
 #include <inttypes.h>
@@ -32,9 +34,11 @@
 #include "action_instance_data_json.h"
 #include "common.h"
 #include "graph.h"
+#include "graph_config.h"
 #include "graph_instance.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -42,12 +46,41 @@
 /* Expire data after one day. */
 #define EXPIRES_SECS 86400
 
-static void write_callback (__attribute__((unused)) void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+/* The binary format starts with this magic, followed by the format version,
+ * the length of the JSON header including padding and the size of values,
+ * each as a little endian 32 bit integer. The JSON header is the document
+ * the JSON format would return, with the "data" and "time" arrays replaced by
+ * their position in the columns following the header. See "data_columns_t". */
+#define BINARY_MAGIC "C4DB"
+#define BINARY_VERSION 1
+#define BINARY_PREAMBLE_SIZE 16
+
+/* Maximum number of instances "instances_data_json" returns. */
+#define INSTANCES_MAX 256
+
+/* The parameters shared by "instance_data_json" and "instances_data_json". */
+struct data_request_s
 {
-  fwrite ((void *) str, /* size = */ len, /* nmemb = */ 1, stdout);
-} /* }}} void write_callback */
+  time_t tt_begin;
+  time_t tt_end;
+  time_t tt_now;
+
+  dp_time_t begin;
+  dp_time_t end;
+  dp_time_t resolution;
+  dp_cf_t cf;
+  downsample_t downsample;
+  data_columns_t columns;
 
+  time_t expires;
+};
+typedef struct data_request_s data_request_t;
+
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
+{
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
 static int param_get_resolution (dp_time_t *resolution) /* {{{ */
 {
   const char *tmp;
@@ -71,81 +104,279 @@ static int param_get_resolution (dp_time_t *resolution) /* {{{ */
   return (0);
 } /* }}} int param_get_resolution */
 
-int action_instance_data_json (void) /* {{{ */
+/* Returns the size of values in the binary format, or zero for JSON. */
+static int param_get_format (size_t *ret_value_size) /* {{{ */
 {
-  graph_config_t *cfg;
-  graph_instance_t *inst;
-
-  time_t tt_begin = 0;
-  time_t tt_end = 0;
-  time_t tt_now = 0;
+  const char *tmp;
 
-  dp_time_t dp_begin = { 0, 0 };
-  dp_time_t dp_end = { 0, 0 };
-  dp_time_t dp_resolution = { 0, 0 };
+  tmp = param ("format");
+  if ((tmp == NULL) || (strcasecmp ("json", tmp) == 0))
+    *ret_value_size = 0;
+  else if (strcasecmp ("binary", tmp) == 0)
+    *ret_value_size = 8;
+  else if (strcasecmp ("binary32", tmp) == 0)
+    *ret_value_size = 4;
+  else
+    return (EINVAL);
 
-  yajl_gen_config handler_config;
-  yajl_gen handler;
+  return (0);
+} /* }}} int param_get_format */
 
-  time_t expires;
-  char time_buffer[128];
-  int status;
+static void put_uint32 (unsigned char *buffer, uint32_t value) /* {{{ */
+{
+  buffer[0] = (unsigned char) value;
+  buffer[1] = (unsigned char) (value >> 8);
+  buffer[2] = (unsigned char) (value >> 16);
+  buffer[3] = (unsigned char) (value >> 24);
+} /* }}} void put_uint32 */
 
-  cfg = gl_graph_get_selected ();
-  if (cfg == NULL)
-    return (ENOMEM);
+/* Writes the binary format. The header is padded with spaces, so that the
+ * columns are aligned to eight bytes. */
+static int output_binary (json_writer_t *handler, /* {{{ */
+    const data_columns_t *columns)
+{
+  unsigned char preamble[BINARY_PREAMBLE_SIZE];
+  const char *json = NULL;
+  size_t json_len = 0;
+  size_t padding;
 
-  inst = inst_get_selected (cfg);
-  if (inst == NULL)
+  if ((json_writer_get_buffer (handler, &json, &json_len) != 0)
+      || (json == NULL))
+  {
+    cgi_printf ("\n");
     return (EINVAL);
+  }
+
+  padding = (8 - ((BINARY_PREAMBLE_SIZE + json_len) % 8)) % 8;
+
+  memcpy (preamble, BINARY_MAGIC, 4);
+  put_uint32 (preamble + 4, BINARY_VERSION);
+  put_uint32 (preamble + 8, (uint32_t) (json_len + padding));
+  put_uint32 (preamble + 12, (uint32_t) columns->value_size);
+
+  cgi_printf ("Content-Length: %lu\n\n",
+      (unsigned long) (sizeof (preamble) + json_len + padding
+        + columns->buffer_used));
+
+  cgi_write (preamble, sizeof (preamble));
+  cgi_write (json, json_len);
+  cgi_write ("       ", padding);
+  cgi_write (columns->buffer, columns->buffer_used);
+
+  return (0);
+} /* }}} int output_binary */
+
+static int data_request_init (data_request_t *req) /* {{{ */
+{
+  int status;
+
+  memset (req, 0, sizeof (*req));
+  req->cf = DP_CF_AVERAGE;
+  req->downsample = DOWNSAMPLE_AVG;
 
   /* Get selected time(s) */
-  tt_begin = tt_end = tt_now = 0;
-  status = get_time_args (&tt_begin, &tt_end, &tt_now);
+  status = get_time_args (&req->tt_begin, &req->tt_end, &req->tt_now);
   if (status != 0)
     return (status);
 
-  dp_begin.tv_sec = tt_begin;
-  dp_begin.tv_nsec = 0;
-  dp_end.tv_sec = tt_end;
-  dp_end.tv_nsec = 0;
+  req->begin.tv_sec = req->tt_begin;
+  req->end.tv_sec = req->tt_end;
 
-  dp_resolution.tv_sec = (tt_end - tt_begin) / 324;
-  param_get_resolution (&dp_resolution);
+  req->resolution.tv_sec = (req->tt_end - req->tt_begin) / 324;
+  param_get_resolution (&req->resolution);
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 0;
-  handler_config.indentString = "  ";
+  if ((param ("cf") != NULL)
+      && (dp_cf_from_string (param ("cf"), &req->cf) != 0))
+    return (EINVAL);
 
-  handler = yajl_gen_alloc2 (write_callback,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
-  if (handler == NULL)
-    return (-1);
+  if ((param ("downsample") != NULL)
+      && (downsample_from_string (param ("downsample"),
+          &req->downsample) != 0))
+    return (EINVAL);
 
-  printf ("Content-Type: application/json\n");
+  if (param_get_format (&req->columns.value_size) != 0)
+    return (EINVAL);
 
   /* By default, permit caching until 1/1000th after the last data. If that
    * data is in the past, assume the entire data is in the past and allow
    * caching for one day. */
-  expires = tt_end + ((tt_end - tt_begin) / 1000);
-  if (expires < tt_now)
-    expires = tt_now + 86400;
+  req->expires = req->tt_end + ((req->tt_end - req->tt_begin) / 1000);
+  if (req->expires < req->tt_now)
+    req->expires = req->tt_now + EXPIRES_SECS;
+
+  return (0);
+} /* }}} int data_request_init */
+
+/* Sends "304 Not Modified" and returns true if the client's copy is current.
+ * The data only changes if the files are modified or, for time spans relative
+ * to now, if the end moves by more than one data point. */
+static _Bool data_request_not_modified (const data_request_t *req, /* {{{ */
+    time_t mtime, char *etag, size_t etag_size)
+{
+  snprintf (etag, etag_size, "\"%"PRIu64"-%li-%li-%i-%i-%lu\"",
+      gl_get_generation (), (long) mtime,
+      (long) (req->tt_end / ((req->resolution.tv_sec > 0)
+          ? req->resolution.tv_sec : 1)), (int) req->cf, (int) req->downsample,
+      (unsigned long) req->columns.value_size);
+
+  if (!cgi_not_modified (etag, time_arg_is_relative ("end") ? 0 : mtime))
+    return (0);
+
+  cgi_print_not_modified (etag, mtime, req->expires);
+  return (1);
+} /* }}} _Bool data_request_not_modified */
+
+/* Prints the headers and returns the handler to write the document to. */
+static json_writer_t *data_request_begin (data_request_t *req, /* {{{ */
+    const char *etag, time_t mtime)
+{
+  json_writer_t *handler;
+  char time_buffer[128];
+
+  /* The binary format needs the length of the header before the header, so
+   * the JSON is buffered. */
+  handler = json_writer_create ((req->columns.value_size != 0)
+      ? NULL : write_callback, /* user_data = */ NULL, /* flags = */ 0);
+  if (handler == NULL)
+    return (NULL);
 
-  status = time_to_rfc1123 (expires, time_buffer, sizeof (time_buffer));
-  if (status == 0)
-    printf ("Expires: %s\n"
+  cgi_printf ("Content-Type: %s\n", (req->columns.value_size != 0)
+      ? "application/octet-stream" : "application/json");
+  cgi_print_validators (etag, mtime);
+
+  if (time_to_rfc1123 (req->expires, time_buffer, sizeof (time_buffer)) == 0)
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
 
-  status = inst_data_to_json (inst,
-      dp_begin, dp_end, dp_resolution, handler);
+  if (req->columns.value_size == 0)
+    cgi_printf ("\n");
+
+  return (handler);
+} /* }}} json_writer_t *data_request_begin */
+
+/* Sends the binary format, if requested, and frees "handler". "status" is the
+ * status of writing the document. */
+static int data_request_end (data_request_t *req, /* {{{ */
+    json_writer_t *handler, int status)
+{
+  if (req->columns.value_size != 0)
+  {
+    if (status == 0)
+      status = output_binary (handler, &req->columns);
+    else
+      cgi_printf ("\n");
+    free (req->columns.buffer);
+    req->columns.buffer = NULL;
+  }
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
 
   return (status);
+} /* }}} int data_request_end */
+
+int action_instance_data_json (void) /* {{{ */
+{
+  graph_config_t *cfg;
+  graph_instance_t *inst;
+
+  data_request_t req;
+  json_writer_t *handler;
+
+  time_t mtime;
+  char etag[64];
+  int status;
+
+  cfg = gl_graph_get_selected ();
+  if (cfg == NULL)
+    return (ENOMEM);
+
+  inst = inst_get_selected (cfg);
+  if (inst == NULL)
+    return (EINVAL);
+
+  status = data_request_init (&req);
+  if (status != 0)
+    return (status);
+
+  mtime = inst_get_mtime (inst);
+  if (data_request_not_modified (&req, mtime, etag, sizeof (etag)))
+    return (0);
+
+  handler = data_request_begin (&req, etag, mtime);
+  if (handler == NULL)
+    return (-1);
+
+  status = inst_data_to_json (inst, req.begin, req.end, req.resolution,
+      req.cf, req.downsample, (size_t) graph_config_get_fetch_threads (),
+      (req.columns.value_size != 0) ? &req.columns : NULL, handler);
+
+  return (data_request_end (&req, handler, status));
 } /* }}} int action_instance_data_json */
 
+/* The instances are passed as "inst0", "inst1", ..., each holding the
+ * parameters "instance_data_json" takes to select an instance, e.g.
+ * "inst0=host%3Dexample%3Bplugin%3Dload%3B...". Unknown instances are
+ * returned as null. */
+int action_instances_data_json (void) /* {{{ */
+{
+  graph_instance_t *insts[INSTANCES_MAX];
+  size_t insts_num;
+
+  data_request_t req;
+  json_writer_t *handler;
+
+  time_t mtime;
+  char etag[64];
+  int status;
+
+  status = data_request_init (&req);
+  if (status != 0)
+    return (status);
+
+  mtime = 0;
+  for (insts_num = 0; insts_num < INSTANCES_MAX; insts_num++)
+  {
+    char key[32];
+    const char *value;
+    param_list_t *pl;
+
+    snprintf (key, sizeof (key), "inst%lu", (unsigned long) insts_num);
+    value = param (key);
+    if (value == NULL)
+      break;
+
+    pl = param_create (value);
+    if (pl == NULL)
+      return (ENOMEM);
+
+    insts[insts_num] = inst_get_selected_from (/* cfg = */ NULL, pl);
+    param_destroy (pl);
+
+    if (insts[insts_num] != NULL)
+    {
+      time_t inst_mtime = inst_get_mtime (insts[insts_num]);
+      if (mtime < inst_mtime)
+        mtime = inst_mtime;
+    }
+  }
+
+  if (insts_num == 0)
+    return (EINVAL);
+
+  if (data_request_not_modified (&req, mtime, etag, sizeof (etag)))
+    return (0);
+
+  handler = data_request_begin (&req, etag, mtime);
+  if (handler == NULL)
+    return (-1);
+
+  status = inst_data_to_json_multi (insts, insts_num,
+      req.begin, req.end, req.resolution, req.cf, req.downsample,
+      (size_t) graph_config_get_fetch_threads (),
+      (req.columns.value_size != 0) ? &req.columns : NULL, handler);
+
+  return (data_request_end (&req, handler, status));
+} /* }}} int action_instances_data_json */
+
 /* vim: set sw=2 sts=2 et fdm=marker : */
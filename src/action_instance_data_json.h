@@ -26,5 +26,9 @@
 
 int action_instance_data_json (void);
 
+/* Returns the data of several instances, selected by the parameters "inst0",
+ * "inst1", ..., with one request. */
+int action_instances_data_json (void);
+
 #endif /* ACTION_GRAPH_DATA_JSON_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -25,21 +25,24 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 #include "action_list_graphs_json.h"
 #include "common.h"
 #include "graph.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
-static void write_callback (__attribute__((unused)) void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
 {
-  fwrite ((void *) str, /* size = */ len, /* nmemb = */ 1, stdout);
-} /* }}} void write_callback */
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
 
 static int print_one_graph (graph_config_t *cfg, /* {{{ */
     void *user_data)
@@ -48,7 +51,7 @@ static int print_one_graph (graph_config_t *cfg, /* {{{ */
   size_t num_instances;
   graph_ident_t *selector;
 
-  yajl_gen handler = user_data;
+  json_writer_t *handler = user_data;
 
   num_instances = graph_num_instances (cfg);
   if (num_instances < 1)
@@ -61,36 +64,28 @@ static int print_one_graph (graph_config_t *cfg, /* {{{ */
     return (0);
   }
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
   memset (title, 0, sizeof (title));
   graph_get_title (cfg, title, sizeof (title));
 
-  yajl_gen_string (handler,
-      (unsigned char *) "title",
-      (unsigned int) strlen ("title"));
-  yajl_gen_string (handler,
-      (unsigned char *) title,
-      (unsigned int) strlen (title));
+  JSON_LITERAL (handler, "title");
+  json_string (handler, title);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "select",
-      (unsigned int) strlen ("select"));
+  JSON_LITERAL (handler, "select");
   ident_to_json (selector, handler);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "num_instances",
-      (unsigned int) strlen ("num_instances"));
-  yajl_gen_integer (handler, (long int) num_instances);
+  JSON_LITERAL (handler, "num_instances");
+  json_integer (handler, (int64_t) num_instances);
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   ident_destroy (selector);
 
   return (0);
 } /* }}} int print_one_graph */
 
-static int print_all_graphs (yajl_gen handler) /* {{{ */
+static int print_all_graphs (json_writer_t *handler) /* {{{ */
 {
   const char *dynamic;
   _Bool include_dynamic = 0;
@@ -100,49 +95,53 @@ static int print_all_graphs (yajl_gen handler) /* {{{ */
       && (strcmp ("true", dynamic) == 0))
     include_dynamic = 1;
 
-  yajl_gen_array_open (handler);
+  json_array_open (handler);
 
   gl_graph_get_all (include_dynamic, print_one_graph,
       /* user_data = */ handler);
 
-  yajl_gen_array_close (handler);
+  json_array_close (handler);
 
   return (0);
 } /* }}} int print_all_graphs */
 
 int action_list_graphs_json (void) /* {{{ */
 {
-  yajl_gen_config handler_config;
-  yajl_gen handler;
+  json_writer_t *handler;
 
   time_t now;
+  char etag[64];
   char time_buffer[128];
   int status;
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 1;
-  handler_config.indentString = "  ";
+  /* The response only depends on the graph list and the request
+   * parameters. */
+  now = time (NULL);
+  snprintf (etag, sizeof (etag), "\"%"PRIu64"\"", gl_get_generation ());
+  if (cgi_not_modified (etag, /* mtime = */ 0))
+  {
+    cgi_print_not_modified (etag, /* mtime = */ 0, now + 300);
+    return (0);
+  }
 
-  handler = yajl_gen_alloc2 (write_callback,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
+  handler = json_writer_create (write_callback, /* user_data = */ NULL,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
     return (-1);
 
-  printf ("Content-Type: application/json\n");
+  cgi_printf ("Content-Type: application/json\n");
+  cgi_print_validators (etag, /* mtime = */ 0);
 
-  now = time (NULL);
   status = time_to_rfc1123 (now + 300, time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n"
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
+  cgi_printf ("\n");
 
   print_all_graphs (handler);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
 
   return (status);
 } /* }}} int action_list_graphs_json */
@@ -37,7 +37,7 @@
 
 static int left_menu (__attribute__((unused)) void *user_data) /* {{{ */
 {
-  printf ("\n<ul class=\"menu left\">\n"
+  cgi_printf ("\n<ul class=\"menu left\">\n"
       "  <li><a href=\"%s?action=search\">Search</a></li>\n"
       "  <li><a href=\"%s?action=list_graphs\">All graphs</a></li>\n"
       "</ul>\n",
@@ -55,7 +55,7 @@ static int print_one_host (const char *host, /* {{{ */
   host_html[sizeof (host_html) - 1] = 0;
   html_escape_buffer (host_html, sizeof (host_html));
 
-  printf ("      <li class=\"host\"><a href=\"%s?action=search;q=host:%s\">"
+  cgi_printf ("      <li class=\"host\"><a href=\"%s?action=search;q=host:%s\">"
       "%s</a></li>\n",
       script_name (), host_html, host_html);
 
@@ -64,9 +64,9 @@ static int print_one_host (const char *host, /* {{{ */
 
 static int print_all_hosts (__attribute__((unused)) void *user_data) /* {{{ */
 {
-  printf ("    <ul class=\"host_list\">\n");
+  cgi_printf ("    <ul class=\"host_list\">\n");
   gl_foreach_host (print_one_host, /* user_data = */ NULL);
-  printf ("    </ul>\n");
+  cgi_printf ("    </ul>\n");
 
   return (0);
 } /* }}} int print_all_hosts */
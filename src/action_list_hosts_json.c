@@ -25,83 +25,86 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 #include "action_list_hosts_json.h"
 #include "common.h"
 #include "graph.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
-static void write_callback (__attribute__((unused)) void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
 {
-  fwrite ((void *) str, /* size = */ len, /* nmemb = */ 1, stdout);
-} /* }}} void write_callback */
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
 
 static int print_one_host (const char *host, /* {{{ */
     void *user_data)
 {
-  yajl_gen handler = user_data;
+  json_writer_t *handler = user_data;
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "host",
-      (unsigned int) strlen ("host"));
-  yajl_gen_string (handler,
-      (unsigned char *) host,
-      (unsigned int) strlen (host));
+  JSON_LITERAL (handler, "host");
+  json_string (handler, host);
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   return (0);
 } /* }}} int print_one_host */
 
-static int print_all_hosts (yajl_gen handler) /* {{{ */
+static int print_all_hosts (json_writer_t *handler) /* {{{ */
 {
-  yajl_gen_array_open (handler);
+  json_array_open (handler);
   gl_foreach_host (print_one_host, /* user_data = */ handler);
-  yajl_gen_array_close (handler);
+  json_array_close (handler);
 
   return (0);
 } /* }}} int print_all_hosts */
 
 int action_list_hosts_json (void) /* {{{ */
 {
-  yajl_gen_config handler_config;
-  yajl_gen handler;
+  json_writer_t *handler;
 
   time_t now;
+  char etag[64];
   char time_buffer[128];
   int status;
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 1;
-  handler_config.indentString = "  ";
-
-  handler = yajl_gen_alloc2 (write_callback,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
+  /* The response only depends on the graph list and the request
+   * parameters. */
+  now = time (NULL);
+  snprintf (etag, sizeof (etag), "\"%"PRIu64"\"", gl_get_generation ());
+  if (cgi_not_modified (etag, /* mtime = */ 0))
+  {
+    cgi_print_not_modified (etag, /* mtime = */ 0, now + 300);
+    return (0);
+  }
+
+  handler = json_writer_create (write_callback, /* user_data = */ NULL,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
     return (-1);
 
-  printf ("Content-Type: application/json\n");
+  cgi_printf ("Content-Type: application/json\n");
+  cgi_print_validators (etag, /* mtime = */ 0);
 
-  now = time (NULL);
   status = time_to_rfc1123 (now + 300, time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n"
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
+  cgi_printf ("\n");
 
   print_all_hosts (handler);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
 
   return (status);
 } /* }}} int action_list_hosts_json */
@@ -0,0 +1,155 @@
+/**
+ * collection4 - action_metrics.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "action_metrics.h"
+#include "collectd_flush.h"
+#include "common.h"
+#include "graph_list.h"
+#include "render_cache.h"
+#include "utils_cgi.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+/* Prints internal statistics in the Prometheus text format. */
+int action_metrics (void) /* {{{ */
+{
+  gl_stats_t stats;
+  rc_stats_t rc_stats;
+  flush_stats_t flush_stats;
+  int status;
+
+  memset (&stats, 0, sizeof (stats));
+  status = gl_get_stats (&stats);
+  if (status != 0)
+    return (status);
+
+  memset (&rc_stats, 0, sizeof (rc_stats));
+  status = rc_get_stats (&rc_stats);
+  if (status != 0)
+    return (status);
+
+  memset (&flush_stats, 0, sizeof (flush_stats));
+  status = flush_get_stats (&flush_stats);
+  if (status != 0)
+    return (status);
+
+  cgi_printf ("Content-Type: text/plain; version=0.0.4\n"
+      "Cache-Control: no-cache\n"
+      "\n");
+
+  cgi_printf ("# HELP collection4_graph_list_staleness_seconds "
+      "Time since the graph list was last known to be up to date.\n"
+      "# TYPE collection4_graph_list_staleness_seconds gauge\n"
+      "collection4_graph_list_staleness_seconds %.0f\n",
+      stats.staleness);
+
+  cgi_printf ("# HELP collection4_graph_list_refresh_duration_seconds "
+      "Duration of the last graph list refresh.\n"
+      "# TYPE collection4_graph_list_refresh_duration_seconds gauge\n"
+      "collection4_graph_list_refresh_duration_seconds %.6f\n",
+      stats.refresh_duration_last);
+
+  cgi_printf ("# HELP collection4_graph_list_refresh_duration_max_seconds "
+      "Duration of the longest graph list refresh.\n"
+      "# TYPE collection4_graph_list_refresh_duration_max_seconds gauge\n"
+      "collection4_graph_list_refresh_duration_max_seconds %.6f\n",
+      stats.refresh_duration_max);
+
+  cgi_printf ("# HELP collection4_graph_list_refreshes_total "
+      "Number of graph list refreshes.\n"
+      "# TYPE collection4_graph_list_refreshes_total counter\n"
+      "collection4_graph_list_refreshes_total %llu\n",
+      (unsigned long long) stats.refresh_num);
+
+  cgi_printf ("# HELP collection4_render_cache_hits_total "
+      "Number of graphs served from the render cache.\n"
+      "# TYPE collection4_render_cache_hits_total counter\n"
+      "collection4_render_cache_hits_total %llu\n",
+      (unsigned long long) rc_stats.hits);
+
+  cgi_printf ("# HELP collection4_render_cache_misses_total "
+      "Number of render cache lookups without a valid entry.\n"
+      "# TYPE collection4_render_cache_misses_total counter\n"
+      "collection4_render_cache_misses_total %llu\n",
+      (unsigned long long) rc_stats.misses);
+
+  cgi_printf ("# HELP collection4_render_cache_evictions_total "
+      "Number of entries evicted to make room for new graphs.\n"
+      "# TYPE collection4_render_cache_evictions_total counter\n"
+      "collection4_render_cache_evictions_total %llu\n",
+      (unsigned long long) rc_stats.evictions);
+
+  cgi_printf ("# HELP collection4_render_cache_entries "
+      "Number of graphs in the render cache.\n"
+      "# TYPE collection4_render_cache_entries gauge\n"
+      "collection4_render_cache_entries %lu\n",
+      (unsigned long) rc_stats.entries_num);
+
+  cgi_printf ("# HELP collection4_render_cache_bytes "
+      "Bytes used by graphs in the render cache.\n"
+      "# TYPE collection4_render_cache_bytes gauge\n"
+      "collection4_render_cache_bytes %lu\n",
+      (unsigned long) rc_stats.size);
+
+  cgi_printf ("# HELP collection4_flush_idents_total "
+      "Number of identifiers collectd was asked to flush.\n"
+      "# TYPE collection4_flush_idents_total counter\n"
+      "collection4_flush_idents_total %llu\n",
+      (unsigned long long) flush_stats.flushed);
+
+  cgi_printf ("# HELP collection4_flush_skipped_total "
+      "Number of identifiers not flushed because they were flushed "
+      "recently.\n"
+      "# TYPE collection4_flush_skipped_total counter\n"
+      "collection4_flush_skipped_total %llu\n",
+      (unsigned long long) flush_stats.skipped);
+
+  cgi_printf ("# HELP collection4_flush_timeouts_total "
+      "Number of flushes abandoned because collectd didn't answer in "
+      "time.\n"
+      "# TYPE collection4_flush_timeouts_total counter\n"
+      "collection4_flush_timeouts_total %llu\n",
+      (unsigned long long) flush_stats.timeouts);
+
+  cgi_printf ("# HELP collection4_flush_errors_total "
+      "Number of flushes that failed otherwise.\n"
+      "# TYPE collection4_flush_errors_total counter\n"
+      "collection4_flush_errors_total %llu\n",
+      (unsigned long long) flush_stats.errors);
+
+  cgi_printf ("# HELP collection4_flush_rejected_total "
+      "Number of flush commands collectd answered with an error.\n"
+      "# TYPE collection4_flush_rejected_total counter\n"
+      "collection4_flush_rejected_total %llu\n",
+      (unsigned long long) flush_stats.rejected);
+
+  return (0);
+} /* }}} int action_metrics */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
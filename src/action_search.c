@@ -58,7 +58,7 @@ typedef struct callback_data_s callback_data_t;
 
 static int left_menu (__attribute__((unused)) void *user_data) /* {{{ */
 {
-  printf ("\n<ul class=\"menu left\">\n"
+  cgi_printf ("\n<ul class=\"menu left\">\n"
       "  <li><a href=\"%s?action=list_graphs\">All graphs</a></li>\n"
       "  <li><a href=\"%s?action=list_hosts\">All hosts</a></li>\n"
       "</ul>\n",
@@ -85,13 +85,13 @@ static int print_graph_inst_html (graph_config_t *cfg, /* {{{ */
     }
 
     if (data->cfg != NULL)
-      printf ("  </ul></li>\n");
+      cgi_printf ("  </ul></li>\n");
 
     memset (desc, 0, sizeof (desc));
     graph_get_title (cfg, desc, sizeof (desc));
     html_escape_buffer (desc, sizeof (desc));
 
-    printf ("  <li class=\"graph\">%s\n"
+    cgi_printf ("  <li class=\"graph\">%s\n"
         "  <ul class=\"instance_list\">\n", desc);
 
     data->cfg = cfg;
@@ -121,7 +121,7 @@ static int print_graph_inst_html (graph_config_t *cfg, /* {{{ */
 
       free (search_term_html);
 
-      printf ("    <li class=\"instance more\"><a href=\"%s"
+      cgi_printf ("    <li class=\"instance more\"><a href=\"%s"
           "?action=show_graph;%s%s\">More &#x2026;</a></li>\n",
           script_name (), params, param_search_term);
 
@@ -138,7 +138,7 @@ static int print_graph_inst_html (graph_config_t *cfg, /* {{{ */
   inst_describe (cfg, inst, desc, sizeof (desc));
   html_escape_buffer (desc, sizeof (desc));
 
-  printf ("    <li class=\"instance\"><a href=\"%s?action=show_instance;%s\">%s</a></li>\n",
+  cgi_printf ("    <li class=\"instance\"><a href=\"%s?action=show_instance;%s\">%s</a></li>\n",
       script_name (), params, desc);
 
   return (0);
@@ -163,25 +163,25 @@ static int print_search_result (void *user_data) /* {{{ */
   assert (pg_data->search_term != NULL);
 
   search_term_html = html_escape (pg_data->search_term);
-  printf ("    <h2>Search results for &quot;%s&quot;</h2>\n",
+  cgi_printf ("    <h2>Search results for &quot;%s&quot;</h2>\n",
       search_term_html);
   free (search_term_html);
 
-  printf ("    <ul id=\"search-output\" class=\"graph_list\">\n");
+  cgi_printf ("    <ul id=\"search-output\" class=\"graph_list\">\n");
 
   gl_search (pg_data->search_info, print_graph_inst_html,
       /* user_data = */ &cb_data);
 
 
   if (cb_data.cfg != NULL)
-    printf ("      </ul></li>\n");
+    cgi_printf ("      </ul></li>\n");
 
   if (cb_data.graph_more)
   {
-    printf ("    <li class=\"graph more\">More ...</li>\n");
+    cgi_printf ("    <li class=\"graph more\">More ...</li>\n");
   }
 
-  printf ("    </ul>\n");
+  cgi_printf ("    </ul>\n");
 
   return (0);
 } /* }}} int print_search_result */
@@ -201,7 +201,7 @@ static int print_search_form (void *user_data) /* {{{ */
     search_term_html[0] = 0;
   }
 
-  printf ("<form action=\"%s\" method=\"get\">\n"
+  cgi_printf ("<form action=\"%s\" method=\"get\">\n"
       "  <input type=\"hidden\" name=\"action\" value=\"search\" />\n"
       "  <fieldset>\n"
       "    <legend>Advanced search</legend>\n"
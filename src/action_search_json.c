@@ -33,6 +33,7 @@
 #include "graph_instance.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -42,34 +43,44 @@
 struct callback_data_s
 {
   graph_config_t *cfg;
+  json_writer_t *handler;
   int limit;
   _Bool first;
 };
 typedef struct callback_data_s callback_data_t;
 
-static int json_begin_graph (graph_config_t *cfg) /* {{{ */
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
+{
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
+
+static int json_begin_graph (json_writer_t *handler, /* {{{ */
+    graph_config_t *cfg)
 {
   char desc[1024];
 
   if (cfg == NULL)
     return (EINVAL);
 
+  memset (desc, 0, sizeof (desc));
   graph_get_title (cfg, desc, sizeof (desc));
 
-  printf ("{\"title\":\"%s\",\"instances\":[", desc);
-
-  return (0);
+  json_map_open (handler);
+  JSON_LITERAL (handler, "title");
+  json_string (handler, desc);
+  JSON_LITERAL (handler, "instances");
+  return (json_array_open (handler));
 } /* }}} int json_begin_graph */
 
-static int json_end_graph (void) /* {{{ */
+static int json_end_graph (json_writer_t *handler) /* {{{ */
 {
-  printf ("]}");
-
-  return (0);
+  json_array_close (handler);
+  return (json_map_close (handler));
 } /* }}} int json_end_graph */
 
-static int json_print_instance (graph_config_t *cfg, /* {{{ */
-    graph_instance_t *inst)
+static int json_print_instance (json_writer_t *handler, /* {{{ */
+    graph_config_t *cfg, graph_instance_t *inst)
 {
   char params[1024];
   char desc[1024];
@@ -83,10 +94,12 @@ static int json_print_instance (graph_config_t *cfg, /* {{{ */
   memset (params, 0, sizeof (params));
   inst_get_params (cfg, inst, params, sizeof (params));
 
-  printf ("{\"description\":\"%s\",\"params\":\"%s\"}",
-      desc, params);
-
-  return (0);
+  json_map_open (handler);
+  JSON_LITERAL (handler, "description");
+  json_string (handler, desc);
+  JSON_LITERAL (handler, "params");
+  json_string (handler, params);
+  return (json_map_close (handler));
 } /* }}} int json_print_instance */
 
 static int json_print_graph_instance (graph_config_t *cfg, /* {{{ */
@@ -98,21 +111,14 @@ static int json_print_graph_instance (graph_config_t *cfg, /* {{{ */
   if (data->cfg != cfg)
   {
     if (!data->first)
-    {
-      json_end_graph ();
-      printf (",\n");
-    }
-    json_begin_graph (cfg);
+      json_end_graph (data->handler);
+    json_begin_graph (data->handler, cfg);
 
     data->cfg = cfg;
     data->first = 0;
   }
-  else /* if (not first instance) */
-  {
-    printf (",\n");
-  }
 
-  json_print_instance (cfg, inst);
+  json_print_instance (data->handler, cfg, inst);
 
   if (data->limit > 0)
     data->limit--;
@@ -131,30 +137,36 @@ static int list_graphs_json (const char *term) /* {{{ */
   char time_buffer[128];
   int status;
 
-  printf ("Content-Type: application/json\n");
+  data.handler = json_writer_create (write_callback, /* user_data = */ NULL,
+      /* flags = */ 0);
+  if (data.handler == NULL)
+    return (ENOMEM);
+
+  cgi_printf ("Content-Type: application/json\n");
 
   now = time (NULL);
   status = time_to_rfc1123 (now + 300, time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n"
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
+  cgi_printf ("\n");
 
   data.cfg = NULL;
   data.limit = RESULT_LIMIT;
   data.first = 1;
 
-  printf ("[\n");
+  json_array_open (data.handler);
   if (term == NULL)
     gl_instance_get_all (json_print_graph_instance, /* user_data = */ &data);
   else
     gl_search_string (term, json_print_graph_instance, /* user_data = */ &data);
 
   if (!data.first)
-    json_end_graph ();
+    json_end_graph (data.handler);
+  json_array_close (data.handler);
 
-  printf ("\n]");
+  json_writer_destroy (data.handler);
 
   return (0);
 } /* }}} int list_graphs_json */
@@ -41,8 +41,8 @@
 #include <fcgi_stdio.h>
 
 #define OUTPUT_ERROR(...) do {             \
-  printf ("Content-Type: text/plain\n\n"); \
-  printf (__VA_ARGS__);                    \
+  cgi_printf ("Content-Type: text/plain\n\n"); \
+  cgi_printf (__VA_ARGS__);                    \
   return (0);                              \
 } while (0)
 
@@ -64,11 +64,11 @@ static int show_time_selector (__attribute__((unused)) void *user_data) /* {{{ *
   param_set (pl, "end", NULL);
   param_set (pl, "button", NULL);
 
-  printf ("<form action=\"%s\" method=\"get\">\n", script_name ());
+  cgi_printf ("<form action=\"%s\" method=\"get\">\n", script_name ());
 
   param_print_hidden (pl);
 
-  printf ("  <select name=\"begin\">\n"
+  cgi_printf ("  <select name=\"begin\">\n"
       "    <option value=\"-3600\">Hour</option>\n"
       "    <option value=\"-86400\">Day</option>\n"
       "    <option value=\"-604800\">Week</option>\n"
@@ -77,7 +77,7 @@ static int show_time_selector (__attribute__((unused)) void *user_data) /* {{{ *
       "  </select>\n"
       "  <input type=\"submit\" name=\"button\" value=\"Go\" />\n");
 
-  printf ("</form>\n");
+  cgi_printf ("</form>\n");
 
   param_destroy (pl);
 
@@ -88,7 +88,7 @@ static int left_menu (void *user_data) /* {{{ */
 {
   show_graph_data_t *data = user_data;
 
-  printf ("\n<ul class=\"menu left\">\n");
+  cgi_printf ("\n<ul class=\"menu left\">\n");
 
   if ((data->search_term != NULL) && (data->search_term[0] != 0))
   {
@@ -98,12 +98,12 @@ static int left_menu (void *user_data) /* {{{ */
     graph_get_params (data->cfg, params, sizeof (params));
     html_escape_buffer (params, sizeof (params));
 
-    printf ("  <li><a href=\"%s?action=show_graph;%s\">"
+    cgi_printf ("  <li><a href=\"%s?action=show_graph;%s\">"
         "All instances</a></li>\n",
         script_name (), params);
   }
 
-  printf ("  <li><a href=\"%s?action=list_graphs\">All graphs</a></li>\n"
+  cgi_printf ("  <li><a href=\"%s?action=list_graphs\">All graphs</a></li>\n"
       "</ul>\n",
       script_name ());
 
@@ -170,7 +170,7 @@ static int show_instance_cb (graph_instance_t *inst, /* {{{ */
   inst_get_params (data->cfg, inst, params, sizeof (params));
   html_escape_buffer (params, sizeof (params));
 
-  printf ("  <li class=\"instance\"><a href=\"%s?action=show_instance;%s\">"
+  cgi_printf ("  <li class=\"instance\"><a href=\"%s?action=show_instance;%s\">"
       "%s</a></li>\n",
       script_name (), params, descr);
 
@@ -182,18 +182,18 @@ static int show_graph (void *user_data) /* {{{ */
   show_graph_data_t *data = user_data;
 
   if ((data->search_term == NULL) || (data->search_term[0] == 0))
-    printf ("<h2>All instances</h2>\n");
+    cgi_printf ("<h2>All instances</h2>\n");
   else
   {
     char *search_term_html = html_escape (data->search_term);
-    printf ("<h2>Instances matching &quot;%s&quot;</h2>\n",
+    cgi_printf ("<h2>Instances matching &quot;%s&quot;</h2>\n",
         search_term_html);
     free (search_term_html);
   }
 
-  printf ("<ul class=\"instance_list\">\n");
+  cgi_printf ("<ul class=\"instance_list\">\n");
   graph_inst_foreach (data->cfg, show_instance_cb, data);
-  printf ("</ul>\n");
+  cgi_printf ("</ul>\n");
 
   return (0);
 } /* }}} int show_graph */
@@ -36,22 +36,22 @@
 #include "graph_instance.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
-static void write_callback (__attribute__((unused)) void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+static int write_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
 {
-  fwrite ((void *) str, /* size = */ len, /* nmemb = */ 1, stdout);
-} /* }}} void write_callback */
+  return (cgi_write (buffer, buffer_size));
+} /* }}} int write_callback */
 
 int action_show_graph_json (void) /* {{{ */
 {
   graph_config_t const *cfg;
 
-  yajl_gen_config handler_config;
-  yajl_gen handler;
+  json_writer_t *handler;
 
   time_t now;
   char time_buffer[128];
@@ -61,30 +61,24 @@ int action_show_graph_json (void) /* {{{ */
   if (cfg == NULL)
     return (ENOMEM);
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 1;
-  handler_config.indentString = "  ";
-
-  handler = yajl_gen_alloc2 (write_callback,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
+  handler = json_writer_create (write_callback, /* user_data = */ NULL,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
     return (-1);
 
-  printf ("Content-Type: application/json\n");
+  cgi_printf ("Content-Type: application/json\n");
 
   now = time (NULL);
   status = time_to_rfc1123 (now + 300, time_buffer, sizeof (time_buffer));
   if (status == 0)
-    printf ("Expires: %s\n"
+    cgi_printf ("Expires: %s\n"
         "Cache-Control: public\n",
         time_buffer);
-  printf ("\n");
+  cgi_printf ("\n");
 
   status = graph_to_json (cfg, handler);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
 
   return (status);
 } /* }}} int action_show_graph_json */
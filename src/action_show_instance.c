@@ -36,13 +36,14 @@
 #include "graph_instance.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
 #define OUTPUT_ERROR(...) do {             \
-  printf ("Content-Type: text/plain\n\n"); \
-  printf (__VA_ARGS__);                    \
+  cgi_printf ("Content-Type: text/plain\n\n"); \
+  cgi_printf (__VA_ARGS__);                    \
   return (0);                              \
 } while (0)
 
@@ -64,20 +65,20 @@ static void show_breadcrump_field (const char *str, /* {{{ */
     const char *field_name)
 {
   if ((str == NULL) || (str[0] == 0))
-    printf ("<em>none</em>");
+    cgi_printf ("<em>none</em>");
   else if (IS_ANY (str))
-    printf ("<em>any</em>");
+    cgi_printf ("<em>any</em>");
   else if (IS_ALL (str))
-    printf ("<em>all</em>");
+    cgi_printf ("<em>all</em>");
   else
   {
     char *str_html = html_escape (str);
 
     if (field_name != NULL)
-      printf ("<a href=\"%s?action=search;q=%s:%s\">%s</a>",
+      cgi_printf ("<a href=\"%s?action=search;q=%s:%s\">%s</a>",
           script_name (), field_name, str_html, str_html);
     else
-      printf ("<a href=\"%s?action=search;q=%s\">%s</a>",
+      cgi_printf ("<a href=\"%s?action=search;q=%s\">%s</a>",
           script_name (), str_html, str_html);
 
     free (str_html);
@@ -101,17 +102,17 @@ static int show_breadcrump (graph_config_t *cfg, /* {{{ */
     ident = graph_get_selector (cfg);
   }
 
-  printf ("<div class=\"breadcrump\">%s: &quot;", prefix);
+  cgi_printf ("<div class=\"breadcrump\">%s: &quot;", prefix);
   show_breadcrump_field (ident_get_host (ident), "host");
-  printf ("&nbsp;/ ");
+  cgi_printf ("&nbsp;/ ");
   show_breadcrump_field (ident_get_plugin (ident), "plugin");
-  printf ("&nbsp;&ndash; ");
+  cgi_printf ("&nbsp;&ndash; ");
   show_breadcrump_field (ident_get_plugin_instance (ident), "plugin_instance");
-  printf ("&nbsp;/ ");
+  cgi_printf ("&nbsp;/ ");
   show_breadcrump_field (ident_get_type (ident), "type");
-  printf ("&nbsp;&ndash; ");
+  cgi_printf ("&nbsp;&ndash; ");
   show_breadcrump_field (ident_get_type_instance (ident), "type_instance");
-  printf ("&quot;</div>\n");
+  cgi_printf ("&quot;</div>\n");
 
   ident_destroy (ident);
   return (0);
@@ -126,24 +127,24 @@ static int show_time_selector (__attribute__((unused)) void *user_data) /* {{{ *
   param_set (pl, "end", NULL);
   param_set (pl, "button", NULL);
 
-  printf ("<form action=\"%s\" method=\"get\">\n", script_name ());
+  cgi_printf ("<form action=\"%s\" method=\"get\">\n", script_name ());
 
   param_print_hidden (pl);
 
-  printf ("  <select name=\"begin\">\n"
+  cgi_printf ("  <select name=\"begin\">\n"
       "    <option value=\"-3600\">Hour</option>\n"
       "    <option value=\"-86400\">Day</option>\n"
       "    <option value=\"-604800\">Week</option>\n"
       "    <option value=\"-2678400\">Month</option>\n"
       "    <option value=\"-31622400\">Year</option>\n"
       "  </select><br />\n");
-  printf ("  <input id=\"format-json\" type=\"radio\" name=\"format\" value=\"JSON\" checked=\"checked\" />"
+  cgi_printf ("  <input id=\"format-json\" type=\"radio\" name=\"format\" value=\"JSON\" checked=\"checked\" />"
       "<label for=\"format-json\">&nbsp;JavaScript</label><br />\n"
       "  <input id=\"format-rrd\" type=\"radio\" name=\"format\" value=\"RRD\" />"
       "<label for=\"format-rrd\">&nbsp;RRDtool</label>\n<br />");
-  printf ("  <input type=\"submit\" name=\"button\" value=\"Go\" />\n");
+  cgi_printf ("  <input type=\"submit\" name=\"button\" value=\"Go\" />\n");
 
-  printf ("</form>\n");
+  cgi_printf ("</form>\n");
 
   param_destroy (pl);
 
@@ -168,7 +169,7 @@ static int left_menu (void *user_data) /* {{{ */
   if (IS_ANY (host))
     host = NULL;
 
-  printf ("\n<ul class=\"menu left\">\n"
+  cgi_printf ("\n<ul class=\"menu left\">\n"
       "  <li><a href=\"%s?action=show_graph;%s\">All instances</a></li>\n"
       "  <li><a href=\"%s?action=list_graphs\">All graphs</a></li>\n",
       script_name (), params,
@@ -181,10 +182,10 @@ static int left_menu (void *user_data) /* {{{ */
     html_escape_copy (host_html, host, sizeof (host_html));
     uri_escape_copy (host_uri, host, sizeof (host_uri));
 
-    printf ("  <li><a href=\"%s?action=search;q=host:%s\">Host &quot;%s&quot;</a></li>\n",
+    cgi_printf ("  <li><a href=\"%s?action=search;q=host:%s\">Host &quot;%s&quot;</a></li>\n",
         script_name (), host_uri, host_html);
   }
-  printf ("</ul>\n");
+  cgi_printf ("</ul>\n");
 
   host = NULL;
   ident_destroy (ident);
@@ -196,10 +197,9 @@ static int show_instance_json (graph_config_t *cfg, /* {{{ */
     graph_instance_t *inst,
     long begin, long end, int index)
 {
-  yajl_gen_config handler_config;
-  yajl_gen handler;
-  const unsigned char *json_buffer;
-  unsigned int json_buffer_length;
+  json_writer_t *handler;
+  const char *json_buffer;
+  size_t json_buffer_length;
 
   graph_ident_t *graph_selector;
   graph_ident_t *inst_selector;
@@ -215,14 +215,8 @@ static int show_instance_json (graph_config_t *cfg, /* {{{ */
     return (ENOMEM);
   }
 
-  memset (&handler_config, 0, sizeof (handler_config));
-  handler_config.beautify = 1;
-  handler_config.indentString = "  ";
-
-  handler = yajl_gen_alloc2 (/* callback = */ NULL,
-      &handler_config,
-      /* alloc functions = */ NULL,
-      /* context = */ NULL);
+  handler = json_writer_create (/* callback = */ NULL, /* user_data = */ NULL,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
   {
     ident_destroy (inst_selector);
@@ -230,47 +224,38 @@ static int show_instance_json (graph_config_t *cfg, /* {{{ */
     return (-1);
   }
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "graph_selector",
-      (unsigned int) strlen ("graph_selector"));
+  JSON_LITERAL (handler, "graph_selector");
   ident_to_json (graph_selector, handler);
   ident_destroy (graph_selector);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "instance_selector",
-      (unsigned int) strlen ("instance_selector"));
+  JSON_LITERAL (handler, "instance_selector");
   ident_to_json (inst_selector, handler);
   ident_destroy (inst_selector);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "begin",
-      (unsigned int) strlen ("begin"));
-  yajl_gen_integer (handler, begin);
+  JSON_LITERAL (handler, "begin");
+  json_integer (handler, begin);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "end",
-      (unsigned int) strlen ("end"));
-  yajl_gen_integer (handler, end);
+  JSON_LITERAL (handler, "end");
+  json_integer (handler, end);
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   json_buffer = NULL;
   json_buffer_length = 0;
-  yajl_gen_get_buf (handler, &json_buffer, &json_buffer_length);
-
-  if (json_buffer == NULL)
+  if ((json_writer_get_buffer (handler, &json_buffer, &json_buffer_length) != 0)
+      || (json_buffer == NULL))
   {
-    yajl_gen_free (handler);
+    json_writer_destroy (handler);
     return (EINVAL);
   }
 
-  printf ("<div id=\"c4-graph%i\" class=\"graph-json\"></div>\n", index);
-  printf ("<script type=\"text/javascript\">c4.instances[%i] = %s;</script>\n",
-      index, (const char *) json_buffer);
+  cgi_printf ("<div id=\"c4-graph%i\" class=\"graph-json\"></div>\n", index);
+  cgi_printf ("<script type=\"text/javascript\">c4.instances[%i] = %s;</script>\n",
+      index, json_buffer);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
   return (0);
 } /* }}} int show_instance_json */
 
@@ -300,16 +285,16 @@ static int show_instance_rrdtool (graph_config_t *cfg, /* {{{ */
   time_params[sizeof (time_params) - 1] = 0;
 
   if (index < MAX_SHOW_GRAPHS)
-    printf ("<div class=\"graph-img\"><img src=\"%s?action=graph;%s%s\" "
+    cgi_printf ("<div class=\"graph-img\"><img src=\"%s?action=graph;%s%s\" "
         "title=\"%s / %s\" /></div>\n",
         script_name (), params, time_params, title, descr);
   else
-    printf ("<a href=\"%s?action=show_instance;%s\">Show graph "
+    cgi_printf ("<a href=\"%s?action=show_instance;%s\">Show graph "
         "&quot;%s / %s&quot;</a>\n",
         script_name (), params, title, descr);
 
 #if 0
-  printf ("<div><a href=\"%s?action=instance_data_json;%s%s\">"
+  cgi_printf ("<div><a href=\"%s?action=instance_data_json;%s%s\">"
       "Get graph data as JSON</a></div>\n",
       script_name (), params, time_params);
 #endif
@@ -339,7 +324,7 @@ static int show_instance_cb (graph_config_t *cfg, /* {{{ */
   if (status != 0)
     return (status);
 
-  printf ("<h2>Instance &quot;%s&quot;</h2>\n", descr);
+  cgi_printf ("<h2>Instance &quot;%s&quot;</h2>\n", descr);
 
   show_breadcrump (cfg, inst);
 
@@ -370,7 +355,7 @@ static int show_instance (void *user_data) /* {{{ */
   graph_get_params (data->cfg, params, sizeof (params));
   html_escape_buffer (params, sizeof (params));
 
-  printf ("<div style=\"clear: both;\"><a href=\"%s?action=graph_def_json;%s\">"
+  cgi_printf ("<div style=\"clear: both;\"><a href=\"%s?action=graph_def_json;%s\">"
       "Get graph definition as JSON</a></div>\n",
       script_name (), params);
 #endif
@@ -0,0 +1,268 @@
+/**
+ * collection4 - bench_classifier.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Routes a synthetic set of files to a few hundred graphs, once by checking
+ * every graph's selector with "graph_ident_matches", as "gl_register_file"
+ * used to do, and once with the classifier. It prints the time of both and
+ * fails if they don't find the same graphs, in the same order, for every
+ * file. The optional arguments are the number of graphs and files. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "graph.h"
+#include "graph_classifier.h"
+#include "graph_ident.h"
+
+#define BENCH_PLUGINS 40
+#define BENCH_TYPES 25
+#define BENCH_HOSTS 1000
+
+struct bench_result_s
+{
+  graph_config_t **graphs;
+  size_t graphs_num;
+  size_t graphs_size;
+};
+typedef struct bench_result_s bench_result_t;
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static uint64_t bench_random (void) /* {{{ */
+{
+  bench_state ^= bench_state << 13;
+  bench_state ^= bench_state >> 7;
+  bench_state ^= bench_state << 17;
+  return (bench_state);
+} /* }}} uint64_t bench_random */
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+static int bench_collect (graph_config_t *cfg, void *user_data) /* {{{ */
+{
+  bench_result_t *r = user_data;
+
+  if (r->graphs_num >= r->graphs_size)
+  {
+    graph_config_t **tmp;
+    size_t tmp_size;
+
+    tmp_size = (r->graphs_size > 0) ? (2 * r->graphs_size) : 1024;
+    tmp = realloc (r->graphs, tmp_size * sizeof (*tmp));
+    if (tmp == NULL)
+      return (ENOMEM);
+    r->graphs = tmp;
+    r->graphs_size = tmp_size;
+  }
+
+  r->graphs[r->graphs_num] = cfg;
+  r->graphs_num++;
+  return (0);
+} /* }}} int bench_collect */
+
+/* Most graphs select one plugin and type, like the default configuration.
+ * Some narrow that down to one host or type instance, some take any type of
+ * a plugin, and a few combine all instances. */
+static graph_config_t *bench_create_graph (void) /* {{{ */
+{
+  char host[64];
+  char plugin[64];
+  char type[64];
+  char type_instance[64];
+  graph_ident_t *selector;
+  graph_config_t *cfg;
+  uint64_t r;
+
+  r = bench_random ();
+
+  if ((r % 10) == 0)
+    snprintf (host, sizeof (host), "host%04u.example.com",
+        (unsigned int) ((r >> 8) % BENCH_HOSTS));
+  else
+    snprintf (host, sizeof (host), "%s", ANY_TOKEN);
+
+  snprintf (plugin, sizeof (plugin), "plugin%02u",
+      (unsigned int) ((r >> 20) % BENCH_PLUGINS));
+
+  if (((r >> 32) % 8) == 0)
+    snprintf (type, sizeof (type), "%s", ANY_TOKEN);
+  else
+    snprintf (type, sizeof (type), "type%02u",
+        (unsigned int) ((r >> 36) % BENCH_TYPES));
+
+  if (((r >> 44) % 5) == 0)
+    snprintf (type_instance, sizeof (type_instance), "%s", ALL_TOKEN);
+  else if (((r >> 44) % 5) == 1)
+    snprintf (type_instance, sizeof (type_instance), "ti%u",
+        (unsigned int) ((r >> 48) % 4));
+  else
+    snprintf (type_instance, sizeof (type_instance), "%s", ANY_TOKEN);
+
+  selector = ident_create (host, plugin, ANY_TOKEN, type, type_instance);
+  if (selector == NULL)
+    return (NULL);
+
+  cfg = graph_create (selector);
+  ident_destroy (selector);
+  return (cfg);
+} /* }}} graph_config_t *bench_create_graph */
+
+static graph_ident_t *bench_create_file (void) /* {{{ */
+{
+  char host[64];
+  char plugin[64];
+  char plugin_instance[64];
+  char type[64];
+  char type_instance[64];
+  uint64_t r;
+
+  r = bench_random ();
+
+  snprintf (host, sizeof (host), "host%04u.example.com",
+      (unsigned int) (r % BENCH_HOSTS));
+  snprintf (plugin, sizeof (plugin), "plugin%02u",
+      (unsigned int) ((r >> 16) % BENCH_PLUGINS));
+  snprintf (plugin_instance, sizeof (plugin_instance), "%u",
+      (unsigned int) ((r >> 24) % 8));
+  snprintf (type, sizeof (type), "type%02u",
+      (unsigned int) ((r >> 32) % BENCH_TYPES));
+  snprintf (type_instance, sizeof (type_instance), "ti%u",
+      (unsigned int) ((r >> 40) % 4));
+
+  return (ident_create (host, plugin, plugin_instance, type, type_instance));
+} /* }}} graph_ident_t *bench_create_file */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  graph_config_t **graphs;
+  size_t graphs_num = 500;
+  graph_ident_t **files;
+  size_t files_num = 100000;
+  graph_classifier_t *gc;
+  bench_result_t scanned;
+  bench_result_t classified;
+  double t_scan;
+  double t_classify;
+  double t0;
+  _Bool equal;
+  size_t i;
+  size_t j;
+
+  if (argc > 1)
+    graphs_num = (size_t) strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    files_num = (size_t) strtoul (argv[2], NULL, 0);
+
+  graphs = calloc (graphs_num, sizeof (*graphs));
+  files = calloc (files_num, sizeof (*files));
+  if ((graphs == NULL) || (files == NULL))
+  {
+    fprintf (stderr, "bench_classifier: calloc failed.\n");
+    return (EXIT_FAILURE);
+  }
+
+  for (i = 0; i < graphs_num; i++)
+  {
+    graphs[i] = bench_create_graph ();
+    if (graphs[i] == NULL)
+    {
+      fprintf (stderr, "bench_classifier: graph_create failed.\n");
+      return (EXIT_FAILURE);
+    }
+  }
+
+  for (i = 0; i < files_num; i++)
+  {
+    files[i] = bench_create_file ();
+    if (files[i] == NULL)
+    {
+      fprintf (stderr, "bench_classifier: ident_create failed.\n");
+      return (EXIT_FAILURE);
+    }
+  }
+
+  t0 = bench_now ();
+  gc = gc_create (graphs, graphs_num);
+  if (gc == NULL)
+  {
+    fprintf (stderr, "bench_classifier: gc_create failed.\n");
+    return (EXIT_FAILURE);
+  }
+  printf ("%zu graphs, %zu files, classifier built in %.3f ms\n",
+      graphs_num, files_num, 1000.0 * (bench_now () - t0));
+
+  memset (&scanned, 0, sizeof (scanned));
+  memset (&classified, 0, sizeof (classified));
+
+  t0 = bench_now ();
+  for (i = 0; i < files_num; i++)
+    for (j = 0; j < graphs_num; j++)
+      if (graph_ident_matches (graphs[j], files[i]))
+        bench_collect (graphs[j], &scanned);
+  t_scan = bench_now () - t0;
+
+  t0 = bench_now ();
+  for (i = 0; i < files_num; i++)
+    gc_foreach_match (gc, files[i], bench_collect, &classified);
+  t_classify = bench_now () - t0;
+
+  /* Matches are appended file by file, so equal arrays mean the same graphs
+   * in the same order for every file. */
+  equal = (scanned.graphs_num == classified.graphs_num)
+    && ((scanned.graphs_num == 0)
+        || (memcmp (scanned.graphs, classified.graphs,
+            scanned.graphs_num * sizeof (*scanned.graphs)) == 0));
+
+  printf ("%zu matches\n", scanned.graphs_num);
+  printf ("scan:       %9.3f ms (%7.3f us/file)\n", 1000.0 * t_scan,
+      1000000.0 * t_scan / (double) files_num);
+  printf ("classifier: %9.3f ms (%7.3f us/file)%s\n", 1000.0 * t_classify,
+      1000000.0 * t_classify / (double) files_num,
+      equal ? "" : ", RESULTS DIFFER");
+
+  gc_destroy (gc);
+  for (i = 0; i < files_num; i++)
+    ident_destroy (files[i]);
+  for (i = 0; i < graphs_num; i++)
+    graph_destroy (graphs[i]);
+  free (files);
+  free (graphs);
+  free (scanned.graphs);
+  free (classified.graphs);
+
+  return (equal ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,344 @@
+/**
+ * collection4 - bench_dtype.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Generates a data directory with 100 hosts, 100 plugins per host and 100
+ * files per plugin, one million files in total, and walks it like the
+ * rrdtool data provider does, in three ways:
+ *
+ *   d_type   Types are taken from the directory entries and only looked up
+ *            with fstatat(2) if the file system doesn't provide them.
+ *   fstatat  Every entry is looked up with fstatat(2), which is what happens
+ *            on file systems reporting DT_UNKNOWN.
+ *   stat     Every entry is looked up with stat(2) on its full path, like the
+ *            scan did before it used "fs_foreach_entry".
+ *
+ * For each it prints the wall time and the number of stat calls made. The
+ * files are hard links to one empty file per host, so the tree needs neither
+ * data blocks nor inodes. The numbers are for a warm dentry cache; to
+ * measure the cold case, drop the caches between the walks, e.g. by running
+ * the bench once per mode as root after "echo 3 > /proc/sys/vm/drop_caches".
+ * To count the system calls of the whole process instead, run it under
+ * "strace -f -c -e trace=stat,newfstatat,fstatat64,statx".
+ *
+ * The optional arguments are the number of hosts and the mode to run, one of
+ * the names above; by default all modes are run. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "filesystem.h"
+
+#define BENCH_PLUGINS 100
+#define BENCH_FILES 100
+/* The data directory, host and plugin directories. */
+#define BENCH_DEPTH 3
+
+enum bench_mode_e
+{
+  BENCH_MODE_DTYPE = 0,
+  BENCH_MODE_FSTATAT,
+  BENCH_MODE_STAT,
+  _BENCH_MODE_LAST
+};
+typedef enum bench_mode_e bench_mode_t;
+
+static const char *bench_mode_names[_BENCH_MODE_LAST] =
+{
+  "d_type", "fstatat", "stat"
+};
+
+struct bench_walk_s
+{
+  bench_mode_t mode;
+  const char *path;
+  int depth;
+
+  uint64_t *stat_calls;
+  uint64_t *files_num;
+  uint64_t *dirs_num;
+};
+typedef struct bench_walk_s bench_walk_t;
+
+static char bench_dir[] = "bench_dtype.XXXXXX";
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+static int bench_create_tree (size_t hosts_num) /* {{{ */
+{
+  char template[1024];
+  char path[1024];
+  size_t i;
+  size_t j;
+  size_t k;
+  int fd;
+
+  for (i = 0; i < hosts_num; i++)
+  {
+    snprintf (path, sizeof (path), "%s/host%04zu.example.com", bench_dir, i);
+    if (mkdir (path, 0755) != 0)
+      return (errno);
+
+    /* One file per host keeps below the file system's link limit. Hidden,
+     * so it is skipped by "fs_foreach_entry". */
+    snprintf (template, sizeof (template),
+        "%s/host%04zu.example.com/.template.rrd", bench_dir, i);
+    fd = open (template, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return (errno);
+    close (fd);
+
+    for (j = 0; j < BENCH_PLUGINS; j++)
+    {
+      snprintf (path, sizeof (path), "%s/host%04zu.example.com/plugin-%zu",
+          bench_dir, i, j);
+      if (mkdir (path, 0755) != 0)
+        return (errno);
+
+      for (k = 0; k < BENCH_FILES; k++)
+      {
+        snprintf (path, sizeof (path),
+            "%s/host%04zu.example.com/plugin-%zu/type-%zu.rrd",
+            bench_dir, i, j, k);
+        if (link (template, path) != 0)
+          return (errno);
+      }
+    }
+  }
+
+  return (0);
+} /* }}} int bench_create_tree */
+
+static fs_type_t bench_stat_type (const char *path) /* {{{ */
+{
+  struct stat statbuf;
+
+  memset (&statbuf, 0, sizeof (statbuf));
+  if (stat (path, &statbuf) != 0)
+    return (FS_TYPE_UNKNOWN);
+
+  if (S_ISREG (statbuf.st_mode))
+    return (FS_TYPE_FILE);
+  else if (S_ISDIR (statbuf.st_mode))
+    return (FS_TYPE_DIR);
+  return (FS_TYPE_OTHER);
+} /* }}} fs_type_t bench_stat_type */
+
+static int bench_walk (bench_walk_t *w);
+
+static int bench_walk_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  bench_walk_t *w = user_data;
+  char path[1024];
+  fs_type_t want_type;
+
+  snprintf (path, sizeof (path), "%s/%s", w->path, entry);
+
+  if (w->mode == BENCH_MODE_FSTATAT)
+    type = FS_TYPE_UNKNOWN;
+
+  if (w->mode == BENCH_MODE_STAT)
+  {
+    type = bench_stat_type (path);
+    (*w->stat_calls)++;
+  }
+  else if (type == FS_TYPE_UNKNOWN)
+  {
+    type = fs_entry_type (dir_fd, entry);
+    (*w->stat_calls)++;
+  }
+
+  want_type = (w->depth >= BENCH_DEPTH - 1) ? FS_TYPE_FILE : FS_TYPE_DIR;
+  if (type != want_type)
+    return (0);
+
+  if (type == FS_TYPE_FILE)
+  {
+    (*w->files_num)++;
+    return (0);
+  }
+
+  {
+    bench_walk_t child = *w;
+
+    child.path = path;
+    child.depth = w->depth + 1;
+    return (bench_walk (&child));
+  }
+} /* }}} int bench_walk_cb */
+
+static int bench_walk (bench_walk_t *w) /* {{{ */
+{
+  (*w->dirs_num)++;
+  return (fs_foreach_entry (w->path, bench_walk_cb, w));
+} /* }}} int bench_walk */
+
+static int bench_remove_path (const char *path);
+
+static int bench_remove_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  const char *dir = user_data;
+  char path[1024];
+
+  snprintf (path, sizeof (path), "%s/%s", dir, entry);
+
+  if (type == FS_TYPE_UNKNOWN)
+    type = fs_entry_type (dir_fd, entry);
+
+  if (type == FS_TYPE_DIR)
+    return (bench_remove_path (path));
+
+  if (unlink (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int bench_remove_cb */
+
+static int bench_remove_path (const char *path) /* {{{ */
+{
+  char template[1024];
+  int status;
+
+  /* Skipped by "fs_foreach_entry". */
+  snprintf (template, sizeof (template), "%s/.template.rrd", path);
+  unlink (template);
+
+  status = fs_foreach_entry (path, bench_remove_cb, (void *) path);
+  if (status != 0)
+    return (status);
+
+  if (rmdir (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int bench_remove_path */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  size_t hosts_num = 100;
+  uint64_t files_expected;
+  int mode = -1;
+  double t0;
+  int errors = 0;
+  int status;
+  int i;
+
+  if (argc > 1)
+    hosts_num = (size_t) strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+  {
+    for (i = 0; i < _BENCH_MODE_LAST; i++)
+      if (strcmp (bench_mode_names[i], argv[2]) == 0)
+        mode = i;
+    if (mode < 0)
+    {
+      fprintf (stderr, "Usage: %s [<hosts> [d_type|fstatat|stat]]\n",
+          argv[0]);
+      return (EXIT_FAILURE);
+    }
+  }
+
+  files_expected = (uint64_t) hosts_num * BENCH_PLUGINS * BENCH_FILES;
+
+  if (mkdtemp (bench_dir) == NULL)
+  {
+    perror ("mkdtemp");
+    return (EXIT_FAILURE);
+  }
+
+  t0 = bench_now ();
+  status = bench_create_tree (hosts_num);
+  if (status != 0)
+  {
+    fprintf (stderr, "bench_dtype: Creating the tree failed: %s\n",
+        strerror (status));
+    bench_remove_path (bench_dir);
+    return (EXIT_FAILURE);
+  }
+  printf ("%zu hosts, %zu directories, %llu files, created in %.2f s\n",
+      hosts_num, hosts_num * (BENCH_PLUGINS + 1),
+      (unsigned long long) files_expected, bench_now () - t0);
+
+  for (i = 0; i < _BENCH_MODE_LAST; i++)
+  {
+    bench_walk_t w;
+    uint64_t stat_calls = 0;
+    uint64_t files_num = 0;
+    uint64_t dirs_num = 0;
+
+    if ((mode >= 0) && (i != mode))
+      continue;
+
+    memset (&w, 0, sizeof (w));
+    w.mode = (bench_mode_t) i;
+    w.path = bench_dir;
+    w.depth = 0;
+    w.stat_calls = &stat_calls;
+    w.files_num = &files_num;
+    w.dirs_num = &dirs_num;
+
+    t0 = bench_now ();
+    status = bench_walk (&w);
+    t0 = bench_now () - t0;
+
+    if ((status != 0) || (files_num != files_expected))
+    {
+      fprintf (stderr, "bench_dtype: The %s walk returned status %i and "
+          "found %llu of %llu files.\n", bench_mode_names[i], status,
+          (unsigned long long) files_num,
+          (unsigned long long) files_expected);
+      errors++;
+    }
+
+    printf ("%-8s %9.3f s, %9llu stat calls, %llu directories read\n",
+        bench_mode_names[i], t0, (unsigned long long) stat_calls,
+        (unsigned long long) dirs_num);
+  }
+
+  t0 = bench_now ();
+  status = bench_remove_path (bench_dir);
+  if (status != 0)
+    fprintf (stderr, "bench_dtype: Removing %s failed: %s\n",
+        bench_dir, strerror (status));
+  else
+    printf ("removed in %.2f s\n", bench_now () - t0);
+
+  return ((errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
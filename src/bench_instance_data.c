@@ -0,0 +1,228 @@
+/**
+ * collection4 - bench_instance_data.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Writes the data of a number of identifiers the way
+ * "action_instances_data_json" does, once for each output format, and prints
+ * the size of the response and the time it took to build. The data comes
+ * from a synthetic data provider: two data sources per identifier, one day
+ * at ten second resolution, with 5% gaps. The optional argument is the
+ * number of identifiers, 100 by default. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "data_provider.h"
+#include "graph_ident.h"
+#include "utils_json.h"
+
+#define BENCH_INTERVAL 10
+#define BENCH_POINTS 8640
+
+/* Size of the binary preamble, see "action_instance_data_json.c". */
+#define BENCH_PREAMBLE_SIZE 16
+
+static double bench_values[BENCH_POINTS];
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+/* The synthetic data provider. The values look like a network interface's
+ * octets per second. */
+int data_provider_get_ident_data_all (graph_ident_t *ident, /* {{{ */
+    dp_time_t begin, __attribute__((unused)) dp_time_t end,
+    __attribute__((unused)) dp_time_t resolution,
+    __attribute__((unused)) dp_cf_t cf,
+    dp_get_ident_data_callback callback, void *user_data)
+{
+  dp_time_t interval = { BENCH_INTERVAL, 0 };
+  int status;
+
+  status = (*callback) (ident, "rx", begin, interval,
+      BENCH_POINTS, bench_values, user_data);
+  if (status == 0)
+    status = (*callback) (ident, "tx", begin, interval,
+        BENCH_POINTS, bench_values, user_data);
+
+  return (status);
+} /* }}} int data_provider_get_ident_data_all */
+
+int data_provider_get_ident_file ( /* {{{ */
+    __attribute__((unused)) const graph_ident_t *ident,
+    __attribute__((unused)) char *buffer,
+    __attribute__((unused)) size_t buffer_size)
+{
+  return (ENOTSUP);
+} /* }}} int data_provider_get_ident_file */
+
+static void bench_values_init (void) /* {{{ */
+{
+  uint64_t state = 88172645463325252ULL;
+  size_t i;
+
+  for (i = 0; i < BENCH_POINTS; i++)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    if ((state % 20) == 0)
+      bench_values[i] = NAN;
+    else
+      bench_values[i] = 125000.0 + ((double) (i % 360)) * 1000.0
+        + ((double) (state % 1000000)) / 3.0;
+  }
+} /* }}} void bench_values_init */
+
+/* Returns the number of bytes the response would have. "value_size" is zero
+ * for JSON. */
+static size_t bench_format (graph_ident_t **idents, size_t idents_num, /* {{{ */
+    size_t value_size, double *ret_time)
+{
+  dp_time_t begin = { 1700000000, 0 };
+  dp_time_t end = { 1700000000 + BENCH_INTERVAL * BENCH_POINTS, 0 };
+  dp_time_t resolution = { BENCH_INTERVAL, 0 };
+  data_columns_t columns;
+  json_writer_t *w;
+  const char *json = NULL;
+  size_t json_len = 0;
+  size_t bytes;
+  double t0;
+  size_t i;
+
+  memset (&columns, 0, sizeof (columns));
+  columns.value_size = value_size;
+
+  t0 = bench_now ();
+
+  w = json_writer_create (/* callback = */ NULL, /* user_data = */ NULL,
+      /* flags = */ 0);
+  if (w == NULL)
+  {
+    fprintf (stderr, "bench_instance_data: json_writer_create failed.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  json_array_open (w);
+  for (i = 0; i < idents_num; i++)
+  {
+    int status;
+
+    status = ident_data_to_json (idents[i], begin, end, resolution,
+        DP_CF_AVERAGE, DOWNSAMPLE_AVG,
+        (value_size != 0) ? &columns : NULL, w);
+    if (status != 0)
+    {
+      fprintf (stderr, "bench_instance_data: ident_data_to_json failed "
+          "with status %i.\n", status);
+      exit (EXIT_FAILURE);
+    }
+  }
+  json_array_close (w);
+
+  json_writer_get_buffer (w, &json, &json_len);
+  bytes = json_len;
+  if (value_size != 0)
+  {
+    /* The header is padded to eight bytes. */
+    bytes = BENCH_PREAMBLE_SIZE + json_len;
+    bytes += (8 - (bytes % 8)) % 8;
+    bytes += columns.buffer_used;
+  }
+
+  *ret_time = bench_now () - t0;
+
+  json_writer_destroy (w);
+  free (columns.buffer);
+
+  return (bytes);
+} /* }}} size_t bench_format */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  const char *format_names[] = { "json", "binary", "binary32" };
+  size_t value_sizes[] = { 0, 8, 4 };
+  graph_ident_t **idents;
+  size_t idents_num = 100;
+  double points;
+  size_t i;
+
+  if (argc > 1)
+    idents_num = (size_t) strtoul (argv[1], NULL, 0);
+  if (idents_num == 0)
+    return (0);
+
+  bench_values_init ();
+
+  idents = calloc (idents_num, sizeof (*idents));
+  if (idents == NULL)
+  {
+    fprintf (stderr, "bench_instance_data: calloc failed.\n");
+    return (EXIT_FAILURE);
+  }
+
+  for (i = 0; i < idents_num; i++)
+  {
+    char host[64];
+
+    snprintf (host, sizeof (host), "host%zu", i);
+    idents[i] = ident_create (host, "interface", "eth0", "if_octets", "");
+    if (idents[i] == NULL)
+    {
+      fprintf (stderr, "bench_instance_data: ident_create failed.\n");
+      return (EXIT_FAILURE);
+    }
+  }
+
+  points = 2.0 * ((double) BENCH_POINTS) * ((double) idents_num);
+  printf ("%zu identifiers, %.0f data points\n", idents_num, points);
+
+  for (i = 0; i < (sizeof (value_sizes) / sizeof (value_sizes[0])); i++)
+  {
+    double t;
+    size_t bytes;
+
+    bytes = bench_format (idents, idents_num, value_sizes[i], &t);
+    printf ("%-8s: %10zu bytes, %5.2f bytes/point, %8.2f ms\n",
+        format_names[i], bytes, ((double) bytes) / points, 1000.0 * t);
+  }
+
+  for (i = 0; i < idents_num; i++)
+    ident_destroy (idents[i]);
+  free (idents);
+
+  return (0);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,179 @@
+/**
+ * collection4 - bench_json.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Serialises an array of data points, with 5% gaps, once with yajl's
+ * generator and once with the JSON writer, and prints the time and size of
+ * both. The optional argument is the number of points, ten million by
+ * default. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <yajl/yajl_gen.h>
+
+#include "utils_json.h"
+
+static size_t bench_bytes = 0;
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+/* Both callbacks only count the bytes, so that the benchmark measures the
+ * generators and not the output. */
+static void yajl_callback (__attribute__((unused)) void *ctx, /* {{{ */
+    __attribute__((unused)) const char *str, unsigned int len)
+{
+  bench_bytes += (size_t) len;
+} /* }}} void yajl_callback */
+
+static int json_callback (__attribute__((unused)) void *user_data, /* {{{ */
+    __attribute__((unused)) const char *buffer, size_t buffer_size)
+{
+  bench_bytes += buffer_size;
+  return (0);
+} /* }}} int json_callback */
+
+static double bench_yajl (const double *values, size_t values_num) /* {{{ */
+{
+  yajl_gen_config config = { /* beautify = */ 0, /* indentString = */ "" };
+  yajl_gen handler;
+  double t0;
+  size_t i;
+
+  t0 = bench_now ();
+
+  handler = yajl_gen_alloc2 (yajl_callback, &config,
+      /* alloc funcs = */ NULL, /* ctx = */ NULL);
+  if (handler == NULL)
+  {
+    fprintf (stderr, "bench_json: yajl_gen_alloc2 failed.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  yajl_gen_array_open (handler);
+  for (i = 0; i < values_num; i++)
+  {
+    if (isnan (values[i]))
+      yajl_gen_null (handler);
+    else
+      yajl_gen_double (handler, values[i]);
+  }
+  yajl_gen_array_close (handler);
+  yajl_gen_free (handler);
+
+  return (bench_now () - t0);
+} /* }}} double bench_yajl */
+
+static double bench_writer (const double *values, size_t values_num) /* {{{ */
+{
+  json_writer_t *w;
+  double t0;
+  size_t i;
+
+  t0 = bench_now ();
+
+  w = json_writer_create (json_callback, /* user_data = */ NULL,
+      /* flags = */ 0);
+  if (w == NULL)
+  {
+    fprintf (stderr, "bench_json: json_writer_create failed.\n");
+    exit (EXIT_FAILURE);
+  }
+
+  json_array_open (w);
+  for (i = 0; i < values_num; i++)
+    json_double (w, values[i]);
+  json_array_close (w);
+  json_writer_destroy (w);
+
+  return (bench_now () - t0);
+} /* }}} double bench_writer */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  size_t values_num = 10000000;
+  double *values;
+  double yajl_time;
+  double writer_time;
+  size_t yajl_bytes;
+  size_t writer_bytes;
+  uint64_t state = 88172645463325252ULL;
+  size_t i;
+
+  if (argc > 1)
+    values_num = (size_t) strtoul (argv[1], NULL, 0);
+  if (values_num == 0)
+    return (0);
+
+  values = malloc (values_num * sizeof (*values));
+  if (values == NULL)
+  {
+    fprintf (stderr, "bench_json: malloc failed.\n");
+    return (EXIT_FAILURE);
+  }
+
+  /* Something like a gauge: a slow ramp plus noise, with 5% gaps. */
+  for (i = 0; i < values_num; i++)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    if ((state % 20) == 0)
+      values[i] = NAN;
+    else
+      values[i] = ((double) (i % 8640)) / 8.64
+        + ((double) (state % 10000)) / 7.0;
+  }
+
+  bench_bytes = 0;
+  yajl_time = bench_yajl (values, values_num);
+  yajl_bytes = bench_bytes;
+
+  bench_bytes = 0;
+  writer_time = bench_writer (values, values_num);
+  writer_bytes = bench_bytes;
+
+  printf ("yajl_gen:    %7.3f s, %7.1f Mpoints/s, %zu bytes\n",
+      yajl_time, ((double) values_num) / yajl_time / 1000000.0, yajl_bytes);
+  printf ("json_writer: %7.3f s, %7.1f Mpoints/s, %zu bytes, "
+      "speedup %.2f\n",
+      writer_time, ((double) values_num) / writer_time / 1000000.0,
+      writer_bytes, yajl_time / writer_time);
+
+  free (values);
+  return (0);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,322 @@
+/**
+ * collection4 - bench_scan_threads.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Generates a data directory with 500 hosts, ten plugins per host and ten
+ * RRD files per plugin, hard links to one small RRD file per host, and scans
+ * it with "ScanThreads" set to one through eight. It prints the best time of
+ * three full scans for each setting and the speedup over the serial scan, and
+ * fails if a scan doesn't report every file exactly once. The tree is scanned
+ * once beforehand, so the numbers are for a warm dentry cache; drop the caches
+ * between runs to measure the cold case, which is where the threads help
+ * most. The optional arguments are the number of hosts and the largest number
+ * of threads. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <rrd.h>
+
+#include "oconfig.h"
+#include "data_provider.h"
+#include "dp_rrdtool.h"
+#include "filesystem.h"
+#include "graph_ident.h"
+
+#define BENCH_PLUGINS 10
+#define BENCH_FILES 10
+#define BENCH_REPEAT 3
+
+static char bench_dir[] = "bench_scan_threads.XXXXXX";
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+/* The scan reads the data sources of each new file, so the files have to be
+ * valid. One file per host keeps below the file system's link limit. Hidden
+ * files are ignored by the scan. */
+static int bench_create_template (size_t host, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  const char *argv[] = { "DS:value:GAUGE:600:U:U", "RRA:AVERAGE:0.5:1:1" };
+
+  snprintf (buffer, buffer_size, "%s/host%04zu.example.com/.template.rrd",
+      bench_dir, host);
+
+  rrd_clear_error ();
+  if (rrd_create_r (buffer, /* step = */ 300, /* last_up = */ 0,
+        (int) (sizeof (argv) / sizeof (argv[0])), argv) != 0)
+  {
+    fprintf (stderr, "bench_scan_threads: rrd_create_r (%s) failed: %s\n",
+        buffer, rrd_get_error ());
+    return (-1);
+  }
+
+  return (0);
+} /* }}} int bench_create_template */
+
+static int bench_create_tree (size_t hosts_num) /* {{{ */
+{
+  char template[1024];
+  char path[1024];
+  size_t i;
+  size_t j;
+  size_t k;
+
+  for (i = 0; i < hosts_num; i++)
+  {
+    snprintf (path, sizeof (path), "%s/host%04zu.example.com", bench_dir, i);
+    if (mkdir (path, 0755) != 0)
+      return (errno);
+
+    if (bench_create_template (i, template, sizeof (template)) != 0)
+      return (EINVAL);
+
+    for (j = 0; j < BENCH_PLUGINS; j++)
+    {
+      snprintf (path, sizeof (path), "%s/host%04zu.example.com/plugin-%zu",
+          bench_dir, i, j);
+      if (mkdir (path, 0755) != 0)
+        return (errno);
+
+      for (k = 0; k < BENCH_FILES; k++)
+      {
+        snprintf (path, sizeof (path),
+            "%s/host%04zu.example.com/plugin-%zu/type-%zu.rrd",
+            bench_dir, i, j, k);
+        if (link (template, path) != 0)
+          return (errno);
+      }
+    }
+  }
+
+  return (0);
+} /* }}} int bench_create_tree */
+
+static int bench_remove_path (const char *path);
+
+static int bench_remove_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  const char *dir = user_data;
+  char path[1024];
+
+  snprintf (path, sizeof (path), "%s/%s", dir, entry);
+
+  if (type == FS_TYPE_UNKNOWN)
+    type = fs_entry_type (dir_fd, entry);
+
+  if (type == FS_TYPE_DIR)
+    return (bench_remove_path (path));
+
+  if (unlink (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int bench_remove_cb */
+
+static int bench_remove_path (const char *path) /* {{{ */
+{
+  char template[1024];
+  int status;
+
+  /* Skipped by "fs_foreach_entry". */
+  snprintf (template, sizeof (template), "%s/.template.rrd", path);
+  unlink (template);
+
+  status = fs_foreach_entry (path, bench_remove_cb, (void *) path);
+  if (status != 0)
+    return (status);
+
+  if (rmdir (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int bench_remove_path */
+
+/* Configures a new rrdtool data provider for "bench_dir", replacing the
+ * previous one. */
+static int bench_configure (int scan_threads) /* {{{ */
+{
+  oconfig_value_t values[2];
+  oconfig_item_t children[2];
+  oconfig_item_t ci;
+  int status;
+
+  memset (values, 0, sizeof (values));
+  memset (children, 0, sizeof (children));
+  memset (&ci, 0, sizeof (ci));
+
+  values[0].type = OCONFIG_TYPE_STRING;
+  values[0].value.string = bench_dir;
+  children[0].key = "DataDir";
+
+  values[1].type = OCONFIG_TYPE_NUMBER;
+  values[1].value.number = (double) scan_threads;
+  children[1].key = "ScanThreads";
+
+  children[0].values = values + 0;
+  children[1].values = values + 1;
+  children[0].values_num = 1;
+  children[1].values_num = 1;
+
+  ci.key = "DataProvider";
+  ci.children = children;
+  ci.children_num = 2;
+
+  status = dp_rrdtool_config (&ci);
+  if (status == 0)
+    status = data_provider_config_submit ();
+
+  return (status);
+} /* }}} int bench_configure */
+
+static int bench_count_cb (__attribute__((unused)) graph_ident_t *ident, /* {{{ */
+    void *user_data)
+{
+  size_t *count = user_data;
+
+  (*count)++;
+  return (0);
+} /* }}} int bench_count_cb */
+
+/* Returns the best time of "BENCH_REPEAT" full scans, or a negative value if
+ * a scan failed or didn't find "files_num" files. */
+static double bench_scan (size_t files_num) /* {{{ */
+{
+  double best = -1.0;
+  int i;
+
+  for (i = 0; i < BENCH_REPEAT; i++)
+  {
+    size_t count = 0;
+    double t0;
+    int status;
+
+    t0 = bench_now ();
+    status = data_provider_get_idents (bench_count_cb, &count);
+    t0 = bench_now () - t0;
+
+    if ((status != 0) || (count != files_num))
+    {
+      fprintf (stderr, "bench_scan_threads: Scan returned status %i and "
+          "%zu of %zu files.\n", status, count, files_num);
+      return (-1.0);
+    }
+
+    if ((best < 0.0) || (t0 < best))
+      best = t0;
+  }
+
+  return (best);
+} /* }}} double bench_scan */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  size_t hosts_num = 500;
+  int threads_max = 8;
+  size_t files_num;
+  double serial = -1.0;
+  double t0;
+  int errors = 0;
+  int status;
+  int i;
+
+  if (argc > 1)
+    hosts_num = (size_t) strtoul (argv[1], NULL, 0);
+  if (argc > 2)
+    threads_max = atoi (argv[2]);
+  if (threads_max < 1)
+    threads_max = 1;
+
+  files_num = hosts_num * BENCH_PLUGINS * BENCH_FILES;
+
+  if (mkdtemp (bench_dir) == NULL)
+  {
+    perror ("mkdtemp");
+    return (EXIT_FAILURE);
+  }
+
+  t0 = bench_now ();
+  status = bench_create_tree (hosts_num);
+  if (status != 0)
+  {
+    fprintf (stderr, "bench_scan_threads: Creating the tree failed: %s\n",
+        strerror (status));
+    bench_remove_path (bench_dir);
+    return (EXIT_FAILURE);
+  }
+  printf ("%zu hosts, %zu directories, %zu files, created in %.2f s, "
+      "%li CPU(s) online\n",
+      hosts_num, hosts_num * (BENCH_PLUGINS + 1), files_num,
+      bench_now () - t0, sysconf (_SC_NPROCESSORS_ONLN));
+
+  for (i = 0; i <= threads_max; i++)
+  {
+    double t;
+
+    /* Round zero only warms up the caches. */
+    status = bench_configure ((i > 0) ? i : 1);
+    if (status != 0)
+    {
+      fprintf (stderr, "bench_scan_threads: bench_configure failed with "
+          "status %i.\n", status);
+      errors++;
+      break;
+    }
+
+    t = bench_scan (files_num);
+    if (t < 0.0)
+    {
+      errors++;
+      break;
+    }
+
+    if (i == 0)
+      continue;
+    if (i == 1)
+      serial = t;
+
+    printf ("ScanThreads %2i: %9.3f ms, speedup %5.2f\n",
+        i, 1000.0 * t, serial / t);
+  }
+
+  status = bench_remove_path (bench_dir);
+  if (status != 0)
+    fprintf (stderr, "bench_scan_threads: Removing %s failed: %s\n",
+        bench_dir, strerror (status));
+
+  return ((errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,284 @@
+/**
+ * collection4 - bench_search.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Builds ten graphs with one million instances in total, publishes them and
+ * searches the instance descriptions with and without the trigram index. It
+ * prints the time to publish all graphs, to republish after one instance was
+ * added, and the time of each search. The results of both searches must be
+ * identical. The optional argument is the number of hosts, each of which
+ * adds 100 instances. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "graph.h"
+#include "graph_ident.h"
+
+#define BENCH_GRAPHS 10
+#define BENCH_PER_HOST 10
+
+struct bench_result_s
+{
+  size_t *indices;
+  size_t indices_num;
+  size_t indices_size;
+};
+typedef struct bench_result_s bench_result_t;
+
+static const char *bench_plugins[BENCH_GRAPHS][2] =
+{
+  { "cpu", "cpu" },
+  { "memory", "memory" },
+  { "interface", "if_octets" },
+  { "df", "df_complex" },
+  { "disk", "disk_octets" },
+  { "load", "load" },
+  { "processes", "ps_state" },
+  { "swap", "swap" },
+  { "nginx", "nginx_requests" },
+  { "mysql", "mysql_commands" }
+};
+
+static const char *bench_terms[] =
+{
+  "e", "et", "eth", "eth1", "host0001", "host00042.example", "idle", "user",
+  "0.ex", "m", "com", "xyz"
+};
+
+static double bench_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double bench_now */
+
+static int bench_collect (size_t index, void *user_data) /* {{{ */
+{
+  bench_result_t *r = user_data;
+
+  if (r->indices_num >= r->indices_size)
+  {
+    size_t *tmp;
+    size_t tmp_size;
+
+    tmp_size = (r->indices_size > 0) ? (2 * r->indices_size) : 1024;
+    tmp = realloc (r->indices, tmp_size * sizeof (*tmp));
+    if (tmp == NULL)
+      return (ENOMEM);
+    r->indices = tmp;
+    r->indices_size = tmp_size;
+  }
+
+  r->indices[r->indices_num] = index;
+  r->indices_num++;
+  return (0);
+} /* }}} int bench_collect */
+
+/* Adds the files of one host. Every third graph combines all type instances
+ * into one instance, so those get a second file per instance. */
+static void bench_add_host (graph_config_t **graphs, size_t host) /* {{{ */
+{
+  char host_name[64];
+  size_t i;
+  size_t j;
+
+  snprintf (host_name, sizeof (host_name), "Host%05zu.Example.Com", host);
+
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    for (j = 0; j < BENCH_PER_HOST; j++)
+    {
+      char plugin_instance[64];
+      char type_instance[64];
+      graph_ident_t *file;
+
+      snprintf (plugin_instance, sizeof (plugin_instance), "%s%zu",
+          (i == 2) ? "eth" : "", j);
+      snprintf (type_instance, sizeof (type_instance), "%s",
+          ((j % 2) != 0) ? "Idle" : "user");
+
+      file = ident_create (host_name, bench_plugins[i][0], plugin_instance,
+          bench_plugins[i][1], type_instance);
+      graph_add_file (graphs[i], file);
+      ident_destroy (file);
+
+      if ((i % 3) != 0)
+        continue;
+
+      snprintf (type_instance, sizeof (type_instance), "st%zu", j);
+      file = ident_create (host_name, bench_plugins[i][0], plugin_instance,
+          bench_plugins[i][1], type_instance);
+      graph_add_file (graphs[i], file);
+      ident_destroy (file);
+    }
+  }
+} /* }}} void bench_add_host */
+
+static double bench_publish (graph_config_t **graphs, /* {{{ */
+    graph_config_t **published)
+{
+  double t0;
+  size_t i;
+
+  t0 = bench_now ();
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    graph_unref (published[i]);
+    published[i] = graph_publish (graphs[i]);
+    if (published[i] == NULL)
+    {
+      fprintf (stderr, "bench_search: graph_publish failed.\n");
+      exit (EXIT_FAILURE);
+    }
+  }
+
+  return (bench_now () - t0);
+} /* }}} double bench_publish */
+
+/* Searches all graphs for "term", returning the number of matches. */
+static size_t bench_search (graph_config_t **graphs, const char *term, /* {{{ */
+    bench_result_t *results, double *ret_time)
+{
+  size_t matches = 0;
+  double t0;
+  size_t i;
+
+  t0 = bench_now ();
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    results[i].indices_num = 0;
+    graph_search_descriptions (graphs[i], term, bench_collect, results + i);
+    matches += results[i].indices_num;
+  }
+  *ret_time = bench_now () - t0;
+
+  return (matches);
+} /* }}} size_t bench_search */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  graph_config_t *graphs[BENCH_GRAPHS];
+  graph_config_t *published[BENCH_GRAPHS];
+  bench_result_t indexed[BENCH_GRAPHS];
+  bench_result_t scanned[BENCH_GRAPHS];
+  size_t hosts_num = 10000;
+  size_t instances_num;
+  graph_ident_t *file;
+  double t0;
+  double t;
+  int errors = 0;
+  size_t i;
+  size_t j;
+
+  if (argc > 1)
+    hosts_num = (size_t) strtoul (argv[1], NULL, 0);
+
+  memset (published, 0, sizeof (published));
+  memset (indexed, 0, sizeof (indexed));
+  memset (scanned, 0, sizeof (scanned));
+
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    graph_ident_t *selector;
+
+    selector = ident_create (ANY_TOKEN, bench_plugins[i][0], ANY_TOKEN,
+        bench_plugins[i][1], ((i % 3) == 0) ? ALL_TOKEN : ANY_TOKEN);
+    graphs[i] = graph_create (selector);
+    ident_destroy (selector);
+    if (graphs[i] == NULL)
+    {
+      fprintf (stderr, "bench_search: graph_create failed.\n");
+      return (EXIT_FAILURE);
+    }
+  }
+
+  t0 = bench_now ();
+  for (i = 0; i < hosts_num; i++)
+    bench_add_host (graphs, i);
+
+  instances_num = 0;
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    graph_sort_instances (graphs[i]);
+    instances_num += graph_num_instances (graphs[i]);
+  }
+  printf ("%zu instances, added in %.2f s\n", instances_num,
+      bench_now () - t0);
+
+  t = bench_publish (graphs, published);
+  printf ("publish (copy and index): %8.3f s\n", t);
+
+  /* Only the changed graph has to be copied and indexed again. */
+  file = ident_create ("Host00000.Example.Com", "cpu", "99", "cpu", "user");
+  graph_add_file (graphs[0], file);
+  ident_destroy (file);
+  graph_sort_instances (graphs[0]);
+
+  t = bench_publish (graphs, published);
+  printf ("republish after a change: %8.3f s\n", t);
+
+  /* The working copies have no index, so searching them describes each
+   * instance. */
+  for (i = 0; i < (sizeof (bench_terms) / sizeof (bench_terms[0])); i++)
+  {
+    size_t matches;
+    double t_indexed;
+    double t_scanned;
+    _Bool equal = 1;
+
+    matches = bench_search (published, bench_terms[i], indexed, &t_indexed);
+    bench_search (graphs, bench_terms[i], scanned, &t_scanned);
+
+    for (j = 0; j < BENCH_GRAPHS; j++)
+      if ((indexed[j].indices_num != scanned[j].indices_num)
+          || ((indexed[j].indices_num > 0)
+            && (memcmp (indexed[j].indices, scanned[j].indices,
+                indexed[j].indices_num * sizeof (size_t)) != 0)))
+        equal = 0;
+
+    if (!equal)
+      errors++;
+
+    printf ("%-18s %8zu matches: index %9.3f ms, scan %9.3f ms%s\n",
+        bench_terms[i], matches, 1000.0 * t_indexed,
+        1000.0 * t_scanned, equal ? "" : ", RESULTS DIFFER");
+  }
+
+  for (i = 0; i < BENCH_GRAPHS; i++)
+  {
+    graph_unref (published[i]);
+    graph_destroy (graphs[i]);
+    free (indexed[i].indices);
+    free (scanned[i].indices);
+  }
+
+  return ((errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,594 @@
+/**
+ * collection4 - collectd_flush.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "collectd_flush.h"
+#include "graph_config.h"
+#include "graph_ident.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+/* collectd's unixsock plugin reads commands into a buffer of 1024 bytes, so
+ * longer batches are split into several FLUSH commands. */
+#define FLUSH_LINE_MAX 1000
+
+/* "flush_recent" is not pruned before it has this many entries. */
+#define FLUSH_RECENT_MIN 1024
+
+struct flush_recent_s /* {{{ */
+{
+  /* Key of the "flush_recent" entry. */
+  graph_ident_t *ident;
+  double time;
+}; /* }}} struct flush_recent_s */
+typedef struct flush_recent_s flush_recent_t;
+
+/* Serializes the use of "flush_fd" and "flush_recent". */
+static pthread_mutex_t flush_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Connection to collectd, -1 if not connected. */
+static int flush_fd = -1;
+/* Identifiers flushed recently. Expired entries are removed once the table
+ * has grown to "flush_recent_limit" entries. */
+static c4_hash_t *flush_recent = NULL;
+static size_t flush_recent_limit = FLUSH_RECENT_MIN;
+
+/* Separate from "flush_lock", which may be held while waiting for
+ * collectd. */
+static pthread_mutex_t flush_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static flush_stats_t flush_stats;
+
+/*
+ * Private functions
+ */
+static double flush_time (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double flush_time */
+
+static void flush_count (uint64_t flushed, uint64_t skipped, /* {{{ */
+    uint64_t timeouts, uint64_t errors, uint64_t rejected)
+{
+  pthread_mutex_lock (&flush_stats_lock);
+  flush_stats.flushed += flushed;
+  flush_stats.skipped += skipped;
+  flush_stats.timeouts += timeouts;
+  flush_stats.errors += errors;
+  flush_stats.rejected += rejected;
+  pthread_mutex_unlock (&flush_stats_lock);
+} /* }}} void flush_count */
+
+static void flush_disconnect (void) /* {{{ */
+{
+  if (flush_fd < 0)
+    return;
+
+  close (flush_fd);
+  flush_fd = -1;
+} /* }}} void flush_disconnect */
+
+static int flush_connect (void) /* {{{ */
+{
+  struct sockaddr_un sa;
+  int flags;
+  int fd;
+  int status;
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sun_family = AF_UNIX;
+  status = graph_config_get_collectd_socket (sa.sun_path,
+      sizeof (sa.sun_path));
+  if (status != 0)
+    return (status);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, /* protocol = */ 0);
+  if (fd < 0)
+    return (errno);
+
+  /* Never block. If collectd's backlog is full, connect(2) fails instead of
+   * waiting. */
+  flags = fcntl (fd, F_GETFL);
+  if ((flags < 0) || (fcntl (fd, F_SETFL, flags | O_NONBLOCK) != 0))
+  {
+    status = errno;
+    close (fd);
+    return (status);
+  }
+
+  status = connect (fd, (struct sockaddr *) &sa, sizeof (sa));
+  if (status != 0)
+  {
+    status = errno;
+    close (fd);
+    return (status);
+  }
+
+  flush_fd = fd;
+  return (0);
+} /* }}} int flush_connect */
+
+/* Waits until "flush_fd" is ready for "events" or "deadline" has passed. */
+static int flush_poll (short events, double deadline) /* {{{ */
+{
+  struct pollfd pfd;
+
+  memset (&pfd, 0, sizeof (pfd));
+  pfd.fd = flush_fd;
+  pfd.events = events;
+
+  while (42)
+  {
+    double remaining = deadline - flush_time ();
+    int status;
+
+    if (remaining <= 0.0)
+      return (ETIMEDOUT);
+
+    status = poll (&pfd, 1, (int) (remaining * 1000.0) + 1);
+    if (status > 0)
+      return (0);
+    else if (status == 0)
+      return (ETIMEDOUT);
+    else if (errno != EINTR)
+      return (errno);
+  }
+} /* }}} int flush_poll */
+
+static int flush_send (const char *buffer, size_t buffer_size, /* {{{ */
+    double deadline)
+{
+  while (buffer_size > 0)
+  {
+    ssize_t status;
+
+    /* MSG_NOSIGNAL: Don't die if collectd closed the connection. */
+    status = send (flush_fd, buffer, buffer_size, MSG_NOSIGNAL);
+    if (status < 0)
+    {
+      int tmp;
+
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        return (errno);
+
+      tmp = flush_poll (POLLOUT, deadline);
+      if (tmp != 0)
+        return (tmp);
+      continue;
+    }
+
+    buffer += status;
+    buffer_size -= (size_t) status;
+  }
+
+  return (0);
+} /* }}} int flush_send */
+
+/* Reads one status line for each of the "commands_num" commands sent and
+ * counts the negative ones in "*ret_rejected". */
+static int flush_receive (size_t commands_num, double deadline, /* {{{ */
+    uint64_t *ret_rejected)
+{
+  char buffer[4096];
+  size_t buffer_fill = 0;
+  size_t done = 0;
+
+  while (done < commands_num)
+  {
+    char *newline;
+    ssize_t status;
+
+    newline = memchr (buffer, '\n', buffer_fill);
+    if (newline != NULL)
+    {
+      size_t len = (size_t) (newline - buffer) + 1;
+
+      *newline = 0;
+      /* A negative status means the command was rejected. Unknown
+       * identifiers are only counted as "errors" in a successful reply. */
+      if (atoi (buffer) < 0)
+      {
+        fprintf (stderr, "flush_idents: collectd replied: %s\n", buffer);
+        (*ret_rejected)++;
+      }
+
+      memmove (buffer, buffer + len, buffer_fill - len);
+      buffer_fill -= len;
+      done++;
+      continue;
+    }
+
+    /* Discard overly long lines. Their end is still counted. */
+    if (buffer_fill >= sizeof (buffer))
+      buffer_fill = 0;
+
+    status = recv (flush_fd, buffer + buffer_fill,
+        sizeof (buffer) - buffer_fill, /* flags = */ 0);
+    if (status == 0)
+      return (ECONNRESET);
+    else if (status < 0)
+    {
+      int tmp;
+
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        return (errno);
+
+      tmp = flush_poll (POLLIN, deadline);
+      if (tmp != 0)
+        return (tmp);
+      continue;
+    }
+
+    buffer_fill += (size_t) status;
+  }
+
+  return (0);
+} /* }}} int flush_receive */
+
+static int flush_append (char **buffer, size_t *buffer_fill, /* {{{ */
+    size_t *buffer_size, const char *str, size_t str_len)
+{
+  if ((*buffer_fill + str_len + 1) > *buffer_size)
+  {
+    size_t new_size = (*buffer_size > 0) ? (2 * *buffer_size) : 1024;
+    char *tmp;
+
+    while (new_size < (*buffer_fill + str_len + 1))
+      new_size *= 2;
+
+    tmp = realloc (*buffer, new_size);
+    if (tmp == NULL)
+      return (ENOMEM);
+    *buffer = tmp;
+    *buffer_size = new_size;
+  }
+
+  memcpy (*buffer + *buffer_fill, str, str_len);
+  *buffer_fill += str_len;
+  (*buffer)[*buffer_fill] = 0;
+
+  return (0);
+} /* }}} int flush_append */
+
+/* Formats the "identifier" option for "ident", quoting the identifier as
+ * expected by the unixsock plugin. */
+static int flush_format_option (const graph_ident_t *ident, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  char *ident_str;
+  size_t fill;
+  size_t i;
+
+  ident_str = ident_to_string (ident);
+  if (ident_str == NULL)
+    return (ENOMEM);
+
+  fill = (size_t) snprintf (buffer, buffer_size, " identifier=\"");
+  for (i = 0; ident_str[i] != 0; i++)
+  {
+    if ((fill + 4) >= buffer_size)
+      break;
+
+    if ((ident_str[i] == '"') || (ident_str[i] == '\\'))
+      buffer[fill++] = '\\';
+    buffer[fill++] = ident_str[i];
+  }
+
+  if ((ident_str[i] != 0) || ((fill + 2) > buffer_size))
+  {
+    free (ident_str);
+    return (ENAMETOOLONG);
+  }
+
+  buffer[fill++] = '"';
+  buffer[fill] = 0;
+
+  free (ident_str);
+  return (0);
+} /* }}} int flush_format_option */
+
+/* Remembers that "ident" has been flushed at "now". */
+static void flush_remember (const graph_ident_t *ident, double now) /* {{{ */
+{
+  flush_recent_t *r;
+
+  if (flush_recent == NULL)
+  {
+    flush_recent = c4_hash_create (ident_hash, ident_compare_void);
+    if (flush_recent == NULL)
+      return;
+  }
+
+  r = c4_hash_lookup (flush_recent, ident);
+  if (r != NULL)
+  {
+    r->time = now;
+    return;
+  }
+
+  r = malloc (sizeof (*r));
+  if (r == NULL)
+    return;
+
+  r->ident = ident_clone (ident);
+  r->time = now;
+  if ((r->ident == NULL)
+      || (c4_hash_insert (flush_recent, r->ident, r) != 0))
+  {
+    ident_destroy (r->ident);
+    free (r);
+  }
+} /* }}} void flush_remember */
+
+struct flush_prune_data_s /* {{{ */
+{
+  double expired;
+  flush_recent_t **entries;
+  size_t entries_num;
+}; /* }}} struct flush_prune_data_s */
+typedef struct flush_prune_data_s flush_prune_data_t;
+
+static int flush_prune_cb (__attribute__((unused)) const void *key, /* {{{ */
+    void *value, void *user_data)
+{
+  flush_recent_t *r = value;
+  flush_prune_data_t *data = user_data;
+
+  if (r->time < data->expired)
+  {
+    data->entries[data->entries_num] = r;
+    data->entries_num++;
+  }
+
+  return (0);
+} /* }}} int flush_prune_cb */
+
+/* Removes the entries that are older than "window" seconds once the table
+ * has doubled in size. */
+static void flush_prune (double now, double window) /* {{{ */
+{
+  flush_prune_data_t data;
+  size_t size;
+  size_t i;
+
+  if (flush_recent == NULL)
+    return;
+
+  size = c4_hash_size (flush_recent);
+  if (size < flush_recent_limit)
+    return;
+
+  memset (&data, 0, sizeof (data));
+  data.expired = now - window;
+  data.entries = calloc (size, sizeof (*data.entries));
+  if (data.entries == NULL)
+    return;
+
+  c4_hash_foreach (flush_recent, flush_prune_cb, &data);
+
+  for (i = 0; i < data.entries_num; i++)
+  {
+    flush_recent_t *r = data.entries[i];
+
+    c4_hash_remove (flush_recent, r->ident);
+    ident_destroy (r->ident);
+    free (r);
+  }
+  free (data.entries);
+
+  flush_recent_limit = 2 * c4_hash_size (flush_recent);
+  if (flush_recent_limit < FLUSH_RECENT_MIN)
+    flush_recent_limit = FLUSH_RECENT_MIN;
+} /* }}} void flush_prune */
+
+/*
+ * Public functions
+ */
+int flush_idents (graph_ident_t * const *idents, size_t idents_num) /* {{{ */
+{
+  struct timespec abstime;
+  int timeout;
+  double window;
+  double now;
+  double deadline;
+
+  char *commands = NULL;
+  size_t commands_fill = 0;
+  size_t commands_size = 0;
+  size_t commands_num = 0;
+  size_t line_len = 0;
+
+  uint64_t flushed = 0;
+  uint64_t skipped = 0;
+  uint64_t rejected = 0;
+  size_t i;
+  int status;
+
+  if ((idents == NULL) && (idents_num > 0))
+    return (EINVAL);
+
+  if (idents_num == 0)
+    return (0);
+
+  timeout = graph_config_get_flush_timeout ();
+  window = (double) graph_config_get_flush_window ();
+
+  now = flush_time ();
+  deadline = now + (((double) timeout) / 1000.0);
+
+  /* Another thread may be waiting for collectd. Don't wait for it longer
+   * than we'd wait for collectd ourselves. */
+  clock_gettime (CLOCK_REALTIME, &abstime);
+  abstime.tv_sec += (time_t) (timeout / 1000);
+  abstime.tv_nsec += ((long) (timeout % 1000)) * 1000000L;
+  if (abstime.tv_nsec >= 1000000000L)
+  {
+    abstime.tv_sec++;
+    abstime.tv_nsec -= 1000000000L;
+  }
+
+  status = pthread_mutex_timedlock (&flush_lock, &abstime);
+  if (status != 0)
+  {
+    flush_count (0, 0, /* timeouts = */ 1, 0, 0);
+    return (ETIMEDOUT);
+  }
+
+  for (i = 0; i < idents_num; i++)
+  {
+    flush_recent_t *r = NULL;
+    char option[FLUSH_LINE_MAX];
+    size_t option_len;
+
+    if (flush_recent != NULL)
+      r = c4_hash_lookup (flush_recent, idents[i]);
+    if ((r != NULL) && ((now - r->time) < window))
+    {
+      skipped++;
+      continue;
+    }
+
+    status = flush_format_option (idents[i], option,
+        sizeof (option) - strlen ("FLUSH"));
+    if (status != 0)
+      continue;
+    option_len = strlen (option);
+
+    if ((line_len > 0) && ((line_len + option_len) >= FLUSH_LINE_MAX))
+    {
+      status = flush_append (&commands, &commands_fill, &commands_size,
+          "\n", 1);
+      if (status != 0)
+        break;
+      line_len = 0;
+    }
+
+    if (line_len == 0)
+    {
+      status = flush_append (&commands, &commands_fill, &commands_size,
+          "FLUSH", strlen ("FLUSH"));
+      if (status != 0)
+        break;
+      line_len = strlen ("FLUSH");
+      commands_num++;
+    }
+
+    status = flush_append (&commands, &commands_fill, &commands_size,
+        option, option_len);
+    if (status != 0)
+      break;
+    line_len += option_len;
+
+    /* Remembered even if the flush fails, so that a collectd which doesn't
+     * answer isn't asked again for every request. */
+    flush_remember (idents[i], now);
+    flushed++;
+  }
+
+  if (line_len > 0)
+    status = flush_append (&commands, &commands_fill, &commands_size,
+        "\n", 1);
+  else
+    status = 0;
+
+  if ((status == 0) && (commands_num > 0))
+  {
+    if (flush_fd < 0)
+      status = flush_connect ();
+    if (status == 0)
+      status = flush_send (commands, commands_fill, deadline);
+    if (status == 0)
+      status = flush_receive (commands_num, deadline, &rejected);
+
+    /* Replies to commands we gave up on would be mistaken for replies to
+     * the next ones. */
+    if (status != 0)
+      flush_disconnect ();
+  }
+
+  flush_prune (now, window);
+
+  pthread_mutex_unlock (&flush_lock);
+
+  free (commands);
+
+  if (status == ETIMEDOUT)
+  {
+    fprintf (stderr, "flush_idents: collectd didn't answer within %i ms. "
+        "Using the data on disk.\n", timeout);
+    flush_count (0, skipped, /* timeouts = */ 1, 0, rejected);
+  }
+  else if (status != 0)
+  {
+    char path[PATH_MAX];
+
+    graph_config_get_collectd_socket (path, sizeof (path));
+    fprintf (stderr, "flush_idents: Flushing %lu identifier(s) via \"%s\" "
+        "failed with status %i.\n", (unsigned long) flushed,
+        path, status);
+    flush_count (0, skipped, 0, /* errors = */ 1, rejected);
+  }
+  else
+  {
+    flush_count (flushed, skipped, 0, 0, rejected);
+  }
+
+  return (status);
+} /* }}} int flush_idents */
+
+int flush_get_stats (flush_stats_t *ret_stats) /* {{{ */
+{
+  if (ret_stats == NULL)
+    return (EINVAL);
+
+  pthread_mutex_lock (&flush_stats_lock);
+  *ret_stats = flush_stats;
+  pthread_mutex_unlock (&flush_stats_lock);
+
+  return (0);
+} /* }}} int flush_get_stats */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,58 @@
+/**
+ * collection4 - collectd_flush.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef COLLECTD_FLUSH_H
+#define COLLECTD_FLUSH_H 1
+
+#include <stdint.h>
+
+#include "graph_types.h"
+
+struct flush_stats_s
+{
+  /* Identifiers sent to collectd. */
+  uint64_t flushed;
+  /* Identifiers skipped because they had been flushed recently. */
+  uint64_t skipped;
+  /* Flushes abandoned because collectd didn't answer in time. */
+  uint64_t timeouts;
+  /* Flushes that failed otherwise, e.g. because collectd isn't running. */
+  uint64_t errors;
+  /* FLUSH commands collectd answered with a negative status. */
+  uint64_t rejected;
+};
+typedef struct flush_stats_s flush_stats_t;
+
+/* Asks collectd to write the values it has cached for "idents" to disk, so
+ * that fetching the data returns current values. Identifiers flushed within
+ * the last "FlushWindow" seconds are skipped, the others are sent to the
+ * "CollectdSocket" in one batch. Waits at most "FlushTimeout" milliseconds,
+ * including the time spent waiting for other threads. If collectd doesn't
+ * answer in time, ETIMEDOUT is returned and the caller should go ahead with
+ * the data on disk. */
+int flush_idents (graph_ident_t * const *idents, size_t idents_num);
+
+int flush_get_stats (flush_stats_t *ret_stats);
+
+#endif /* COLLECTD_FLUSH_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -74,19 +74,18 @@ size_t c_strlcat (char *dst, const char *src, size_t size) /* {{{ */
 int ds_list_from_rrd_file (char *file, /* {{{ */
     size_t *ret_dses_num, char ***ret_dses)
 {
-  char *rrd_argv[] = { "info", file, NULL };
-  int rrd_argc = (sizeof (rrd_argv) / sizeof (rrd_argv[0])) - 1;
-
   rrd_info_t *info;
   rrd_info_t *ptr;
 
   char **dses = NULL;
   size_t dses_num = 0;
 
-  info = rrd_info (rrd_argc, rrd_argv);
+  /* Unlike rrd_info(), rrd_info_r() doesn't use getopt(3) and may be called
+   * from multiple threads. */
+  info = rrd_info_r (file);
   if (info == NULL)
   {
-    printf ("%s: rrd_info (%s) failed.\n", __func__, file);
+    fprintf (stderr, "%s: rrd_info_r (%s) failed.\n", __func__, file);
     return (-1);
   }
 
@@ -233,7 +232,7 @@ int print_debug (const char *format, ...) /* {{{ */
 
   if (!have_header)
   {
-    printf ("Content-Type: text/plain\n\n");
+    cgi_printf ("Content-Type: text/plain\n\n");
     have_header = 1;
   }
 
@@ -339,4 +338,15 @@ int get_time_args (long *ret_begin, long *ret_end, /* {{{ */
   return (0);
 } /* }}} int get_time_args */
 
+_Bool time_arg_is_relative (const char *name) /* {{{ */
+{
+  const char *str;
+
+  str = param (name);
+  if (str == NULL)
+    return (1);
+
+  return (strtol (str, NULL, /* base = */ 0) <= 0);
+} /* }}} _Bool time_arg_is_relative */
+
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -56,5 +56,9 @@ char *strtolower_copy (const char *str);
 int get_time_args (long *ret_begin, long *ret_end,
     long *ret_now);
 
+/* Returns true if the time parameter "name", i.e. "begin" or "end", is
+ * relative to the current time. This is the case if it is absent. */
+_Bool time_arg_is_relative (const char *name);
+
 #endif /* COMMON_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
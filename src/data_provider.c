@@ -23,143 +23,763 @@
  **/
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
-#include <assert.h>
+#include <pthread.h>
 
+#include "collectd_flush.h"
 #include "data_provider.h"
 #include "dp_rrdtool.h"
 #include "graph_ident.h"
+#include "utils_hash.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
-#include <collectd/client.h>
+/* Providers are identified by a bit in "dp_owner_t.providers". */
+#define DP_PROVIDERS_MAX 64
 
-/* TODO: Turn this into an array for multiple data providers. */
-static data_provider_t *data_provider = NULL;
+struct dp_list_s /* {{{ */
+{
+  data_provider_t *providers;
+  size_t providers_num;
+
+  /* Number of users, including "dp_list" itself. Protected by
+   * "dp_list_lock". */
+  unsigned int refcount;
+}; /* }}} struct dp_list_s */
+typedef struct dp_list_s dp_list_t;
 
-static lcc_connection_t *collectd_connection = NULL;
+/* Identifiers reported by more than one provider are only passed on once.
+ * Their data is fetched from the first configured provider having them. With
+ * a single provider, none of this is needed and "dp_owners" stays empty. */
+struct dp_owner_s /* {{{ */
+{
+  /* Key of the "dp_owners" entry. */
+  graph_ident_t *ident;
+  /* Bit i is set if provider i has the identifier. */
+  uint64_t providers;
+}; /* }}} struct dp_owner_s */
+typedef struct dp_owner_s dp_owner_t;
 
-static int data_provider_ident_flush (const graph_ident_t *ident) /* {{{ */
+/* State of one provider's scan. Providers are scanned in parallel. */
+struct dp_scan_s /* {{{ */
 {
-  char *ident_str;
-  lcc_identifier_t ident_lcc;
+  data_provider_t *provider;
+  uint64_t mask;
+
+  /* One of "get_idents", "get_idents_delta" and "get_idents_events". */
+  int method;
+  /* Set if this is the only provider. Changes are passed on as they are. */
+  _Bool single;
+  dp_get_idents_callback idents_callback;
+  dp_get_idents_delta_callback delta_callback;
+  void *user_data;
+
+  size_t duplicates;
   int status;
+}; /* }}} struct dp_scan_s */
+typedef struct dp_scan_s dp_scan_t;
 
-  if (ident == NULL)
-    return (EINVAL);
+#define DP_SCAN_IDENTS 0
+#define DP_SCAN_DELTA  1
+#define DP_SCAN_EVENTS 2
 
-  ident_str = ident_to_string (ident);
-  if (ident_str == NULL)
-    return (ENOMEM);
+/* The list in use. Other threads may still be using a list after it has been
+ * replaced, so lists are reference counted. */
+static dp_list_t *dp_list = NULL;
+/* Providers registered while reading the config file. Replaces "dp_list" in
+ * "data_provider_config_submit". */
+static dp_list_t *dp_list_pending = NULL;
+static pthread_mutex_t dp_list_lock = PTHREAD_MUTEX_INITIALIZER;
 
-  if (collectd_connection == NULL)
+static c4_hash_t *dp_owners = NULL;
+static pthread_mutex_t dp_owners_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Serializes the callbacks of providers scanned in parallel. Taken before
+ * "dp_owners_lock". */
+static pthread_mutex_t dp_callback_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void dp_list_destroy (dp_list_t *list) /* {{{ */
+{
+  size_t i;
+
+  if (list == NULL)
+    return;
+
+  for (i = 0; i < list->providers_num; i++)
   {
-    /* TODO: Make socket path configurable */
-    status = lcc_connect (/* path = */ "/var/run/collectd-unixsock",
-		    &collectd_connection);
-    if (status != 0)
+    data_provider_t *p = list->providers + i;
+
+    if (p->destroy != NULL)
+      (*p->destroy) (p->private_data);
+  }
+
+  free (list->providers);
+  free (list);
+} /* }}} void dp_list_destroy */
+
+/* Returns the list in use or NULL if there are no providers. The list must be
+ * released with "dp_list_unref". */
+static dp_list_t *dp_get_list (void) /* {{{ */
+{
+  dp_list_t *list;
+
+  pthread_mutex_lock (&dp_list_lock);
+  list = dp_list;
+  if ((list != NULL) && (list->providers_num == 0))
+    list = NULL;
+  if (list != NULL)
+    list->refcount++;
+  pthread_mutex_unlock (&dp_list_lock);
+
+  return (list);
+} /* }}} dp_list_t *dp_get_list */
+
+static void dp_list_unref (dp_list_t *list) /* {{{ */
+{
+  unsigned int refcount;
+
+  if (list == NULL)
+    return;
+
+  pthread_mutex_lock (&dp_list_lock);
+  list->refcount--;
+  refcount = list->refcount;
+  pthread_mutex_unlock (&dp_list_lock);
+
+  /* The last user of a replaced list shuts its providers down. */
+  if (refcount == 0)
+    dp_list_destroy (list);
+} /* }}} void dp_list_unref */
+
+static int dp_owners_clear_cb (__attribute__((unused)) const void *key, /* {{{ */
+    void *value, __attribute__((unused)) void *user_data)
+{
+  dp_owner_t *o = value;
+
+  ident_destroy (o->ident);
+  free (o);
+
+  return (0);
+} /* }}} int dp_owners_clear_cb */
+
+/* Forgets which provider has which identifier. Must be called with
+ * "dp_owners_lock" held. */
+static void dp_owners_clear (void) /* {{{ */
+{
+  if (dp_owners == NULL)
+    return;
+
+  c4_hash_foreach (dp_owners, dp_owners_clear_cb, /* user data = */ NULL);
+  c4_hash_destroy (dp_owners);
+  dp_owners = NULL;
+} /* }}} void dp_owners_clear */
+
+/* Records that the provider(s) in "mask" have "ident". Returns true if no
+ * other provider had it before. */
+static _Bool dp_owners_add (const graph_ident_t *ident, /* {{{ */
+    uint64_t mask)
+{
+  dp_owner_t *o;
+  _Bool first;
+
+  pthread_mutex_lock (&dp_owners_lock);
+
+  if (dp_owners == NULL)
+    dp_owners = c4_hash_create (ident_hash, ident_compare_void);
+
+  o = NULL;
+  if (dp_owners != NULL)
+    o = c4_hash_lookup (dp_owners, ident);
+
+  if (o != NULL)
+  {
+    first = ((o->providers & ~mask) == 0);
+    o->providers |= mask;
+    pthread_mutex_unlock (&dp_owners_lock);
+    return (first);
+  }
+
+  /* If the identifier can't be recorded, it is looked up in all providers
+   * when fetching data. */
+  o = malloc (sizeof (*o));
+  if ((o != NULL) && (dp_owners != NULL))
+  {
+    o->ident = ident_clone (ident);
+    o->providers = mask;
+    if ((o->ident == NULL)
+        || (c4_hash_insert (dp_owners, o->ident, o) != 0))
     {
-      assert (collectd_connection == NULL);
-      fprintf (stderr, "data_provider_ident_flush: lcc_connect failed "
-          "with status %i.\n", status);
-      return (status);
+      ident_destroy (o->ident);
+      free (o);
     }
-    assert (collectd_connection != NULL);
   }
+  else
+  {
+    free (o);
+  }
+
+  pthread_mutex_unlock (&dp_owners_lock);
+  return (1);
+} /* }}} _Bool dp_owners_add */
+
+/* Records that the provider(s) in "mask" no longer have "ident". Returns
+ * true if no other provider has it. */
+static _Bool dp_owners_remove (const graph_ident_t *ident, /* {{{ */
+    uint64_t mask)
+{
+  dp_owner_t *o = NULL;
 
-  memset (&ident_lcc, 0, sizeof (ident_lcc));
-  status = lcc_string_to_identifier (collectd_connection,
-      &ident_lcc, ident_str);
-  if (status != 0)
+  pthread_mutex_lock (&dp_owners_lock);
+
+  if (dp_owners != NULL)
+    o = c4_hash_lookup (dp_owners, ident);
+
+  if (o == NULL)
   {
-    fprintf (stderr, "data_provider_ident_flush: lcc_string_to_identifier "
-        "failed: %s (%i)\n",
-        lcc_strerror (collectd_connection), status);
-    free (ident_str);
-    return (status);
+    pthread_mutex_unlock (&dp_owners_lock);
+    return (1);
   }
 
-  status = lcc_flush (collectd_connection,
-      /* write-plugin = */ NULL,
-      /* identifier   = */ &ident_lcc,
-      /* timeout      = */ -1);
-  if (status != 0)
+  o->providers &= ~mask;
+  if (o->providers != 0)
   {
-    fprintf (stderr, "data_provider_ident_flush: lcc_flush (\"%s\") failed: %s (%i)\n",
-        ident_str, lcc_strerror (collectd_connection), status);
-    free (ident_str);
+    pthread_mutex_unlock (&dp_owners_lock);
+    return (0);
+  }
 
-    lcc_disconnect (collectd_connection);
-    collectd_connection = NULL;
+  c4_hash_remove (dp_owners, o->ident);
+  ident_destroy (o->ident);
+  free (o);
+
+  pthread_mutex_unlock (&dp_owners_lock);
+  return (1);
+} /* }}} _Bool dp_owners_remove */
+
+/* Returns the providers to ask for the data of "ident": the first configured
+ * provider having it or, if it is unknown, e.g. because the graph list was
+ * read from the cache file, all of them. */
+static uint64_t dp_owners_get (const dp_list_t *list, /* {{{ */
+    const graph_ident_t *ident)
+{
+  dp_owner_t *o = NULL;
+  uint64_t providers = 0;
 
-    return (status);
+  if (list->providers_num < 2)
+    return (1);
+
+  pthread_mutex_lock (&dp_owners_lock);
+  if (dp_owners != NULL)
+    o = c4_hash_lookup (dp_owners, ident);
+  if (o != NULL)
+    providers = o->providers;
+  pthread_mutex_unlock (&dp_owners_lock);
+
+  /* Lowest bit set. */
+  providers &= -providers;
+
+  if (providers == 0)
+  {
+    if (list->providers_num >= DP_PROVIDERS_MAX)
+      providers = UINT64_MAX;
+    else
+      providers = (((uint64_t) 1) << list->providers_num) - 1;
+  }
+
+  return (providers);
+} /* }}} uint64_t dp_owners_get */
+
+static int dp_scan_report (dp_scan_t *scan, /* {{{ */
+    graph_ident_t *ident, dp_ident_change_t change)
+{
+  _Bool forward;
+  int status = 0;
+
+  /* Nothing to de-duplicate and nobody to serialize with. */
+  if (scan->single)
+  {
+    if (scan->method == DP_SCAN_IDENTS)
+      return ((*scan->idents_callback) (ident, scan->user_data));
+    return ((*scan->delta_callback) (ident, change, scan->user_data));
+  }
+
+  pthread_mutex_lock (&dp_callback_lock);
+
+  if (change == DP_IDENT_ADDED)
+  {
+    forward = dp_owners_add (ident, scan->mask);
+    if (!forward)
+      scan->duplicates++;
+  }
+  else
+  {
+    forward = dp_owners_remove (ident, scan->mask);
+  }
+
+  if (forward)
+  {
+    if (scan->method == DP_SCAN_IDENTS)
+      status = (*scan->idents_callback) (ident, scan->user_data);
+    else
+      status = (*scan->delta_callback) (ident, change, scan->user_data);
+  }
+
+  pthread_mutex_unlock (&dp_callback_lock);
+
+  return (status);
+} /* }}} int dp_scan_report */
+
+static int dp_scan_idents_cb (graph_ident_t *ident, /* {{{ */
+    void *user_data)
+{
+  return (dp_scan_report (user_data, ident, DP_IDENT_ADDED));
+} /* }}} int dp_scan_idents_cb */
+
+static int dp_scan_delta_cb (graph_ident_t *ident, /* {{{ */
+    dp_ident_change_t change, void *user_data)
+{
+  return (dp_scan_report (user_data, ident, change));
+} /* }}} int dp_scan_delta_cb */
+
+static void *dp_scan_thread (void *arg) /* {{{ */
+{
+  dp_scan_t *scan = arg;
+  data_provider_t *p = scan->provider;
+
+  if (scan->method == DP_SCAN_IDENTS)
+    scan->status = (*p->get_idents) (p->private_data,
+        dp_scan_idents_cb, scan);
+  else if (scan->method == DP_SCAN_DELTA)
+    scan->status = (*p->get_idents_delta) (p->private_data,
+        dp_scan_delta_cb, scan);
+  else
+    scan->status = (*p->get_idents_events) (p->private_data,
+        dp_scan_delta_cb, scan);
+
+  return (NULL);
+} /* }}} void *dp_scan_thread */
+
+/* Calls "method" of all providers. The (slow) directory scans of the
+ * providers run in parallel, the callbacks are serialized. */
+static int dp_scan (int method, /* {{{ */
+    dp_get_idents_callback idents_callback,
+    dp_get_idents_delta_callback delta_callback, void *user_data)
+{
+  dp_list_t *list;
+  dp_scan_t *scans;
+  pthread_t *threads;
+  _Bool *started;
+  size_t duplicates = 0;
+  size_t i;
+  int status = 0;
+
+  list = dp_get_list ();
+  if (list == NULL)
+    return (EINVAL);
+
+  /* Changes can only be reported if all providers can report them. */
+  for (i = 0; i < list->providers_num; i++)
+  {
+    if ((method == DP_SCAN_DELTA)
+        && (list->providers[i].get_idents_delta == NULL))
+    {
+      dp_list_unref (list);
+      return (ENOTSUP);
+    }
+    if ((method == DP_SCAN_EVENTS)
+        && (list->providers[i].get_idents_events == NULL))
+    {
+      dp_list_unref (list);
+      return (ENOTSUP);
+    }
+  }
+
+  scans = calloc (list->providers_num, sizeof (*scans));
+  threads = calloc (list->providers_num, sizeof (*threads));
+  started = calloc (list->providers_num, sizeof (*started));
+  if ((scans == NULL) || (threads == NULL) || (started == NULL))
+  {
+    free (scans);
+    free (threads);
+    free (started);
+    dp_list_unref (list);
+    return (ENOMEM);
   }
 
-  /* fprintf (stderr, "data_provider_ident_flush: lcc_flush (\"%s\") succeeded.\n", ident_str); */
-  free (ident_str);
+  /* Everything is reported again. */
+  if ((method == DP_SCAN_IDENTS) && (list->providers_num > 1))
+  {
+    pthread_mutex_lock (&dp_owners_lock);
+    dp_owners_clear ();
+    pthread_mutex_unlock (&dp_owners_lock);
+  }
+
+  for (i = 0; i < list->providers_num; i++)
+  {
+    scans[i].provider = list->providers + i;
+    scans[i].mask = ((uint64_t) 1) << i;
+    scans[i].method = method;
+    scans[i].single = (list->providers_num < 2);
+    scans[i].idents_callback = idents_callback;
+    scans[i].delta_callback = delta_callback;
+    scans[i].user_data = user_data;
+
+    /* Checking for events is cheap and done for every request. Don't start
+     * threads for that. */
+    if ((list->providers_num < 2) || (method == DP_SCAN_EVENTS))
+      continue;
+
+    if (pthread_create (threads + i, /* attr = */ NULL,
+          dp_scan_thread, scans + i) == 0)
+      started[i] = 1;
+  }
+
+  for (i = 0; i < list->providers_num; i++)
+  {
+    if (started[i])
+      pthread_join (threads[i], /* return value = */ NULL);
+    else
+      dp_scan_thread (scans + i);
+
+    if ((status == 0) && (scans[i].status != 0))
+      status = scans[i].status;
+    duplicates += scans[i].duplicates;
+  }
+
+  if (duplicates > 0)
+    fprintf (stderr, "data_provider: %lu identifier(s) have been reported by "
+        "more than one data provider. Using the first one.\n",
+        (unsigned long) duplicates);
+
+  free (scans);
+  free (threads);
+  free (started);
+  dp_list_unref (list);
+
+  return (status);
+} /* }}} int dp_scan */
+
+/*
+ * Public functions
+ */
+int dp_cf_from_string (const char *str, dp_cf_t *ret_cf) /* {{{ */
+{
+  if ((str == NULL) || (ret_cf == NULL))
+    return (EINVAL);
+
+  if (strcasecmp ("AVERAGE", str) == 0)
+    *ret_cf = DP_CF_AVERAGE;
+  else if (strcasecmp ("MIN", str) == 0)
+    *ret_cf = DP_CF_MIN;
+  else if (strcasecmp ("MAX", str) == 0)
+    *ret_cf = DP_CF_MAX;
+  else
+    return (EINVAL);
+
   return (0);
-} /* }}} int data_provider_ident_flush */
+} /* }}} int dp_cf_from_string */
+
+const char *dp_cf_to_string (dp_cf_t cf) /* {{{ */
+{
+  if (cf == DP_CF_MIN)
+    return ("MIN");
+  else if (cf == DP_CF_MAX)
+    return ("MAX");
+  return ("AVERAGE");
+} /* }}} const char *dp_cf_to_string */
 
 int data_provider_config (const oconfig_item_t *ci) /* {{{ */
 {
-  /* FIXME: Actually determine which data provider to call. */
-  return (dp_rrdtool_config (ci));
+  const char *name = "rrdtool";
+
+  if (ci->values_num > 0)
+  {
+    if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_STRING))
+    {
+      fprintf (stderr, "data_provider_config: The \"DataProvider\" block "
+          "needs exactly one string argument.\n");
+      return (EINVAL);
+    }
+    name = ci->values[0].value.string;
+  }
+
+  if (strcasecmp ("rrdtool", name) == 0)
+    return (dp_rrdtool_config (ci));
+
+  fprintf (stderr, "data_provider_config: Unknown data provider \"%s\".\n",
+      name);
+  return (ENOENT);
 } /* }}} int data_provider_config */
 
 int data_provider_register (const char *name, data_provider_t *p) /* {{{ */
 {
+  data_provider_t *tmp;
+
   fprintf (stderr, "data_provider_register (name = %s, ptr = %p)\n",
       name, (void *) p);
 
-  if (data_provider == NULL)
-    data_provider = malloc (sizeof (*data_provider));
-  if (data_provider == NULL)
+  pthread_mutex_lock (&dp_list_lock);
+
+  if (dp_list_pending == NULL)
+  {
+    dp_list_pending = calloc (1, sizeof (*dp_list_pending));
+    if (dp_list_pending == NULL)
+    {
+      pthread_mutex_unlock (&dp_list_lock);
+      return (ENOMEM);
+    }
+    dp_list_pending->refcount = 1;
+  }
+
+  if (dp_list_pending->providers_num >= DP_PROVIDERS_MAX)
+  {
+    pthread_mutex_unlock (&dp_list_lock);
+    fprintf (stderr, "data_provider_register: At most %i data providers "
+        "are supported.\n", DP_PROVIDERS_MAX);
+    return (ENOSPC);
+  }
+
+  tmp = realloc (dp_list_pending->providers,
+      (dp_list_pending->providers_num + 1) * sizeof (*tmp));
+  if (tmp == NULL)
+  {
+    pthread_mutex_unlock (&dp_list_lock);
     return (ENOMEM);
+  }
+  dp_list_pending->providers = tmp;
 
-  *data_provider = *p;
+  dp_list_pending->providers[dp_list_pending->providers_num] = *p;
+  dp_list_pending->providers_num++;
+
+  pthread_mutex_unlock (&dp_list_lock);
 
   return (0);
 } /* }}} int data_provider_register */
 
-int data_provider_get_idents (dp_get_idents_callback callback, /* {{{ */
-    void *user_data)
+int data_provider_config_submit (void) /* {{{ */
 {
-  int status;
+  dp_list_t *old = NULL;
 
-  if (data_provider == NULL)
-    return (EINVAL);
+  pthread_mutex_lock (&dp_list_lock);
+  /* Keep the old providers if the config file doesn't configure any. */
+  if (dp_list_pending != NULL)
+  {
+    old = dp_list;
+    dp_list = dp_list_pending;
+    dp_list_pending = NULL;
+  }
+  pthread_mutex_unlock (&dp_list_lock);
 
-  /* TODO: Iterate over all data providers */
-  status = data_provider->get_idents (data_provider->private_data,
-      callback, user_data);
+  /* Drops the reference held by "dp_list". */
+  dp_list_unref (old);
 
-  return (status);
+  /* The bits refer to the old list. */
+  pthread_mutex_lock (&dp_owners_lock);
+  dp_owners_clear ();
+  pthread_mutex_unlock (&dp_owners_lock);
+
+  return (0);
+} /* }}} int data_provider_config_submit */
+
+int data_provider_get_idents (dp_get_idents_callback callback, /* {{{ */
+    void *user_data)
+{
+  return (dp_scan (DP_SCAN_IDENTS, callback, /* delta = */ NULL,
+        user_data));
 } /* }}} int data_provider_get_idents */
 
+int data_provider_get_idents_delta ( /* {{{ */
+    dp_get_idents_delta_callback callback, void *user_data)
+{
+  return (dp_scan (DP_SCAN_DELTA, /* idents = */ NULL, callback,
+        user_data));
+} /* }}} int data_provider_get_idents_delta */
+
+int data_provider_get_idents_events ( /* {{{ */
+    dp_get_idents_delta_callback callback, void *user_data)
+{
+  return (dp_scan (DP_SCAN_EVENTS, /* idents = */ NULL, callback,
+        user_data));
+} /* }}} int data_provider_get_idents_events */
+
 int data_provider_get_ident_ds_names (graph_ident_t *ident, /* {{{ */
     dp_list_get_ident_ds_names_callback callback, void *user_data)
 {
-  if (data_provider == NULL)
+  dp_list_t *list;
+  uint64_t providers;
+  size_t i;
+  int status = ENOENT;
+
+  list = dp_get_list ();
+  if (list == NULL)
     return (EINVAL);
 
-  return (data_provider->get_ident_ds_names (data_provider->private_data,
-        ident, callback, user_data));
+  providers = dp_owners_get (list, ident);
+  for (i = 0; i < list->providers_num; i++)
+  {
+    data_provider_t *p = list->providers + i;
+
+    if ((providers & (((uint64_t) 1) << i)) == 0)
+      continue;
+
+    status = (*p->get_ident_ds_names) (p->private_data,
+        ident, callback, user_data);
+    if (status == 0)
+      break;
+  }
+
+  dp_list_unref (list);
+  return (status);
 } /* }}} int data_provider_get_ident_ds_names */
 
 int data_provider_get_ident_data (graph_ident_t *ident, /* {{{ */
     const char *ds_name,
     dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
     dp_get_ident_data_callback callback, void *user_data)
 {
-  if (data_provider == NULL)
+  dp_list_t *list;
+  uint64_t providers;
+  size_t i;
+  int status = ENOENT;
+
+  list = dp_get_list ();
+  if (list == NULL)
     return (EINVAL);
 
-  data_provider_ident_flush (ident);
+  /* If collectd is slow, go ahead with the data on disk. */
+  flush_idents (&ident, 1);
+
+  providers = dp_owners_get (list, ident);
+  for (i = 0; i < list->providers_num; i++)
+  {
+    data_provider_t *p = list->providers + i;
+
+    if ((providers & (((uint64_t) 1) << i)) == 0)
+      continue;
 
-  return (data_provider->get_ident_data (data_provider->private_data,
-        ident, ds_name, begin, end, callback, user_data));
+    status = (*p->get_ident_data) (p->private_data,
+        ident, ds_name, begin, end, resolution, cf, callback, user_data);
+    if (status == 0)
+      break;
+  }
+
+  dp_list_unref (list);
+  return (status);
 } /* }}} int data_provider_get_ident_data */
 
+struct dp_get_ident_data_all_s /* {{{ */
+{
+  data_provider_t *provider;
+  dp_time_t begin;
+  dp_time_t end;
+  dp_time_t resolution;
+  dp_cf_t cf;
+  dp_get_ident_data_callback callback;
+  void *user_data;
+}; /* }}} struct dp_get_ident_data_all_s */
+typedef struct dp_get_ident_data_all_s dp_get_ident_data_all_t;
+
+static int dp_get_ident_data_all_cb (graph_ident_t *ident, /* {{{ */
+    const char *ds_name, void *user_data)
+{
+  dp_get_ident_data_all_t *data = user_data;
+  data_provider_t *p = data->provider;
+
+  return ((*p->get_ident_data) (p->private_data,
+        ident, ds_name, data->begin, data->end,
+        data->resolution, data->cf, data->callback, data->user_data));
+} /* }}} int dp_get_ident_data_all_cb */
+
+int data_provider_get_ident_data_all (graph_ident_t *ident, /* {{{ */
+    dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
+    dp_get_ident_data_callback callback, void *user_data)
+{
+  dp_list_t *list;
+  uint64_t providers;
+  size_t i;
+  int status = ENOENT;
+
+  list = dp_get_list ();
+  if (list == NULL)
+    return (EINVAL);
+
+  /* If collectd is slow, go ahead with the data on disk. */
+  flush_idents (&ident, 1);
+
+  providers = dp_owners_get (list, ident);
+  for (i = 0; i < list->providers_num; i++)
+  {
+    data_provider_t *p = list->providers + i;
+    dp_get_ident_data_all_t data;
+
+    if ((providers & (((uint64_t) 1) << i)) == 0)
+      continue;
+
+    if (p->get_ident_data_all != NULL)
+    {
+      status = (*p->get_ident_data_all) (p->private_data,
+          ident, begin, end, resolution, cf, callback, user_data);
+    }
+    else
+    {
+      data.provider = p;
+      data.begin = begin;
+      data.end = end;
+      data.resolution = resolution;
+      data.cf = cf;
+      data.callback = callback;
+      data.user_data = user_data;
+
+      status = (*p->get_ident_ds_names) (p->private_data,
+          ident, dp_get_ident_data_all_cb, &data);
+    }
+
+    if (status == 0)
+      break;
+  }
+
+  dp_list_unref (list);
+  return (status);
+} /* }}} int data_provider_get_ident_data_all */
+
+int data_provider_get_ident_file (const graph_ident_t *ident, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  dp_list_t *list;
+  uint64_t providers;
+  size_t i;
+  int status = ENOENT;
+
+  list = dp_get_list ();
+  if (list == NULL)
+    return (EINVAL);
+
+  /* Without knowing the owner, the first provider is as good a guess as
+   * any. */
+  providers = dp_owners_get (list, ident);
+  for (i = 0; i < list->providers_num; i++)
+  {
+    data_provider_t *p = list->providers + i;
+
+    if ((providers & (((uint64_t) 1) << i)) == 0)
+      continue;
+
+    if (p->get_ident_file == NULL)
+      status = ENOTSUP;
+    else
+      status = (*p->get_ident_file) (p->private_data,
+          ident, buffer, buffer_size);
+    break;
+  }
+
+  dp_list_unref (list);
+  return (status);
+} /* }}} int data_provider_get_ident_file */
+
 /* vim: set sw=2 sts=2 et fdm=marker : */
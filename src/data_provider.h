@@ -31,6 +31,15 @@
 
 typedef struct timespec dp_time_t;
 
+/* Function used to consolidate data points. */
+enum dp_cf_e
+{
+  DP_CF_AVERAGE,
+  DP_CF_MIN,
+  DP_CF_MAX
+};
+typedef enum dp_cf_e dp_cf_t;
+
 struct dp_data_point_s
 {
   dp_time_t time;
@@ -41,6 +50,16 @@ typedef struct dp_data_point_s dp_data_point_t;
 /* Callback passed to the "get_idents" function. */
 typedef int (*dp_get_idents_callback) (graph_ident_t *, void *);
 
+/* Callback passed to the "get_idents_delta" function. */
+enum dp_ident_change_e
+{
+  DP_IDENT_ADDED,
+  DP_IDENT_REMOVED
+};
+typedef enum dp_ident_change_e dp_ident_change_t;
+typedef int (*dp_get_idents_delta_callback) (graph_ident_t *,
+    dp_ident_change_t, void *);
+
 /* Callback passed to the "get_ident_ds_names" function. */
 typedef int (*dp_list_get_ident_ds_names_callback) (graph_ident_t *,
     const char *ds_name, void *);
@@ -54,28 +73,81 @@ typedef int (*dp_get_ident_data_callback) (graph_ident_t *, const char *ds_name,
 struct data_provider_s
 {
   int (*get_idents) (void *priv, dp_get_idents_callback, void *);
+  /* Optional method: Reports the identifiers added and removed since the
+   * last call to "get_idents" or "get_idents_delta". */
+  int (*get_idents_delta) (void *priv, dp_get_idents_delta_callback, void *);
+  /* Optional method: Like "get_idents_delta", but only reports changes the
+   * provider has been notified about, without scanning. Called for every
+   * request, so it must return quickly if nothing changed. */
+  int (*get_idents_events) (void *priv, dp_get_idents_delta_callback, void *);
   int (*get_ident_ds_names) (void *priv, graph_ident_t *,
       dp_list_get_ident_ds_names_callback, void *);
+  /* "resolution" is the interval between data points the caller will
+   * display. Providers storing data at multiple resolutions should return
+   * the lowest resolution at least as fine as that, consolidated with "cf".
+   * A zero resolution asks for the finest resolution available. */
   int (*get_ident_data) (void *priv,
       graph_ident_t *, const char *ds_name,
       dp_time_t begin, dp_time_t end,
+      dp_time_t resolution, dp_cf_t cf,
       dp_get_ident_data_callback, void *);
+  /* Optional method: Like "get_ident_data", but calls the callback for each
+   * data source of the identifier, fetching all of them at once. */
+  int (*get_ident_data_all) (void *priv,
+      graph_ident_t *,
+      dp_time_t begin, dp_time_t end,
+      dp_time_t resolution, dp_cf_t cf,
+      dp_get_ident_data_callback, void *);
+  /* Optional method: Returns the name of the file holding the identifier's
+   * data. Used by RRDtool when graphing. */
+  int (*get_ident_file) (void *priv, const graph_ident_t *,
+      char *buffer, size_t buffer_size);
   /* Optional method: Prints graph to STDOUT, including HTTP header. */
   int (*print_graph) (void *priv, graph_config_t *cfg, graph_instance_t *inst);
+  /* Optional method: Frees "priv". Called once the provider has been replaced
+   * by a new config and no request is using it anymore. */
+  void (*destroy) (void *priv);
   void *private_data;
 };
 typedef struct data_provider_s data_provider_t;
 
+/* Parses "AVERAGE", "MIN" or "MAX", ignoring case. */
+int dp_cf_from_string (const char *str, dp_cf_t *ret_cf);
+const char *dp_cf_to_string (dp_cf_t cf);
+
 int data_provider_config (const oconfig_item_t *ci);
 
+/* Providers registered while reading the config file are used once
+ * "data_provider_config_submit" is called. */
 int data_provider_register (const char *name, data_provider_t *p);
+int data_provider_config_submit (void);
+
+/* The functions below use all registered providers. Identifiers reported by
+ * several providers are only reported once and their data is fetched from
+ * the first configured provider having them. */
 int data_provider_get_idents (dp_get_idents_callback callback, void *user_data);
+/* Returns ENOTSUP if the data provider can't report changes. */
+int data_provider_get_idents_delta (dp_get_idents_delta_callback callback,
+    void *user_data);
+int data_provider_get_idents_events (dp_get_idents_delta_callback callback,
+    void *user_data);
 int data_provider_get_ident_ds_names (graph_ident_t *ident,
     dp_list_get_ident_ds_names_callback callback, void *user_data);
 int data_provider_get_ident_data (graph_ident_t *ident,
     const char *ds_name,
     dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
+    dp_get_ident_data_callback callback, void *user_data);
+/* Calls "callback" with the data of each data source of "ident". Falls back
+ * to fetching one data source at a time if the data provider can't fetch all
+ * of them at once. */
+int data_provider_get_ident_data_all (graph_ident_t *ident,
+    dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
     dp_get_ident_data_callback callback, void *user_data);
+/* Returns ENOTSUP if the data provider doesn't store identifiers in files. */
+int data_provider_get_ident_file (const graph_ident_t *ident,
+    char *buffer, size_t buffer_size);
 
 #endif /* DATA_PROVIDER_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
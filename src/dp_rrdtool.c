@@ -29,119 +29,1087 @@
 #include <limits.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 
 #include <rrd.h>
 
 #include "graph_types.h"
 #include "graph_config.h"
+#include "graph_ds.h"
 #include "graph_ident.h"
 #include "data_provider.h"
 #include "filesystem.h"
 #include "oconfig.h"
 #include "common.h"
+#include "rrd_reader.h"
+#include "utils_atom.h"
+#include "utils_hash.h"
+#include "utils_pool.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
+/* Directories are remembered between scans, so that only directories whose
+ * modification time changed have to be read again. Entries of the data
+ * directory and of host directories are directories themselves ("children"),
+ * entries of plugin directories are RRD files. */
+#define DIR_DEPTH_DATA   0
+#define DIR_DEPTH_HOST   1
+#define DIR_DEPTH_PLUGIN 2
+
+#if HAVE_SYS_INOTIFY_H
+# define DP_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+    | IN_ONLYDIR)
+#endif
+
+/* Default for the "WatchLimit" option. */
+#define DP_WATCH_LIMIT 65536
+
+struct dp_rrd_dir_s;
+typedef struct dp_rrd_dir_s dp_rrd_dir_t;
+struct dp_rrd_dir_s
+{ /* {{{ */
+  time_t mtime;
+  /* Time the directory was last read, zero if it has never been read. If the
+   * modification time is not older than this, the directory may have been
+   * changed within the same second and is read again. */
+  time_t read_time;
+
+  /* Sorted names of the entries. File names don't include the ".rrd"
+   * suffix. */
+  atom_t *entries;
+  /* Sub-directories in the same order as "entries". NULL for plugin
+   * directories. */
+  dp_rrd_dir_t **children;
+  size_t entries_num;
+
+  dp_rrd_dir_t *parent;
+
+  /* inotify(7) watch descriptor, -1 if the directory isn't watched. */
+  int wd;
+  /* Set when an event has been received for this directory ("dirty") or
+   * one of its descendants ("dirty_below"). */
+  _Bool dirty;
+  _Bool dirty_below;
+}; /* }}} */
+
 struct dp_rrdtool_s
 {
   char *data_dir;
+  /* Directory tree as of the last scan, NULL if there is none. */
+  dp_rrd_dir_t *root;
+
+  /* If enabled, directories are watched using inotify(7) so that only
+   * directories with pending events need to be read. If a watch can't be
+   * added, e.g. because "watch_limit" has been reached, watching is disabled
+   * and all directories are stat(2)ed again. */
+  _Bool watch;
+  int watch_limit;
+  int watch_fd;
+  /* Maps watch descriptors to directories. */
+  c4_hash_t *watch_dirs;
+  /* Events have been lost: stat(2) all directories during the next scan. */
+  _Bool watch_overflow;
+  /* Protects "watch_fd" and "watch_dirs" while hosts are scanned in
+   * parallel. Everything else is only done by the main thread. */
+  pthread_mutex_t watch_lock;
+
+  /* Number of threads scanning host directories in parallel. */
+  int scan_threads;
+
+  /* Read data with "rrdr_fetch" instead of librrd where possible. */
+  _Bool native_reader;
 };
 typedef struct dp_rrdtool_s dp_rrdtool_t;
 
-struct dp_get_idents_data_s
+/* A change recorded by a thread scanning a host directory. */
+struct dp_change_s
 { /* {{{ */
+  atom_t path[DIR_DEPTH_PLUGIN + 1];
+  dp_ident_change_t change;
+}; /* }}} */
+typedef struct dp_change_s dp_change_t;
+
+struct dp_scan_data_s
+{ /* {{{ */
+  /* NULL while scanning in parallel: changes are recorded in "changes"
+   * instead and reported by the main thread afterwards. */
   graph_ident_t *ident;
-  dp_get_idents_callback callback;
+  /* Entries leading to the current directory or file. */
+  atom_t path[DIR_DEPTH_PLUGIN + 1];
+  /* Exactly one of the callbacks is set. "get_idents" only reports added
+   * identifiers. */
+  dp_get_idents_callback idents_callback;
+  dp_get_idents_delta_callback delta_callback;
   void *user_data;
+  dp_rrdtool_t *config;
+  time_t now;
+  /* Only read directories marked by inotify events instead of stat(2)ing
+   * every directory. */
+  _Bool events_only;
+  /* First non-zero status returned by a callback. */
+  int status;
+
+  dp_change_t *changes;
+  size_t changes_num;
+  size_t changes_size;
+}; /* }}} */
+typedef struct dp_scan_data_s dp_scan_data_t;
+
+/* Host directories scanned by "dir_update_parallel". */
+struct dp_host_task_s
+{ /* {{{ */
+  dp_rrd_dir_t *dir;
+  dp_scan_data_t data;
 }; /* }}} */
-typedef struct dp_get_idents_data_s dp_get_idents_data_t;
+typedef struct dp_host_task_s dp_host_task_t;
 
-static int scan_type_cb (__attribute__((unused)) const char *base_dir,
-    const char *file, void *ud)
+struct dp_host_tasks_s
 { /* {{{ */
-  dp_get_idents_data_t *data = ud;
-  size_t file_len;
-  char type_copy[1024];
-  size_t type_copy_len;
-  char *type_inst;
-
-  file_len = strlen (file);
-  if (file_len < 5)
+  const char *data_dir;
+  dp_host_task_t *tasks;
+}; /* }}} */
+typedef struct dp_host_tasks_s dp_host_tasks_t;
+
+static int dir_compare_atoms (const void *a0, const void *a1) /* {{{ */
+{
+  return (strcmp (atom_get (*(const atom_t *) a0),
+        atom_get (*(const atom_t *) a1)));
+} /* }}} int dir_compare_atoms */
+
+static void dir_destroy (dp_rrdtool_t *config, dp_rrd_dir_t *dir) /* {{{ */
+{
+  size_t i;
+
+  if (dir == NULL)
+    return;
+
+  if (dir->children != NULL)
+    for (i = 0; i < dir->entries_num; i++)
+      dir_destroy (config, dir->children[i]);
+
+#if HAVE_SYS_INOTIFY_H
+  pthread_mutex_lock (&config->watch_lock);
+  if ((dir->wd >= 0) && (config->watch_fd >= 0))
+  {
+    c4_hash_remove (config->watch_dirs, (void *) (intptr_t) dir->wd);
+    /* Fails if the directory has been removed already. */
+    inotify_rm_watch (config->watch_fd, dir->wd);
+  }
+  pthread_mutex_unlock (&config->watch_lock);
+#endif
+
+  free (dir->entries);
+  free (dir->children);
+  free (dir);
+} /* }}} void dir_destroy */
+
+static dp_rrd_dir_t *dir_create (dp_rrd_dir_t *parent) /* {{{ */
+{
+  dp_rrd_dir_t *dir;
+
+  dir = malloc (sizeof (*dir));
+  if (dir == NULL)
+    return (NULL);
+  memset (dir, 0, sizeof (*dir));
+
+  dir->parent = parent;
+  dir->wd = -1;
+
+  return (dir);
+} /* }}} dp_rrd_dir_t *dir_create */
+
+/*
+ * inotify(7) functions
+ */
+static uint32_t watch_hash (const void *key) /* {{{ */
+{
+  return ((uint32_t) (intptr_t) key);
+} /* }}} uint32_t watch_hash */
+
+static int watch_compare (const void *k0, const void *k1) /* {{{ */
+{
+  intptr_t wd0 = (intptr_t) k0;
+  intptr_t wd1 = (intptr_t) k1;
+
+  if (wd0 < wd1)
+    return (-1);
+  else if (wd0 > wd1)
+    return (1);
+  return (0);
+} /* }}} int watch_compare */
+
+static void watch_close (dp_rrdtool_t *config) /* {{{ */
+{
+  /* Closing the descriptor removes all watches. */
+  if (config->watch_fd >= 0)
+    close (config->watch_fd);
+  config->watch_fd = -1;
+
+  c4_hash_destroy (config->watch_dirs);
+  config->watch_dirs = NULL;
+} /* }}} void watch_close */
+
+/* Opens a new inotify instance, dropping all existing watches. The caller
+ * must throw away the directory tree, because it still holds the old watch
+ * descriptors. */
+static int watch_open (dp_rrdtool_t *config) /* {{{ */
+{
+  watch_close (config);
+  config->watch_overflow = 0;
+
+  if (!config->watch)
     return (0);
 
-  /* Ignore files that don't end in ".rrd". */
-  if (strcasecmp (".rrd", file + (file_len - 4)) != 0)
+#if HAVE_SYS_INOTIFY_H
+  config->watch_dirs = c4_hash_create (watch_hash, watch_compare);
+  if (config->watch_dirs == NULL)
+    return (ENOMEM);
+
+  config->watch_fd = inotify_init ();
+  if (config->watch_fd >= 0)
+  {
+    fcntl (config->watch_fd, F_SETFL,
+        fcntl (config->watch_fd, F_GETFL) | O_NONBLOCK);
+    fcntl (config->watch_fd, F_SETFD, FD_CLOEXEC);
     return (0);
+  }
+
+  fprintf (stderr, "dp_rrdtool: inotify_init failed with status %i. "
+      "Falling back to scanning periodically.\n", errno);
+#else
+  fprintf (stderr, "dp_rrdtool: inotify(7) is not available. "
+      "Falling back to scanning periodically.\n");
+#endif
+  watch_close (config);
+  config->watch = 0;
+  return (ENOTSUP);
+} /* }}} int watch_open */
+
+/* Stops watching for good. The directory tree is kept, the next scans
+ * stat(2) all directories again. */
+static void watch_disable (dp_rrdtool_t *config, /* {{{ */
+    const char *reason)
+{
+  fprintf (stderr, "dp_rrdtool: Disabling inotify watches: %s. "
+      "Falling back to scanning periodically.\n", reason);
+  fflush (stderr);
+
+  watch_close (config);
+  config->watch = 0;
+} /* }}} void watch_disable */
 
-  strncpy (type_copy, file, sizeof (type_copy));
-  type_copy_len = file_len - 4;
-  if (type_copy_len > (sizeof (type_copy) - 1))
-    type_copy_len = sizeof (type_copy) - 1;
-  type_copy[type_copy_len] = 0;
+static void watch_add_locked (dp_rrdtool_t *config, /* {{{ */
+    const char *path, dp_rrd_dir_t *dir)
+{
+#if HAVE_SYS_INOTIFY_H
+  int wd;
+
+  if ((config->watch_fd < 0) || (dir->wd >= 0))
+    return;
 
-  type_inst = strchr (type_copy, '-');
-  if (type_inst != NULL)
+  if (c4_hash_size (config->watch_dirs) >= (size_t) config->watch_limit)
+  {
+    watch_disable (config, "WatchLimit has been reached");
+    return;
+  }
+
+  wd = inotify_add_watch (config->watch_fd, path, DP_WATCH_MASK);
+  if ((wd < 0) && ((errno == ENOENT) || (errno == ENOTDIR)))
+  {
+    /* The directory has been removed in the meantime. The event for the
+     * parent directory takes care of it. */
+    return;
+  }
+  else if (wd < 0)
   {
-    *type_inst = 0;
-    type_inst++;
+    /* Most likely ENOSPC, i.e. the "max_user_watches" limit. A directory
+     * which isn't watched would never be read again, so give up. */
+    char reason[256];
+
+    snprintf (reason, sizeof (reason), "inotify_add_watch (%s) failed "
+        "with status %i", path, errno);
+    reason[sizeof (reason) - 1] = 0;
+    watch_disable (config, reason);
+    return;
+  }
+
+  if (c4_hash_insert (config->watch_dirs, (void *) (intptr_t) wd, dir) != 0)
+  {
+    inotify_rm_watch (config->watch_fd, wd);
+    watch_disable (config, "c4_hash_insert failed");
+    return;
+  }
+
+  dir->wd = wd;
+#else
+  config = NULL;
+  path = NULL;
+  dir = NULL;
+#endif
+} /* }}} void watch_add_locked */
+
+/* Starts watching "dir" if it isn't watched already. Called before reading
+ * the directory, so no change can go unnoticed. */
+static void watch_add (dp_rrdtool_t *config, /* {{{ */
+    const char *path, dp_rrd_dir_t *dir)
+{
+  pthread_mutex_lock (&config->watch_lock);
+  watch_add_locked (config, path, dir);
+  pthread_mutex_unlock (&config->watch_lock);
+} /* }}} void watch_add */
+
+static void dir_mark_dirty (dp_rrd_dir_t *dir) /* {{{ */
+{
+  dp_rrd_dir_t *parent;
+
+  dir->dirty = 1;
+
+  for (parent = dir->parent;
+      (parent != NULL) && !parent->dirty_below;
+      parent = parent->parent)
+    parent->dirty_below = 1;
+} /* }}} void dir_mark_dirty */
+
+/* Reads all pending events and marks the directories they refer to. Events
+ * are read in chunks of a fixed size; if the kernel's event queue overflows,
+ * all directories are stat(2)ed during the next scan. Returns true if
+ * anything needs to be looked at. */
+static _Bool watch_read (dp_rrdtool_t *config) /* {{{ */
+{
+  _Bool changed = config->watch_overflow;
+
+#if HAVE_SYS_INOTIFY_H
+  while (config->watch_fd >= 0)
+  {
+    char buffer[4096]
+      __attribute__((aligned (__alignof__ (struct inotify_event))));
+    ssize_t status;
+    size_t offset;
+
+    status = read (config->watch_fd, buffer, sizeof (buffer));
+    if (status < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN)
+      {
+        watch_disable (config, "read(2) failed");
+        changed = 1;
+      }
+      break;
+    }
+
+    for (offset = 0; offset < (size_t) status; )
+    {
+      struct inotify_event *event = (void *) (buffer + offset);
+      dp_rrd_dir_t *dir;
+
+      offset += sizeof (*event) + event->len;
+
+      if ((event->mask & IN_Q_OVERFLOW) != 0)
+      {
+        config->watch_overflow = 1;
+        changed = 1;
+        continue;
+      }
+
+      dir = c4_hash_lookup (config->watch_dirs, (void *) (intptr_t) event->wd);
+      if (dir == NULL)
+        continue;
+
+      if ((event->mask & IN_IGNORED) != 0)
+      {
+        /* The directory has been removed or unmounted. If it still exists
+         * when it's read again, a new watch is added. */
+        c4_hash_remove (config->watch_dirs, (void *) (intptr_t) event->wd);
+        dir->wd = -1;
+      }
+
+      dir_mark_dirty (dir);
+      changed = 1;
+    }
+  }
+#endif
+
+  return (changed);
+} /* }}} _Bool watch_read */
+
+/* Splits "name" at the first hyphen and returns both parts. */
+static void dir_split_name (const char *name, /* {{{ */
+    char *buffer, size_t buffer_size, char **ret_instance)
+{
+  char *instance;
+
+  snprintf (buffer, buffer_size, "%s", name);
+
+  instance = strchr (buffer, '-');
+  if (instance != NULL)
+  {
+    *instance = 0;
+    instance++;
   }
   else
   {
-    type_inst = "";
+    instance = "";
   }
 
-  ident_set_type (data->ident, type_copy);
-  ident_set_type_instance (data->ident, type_inst);
+  *ret_instance = instance;
+} /* }}} void dir_split_name */
 
-  return (data->callback (data->ident, data->user_data));
-} /* }}} int scan_type_cb */
+/* Sets the identifier field(s) corresponding to an entry of a directory at
+ * "depth". */
+static void dir_set_ident (dp_scan_data_t *data, int depth, /* {{{ */
+    atom_t entry)
+{
+  graph_ident_t *ident = data->ident;
+  char buffer[1024];
+  char *instance;
 
-static int scan_plugin_cb (const char *base_dir,
-    const char *sub_dir, void *ud)
-{ /* {{{ */
-  char plugin_copy[1024];
-  char *plugin_inst;
+  data->path[depth] = entry;
+  if (ident == NULL)
+    return;
 
-  dp_get_idents_data_t *data = ud;
-  char abs_dir[PATH_MAX + 1];
+  if (depth == DIR_DEPTH_DATA)
+  {
+    ident_set_host (ident, atom_get (entry));
+  }
+  else if (depth == DIR_DEPTH_HOST)
+  {
+    dir_split_name (atom_get (entry), buffer, sizeof (buffer), &instance);
+    ident_set_plugin (ident, buffer);
+    ident_set_plugin_instance (ident, instance);
+  }
+  else
+  {
+    dir_split_name (atom_get (entry), buffer, sizeof (buffer), &instance);
+    ident_set_type (ident, buffer);
+    ident_set_type_instance (ident, instance);
+  }
+} /* }}} void dir_set_ident */
+
+/* Reads the names and types of the data sources of "file" and stores them
+ * with "ident", see "graph_ds.h". */
+static int ds_read (const char *file, const graph_ident_t *ident, /* {{{ */
+    const struct stat *statbuf)
+{
+  rrd_info_t *info;
+  rrd_info_t *ptr;
+  char **names = NULL;
+  char **types = NULL;
+  size_t ds_num = 0;
+  size_t i;
+  int status = 0;
+
+  /* rrd_info() uses getopt(3), which isn't thread safe. */
+  info = rrd_info_r ((char *) file);
+  if (info == NULL)
+  {
+    fprintf (stderr, "%s: rrd_info_r (%s) failed.\n", __func__, file);
+    fflush (stderr);
+    return (-1);
+  }
+
+  for (ptr = info; ptr != NULL; ptr = ptr->next)
+  {
+    size_t keylen;
+    size_t dslen;
+    char **tmp;
+
+    if (ptr->key[0] != 'd')
+      continue;
+
+    if (strncmp ("ds[", ptr->key, strlen ("ds[")) != 0)
+      continue;
+
+    keylen = strlen (ptr->key);
+    if (keylen < strlen ("ds[?].type"))
+      continue;
+
+    dslen = keylen - strlen ("ds[].type");
+    assert (dslen >= 1);
+
+    if ((strcmp ("].type", ptr->key + (strlen ("ds[") + dslen)) != 0)
+        || (ptr->type != RD_I_STR))
+      continue;
+
+    tmp = realloc (names, (ds_num + 1) * sizeof (*names));
+    if (tmp == NULL)
+    {
+      status = ENOMEM;
+      break;
+    }
+    names = tmp;
+
+    tmp = realloc (types, (ds_num + 1) * sizeof (*types));
+    if (tmp == NULL)
+    {
+      status = ENOMEM;
+      break;
+    }
+    types = tmp;
+
+    names[ds_num] = malloc (dslen + 1);
+    if (names[ds_num] == NULL)
+    {
+      status = ENOMEM;
+      break;
+    }
+    memcpy (names[ds_num], ptr->key + strlen ("ds["), dslen);
+    names[ds_num][dslen] = 0;
+
+    /* Points into "info". */
+    types[ds_num] = ptr->value.u_str;
+    ds_num++;
+  }
+
+  if (status == 0)
+    status = gds_set (ident, (uint64_t) statbuf->st_size,
+        (uint64_t) statbuf->st_ino, ds_num, names, types);
+
+  for (i = 0; i < ds_num; i++)
+    free (names[i]);
+  free (names);
+  free (types);
+  rrd_info_free (info);
+
+  return (status);
+} /* }}} int ds_read */
+
+/* Reads the data sources of a file reported as added, unless they are known
+ * already, e.g. from the cache file. While scanning in parallel, this is
+ * done by the scanning threads. */
+static void dir_capture_ds (dp_scan_data_t *data) /* {{{ */
+{
+  graph_ident_t *ident = data->ident;
+  char plugin[1024];
+  char *plugin_instance;
+  char type[1024];
+  char *type_instance;
+  char file[PATH_MAX + 1];
+  struct stat statbuf;
+
+  if (ident == NULL)
+  {
+    dir_split_name (atom_get (data->path[DIR_DEPTH_HOST]),
+        plugin, sizeof (plugin), &plugin_instance);
+    dir_split_name (atom_get (data->path[DIR_DEPTH_PLUGIN]),
+        type, sizeof (type), &type_instance);
+
+    ident = ident_create (atom_get (data->path[DIR_DEPTH_DATA]),
+        plugin, plugin_instance, type, type_instance);
+    if (ident == NULL)
+      return;
+  }
+
+  if (gds_get (ident, NULL, NULL, NULL, NULL, NULL) != 0)
+  {
+    snprintf (file, sizeof (file), "%s/%s/%s/%s.rrd",
+        data->config->data_dir,
+        atom_get (data->path[DIR_DEPTH_DATA]),
+        atom_get (data->path[DIR_DEPTH_HOST]),
+        atom_get (data->path[DIR_DEPTH_PLUGIN]));
+    file[sizeof (file) - 1] = 0;
+
+    /* Failures are dealt with when the data sources are needed. */
+    memset (&statbuf, 0, sizeof (statbuf));
+    if (stat (file, &statbuf) == 0)
+      ds_read (file, ident, &statbuf);
+  }
+
+  if (ident != data->ident)
+    ident_destroy (ident);
+} /* }}} void dir_capture_ds */
+
+static void dir_report (dp_scan_data_t *data, /* {{{ */
+    dp_ident_change_t change)
+{
+  if (data->status != 0)
+    return;
+
+  if (change == DP_IDENT_ADDED)
+    dir_capture_ds (data);
+  else if (data->ident != NULL)
+    gds_remove (data->ident);
+
+  if (data->ident == NULL)
+  {
+    dp_change_t *c;
+
+    if (data->changes_num >= data->changes_size)
+    {
+      size_t new_size = (data->changes_size > 0)
+        ? (2 * data->changes_size) : 64;
+      dp_change_t *tmp;
+
+      tmp = realloc (data->changes, new_size * sizeof (*data->changes));
+      if (tmp == NULL)
+      {
+        data->status = ENOMEM;
+        return;
+      }
+      data->changes = tmp;
+      data->changes_size = new_size;
+    }
+
+    c = data->changes + data->changes_num;
+    memcpy (c->path, data->path, sizeof (c->path));
+    c->change = change;
+    data->changes_num++;
+  }
+  else if (data->delta_callback != NULL)
+    data->status = (*data->delta_callback) (data->ident, change,
+        data->user_data);
+  else if (change == DP_IDENT_ADDED)
+    data->status = (*data->idents_callback) (data->ident, data->user_data);
+} /* }}} void dir_report */
+
+/* Reports all files below "dir" as added or removed. */
+static void dir_report_all (dp_rrd_dir_t *dir, int depth, /* {{{ */
+    dp_scan_data_t *data, dp_ident_change_t change)
+{
+  size_t i;
+
+  for (i = 0; i < dir->entries_num; i++)
+  {
+    dir_set_ident (data, depth, dir->entries[i]);
+
+    if (depth < DIR_DEPTH_PLUGIN)
+      dir_report_all (dir->children[i], depth + 1, data, change);
+    else
+      dir_report (data, change);
+  }
+} /* }}} void dir_report_all */
+
+struct dir_read_data_s /* {{{ */
+{
+  int depth;
+  const dp_rrd_dir_t *dir;
+
+  atom_t *entries;
+  size_t entries_num;
+  size_t entries_size;
+}; /* }}} */
+typedef struct dir_read_data_s dir_read_data_t;
+
+static int dir_read_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  dir_read_data_t *data = user_data;
+  fs_type_t want_type;
+  char name[1024];
+  size_t name_len;
+  atom_t atom;
+
+  want_type = (data->depth == DIR_DEPTH_PLUGIN) ? FS_TYPE_FILE : FS_TYPE_DIR;
+  if ((type != FS_TYPE_UNKNOWN) && (type != want_type))
+    return (0);
+
+  snprintf (name, sizeof (name), "%s", entry);
+  name_len = strlen (name);
+
+  /* Ignore files that don't end in ".rrd". */
+  if (data->depth == DIR_DEPTH_PLUGIN)
+  {
+    if ((name_len < 5) || (strcasecmp (".rrd", name + (name_len - 4)) != 0))
+      return (0);
+    name[name_len - 4] = 0;
+  }
+
+  atom = atom_intern (name);
+  if (atom == ATOM_INVALID)
+    return (0);
+
+  /* Only stat(2) entries if the file system doesn't tell us their type and
+   * we haven't seen them before. */
+  if ((type == FS_TYPE_UNKNOWN)
+      && ((data->dir->entries_num == 0)
+        || (bsearch (&atom, data->dir->entries, data->dir->entries_num,
+            sizeof (*data->dir->entries), dir_compare_atoms) == NULL))
+      && (fs_entry_type (dir_fd, entry) != want_type))
+    return (0);
+
+  if (data->entries_num >= data->entries_size)
+  {
+    size_t new_size = (data->entries_size > 0)
+      ? (2 * data->entries_size) : 16;
+    atom_t *tmp;
+
+    tmp = realloc (data->entries, new_size * sizeof (*data->entries));
+    if (tmp == NULL)
+      return (ENOMEM);
+    data->entries = tmp;
+    data->entries_size = new_size;
+  }
+
+  data->entries[data->entries_num] = atom;
+  data->entries_num++;
+
+  return (0);
+} /* }}} int dir_read_cb */
+
+/* Reads the names of all relevant entries of "path". The type of entries is
+ * taken from the directory itself if possible. Otherwise only entries unknown
+ * to "dir" are stat(2)ed, known entries are assumed to still have the same
+ * type. */
+static int dir_read (const char *path, int depth, /* {{{ */
+    const dp_rrd_dir_t *dir, atom_t **ret_entries, size_t *ret_entries_num)
+{
+  dir_read_data_t data;
+  atom_t *entries;
+  size_t entries_num;
+  size_t i;
+  size_t j;
+  int status;
+
+  memset (&data, 0, sizeof (data));
+  data.depth = depth;
+  data.dir = dir;
+
+  status = fs_foreach_entry (path, dir_read_cb, &data);
+  if (status != 0)
+  {
+    free (data.entries);
+    return (status);
+  }
+
+  entries = data.entries;
+  entries_num = data.entries_num;
+
+  if (entries_num > 1)
+    qsort (entries, entries_num, sizeof (*entries), dir_compare_atoms);
+
+  /* "foo.rrd" and "foo.RRD" map to the same name. */
+  for (i = 0, j = 0; i < entries_num; i++)
+  {
+    if ((j > 0) && (entries[j - 1] == entries[i]))
+      continue;
+    entries[j] = entries[i];
+    j++;
+  }
+
+  *ret_entries = entries;
+  *ret_entries_num = j;
+  return (0);
+} /* }}} int dir_read */
+
+/* Reads "dir" again and reports the difference to its previous contents. */
+static int dir_reread (const char *path, dp_rrd_dir_t *dir, /* {{{ */
+    int depth, dp_scan_data_t *data, const struct stat *statbuf)
+{
+  atom_t *entries = NULL;
+  size_t entries_num = 0;
+  dp_rrd_dir_t **children = NULL;
+  size_t i;
+  size_t j;
+  int status;
+
+  watch_add (data->config, path, dir);
+  /* Events received from now on may not be reflected by what we read. */
+  dir->dirty = 0;
+
+  status = dir_read (path, depth, dir, &entries, &entries_num);
+  if (status != 0)
+    return (status);
+
+  if ((depth < DIR_DEPTH_PLUGIN) && (entries_num > 0))
+  {
+    children = calloc (entries_num, sizeof (*children));
+    if (children == NULL)
+    {
+      free (entries);
+      return (ENOMEM);
+    }
+  }
+
+  /* Merge the old and new (sorted) lists of entries. */
+  i = 0;
+  j = 0;
+  while ((i < dir->entries_num) || (j < entries_num))
+  {
+    int cmp;
+
+    if (i >= dir->entries_num)
+      cmp = 1;
+    else if (j >= entries_num)
+      cmp = -1;
+    else if (dir->entries[i] == entries[j])
+      cmp = 0;
+    else
+      cmp = dir_compare_atoms (&dir->entries[i], &entries[j]);
 
-  strncpy (plugin_copy, sub_dir, sizeof (plugin_copy));
-  plugin_copy[sizeof (plugin_copy) - 1] = 0;
+    if (cmp < 0) /* removed */
+    {
+      dir_set_ident (data, depth, dir->entries[i]);
+      if (depth < DIR_DEPTH_PLUGIN)
+      {
+        dir_report_all (dir->children[i], depth + 1, data,
+            DP_IDENT_REMOVED);
+        dir_destroy (data->config, dir->children[i]);
+      }
+      else
+      {
+        dir_report (data, DP_IDENT_REMOVED);
+      }
+      i++;
+    }
+    else if (cmp > 0) /* added */
+    {
+      if (depth < DIR_DEPTH_PLUGIN)
+      {
+        /* Reported when descending into the new directory below. */
+        children[j] = dir_create (dir);
+        if (children[j] == NULL)
+        {
+          /* Pretend the directory doesn't exist. */
+          memmove (entries + j, entries + j + 1,
+              sizeof (*entries) * (entries_num - (j + 1)));
+          entries_num--;
+          continue;
+        }
+      }
+      else
+      {
+        dir_set_ident (data, depth, entries[j]);
+        dir_report (data, DP_IDENT_ADDED);
+      }
+      j++;
+    }
+    else /* unchanged */
+    {
+      if (depth < DIR_DEPTH_PLUGIN)
+        children[j] = dir->children[i];
+      i++;
+      j++;
+    }
+  }
 
-  plugin_inst = strchr (plugin_copy, '-');
-  if (plugin_inst != NULL)
+  free (dir->entries);
+  free (dir->children);
+  dir->entries = entries;
+  dir->children = children;
+  dir->entries_num = entries_num;
+
+  dir->mtime = statbuf->st_mtime;
+  dir->read_time = data->now;
+
+  return (0);
+} /* }}} int dir_reread */
+
+static int dir_update_parallel (const char *path, dp_rrd_dir_t *dir,
+    dp_scan_data_t *data);
+
+/* Re-reads "dir" if it has been modified and reports the difference. Then
+ * descends into all sub-directories, because adding a file to a plugin
+ * directory doesn't change the modification time of the host directory. When
+ * watching, only directories marked by events are visited. */
+static int dir_update (const char *path, dp_rrd_dir_t *dir, /* {{{ */
+    int depth, dp_scan_data_t *data)
+{
+  struct stat statbuf;
+  int status;
+  size_t i;
+
+  if (data->events_only && (dir->read_time != 0) && !dir->dirty)
   {
-    *plugin_inst = 0;
-    plugin_inst++;
+    /* Nothing happened in this directory. */
   }
   else
   {
-    plugin_inst = "";
+    memset (&statbuf, 0, sizeof (statbuf));
+    status = stat (path, &statbuf);
+    if (status != 0)
+      return (errno);
+
+    if (dir->dirty
+        || (dir->read_time == 0)
+        || (statbuf.st_mtime != dir->mtime)
+        || (dir->mtime >= dir->read_time))
+    {
+      status = dir_reread (path, dir, depth, data, &statbuf);
+      if (status != 0)
+        return (status);
+    }
   }
 
-  ident_set_plugin (data->ident, plugin_copy);
-  ident_set_plugin_instance (data->ident, plugin_inst);
+  if (depth >= DIR_DEPTH_PLUGIN)
+    return (0);
+
+  dir->dirty_below = 0;
 
-  snprintf (abs_dir, sizeof (abs_dir), "%s/%s", base_dir, sub_dir);
-  abs_dir[sizeof (abs_dir) - 1] = 0;
+  if ((depth == DIR_DEPTH_DATA) && (data->ident != NULL)
+      && (data->config->scan_threads > 1))
+    return (dir_update_parallel (path, dir, data));
 
-  return (fs_foreach_file (abs_dir, scan_type_cb, data));
-} /* }}} int scan_host_cb */
+  for (i = 0; i < dir->entries_num; i++)
+  {
+    dp_rrd_dir_t *child = dir->children[i];
+    char abs_dir[PATH_MAX + 1];
 
-static int scan_host_cb (const char *base_dir,
-    const char *sub_dir, void *ud)
-{ /* {{{ */
-  dp_get_idents_data_t *data = ud;
-  char abs_dir[PATH_MAX + 1];
+    if (data->events_only && (child->read_time != 0)
+        && !child->dirty && !child->dirty_below)
+      continue;
+
+    snprintf (abs_dir, sizeof (abs_dir), "%s/%s",
+        path, atom_get (dir->entries[i]));
+    abs_dir[sizeof (abs_dir) - 1] = 0;
 
-  ident_set_host (data->ident, sub_dir);
+    dir_set_ident (data, depth, dir->entries[i]);
 
-  snprintf (abs_dir, sizeof (abs_dir), "%s/%s", base_dir, sub_dir);
+    /* If the directory vanished, the parent's modification time changed and
+     * the next scan will take care of it. */
+    dir_update (abs_dir, child, depth + 1, data);
+  }
+
+  return (0);
+} /* }}} int dir_update */
+
+static int dir_host_task (size_t index, void *user_data) /* {{{ */
+{
+  dp_host_tasks_t *ctx = user_data;
+  dp_host_task_t *task = ctx->tasks + index;
+  char abs_dir[PATH_MAX + 1];
+
+  snprintf (abs_dir, sizeof (abs_dir), "%s/%s",
+      ctx->data_dir, atom_get (task->data.path[DIR_DEPTH_DATA]));
   abs_dir[sizeof (abs_dir) - 1] = 0;
 
-  return (fs_foreach_dir (abs_dir, scan_plugin_cb, data));
-} /* }}} int scan_host_cb */
+  /* Errors are recorded in the task's "status". A vanished directory is
+   * taken care of by the next scan, just like in "dir_update". */
+  dir_update (abs_dir, task->dir, DIR_DEPTH_HOST, &task->data);
+
+  return (0);
+} /* }}} int dir_host_task */
+
+/* Scans the host directories below the data directory "dir" using
+ * "scan_threads" threads. The threads record their changes, which are then
+ * reported host by host, i.e. in the same order as by a serial scan. */
+static int dir_update_parallel (const char *path, /* {{{ */
+    dp_rrd_dir_t *dir, dp_scan_data_t *data)
+{
+  dp_host_tasks_t ctx;
+  size_t tasks_num;
+  size_t i;
+  size_t j;
+  int status;
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.data_dir = path;
+
+  ctx.tasks = calloc (dir->entries_num + 1, sizeof (*ctx.tasks));
+  if (ctx.tasks == NULL)
+    return (ENOMEM);
+
+  tasks_num = 0;
+  for (i = 0; i < dir->entries_num; i++)
+  {
+    dp_rrd_dir_t *child = dir->children[i];
+    dp_host_task_t *task;
+
+    if (data->events_only && (child->read_time != 0)
+        && !child->dirty && !child->dirty_below)
+      continue;
+
+    task = ctx.tasks + tasks_num;
+    tasks_num++;
+
+    task->dir = child;
+    task->data.ident = NULL;
+    task->data.path[DIR_DEPTH_DATA] = dir->entries[i];
+    task->data.config = data->config;
+    task->data.now = data->now;
+    task->data.events_only = data->events_only;
+  }
+
+  status = pool_run (tasks_num, (size_t) data->config->scan_threads,
+      dir_host_task, &ctx);
+  if (status != 0)
+  {
+    /* No thread ran, e.g. because memory is exhausted. */
+    for (i = 0; i < tasks_num; i++)
+      dir_host_task (i, &ctx);
+  }
+
+  for (i = 0; i < tasks_num; i++)
+  {
+    dp_host_task_t *task = ctx.tasks + i;
+
+    if ((task->data.status != 0) && (data->status == 0))
+      data->status = task->data.status;
+
+    for (j = 0; j < task->data.changes_num; j++)
+    {
+      dp_change_t *c = task->data.changes + j;
+      int depth;
+
+      for (depth = DIR_DEPTH_DATA; depth <= DIR_DEPTH_PLUGIN; depth++)
+        dir_set_ident (data, depth, c->path[depth]);
+      dir_report (data, c->change);
+    }
+
+    free (task->data.changes);
+  }
+
+  free (ctx.tasks);
+  return (0);
+} /* }}} int dir_update_parallel */
+
+/* Throws away the directory tree and all watches. */
+static void dp_reset (dp_rrdtool_t *config) /* {{{ */
+{
+  watch_close (config);
+
+  dir_destroy (config, config->root);
+  config->root = NULL;
+
+  watch_open (config);
+} /* }}} void dp_reset */
+
+/* Updates the directory tree of "config", starting from scratch if there is
+ * none. If anything goes wrong, the tree is thrown away so that the next
+ * scan starts over. */
+static int dp_scan (dp_rrdtool_t *config, dp_scan_data_t *data) /* {{{ */
+{
+  int status;
+
+  data->ident = ident_create ("", "", "", "", "");
+  if (data->ident == NULL)
+    return (ENOMEM);
+  data->config = config;
+  data->now = time (NULL);
+  data->status = 0;
+  data->events_only = (config->root != NULL) && (config->watch_fd >= 0)
+    && !config->watch_overflow;
+
+  if (config->root == NULL)
+    config->root = dir_create (/* parent = */ NULL);
+  if (config->root == NULL)
+  {
+    ident_destroy (data->ident);
+    return (ENOMEM);
+  }
+
+  status = dir_update (config->data_dir, config->root, DIR_DEPTH_DATA, data);
+  if (status == 0)
+    status = data->status;
+
+  if (status != 0)
+    dp_reset (config);
+  else if (!data->events_only)
+    config->watch_overflow = 0;
+
+  ident_destroy (data->ident);
+  return (status);
+} /* }}} int dp_scan */
 
 static int ident_to_rrdfile (const graph_ident_t *ident, /* {{{ */
     dp_rrdtool_t *config,
@@ -191,98 +1159,261 @@ static int get_idents (void *priv,
     dp_get_idents_callback cb, void *ud)
 { /* {{{ */
   dp_rrdtool_t *config = priv;
-  dp_get_idents_data_t data;
-  int status;
+  dp_scan_data_t data;
 
-  data.ident = ident_create ("", "", "", "", "");
-  if (data.ident == NULL)
-    return (ENOMEM);
-  data.callback = cb;
-  data.user_data = ud;
+  /* Report everything, not just the changes since the last scan. */
+  dp_reset (config);
 
-  status = fs_foreach_dir (config->data_dir, scan_host_cb, &data);
+  memset (&data, 0, sizeof (data));
+  data.idents_callback = cb;
+  data.user_data = ud;
 
-  ident_destroy (data.ident);
-  return (status);
+  return (dp_scan (config, &data));
 } /* }}} int get_idents */
 
+static int get_idents_delta (void *priv,
+    dp_get_idents_delta_callback cb, void *ud)
+{ /* {{{ */
+  dp_rrdtool_t *config = priv;
+  dp_scan_data_t data;
+
+  /* Mark directories with pending events. */
+  watch_read (config);
+
+  memset (&data, 0, sizeof (data));
+  data.delta_callback = cb;
+  data.user_data = ud;
+
+  return (dp_scan (config, &data));
+} /* }}} int get_idents_delta */
+
+static int get_idents_events (void *priv,
+    dp_get_idents_delta_callback cb, void *ud)
+{ /* {{{ */
+  dp_rrdtool_t *config = priv;
+  dp_scan_data_t data;
+
+  if ((config->watch_fd < 0) || (config->root == NULL))
+    return (ENOTSUP);
+
+  if (!watch_read (config))
+    return (0);
+
+  memset (&data, 0, sizeof (data));
+  data.delta_callback = cb;
+  data.user_data = ud;
+
+  return (dp_scan (config, &data));
+} /* }}} int get_idents_events */
+
 static int get_ident_ds_names (void *priv, graph_ident_t *ident,
     dp_list_get_ident_ds_names_callback cb, void *ud)
 { /* {{{ */
   dp_rrdtool_t *config = priv;
   char file[PATH_MAX + 1];
+  struct stat statbuf;
+  uint64_t size = 0;
+  uint64_t inode = 0;
+  atom_t *names = NULL;
+  size_t ds_num = 0;
+  size_t i;
   int status;
 
-  char *rrd_argv[] = { "info", file, NULL };
-  int rrd_argc = (sizeof (rrd_argv) / sizeof (rrd_argv[0])) - 1;
-
-  rrd_info_t *info;
-  rrd_info_t *ptr;
-
   memset (file, 0, sizeof (file));
   status = ident_to_rrdfile (ident, config, file, sizeof (file));
   if (status != 0)
     return (status);
 
-  info = rrd_info (rrd_argc, rrd_argv);
-  if (info == NULL)
+  memset (&statbuf, 0, sizeof (statbuf));
+  status = stat (file, &statbuf);
+  if (status != 0)
+    return (errno);
+
+  /* Only read the file if it is new or has been re-created. */
+  status = gds_get (ident, &size, &inode, &ds_num, &names, NULL);
+  if ((status != 0)
+      || (size != (uint64_t) statbuf.st_size)
+      || (inode != (uint64_t) statbuf.st_ino))
   {
-    fprintf (stderr, "%s: rrd_info (%s) failed.\n", __func__, file);
-    fflush (stderr);
-    return (-1);
+    free (names);
+    names = NULL;
+
+    status = ds_read (file, ident, &statbuf);
+    if (status == 0)
+      status = gds_get (ident, NULL, NULL, &ds_num, &names, NULL);
+    if (status != 0)
+      return (status);
   }
 
+  for (i = 0; i < ds_num; i++)
+  {
+    status = (*cb) (ident, atom_get (names[i]), ud);
+    if (status != 0)
+      break;
+  }
+
+  free (names);
+
+  return (status);
+} /* }}} int get_ident_ds_names */
+
+/* Like "rrdr_get_step", but reads the file's layout with rrd_info_r(), so that
+ * the file is only ever read by librrd if "NativeReader" is disabled. */
+static int info_get_step (const char *filename, const char *cf, /* {{{ */
+    time_t start, unsigned long resolution, unsigned long *ret_step)
+{
+  rrd_info_t *info;
+  rrd_info_t *ptr;
+  unsigned long pdp_step = 0;
+  time_t last_up = 0;
+  unsigned long best_step = 0;
+
+  info = rrd_info_r ((char *) filename);
+  if (info == NULL)
+    return (ENOTSUP);
+
   for (ptr = info; ptr != NULL; ptr = ptr->next)
   {
-    size_t keylen;
-    size_t dslen;
-    char *ds;
+    if ((strcmp ("step", ptr->key) == 0) && (ptr->type == RD_I_CNT))
+      pdp_step = ptr->value.u_cnt;
+    else if ((strcmp ("last_update", ptr->key) == 0)
+        && (ptr->type == RD_I_CNT))
+      last_up = (time_t) ptr->value.u_cnt;
+  }
 
-    if (ptr->key[0] != 'd')
-      continue;
+  /* The keys of each RRA are listed in the order "cf", "rows", ...,
+   * "pdp_per_row". */
+  if ((pdp_step > 0) && (last_up > 0))
+  {
+    const char *rra_cf = NULL;
+    unsigned long rra_rows = 0;
 
-    if (strncmp ("ds[", ptr->key, strlen ("ds[")) != 0)
-      continue;
+    for (ptr = info; ptr != NULL; ptr = ptr->next)
+    {
+      const char *field;
+      unsigned long rra_step;
+      time_t cal_end;
+      time_t cal_start;
+
+      if (strncmp ("rra[", ptr->key, strlen ("rra[")) != 0)
+        continue;
+
+      field = strchr (ptr->key, ']');
+      if ((field == NULL) || (field[1] != '.'))
+        continue;
+      field += 2;
+
+      if ((strcmp ("cf", field) == 0) && (ptr->type == RD_I_STR))
+      {
+        rra_cf = ptr->value.u_str;
+        rra_rows = 0;
+        continue;
+      }
+      else if ((strcmp ("rows", field) == 0) && (ptr->type == RD_I_CNT))
+      {
+        rra_rows = ptr->value.u_cnt;
+        continue;
+      }
+      else if ((strcmp ("pdp_per_row", field) != 0)
+          || (ptr->type != RD_I_CNT))
+      {
+        continue;
+      }
+
+      if ((rra_cf == NULL) || (strcmp (rra_cf, cf) != 0))
+        continue;
+
+      rra_step = pdp_step * ptr->value.u_cnt;
+      if ((rra_step == 0) || (rra_step > resolution)
+          || (rra_step <= best_step))
+        continue;
+
+      /* Same as in "rrdr_get_step". */
+      cal_end = last_up - (last_up % (time_t) rra_step);
+      cal_start = cal_end - ((time_t) rra_step * (time_t) rra_rows);
+      if (cal_start > start)
+        continue;
+
+      best_step = rra_step;
+    }
+  }
 
-    keylen = strlen (ptr->key);
-    if (keylen < strlen ("ds[?].type"))
-      continue;
+  rrd_info_free (info);
 
-    dslen = keylen - strlen ("ds[].type");
-    assert (dslen >= 1);
+  if (best_step == 0)
+    return (ENOENT);
 
-    if (strcmp ("].type", ptr->key + (strlen ("ds[") + dslen)) != 0)
-      continue;
+  *ret_step = best_step;
+  return (0);
+} /* }}} int info_get_step */
 
-    ds = malloc (dslen + 1);
-    if (ds == NULL)
-      continue;
+/* Like "fetch_ident_data", using the in-process reader. Returns ENOTSUP if
+ * the file has to be read with librrd. */
+static int fetch_ident_data_native (const char *filename, /* {{{ */
+    graph_ident_t *ident, const char *ds_name,
+    dp_time_t begin, dp_time_t end,
+    const char *cf, unsigned long step,
+    dp_get_ident_data_callback cb, void *ud)
+{
+  rrdr_view_t view;
+  dp_time_t first_value_time;
+  dp_time_t interval;
+  double *data_points;
+  unsigned long ds_index;
+  _Bool found = 0;
+  int status;
+
+  status = rrdr_fetch (filename, cf,
+      (time_t) begin.tv_sec, (time_t) end.tv_sec, step, &view);
+  if (status != 0)
+    return (status);
 
-    memcpy (ds, ptr->key + strlen ("ds["), dslen);
-    ds[dslen] = 0;
+  data_points = calloc (view.rows_num, sizeof (*data_points));
+  if ((data_points == NULL) && (view.rows_num > 0))
+  {
+    rrdr_release (&view);
+    return (ENOMEM);
+  }
 
-    status = (*cb) (ident, ds, ud);
+  memset (&first_value_time, 0, sizeof (first_value_time));
+  first_value_time.tv_sec = view.start;
+  memset (&interval, 0, sizeof (interval));
+  interval.tv_sec = (time_t) view.step;
 
-    free (ds);
+  for (ds_index = 0; ds_index < view.ds_count; ds_index++)
+  {
+    const char *name = rrdr_ds_name (&view, ds_index);
 
+    if ((ds_name != NULL) && (strcmp (ds_name, name) != 0))
+      continue;
+    found = 1;
+
+    rrdr_get_column (&view, ds_index, data_points);
+
+    status = (*cb) (ident, name, first_value_time, interval,
+        view.rows_num, data_points, ud);
     if (status != 0)
       break;
   }
 
-  rrd_info_free (info);
+  free (data_points);
+  rrdr_release (&view);
 
+  if ((status == 0) && !found)
+    status = ENOENT;
   return (status);
-} /* }}} int get_ident_ds_names */
+} /* }}} int fetch_ident_data_native */
 
-static int get_ident_data (void *priv,
+/* Fetches the data of "ds_name" or, if it is NULL, of all data sources
+ * with a single call to rrd_fetch_r() and passes each column to "cb". */
+static int fetch_ident_data (dp_rrdtool_t *config,
     graph_ident_t *ident, const char *ds_name,
     dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf_num,
     dp_get_ident_data_callback cb, void *ud)
 { /* {{{ */
-  dp_rrdtool_t *config = priv;
-
   char filename[PATH_MAX + 1];
-  const char *cf = "AVERAGE"; /* FIXME */
+  const char *cf = dp_cf_to_string (cf_num);
   time_t rrd_start;
   time_t rrd_end;
   unsigned long step;
@@ -297,15 +1428,41 @@ static int get_ident_data (void *priv,
   double *data_points = NULL;
 
   unsigned long ds_index;
+  _Bool found = 0;
   size_t i;
 
   status = ident_to_rrdfile (ident, config, filename, sizeof (filename));
   if (status != 0)
     return (status);
 
+  /* librrd picks the RRA whose step is closest to "step", which may be
+   * coarser than requested. Ask for the exact step of the coarsest RRA that
+   * is fine enough instead, whichever reader is used. The layout is read by
+   * the same code that reads the data. If it can't be read, pass zero so
+   * that librrd picks the finest RRA covering the time span. */
+  step = 0;
+  if (resolution.tv_sec > 0)
+  {
+    if (config->native_reader)
+      status = rrdr_get_step (filename, cf, (time_t) begin.tv_sec,
+          (time_t) end.tv_sec, (unsigned long) resolution.tv_sec, &step);
+    else
+      status = info_get_step (filename, cf, (time_t) begin.tv_sec,
+          (unsigned long) resolution.tv_sec, &step);
+    if (status != 0)
+      step = 0;
+  }
+
+  if (config->native_reader)
+  {
+    status = fetch_ident_data_native (filename, ident, ds_name,
+        begin, end, cf, step, cb, ud);
+    if (status != ENOTSUP)
+      return (status);
+  }
+
   rrd_start = (time_t) begin.tv_sec;
   rrd_end = (time_t) end.tv_sec;
-  step = 0;
   ds_count = 0;
   ds_namv = NULL;
   data = NULL;
@@ -327,37 +1484,69 @@ static int get_ident_data (void *priv,
   return (ret_status);            \
 } while (0)
 
-  for (ds_index = 0; ds_index < ds_count; ds_index++)
-    if (strcmp (ds_name, ds_namv[ds_index]) == 0)
-      break;
-
-  if (ds_index >= ds_count)
-    BAIL_OUT (ENOENT);
-
   memset (&first_value_time, 0, sizeof (first_value_time));
   first_value_time.tv_sec = rrd_start;
   memset (&interval, 0, sizeof (interval));
   interval.tv_sec = (time_t) step;
   data_points_num = (size_t) ((rrd_end - rrd_start) / step);
   data_points = calloc (data_points_num, sizeof (*data_points));
-  if (data_points == NULL)
+  if ((data_points == NULL) && (data_points_num > 0))
     BAIL_OUT (ENOMEM);
 
-  for (i = 0; i < data_points_num; i++)
+  for (ds_index = 0; ds_index < ds_count; ds_index++)
   {
-    unsigned long index = (ds_count * ((unsigned long) i)) + ds_index;
-    data_points[i] = (double) data[index];
+    if ((ds_name != NULL) && (strcmp (ds_name, ds_namv[ds_index]) != 0))
+      continue;
+    found = 1;
+
+    for (i = 0; i < data_points_num; i++)
+    {
+      unsigned long index = (ds_count * ((unsigned long) i)) + ds_index;
+      data_points[i] = (double) data[index];
+    }
+
+    status = (*cb) (ident, ds_namv[ds_index], first_value_time, interval,
+        data_points_num, data_points, ud);
+    if (status != 0)
+      BAIL_OUT (status);
   }
 
-  status = (*cb) (ident, ds_name, first_value_time, interval,
-      data_points_num, data_points, ud);
-  if (status != 0)
-    BAIL_OUT (status);
+  if (!found)
+    BAIL_OUT (ENOENT);
 
   BAIL_OUT (0);
 #undef BAIL_OUT
+} /* }}} int fetch_ident_data */
+
+static int get_ident_data (void *priv,
+    graph_ident_t *ident, const char *ds_name,
+    dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
+    dp_get_ident_data_callback cb, void *ud)
+{ /* {{{ */
+  if (ds_name == NULL)
+    return (EINVAL);
+
+  return (fetch_ident_data (priv, ident, ds_name, begin, end,
+        resolution, cf, cb, ud));
 } /* }}} int get_ident_data */
 
+static int get_ident_data_all (void *priv,
+    graph_ident_t *ident,
+    dp_time_t begin, dp_time_t end,
+    dp_time_t resolution, dp_cf_t cf,
+    dp_get_ident_data_callback cb, void *ud)
+{ /* {{{ */
+  return (fetch_ident_data (priv, ident, /* ds_name = */ NULL,
+        begin, end, resolution, cf, cb, ud));
+} /* }}} int get_ident_data_all */
+
+static int get_ident_file (void *priv,
+    const graph_ident_t *ident, char *buffer, size_t buffer_size)
+{ /* {{{ */
+  return (ident_to_rrdfile (ident, priv, buffer, buffer_size));
+} /* }}} int get_ident_file */
+
 static int print_graph (void *priv,
     graph_config_t *cfg, graph_instance_t *inst)
 { /* {{{ */
@@ -368,17 +1557,40 @@ static int print_graph (void *priv,
   return (-1);
 } /* }}} int print_graph */
 
+static void destroy (void *priv)
+{ /* {{{ */
+  dp_rrdtool_t *config = priv;
+
+  if (config == NULL)
+    return;
+
+  /* Closes the inotify instance first, so that "dir_destroy" doesn't remove
+   * the watches one by one. */
+  watch_close (config);
+  dir_destroy (config, config->root);
+
+  pthread_mutex_destroy (&config->watch_lock);
+  free (config->data_dir);
+  free (config);
+} /* }}} void destroy */
+
 int dp_rrdtool_config (const oconfig_item_t *ci)
 { /* {{{ */
   dp_rrdtool_t *conf;
+  int status;
   int i;
 
   data_provider_t dp =
   {
     get_idents,
+    get_idents_delta,
+    get_idents_events,
     get_ident_ds_names,
     get_ident_data,
+    get_ident_data_all,
+    get_ident_file,
     print_graph,
+    destroy,
     /* private_data = */ NULL
   };
 
@@ -387,6 +1599,14 @@ int dp_rrdtool_config (const oconfig_item_t *ci)
     return (ENOMEM);
   memset (conf, 0, sizeof (*conf));
   conf->data_dir = NULL;
+  conf->root = NULL;
+  conf->watch = 0;
+  conf->watch_limit = DP_WATCH_LIMIT;
+  conf->watch_fd = -1;
+  conf->watch_dirs = NULL;
+  pthread_mutex_init (&conf->watch_lock, /* attr = */ NULL);
+  conf->scan_threads = 1;
+  conf->native_reader = 0;
 
   for (i = 0; i < ci->children_num; i++)
   {
@@ -394,6 +1614,14 @@ int dp_rrdtool_config (const oconfig_item_t *ci)
 
     if (strcasecmp ("DataDir", child->key) == 0)
       graph_config_get_string (child, &conf->data_dir);
+    else if (strcasecmp ("Watch", child->key) == 0)
+      graph_config_get_bool (child, &conf->watch);
+    else if (strcasecmp ("WatchLimit", child->key) == 0)
+      graph_config_get_int (child, &conf->watch_limit);
+    else if (strcasecmp ("ScanThreads", child->key) == 0)
+      graph_config_get_int (child, &conf->scan_threads);
+    else if (strcasecmp ("NativeReader", child->key) == 0)
+      graph_config_get_bool (child, &conf->native_reader);
     else
     {
       fprintf (stderr, "dp_rrdtool_config: Ignoring unknown config option "
@@ -406,13 +1634,21 @@ int dp_rrdtool_config (const oconfig_item_t *ci)
     conf->data_dir = strdup ("/var/lib/collectd/rrd");
   if (conf->data_dir == NULL)
   {
-    free (conf);
+    destroy (conf);
     return (ENOMEM);
   }
 
+  if (conf->watch)
+    watch_open (conf);
+
   dp.private_data = conf;
 
-  data_provider_register ("rrdtool", &dp);
+  status = data_provider_register ("rrdtool", &dp);
+  if (status != 0)
+  {
+    destroy (conf);
+    return (status);
+  }
 
   return (0);
 } /* }}} int dp_rrdtool_config */
@@ -21,18 +21,44 @@
  *   Florian octo Forster <ff at octo.it>
  **/
 
+#include "config.h"
+
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 
+#if HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+
 #include "filesystem.h"
 
+/* Size of the buffer passed to getdents64(2). Large directories are read
+ * with few system calls. */
+#define FS_GETDENTS_BUFFER_SIZE 65536
+
+#ifdef SYS_getdents64
+/* The kernel's "struct linux_dirent64". glibc only exports a wrapper in
+ * recent versions. */
+struct fs_dirent64_s
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+typedef struct fs_dirent64_s fs_dirent64_t;
+#endif
+
 struct fs_scan_dir_data_s /* {{{ */
 {
   fs_ident_cb_t callback;
@@ -52,61 +78,172 @@ typedef int (*callback_plugin_t) (const char *base_dir,
 typedef int (*callback_host_t)   (const char *base_dir,
     const char *host,   void *user_data);
 
-/*
- * Directory and file walking functions
- */
-static int foreach_rrd_file (const char *dir, /* {{{ */
-    int (*callback) (const char *, void *),
-    void *user_data)
+struct fs_foreach_data_s /* {{{ */
 {
-  DIR *dh;
-  struct dirent *entry;
-  int status;
+  int (*callback) (const char *base_dir, const char *entry, void *);
+  const char *base_dir;
+  fs_type_t type;
+  void *user_data;
+}; /* }}} */
+typedef struct fs_foreach_data_s fs_foreach_data_t;
 
-  if (callback == NULL)
-    return (EINVAL);
+static fs_type_t fs_dtype_to_type (unsigned char d_type) /* {{{ */
+{
+  switch (d_type)
+  {
+    case DT_REG:
+      return (FS_TYPE_FILE);
+    case DT_DIR:
+      return (FS_TYPE_DIR);
+    case DT_UNKNOWN:
+    case DT_LNK: /* stat(2) follows symbolic links, so resolve them. */
+      return (FS_TYPE_UNKNOWN);
+    default:
+      return (FS_TYPE_OTHER);
+  }
+} /* }}} fs_type_t fs_dtype_to_type */
 
-  dh = opendir (dir);
-  if (dh == NULL)
-    return (errno);
+#ifdef SYS_getdents64
+/* Returns ENOSYS if the kernel doesn't provide getdents64(2), before
+ * calling the callback. */
+static int fs_foreach_entry_getdents (int dir_fd, /* {{{ */
+    fs_entry_cb_t callback, void *user_data)
+{
+  char *buffer;
+  _Bool first = 1;
+  int status = 0;
 
-  while ((entry = readdir (dh)) != NULL)
+  buffer = malloc (FS_GETDENTS_BUFFER_SIZE);
+  if (buffer == NULL)
+    return (ENOMEM);
+
+  while (status == 0)
   {
-    struct stat statbuf;
-    char abspath[PATH_MAX + 1];
-    size_t d_name_len;
+    long buffer_used;
+    long offset;
+
+    buffer_used = syscall (SYS_getdents64, dir_fd,
+        buffer, FS_GETDENTS_BUFFER_SIZE);
+    if (buffer_used < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      status = errno;
+      if (!first && (status == ENOSYS))
+        status = EIO;
+      break;
+    }
+    else if (buffer_used == 0)
+      break;
 
-    if (entry->d_name[0] == '.')
-      continue;
+    first = 0;
 
-    d_name_len = strlen (entry->d_name);
-    if (d_name_len <= 4)
-      continue;
+    for (offset = 0; offset < buffer_used; )
+    {
+      fs_dirent64_t *entry = (void *) (buffer + offset);
 
-    if (strcasecmp (".rrd", entry->d_name + (d_name_len - 4)) != 0)
-      continue;
+      offset += entry->d_reclen;
 
-    snprintf (abspath, sizeof (abspath), "%s/%s", dir, entry->d_name);
-    abspath[sizeof (abspath) - 1] = 0;
+      if (entry->d_name[0] == '.')
+        continue;
 
-    memset (&statbuf, 0, sizeof (statbuf));
+      status = (*callback) (dir_fd, entry->d_name,
+          fs_dtype_to_type (entry->d_type), user_data);
+      if (status != 0)
+        break;
+    }
+  }
 
-    status = stat (abspath, &statbuf);
-    if (status != 0)
-      continue;
+  free (buffer);
+  return (status);
+} /* }}} int fs_foreach_entry_getdents */
+#endif
 
-    if (!S_ISREG (statbuf.st_mode))
-      continue;
+/* Takes ownership of "dir_fd". */
+static int fs_foreach_entry_readdir (int dir_fd, /* {{{ */
+    fs_entry_cb_t callback, void *user_data)
+{
+  DIR *dh;
+  struct dirent *entry;
+  int status = 0;
+
+  dh = fdopendir (dir_fd);
+  if (dh == NULL)
+  {
+    status = errno;
+    close (dir_fd);
+    return (status);
+  }
 
-    entry->d_name[d_name_len - 4] = 0;
+  while ((entry = readdir (dh)) != NULL)
+  {
+    if (entry->d_name[0] == '.')
+      continue;
 
-    status = (*callback) (entry->d_name, user_data);
+    status = (*callback) (dir_fd, entry->d_name,
+        fs_dtype_to_type (entry->d_type), user_data);
     if (status != 0)
       break;
   } /* while (readdir) */
 
   closedir (dh);
   return (status);
+} /* }}} int fs_foreach_entry_readdir */
+
+static int fs_foreach_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  fs_foreach_data_t *data = user_data;
+
+  if (type == FS_TYPE_UNKNOWN)
+    type = fs_entry_type (dir_fd, entry);
+
+  if (type != data->type)
+    return (0);
+
+  return ((*data->callback) (data->base_dir, entry, data->user_data));
+} /* }}} int fs_foreach_cb */
+
+struct foreach_rrd_file_data_s /* {{{ */
+{
+  int (*callback) (const char *, void *);
+  void *user_data;
+}; /* }}} */
+typedef struct foreach_rrd_file_data_s foreach_rrd_file_data_t;
+
+static int foreach_rrd_file_cb (__attribute__((unused)) const char *dir, /* {{{ */
+    const char *file, void *user_data)
+{
+  foreach_rrd_file_data_t *data = user_data;
+  char name[1024];
+  size_t name_len;
+
+  name_len = strlen (file);
+  if ((name_len <= 4) || (name_len >= sizeof (name)))
+    return (0);
+
+  if (strcasecmp (".rrd", file + (name_len - 4)) != 0)
+    return (0);
+
+  memcpy (name, file, name_len - 4);
+  name[name_len - 4] = 0;
+
+  return ((*data->callback) (name, data->user_data));
+} /* }}} int foreach_rrd_file_cb */
+
+/*
+ * Directory and file walking functions
+ */
+static int foreach_rrd_file (const char *dir, /* {{{ */
+    int (*callback) (const char *, void *),
+    void *user_data)
+{
+  foreach_rrd_file_data_t data = { callback, user_data };
+
+  if (callback == NULL)
+    return (EINVAL);
+
+  return (fs_foreach_file (dir, foreach_rrd_file_cb, &data));
 } /* }}} int foreach_rrd_file */
 
 static int foreach_type (const char *host, const char *plugin, /* {{{ */
@@ -258,92 +395,71 @@ static int scan_host (__attribute__((unused)) const char *base_dir, /* {{{ */
 /*
  * Public function
  */
-int fs_foreach_dir (const char *base_dir, /* {{{ */
-    int (*callback) (const char *base_dir, const char *entry, void *),
-    void *user_data)
+int fs_foreach_entry (const char *dir, /* {{{ */
+    fs_entry_cb_t callback, void *user_data)
 {
-  DIR *dh;
-  struct dirent *entry;
-  int status = 0;
+  int dir_fd;
 
-  if (callback == NULL)
+  if ((dir == NULL) || (callback == NULL))
     return (EINVAL);
 
-  dh = opendir (base_dir);
-  if (dh == NULL)
+  dir_fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0)
     return (errno);
 
-  while ((entry = readdir (dh)) != NULL)
+#ifdef SYS_getdents64
   {
-    struct stat statbuf;
-    char abspath[PATH_MAX + 1];
+    int status;
+
+    status = fs_foreach_entry_getdents (dir_fd, callback, user_data);
+    if (status != ENOSYS)
+    {
+      close (dir_fd);
+      return (status);
+    }
+  }
+#endif
 
-    if (entry->d_name[0] == '.')
-      continue;
+  return (fs_foreach_entry_readdir (dir_fd, callback, user_data));
+} /* }}} int fs_foreach_entry */
 
-    snprintf (abspath, sizeof (abspath), "%s/%s", base_dir, entry->d_name);
-    abspath[sizeof (abspath) - 1] = 0;
+fs_type_t fs_entry_type (int dir_fd, const char *entry) /* {{{ */
+{
+  struct stat statbuf;
 
-    memset (&statbuf, 0, sizeof (statbuf));
+  memset (&statbuf, 0, sizeof (statbuf));
+  if (fstatat (dir_fd, entry, &statbuf, /* flags = */ 0) != 0)
+    return (FS_TYPE_UNKNOWN);
 
-    status = stat (abspath, &statbuf);
-    if (status != 0)
-      continue;
+  if (S_ISREG (statbuf.st_mode))
+    return (FS_TYPE_FILE);
+  else if (S_ISDIR (statbuf.st_mode))
+    return (FS_TYPE_DIR);
+  return (FS_TYPE_OTHER);
+} /* }}} fs_type_t fs_entry_type */
 
-    if (!S_ISDIR (statbuf.st_mode))
-      continue;
+int fs_foreach_dir (const char *base_dir, /* {{{ */
+    int (*callback) (const char *base_dir, const char *entry, void *),
+    void *user_data)
+{
+  fs_foreach_data_t data = { callback, base_dir, FS_TYPE_DIR, user_data };
 
-    status = (*callback) (base_dir, entry->d_name, user_data);
-    if (status != 0)
-      break;
-  } /* while (readdir) */
+  if (callback == NULL)
+    return (EINVAL);
 
-  closedir (dh);
-  return (status);
+  return (fs_foreach_entry (base_dir, fs_foreach_cb, &data));
 } /* }}} int fs_foreach_dir */
 
 int fs_foreach_file (const char *base_dir, /* {{{ */
     int (*callback) (const char *base_dir, const char *entry, void *),
     void *user_data)
 {
-  DIR *dh;
-  struct dirent *entry;
-  int status = 0;
+  fs_foreach_data_t data = { callback, base_dir, FS_TYPE_FILE, user_data };
 
   if (callback == NULL)
     return (EINVAL);
 
-  dh = opendir (base_dir);
-  if (dh == NULL)
-    return (errno);
-
-  while ((entry = readdir (dh)) != NULL)
-  {
-    struct stat statbuf;
-    char abspath[PATH_MAX + 1];
-
-    if (entry->d_name[0] == '.')
-      continue;
-
-    snprintf (abspath, sizeof (abspath), "%s/%s", base_dir, entry->d_name);
-    abspath[sizeof (abspath) - 1] = 0;
-
-    memset (&statbuf, 0, sizeof (statbuf));
-
-    status = stat (abspath, &statbuf);
-    if (status != 0)
-      continue;
-
-    if (!S_ISREG (statbuf.st_mode))
-      continue;
-
-    status = (*callback) (base_dir, entry->d_name, user_data);
-    if (status != 0)
-      break;
-  } /* while (readdir) */
-
-  closedir (dh);
-  return (status);
+  return (fs_foreach_entry (base_dir, fs_foreach_cb, &data));
 } /* }}} int fs_foreach_file */
 
 int fs_scan (fs_ident_cb_t callback, void *user_data) /* {{{ */
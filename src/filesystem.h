@@ -30,6 +30,31 @@
 
 typedef int (*fs_ident_cb_t) (const graph_ident_t *ident, void *user_data);
 
+/* Type of a directory entry. Symbolic links are followed, like stat(2)
+ * does. */
+enum fs_type_e
+{
+  FS_TYPE_UNKNOWN = 0,
+  FS_TYPE_FILE,
+  FS_TYPE_DIR,
+  FS_TYPE_OTHER
+};
+typedef enum fs_type_e fs_type_t;
+
+/* Calls "callback" for each entry of "dir", except for hidden entries.
+ * Entries are read in large batches using getdents64(2) where available.
+ * "type" is taken from the directory entry if the file system provides it,
+ * without calling stat(2). Otherwise it is FS_TYPE_UNKNOWN and the callback
+ * may determine it using "fs_entry_type" with the passed "dir_fd". */
+typedef int (*fs_entry_cb_t) (int dir_fd, const char *entry,
+    fs_type_t type, void *user_data);
+int fs_foreach_entry (const char *dir, fs_entry_cb_t callback,
+    void *user_data);
+
+/* Returns the type of "entry" relative to the directory "dir_fd", using
+ * fstatat(2). Returns FS_TYPE_UNKNOWN on error. */
+fs_type_t fs_entry_type (int dir_fd, const char *entry);
+
 int fs_foreach_dir (const char *base_dir,
     int (*callback) (const char *base_dir, const char *entry, void *),
     void *user_data);
@@ -27,8 +27,10 @@
 #include <inttypes.h>
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "graph.h"
 #include "graph_ident.h"
@@ -39,10 +41,16 @@
 #include "common.h"
 #include "filesystem.h"
 #include "utils_cgi.h"
+#include "utils_hash.h"
+#include "utils_trigram.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
 
+/* Graphs with fewer instances are searched by describing each instance. An
+ * index isn't worth its memory for them. */
+#define GRAPH_INDEX_MIN 64
+
 /*
  * Data types
  */
@@ -58,11 +66,94 @@ struct graph_config_s /* {{{ */
 
   graph_instance_t **instances;
   size_t instances_num;
+
+  /* Maps the instance selectors to the instances in "instances", so that
+   * instances can be found without walking the (sorted) array. May be NULL if
+   * allocating the table failed, in which case the array is searched. */
+  c4_hash_t *instances_index;
+  /* False if instances have been added since "instances" was last sorted. */
+  _Bool instances_sorted;
+
+  /* Copy returned by "graph_publish", reused until the instances change.
+   * NULL if there is none or the graph has changed since. */
+  graph_config_t *published;
+  /* Number of references to a published copy. Protected by
+   * "graph_ref_lock". */
+  unsigned int refcount;
+
+  /* Descriptions of the instances of a published copy, see
+   * "graph_search_descriptions". NULL if the copy is small or building the
+   * index failed. */
+  trigram_index_t *descriptions;
 }; /* }}} struct graph_config_s */
 
+/* Published copies are released by whichever thread drops the last list
+ * using them. */
+static pthread_mutex_t graph_ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Private functions
  */
+static c4_hash_t *graph_index_create (void) /* {{{ */
+{
+  c4_hash_t *index;
+
+  index = c4_hash_create (ident_hash, ident_compare_void);
+  if (index == NULL)
+    fprintf (stderr, "graph_index_create: c4_hash_create failed. "
+        "Instance lookups will be slow.\n");
+
+  return (index);
+} /* }}} c4_hash_t *graph_index_create */
+
+/* Called whenever the instances of "cfg" change: the next "graph_publish"
+ * has to make a new copy. */
+static void graph_changed (graph_config_t *cfg) /* {{{ */
+{
+  graph_unref (cfg->published);
+  cfg->published = NULL;
+} /* }}} void graph_changed */
+
+/* Indexes the descriptions of the instances of a published copy. Since the
+ * copy is shared by all lists until the graph changes, this is done once per
+ * change instead of once per list. */
+static void graph_index_descriptions (graph_config_t *cfg) /* {{{ */
+{
+  trigram_index_t *idx;
+  size_t i;
+  int status = 0;
+
+  if (cfg->instances_num < GRAPH_INDEX_MIN)
+    return;
+
+  idx = tri_create ();
+  if (idx == NULL)
+    return;
+
+  for (i = 0; (i < cfg->instances_num) && (status == 0); i++)
+  {
+    char buffer[1024];
+
+    /* Add a document in any case, so that the numbers stay in sync. */
+    if (inst_describe (cfg, cfg->instances[i], buffer, sizeof (buffer)) != 0)
+      buffer[0] = 0;
+
+    status = tri_add (idx, buffer);
+  }
+
+  if (status == 0)
+    status = tri_finish (idx);
+
+  if (status != 0)
+  {
+    fprintf (stderr, "graph_index_descriptions: Building the index failed "
+        "with status %i. Searches will describe all instances.\n", status);
+    tri_destroy (idx);
+    return;
+  }
+
+  cfg->descriptions = idx;
+} /* }}} void graph_index_descriptions */
 
 /*
  * Config functions
@@ -128,6 +219,10 @@ graph_config_t *graph_create (const graph_ident_t *selector) /* {{{ */
   cfg->vertical_label = NULL;
   cfg->defs = NULL;
   cfg->instances = NULL;
+  cfg->instances_index = graph_index_create ();
+  cfg->instances_sorted = 1;
+  cfg->published = NULL;
+  cfg->refcount = 0;
 
   return (cfg);
 } /* }}} int graph_create */
@@ -139,6 +234,9 @@ void graph_destroy (graph_config_t *cfg) /* {{{ */
   if (cfg == NULL)
     return;
 
+  graph_unref (cfg->published);
+  tri_destroy (cfg->descriptions);
+
   ident_destroy (cfg->select);
 
   free (cfg->title);
@@ -146,11 +244,123 @@ void graph_destroy (graph_config_t *cfg) /* {{{ */
 
   def_destroy (cfg->defs);
 
+  c4_hash_destroy (cfg->instances_index);
+
   for (i = 0; i < cfg->instances_num; i++)
     inst_destroy (cfg->instances[i]);
   free (cfg->instances);
+
+  free (cfg);
 } /* }}} void graph_destroy */
 
+graph_config_t *graph_clone (const graph_config_t *cfg) /* {{{ */
+{
+  graph_config_t *copy;
+  size_t i;
+
+  if (cfg == NULL)
+    return (NULL);
+
+  copy = graph_create (cfg->select);
+  if (copy == NULL)
+    return (NULL);
+
+  copy->show_zero = cfg->show_zero;
+
+  if (cfg->title != NULL)
+  {
+    copy->title = strdup (cfg->title);
+    if (copy->title == NULL)
+    {
+      graph_destroy (copy);
+      return (NULL);
+    }
+  }
+
+  if (cfg->vertical_label != NULL)
+  {
+    copy->vertical_label = strdup (cfg->vertical_label);
+    if (copy->vertical_label == NULL)
+    {
+      graph_destroy (copy);
+      return (NULL);
+    }
+  }
+
+  if (cfg->defs != NULL)
+  {
+    copy->defs = def_clone (cfg->defs);
+    if (copy->defs == NULL)
+    {
+      graph_destroy (copy);
+      return (NULL);
+    }
+  }
+
+  for (i = 0; i < cfg->instances_num; i++)
+  {
+    graph_instance_t *inst;
+
+    inst = inst_clone (cfg->instances[i]);
+    if ((inst == NULL) || (graph_add_inst (copy, inst) != 0))
+    {
+      inst_destroy (inst);
+      graph_destroy (copy);
+      return (NULL);
+    }
+  }
+
+  copy->instances_sorted = cfg->instances_sorted;
+
+  return (copy);
+} /* }}} graph_config_t *graph_clone */
+
+graph_config_t *graph_publish (graph_config_t *cfg) /* {{{ */
+{
+  graph_config_t *copy;
+
+  if (cfg == NULL)
+    return (NULL);
+
+  if (cfg->published == NULL)
+  {
+    copy = graph_clone (cfg);
+    if (copy == NULL)
+      return (NULL);
+
+    graph_index_descriptions (copy);
+
+    /* The reference held by "cfg". */
+    copy->refcount = 1;
+    cfg->published = copy;
+  }
+
+  copy = cfg->published;
+
+  pthread_mutex_lock (&graph_ref_lock);
+  copy->refcount++;
+  pthread_mutex_unlock (&graph_ref_lock);
+
+  return (copy);
+} /* }}} graph_config_t *graph_publish */
+
+void graph_unref (graph_config_t *cfg) /* {{{ */
+{
+  _Bool last;
+
+  if (cfg == NULL)
+    return;
+
+  pthread_mutex_lock (&graph_ref_lock);
+  assert (cfg->refcount > 0);
+  cfg->refcount--;
+  last = (cfg->refcount == 0);
+  pthread_mutex_unlock (&graph_ref_lock);
+
+  if (last)
+    graph_destroy (cfg);
+} /* }}} void graph_unref */
+
 int graph_config_add (const oconfig_item_t *ci) /* {{{ */
 {
   graph_ident_t *select;
@@ -203,15 +413,47 @@ int graph_add_inst (graph_config_t *graph, graph_instance_t *inst) /* {{{ */
 
   graph->instances[graph->instances_num] = inst;
   graph->instances_num++;
+  graph->instances_sorted = 0;
+  graph_changed (graph);
+
+  if (graph->instances_index != NULL)
+  {
+    int status;
+
+    status = c4_hash_insert (graph->instances_index,
+        inst_peek_selector (inst), inst);
+    if (status != 0)
+    {
+      /* Without a complete index, lookups would miss instances. */
+      fprintf (stderr, "graph_add_inst: c4_hash_insert failed with "
+          "status %i. Dropping instance index.\n", status);
+      c4_hash_destroy (graph->instances_index);
+      graph->instances_index = NULL;
+    }
+  }
 
   return (0);
 } /* }}} int graph_add_inst */
 
 int graph_add_file (graph_config_t *cfg, const graph_ident_t *file) /* {{{ */
 {
-  graph_instance_t *inst;
+  graph_instance_t *inst = NULL;
+  graph_ident_t *inst_select = NULL;
+
+  /* The selector of the instance "file" belongs to is the graph's selector
+   * with all "/any/" fields replaced by the file's values. Look that up in the
+   * index instead of matching the file against each instance. */
+  if (cfg->instances_index != NULL)
+    inst_select = ident_copy_with_selector (cfg->select, file,
+        IDENT_FLAG_REPLACE_ANY);
+
+  if (inst_select != NULL)
+    inst = c4_hash_lookup (cfg->instances_index, inst_select);
+  else
+    inst = graph_inst_find_matching (cfg, file);
+
+  ident_destroy (inst_select);
 
-  inst = graph_inst_find_matching (cfg, file);
   if (inst == NULL)
   {
     inst = inst_create (cfg, file);
@@ -221,9 +463,62 @@ int graph_add_file (graph_config_t *cfg, const graph_ident_t *file) /* {{{ */
     graph_add_inst (cfg, inst);
   }
 
+  graph_changed (cfg);
   return (inst_add_file (inst, file));
 } /* }}} int graph_add_file */
 
+int graph_remove_file (graph_config_t *cfg, /* {{{ */
+    const graph_ident_t *file)
+{
+  graph_instance_t *inst = NULL;
+  graph_ident_t *inst_select = NULL;
+  size_t i;
+  int status;
+
+  if ((cfg == NULL) || (file == NULL))
+    return (EINVAL);
+
+  if (cfg->instances_index != NULL)
+    inst_select = ident_copy_with_selector (cfg->select, file,
+        IDENT_FLAG_REPLACE_ANY);
+
+  if (inst_select != NULL)
+    inst = c4_hash_lookup (cfg->instances_index, inst_select);
+  else
+    inst = graph_inst_find_matching (cfg, file);
+
+  ident_destroy (inst_select);
+
+  if (inst == NULL)
+    return (ENOENT);
+
+  status = inst_remove_file (inst, file);
+  if (status != 0)
+    return (status);
+
+  graph_changed (cfg);
+
+  if (inst_num_files (inst) > 0)
+    return (0);
+
+  for (i = 0; i < cfg->instances_num; i++)
+    if (cfg->instances[i] == inst)
+      break;
+  assert (i < cfg->instances_num);
+
+  if (cfg->instances_index != NULL)
+    c4_hash_remove (cfg->instances_index, inst_peek_selector (inst));
+
+  /* Keep the remaining instances in order. */
+  memmove (cfg->instances + i, cfg->instances + i + 1,
+      sizeof (*cfg->instances) * (cfg->instances_num - (i + 1)));
+  cfg->instances_num--;
+
+  inst_destroy (inst);
+
+  return (0);
+} /* }}} int graph_remove_file */
+
 int graph_get_title (graph_config_t *cfg, /* {{{ */
     char *buffer, size_t buffer_size)
 {
@@ -383,6 +678,9 @@ graph_instance_t *graph_inst_find_exact (graph_config_t *cfg, /* {{{ */
   if ((cfg == NULL) || (ident == NULL))
     return (NULL);
 
+  if (cfg->instances_index != NULL)
+    return (c4_hash_lookup (cfg->instances_index, ident));
+
   for (i = 0; i < cfg->instances_num; i++)
     if (inst_compare_ident (cfg->instances[i], ident) == 0)
       return (cfg->instances[i]);
@@ -571,6 +869,40 @@ int graph_search_inst_string (graph_config_t *cfg, const char *term, /* {{{ */
   return (0);
 } /* }}} int graph_search_inst_string */
 
+int graph_search_descriptions (graph_config_t *cfg, const char *term, /* {{{ */
+    int (*callback) (size_t index, void *user_data), void *user_data)
+{
+  size_t i;
+
+  if ((cfg == NULL) || (term == NULL) || (callback == NULL))
+    return (EINVAL);
+
+  if (cfg->descriptions != NULL)
+    return (tri_search (cfg->descriptions, term, callback, user_data));
+
+  for (i = 0; i < cfg->instances_num; i++)
+  {
+    char buffer[1024];
+    size_t j;
+    int status;
+
+    if (inst_describe (cfg, cfg->instances[i], buffer, sizeof (buffer)) != 0)
+      buffer[0] = 0;
+
+    for (j = 0; buffer[j] != 0; j++)
+      buffer[j] = (char) tolower ((int) buffer[j]);
+
+    if (strstr (buffer, term) == NULL)
+      continue;
+
+    status = (*callback) (i, user_data);
+    if (status != 0)
+      return (status);
+  }
+
+  return (0);
+} /* }}} int graph_search_descriptions */
+
 int graph_inst_search_field (graph_config_t *cfg, /* {{{ */
     graph_ident_field_t field, const char *field_value,
     graph_inst_callback_t callback, void *user_data)
@@ -625,68 +957,57 @@ size_t graph_num_instances (graph_config_t *cfg) /* {{{ */
 } /* }}} size_t graph_num_instances */
 
 int graph_to_json (const graph_config_t *cfg, /* {{{ */
-    yajl_gen handler)
+    json_writer_t *handler)
 {
   size_t i;
 
   if ((cfg == NULL) || (handler == NULL))
     return (EINVAL);
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "title",
-      (unsigned int) strlen ("title"));
-  yajl_gen_string (handler,
-      (unsigned char *) cfg->title,
-      (unsigned int) strlen (cfg->title));
+  JSON_LITERAL (handler, "title");
+  json_string (handler, cfg->title);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "select",
-      (unsigned int) strlen ("select"));
+  JSON_LITERAL (handler, "select");
   ident_to_json (cfg->select, handler);
 
-  yajl_gen_string (handler,
-      (unsigned char *) "instances",
-      (unsigned int) strlen ("instances"));
-  yajl_gen_array_open (handler);
+  JSON_LITERAL (handler, "instances");
+  json_array_open (handler);
   for (i = 0; i < cfg->instances_num; i++)
     inst_to_json (cfg->instances[i], handler);
-  yajl_gen_array_close (handler);
+  json_array_close (handler);
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   return (0);
 } /* }}} int graph_to_json */
 
 int graph_def_to_json (graph_config_t *cfg, /* {{{ */
     graph_instance_t *inst,
-    yajl_gen handler)
+    json_writer_t *handler)
 {
-#define yajl_gen_string_cast(h,p,l) \
-  yajl_gen_string (h, (unsigned char *) p, (unsigned int) l)
-
   if ((cfg == NULL) || (handler == NULL))
     return (EINVAL);
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
-  yajl_gen_string_cast (handler, "select", strlen ("select"));
+  JSON_LITERAL (handler, "select");
   ident_to_json (cfg->select, handler);
   if (cfg->title != NULL)
   {
-    yajl_gen_string_cast (handler, "title", strlen ("title"));
-    yajl_gen_string_cast (handler, cfg->title, strlen (cfg->title));
+    JSON_LITERAL (handler, "title");
+    json_string (handler, cfg->title);
   }
   if (cfg->vertical_label != NULL)
   {
-    yajl_gen_string_cast (handler, "vertical_label", strlen ("vertical_label"));
-    yajl_gen_string_cast (handler, cfg->vertical_label, strlen (cfg->vertical_label));
+    JSON_LITERAL (handler, "vertical_label");
+    json_string (handler, cfg->vertical_label);
   }
-  yajl_gen_string_cast (handler, "show_zero", strlen ("show_zero"));
-  yajl_gen_bool (handler, cfg->show_zero);
+  JSON_LITERAL (handler, "show_zero");
+  json_bool (handler, cfg->show_zero);
 
-  yajl_gen_string_cast (handler, "defs", strlen ("defs"));
+  JSON_LITERAL (handler, "defs");
   if (cfg->defs == NULL)
   {
     graph_def_t *defs;
@@ -700,10 +1021,9 @@ int graph_def_to_json (graph_config_t *cfg, /* {{{ */
     def_to_json (cfg->defs, handler);
   }
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   return (0);
-#undef yajl_gen_string_cast
 } /* }}} int graph_def_to_json */
 
 static int graph_sort_instances_cb (const void *v0, const void *v1) /* {{{ */
@@ -717,11 +1037,18 @@ int graph_sort_instances (graph_config_t *cfg) /* {{{ */
   if (cfg == NULL)
     return (EINVAL);
 
+  /* Removing instances keeps the order, so only additions require sorting.
+   * Leaves unchanged graphs (and their published copies) alone. */
+  if (cfg->instances_sorted)
+    return (0);
+  cfg->instances_sorted = 1;
+
   if (cfg->instances_num < 2)
     return (0);
 
   qsort (cfg->instances, cfg->instances_num, sizeof (*cfg->instances),
       graph_sort_instances_cb);
+  graph_changed (cfg);
 
   return (0);
 } /* }}} int graph_sort_instances */
@@ -733,11 +1060,18 @@ int graph_clear_instances (graph_config_t *cfg) /* {{{ */
   if (cfg == NULL)
     return (EINVAL);
 
+  /* The index points to the instances' selectors, so empty it first. */
+  c4_hash_destroy (cfg->instances_index);
+  cfg->instances_index = graph_index_create ();
+
   for (i = 0; i < cfg->instances_num; i++)
     inst_destroy (cfg->instances[i]);
   free (cfg->instances);
   cfg->instances = NULL;
   cfg->instances_num = 0;
+  cfg->instances_sorted = 1;
+
+  graph_changed (cfg);
 
   return (0);
 } /* }}} int graph_clear_instances */
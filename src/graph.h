@@ -24,7 +24,7 @@
 #ifndef GRAPH_H
 #define GRAPH_H 1
 
-#include <yajl/yajl_gen.h>
+#include "utils_json.h"
 
 #include "graph_types.h"
 #include "graph_ident.h"
@@ -40,6 +40,16 @@ graph_config_t *graph_create (const graph_ident_t *selector);
 
 void graph_destroy (graph_config_t *graph);
 
+/* Returns a deep copy of "cfg", including all instances and their files. */
+graph_config_t *graph_clone (const graph_config_t *cfg);
+
+/* Returns a copy of "cfg" for readers in other threads, which must not
+ * modify it. As long as the instances of "cfg" don't change, the same copy is
+ * returned again, so unchanged graphs are shared between graph lists. Each
+ * call adds a reference, which is released with "graph_unref". */
+graph_config_t *graph_publish (graph_config_t *cfg);
+void graph_unref (graph_config_t *cfg);
+
 int graph_config_add (const oconfig_item_t *ci);
 
 /* Add "inst" to the internal list. The instance is *not* copied and may not be
@@ -48,6 +58,11 @@ int graph_add_inst (graph_config_t *graph, graph_instance_t *inst);
 
 int graph_add_file (graph_config_t *cfg, const graph_ident_t *file);
 
+/* Removes "file" from the instance it belongs to. Instances without any files
+ * left are removed from the graph, too. Returns ENOENT if the graph doesn't
+ * contain the file. */
+int graph_remove_file (graph_config_t *cfg, const graph_ident_t *file);
+
 int graph_get_title (graph_config_t *cfg,
     char *buffer, size_t buffer_size);
 
@@ -103,6 +118,13 @@ int graph_search_inst (graph_config_t *cfg, search_info_t *si,
 int graph_search_inst_string (graph_config_t *cfg, const char *term,
     graph_inst_callback_t callback, void *user_data);
 
+/* Calls "callback" with the position of each instance whose description, as
+ * returned by "inst_describe", contains "term", in ascending order. "term"
+ * must be in lower case. Uses an index for copies returned by
+ * "graph_publish". */
+int graph_search_descriptions (graph_config_t *cfg, const char *term,
+    int (*callback) (size_t index, void *user_data), void *user_data);
+
 /* Iterates over all instances and calls "inst_matches_field". If that method
  * returns true, calls the callback with the graph and instance pointers. */
 int graph_inst_search_field (graph_config_t *cfg,
@@ -111,10 +133,10 @@ int graph_inst_search_field (graph_config_t *cfg,
 
 int graph_compare (graph_config_t *cfg, const graph_ident_t *ident);
 
-int graph_to_json (const graph_config_t *cfg, yajl_gen handler);
+int graph_to_json (const graph_config_t *cfg, json_writer_t *handler);
 int graph_def_to_json (graph_config_t *cfg,
     graph_instance_t *inst,
-    yajl_gen handler);
+    json_writer_t *handler);
 
 size_t graph_num_instances (graph_config_t *cfg);
 
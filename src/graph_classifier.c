@@ -0,0 +1,290 @@
+/**
+ * collection4 - graph_classifier.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "graph_classifier.h"
+#include "graph.h"
+#include "graph_ident.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+#define BITS_PER_WORD 64
+
+struct gc_field_s /* {{{ */
+{
+  /* Maps a field value to the bit set of graphs selecting exactly this
+   * value. */
+  c4_hash_t *exact;
+  /* Bit set of graphs using "/any/" or "/all/" for this field. */
+  uint64_t *wildcard;
+}; /* }}} struct gc_field_s */
+typedef struct gc_field_s gc_field_t;
+
+struct graph_classifier_s /* {{{ */
+{
+  graph_config_t **graphs;
+  size_t graphs_num;
+
+  /* Copies of the graphs' selectors. The hash tables' keys point into
+   * these. */
+  graph_ident_t **selectors;
+
+  /* Number of 64 bit words in each bit set. */
+  size_t words_num;
+
+  gc_field_t fields[_GIF_LAST];
+}; /* }}} struct graph_classifier_s */
+
+/*
+ * Private functions
+ */
+static uint64_t *gc_bitset_create (graph_classifier_t *gc) /* {{{ */
+{
+  return (calloc (gc->words_num, sizeof (uint64_t)));
+} /* }}} uint64_t *gc_bitset_create */
+
+static int gc_add_graph (graph_classifier_t *gc, size_t index) /* {{{ */
+{
+  uint64_t mask = ((uint64_t) 1) << (index % BITS_PER_WORD);
+  size_t word = index / BITS_PER_WORD;
+  int i;
+
+  for (i = 0; i < _GIF_LAST; i++)
+  {
+    gc_field_t *field = gc->fields + i;
+    const char *value;
+    uint64_t *bits;
+
+    value = ident_get_field (gc->selectors[index], (graph_ident_field_t) i);
+    if (value == NULL)
+      return (EINVAL);
+
+    if (IS_ANY (value) || IS_ALL (value))
+    {
+      field->wildcard[word] |= mask;
+      continue;
+    }
+
+    bits = c4_hash_lookup (field->exact, value);
+    if (bits == NULL)
+    {
+      int status;
+
+      bits = gc_bitset_create (gc);
+      if (bits == NULL)
+        return (ENOMEM);
+
+      status = c4_hash_insert (field->exact, value, bits);
+      if (status != 0)
+      {
+        free (bits);
+        return (status);
+      }
+    }
+
+    bits[word] |= mask;
+  }
+
+  return (0);
+} /* }}} int gc_add_graph */
+
+/*
+ * Public functions
+ */
+graph_classifier_t *gc_create (graph_config_t **graphs, /* {{{ */
+    size_t graphs_num)
+{
+  graph_classifier_t *gc;
+  size_t i;
+  int status;
+
+  gc = malloc (sizeof (*gc));
+  if (gc == NULL)
+    return (NULL);
+  memset (gc, 0, sizeof (*gc));
+
+  gc->graphs = graphs;
+  gc->graphs_num = graphs_num;
+  gc->words_num = (graphs_num + (BITS_PER_WORD - 1)) / BITS_PER_WORD;
+  if (gc->words_num < 1)
+    gc->words_num = 1;
+
+  gc->selectors = calloc (graphs_num + 1, sizeof (*gc->selectors));
+  if (gc->selectors == NULL)
+  {
+    gc_destroy (gc);
+    return (NULL);
+  }
+
+  for (i = 0; i < _GIF_LAST; i++)
+  {
+    gc->fields[i].exact = c4_hash_create (c4_hash_string,
+        c4_hash_compare_string);
+    gc->fields[i].wildcard = gc_bitset_create (gc);
+    if ((gc->fields[i].exact == NULL) || (gc->fields[i].wildcard == NULL))
+    {
+      gc_destroy (gc);
+      return (NULL);
+    }
+  }
+
+  for (i = 0; i < graphs_num; i++)
+  {
+    gc->selectors[i] = graph_get_selector (graphs[i]);
+    if (gc->selectors[i] == NULL)
+    {
+      fprintf (stderr, "gc_create: graph_get_selector failed\n");
+      gc_destroy (gc);
+      return (NULL);
+    }
+
+    status = gc_add_graph (gc, i);
+    if (status != 0)
+    {
+      fprintf (stderr, "gc_create: gc_add_graph failed with status %i\n",
+          status);
+      gc_destroy (gc);
+      return (NULL);
+    }
+  }
+
+  return (gc);
+} /* }}} graph_classifier_t *gc_create */
+
+static int gc_free_bitset_cb (__attribute__((unused)) const void *key, /* {{{ */
+    void *value, __attribute__((unused)) void *user_data)
+{
+  free (value);
+  return (0);
+} /* }}} int gc_free_bitset_cb */
+
+void gc_destroy (graph_classifier_t *gc) /* {{{ */
+{
+  size_t i;
+
+  if (gc == NULL)
+    return;
+
+  for (i = 0; i < _GIF_LAST; i++)
+  {
+    c4_hash_foreach (gc->fields[i].exact, gc_free_bitset_cb,
+        /* user data = */ NULL);
+    c4_hash_destroy (gc->fields[i].exact);
+    free (gc->fields[i].wildcard);
+  }
+
+  if (gc->selectors != NULL)
+  {
+    for (i = 0; i < gc->graphs_num; i++)
+      ident_destroy (gc->selectors[i]);
+    free (gc->selectors);
+  }
+
+  free (gc);
+} /* }}} void gc_destroy */
+
+/* Does the actual work for "gc_foreach_match". Split off so that the result
+ * bit set can be allocated on the stack after the arguments have been
+ * checked. */
+static int gc_foreach_match_internal (graph_classifier_t *gc, /* {{{ */
+    const graph_ident_t *file,
+    graph_callback_t callback, void *user_data)
+{
+  uint64_t result[gc->words_num];
+  _Bool empty;
+  size_t i;
+  size_t j;
+
+  memset (result, 0xff, sizeof (result));
+
+  for (i = 0; i < _GIF_LAST; i++)
+  {
+    gc_field_t *field = gc->fields + i;
+    const char *value;
+    uint64_t *bits;
+
+    value = ident_get_field (file, (graph_ident_field_t) i);
+    if (value == NULL)
+      return (EINVAL);
+
+    bits = c4_hash_lookup (field->exact, value);
+
+    empty = 1;
+    for (j = 0; j < gc->words_num; j++)
+    {
+      if (bits != NULL)
+        result[j] &= (bits[j] | field->wildcard[j]);
+      else
+        result[j] &= field->wildcard[j];
+
+      if (result[j] != 0)
+        empty = 0;
+    }
+
+    /* No graph left, we can stop looking at the remaining fields. */
+    if (empty)
+      return (0);
+  }
+
+  for (j = 0; j < gc->words_num; j++)
+  {
+    uint64_t word = result[j];
+
+    while (word != 0)
+    {
+      size_t index = (j * BITS_PER_WORD) + ((size_t) __builtin_ctzll (word));
+      int status;
+
+      word &= word - 1;
+
+      if (index >= gc->graphs_num)
+        break;
+
+      status = (*callback) (gc->graphs[index], user_data);
+      if (status != 0)
+        return (status);
+    }
+  }
+
+  return (0);
+} /* }}} int gc_foreach_match_internal */
+
+int gc_foreach_match (graph_classifier_t *gc, /* {{{ */
+    const graph_ident_t *file,
+    graph_callback_t callback, void *user_data)
+{
+  if ((gc == NULL) || (file == NULL) || (callback == NULL))
+    return (EINVAL);
+
+  return (gc_foreach_match_internal (gc, file, callback, user_data));
+} /* }}} int gc_foreach_match */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,54 @@
+/**
+ * collection4 - graph_classifier.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef GRAPH_CLASSIFIER_H
+#define GRAPH_CLASSIFIER_H 1
+
+#include "graph_types.h"
+#include "graph_ident.h"
+
+/*
+ * The classifier routes files to the graphs whose selector matches them. For
+ * each of the ident fields it keeps a hash table mapping the field's value to
+ * the set of graphs requiring exactly that value, plus the set of graphs
+ * using a wildcard ("/any/" or "/all/") for the field. Classifying a file is
+ * then one hash lookup and one bit-set intersection per field, regardless of
+ * the number of graphs.
+ */
+struct graph_classifier_s;
+typedef struct graph_classifier_s graph_classifier_t;
+
+/* Builds a classifier for the given graphs. The array is *not* copied, so it
+ * and the graphs must not be modified or freed while the classifier is in
+ * use. */
+graph_classifier_t *gc_create (graph_config_t **graphs, size_t graphs_num);
+void gc_destroy (graph_classifier_t *gc);
+
+/* Calls "callback" for each graph whose selector matches "file", in the order
+ * in which the graphs were passed to "gc_create". Returns the first non-zero
+ * status returned by the callback. */
+int gc_foreach_match (graph_classifier_t *gc, const graph_ident_t *file,
+    graph_callback_t callback, void *user_data);
+
+#endif /* GRAPH_CLASSIFIER_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -22,12 +22,14 @@
  **/
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <string.h>
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "graph_config.h"
 #include "graph.h"
@@ -41,13 +43,110 @@
 #endif
 
 #ifndef CACHEFILE
-# define CACHEFILE "/tmp/collection4.json"
+# define CACHEFILE "/tmp/collection4.cache"
+#endif
+
+#ifndef RENDER_CACHE_SIZE
+# define RENDER_CACHE_SIZE (16 * 1024 * 1024)
+#endif
+
+#ifndef COLLECTD_SOCKET
+# define COLLECTD_SOCKET "/var/run/collectd-unixsock"
 #endif
 
 static time_t last_read_mtime = 0;
 
+/* The strings below are read by the request threads while the refresh thread
+ * may be re-reading the configuration. They are only replaced and read while
+ * holding "config_lock", see "config_set_string" and "config_copy_string".
+ * The numbers are read without locking. */
+static pthread_mutex_t config_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static char *cache_file = NULL;
 
+static cache_format_t cache_format = CACHE_FORMAT_BINARY;
+
+static int worker_threads = 0;
+static int fetch_threads = 4;
+static int fetch_limit = 16;
+
+static int render_cache_size = RENDER_CACHE_SIZE;
+static int render_cache_quantum = 0;
+
+static char *collectd_socket = NULL;
+static int flush_window = 10;
+static int flush_timeout = 1000;
+
+static int config_set_string (const oconfig_item_t *ci, /* {{{ */
+    char **ret_str)
+{
+  char *tmp = NULL;
+  char *old;
+  int status;
+
+  status = graph_config_get_string (ci, &tmp);
+  if (status != 0)
+    return (status);
+
+  pthread_mutex_lock (&config_lock);
+  old = *ret_str;
+  *ret_str = tmp;
+  pthread_mutex_unlock (&config_lock);
+
+  free (old);
+  return (0);
+} /* }}} int config_set_string */
+
+/* Copies "*str", or "default_str" if it isn't set, to "buffer". */
+static int config_copy_string (char **str, const char *default_str, /* {{{ */
+    char *buffer, size_t buffer_size)
+{
+  const char *value;
+  size_t value_len;
+  int status = 0;
+
+  if ((buffer == NULL) || (buffer_size < 1))
+    return (EINVAL);
+
+  pthread_mutex_lock (&config_lock);
+  value = (*str != NULL) ? *str : default_str;
+  value_len = strlen (value);
+  if (value_len >= buffer_size)
+    status = ENAMETOOLONG;
+  else
+    memcpy (buffer, value, value_len + 1);
+  pthread_mutex_unlock (&config_lock);
+
+  if (status != 0)
+    buffer[0] = 0;
+
+  return (status);
+} /* }}} int config_copy_string */
+
+static int config_get_cache_format (const oconfig_item_t *ci) /* {{{ */
+{
+  char *tmp = NULL;
+  int status;
+
+  status = graph_config_get_string (ci, &tmp);
+  if (status != 0)
+    return (status);
+
+  if (strcasecmp ("binary", tmp) == 0)
+    cache_format = CACHE_FORMAT_BINARY;
+  else if (strcasecmp ("json", tmp) == 0)
+    cache_format = CACHE_FORMAT_JSON;
+  else
+  {
+    fprintf (stderr, "config_get_cache_format: Unknown cache format "
+        "\"%s\". Valid formats are \"binary\" and \"json\".\n", tmp);
+    status = EINVAL;
+  }
+
+  free (tmp);
+  return (status);
+} /* }}} int config_get_cache_format */
+
 static int dispatch_config (const oconfig_item_t *ci) /* {{{ */
 {
   int i;
@@ -62,7 +161,25 @@ static int dispatch_config (const oconfig_item_t *ci) /* {{{ */
     else if (strcasecmp ("DataProvider", child->key) == 0)
       data_provider_config (child);
     else if (strcasecmp ("CacheFile", child->key) == 0)
-      graph_config_get_string (child, &cache_file);
+      config_set_string (child, &cache_file);
+    else if (strcasecmp ("CacheFormat", child->key) == 0)
+      config_get_cache_format (child);
+    else if (strcasecmp ("WorkerThreads", child->key) == 0)
+      graph_config_get_int (child, &worker_threads);
+    else if (strcasecmp ("FetchThreads", child->key) == 0)
+      graph_config_get_int (child, &fetch_threads);
+    else if (strcasecmp ("FetchLimit", child->key) == 0)
+      graph_config_get_int (child, &fetch_limit);
+    else if (strcasecmp ("RenderCacheSize", child->key) == 0)
+      graph_config_get_int (child, &render_cache_size);
+    else if (strcasecmp ("RenderCacheQuantum", child->key) == 0)
+      graph_config_get_int (child, &render_cache_quantum);
+    else if (strcasecmp ("CollectdSocket", child->key) == 0)
+      config_set_string (child, &collectd_socket);
+    else if (strcasecmp ("FlushWindow", child->key) == 0)
+      graph_config_get_int (child, &flush_window);
+    else if (strcasecmp ("FlushTimeout", child->key) == 0)
+      graph_config_get_int (child, &flush_timeout);
     else
     {
       DEBUG ("Unknown config option: %s", child->key);
@@ -84,6 +201,7 @@ static int internal_read_config (void) /* {{{ */
 
   oconfig_free (ci);
 
+  data_provider_config_submit ();
   gl_config_submit ();
 
   return (0);
@@ -150,11 +268,80 @@ int graph_config_get_bool (const oconfig_item_t *ci, /* {{{ */
   return (0);
 } /* }}} int graph_config_get_bool */
 
-const char *graph_config_get_cache_file (void) /* {{{ */
+int graph_config_get_int (const oconfig_item_t *ci, /* {{{ */
+    int *ret_int)
+{
+  if ((ci->values_num != 1) || (ci->values[0].type != OCONFIG_TYPE_NUMBER))
+    return (EINVAL);
+
+  *ret_int = (int) ci->values[0].value.number;
+
+  return (0);
+} /* }}} int graph_config_get_int */
+
+int graph_config_get_cache_file (char *buffer, size_t buffer_size) /* {{{ */
+{
+  return (config_copy_string (&cache_file, CACHEFILE,
+        buffer, buffer_size));
+} /* }}} int graph_config_get_cache_file */
+
+cache_format_t graph_config_get_cache_format (void) /* {{{ */
+{
+  return (cache_format);
+} /* }}} cache_format_t graph_config_get_cache_format */
+
+int graph_config_get_worker_threads (void) /* {{{ */
+{
+  return (worker_threads);
+} /* }}} int graph_config_get_worker_threads */
+
+int graph_config_get_fetch_threads (void) /* {{{ */
 {
-  if (cache_file == NULL)
-    return (CACHEFILE);
-  return (cache_file);
-} /* }}} char graph_config_get_cache_file */
+  if (fetch_threads < 1)
+    return (1);
+  return (fetch_threads);
+} /* }}} int graph_config_get_fetch_threads */
+
+int graph_config_get_fetch_limit (void) /* {{{ */
+{
+  if (fetch_limit < 1)
+    return (1);
+  return (fetch_limit);
+} /* }}} int graph_config_get_fetch_limit */
+
+int graph_config_get_render_cache_size (void) /* {{{ */
+{
+  if (render_cache_size < 0)
+    return (0);
+  return (render_cache_size);
+} /* }}} int graph_config_get_render_cache_size */
+
+int graph_config_get_render_cache_quantum (void) /* {{{ */
+{
+  if (render_cache_quantum < 0)
+    return (0);
+  return (render_cache_quantum);
+} /* }}} int graph_config_get_render_cache_quantum */
+
+int graph_config_get_collectd_socket (char *buffer, /* {{{ */
+    size_t buffer_size)
+{
+  return (config_copy_string (&collectd_socket, COLLECTD_SOCKET,
+        buffer, buffer_size));
+} /* }}} int graph_config_get_collectd_socket */
+
+int graph_config_get_flush_window (void) /* {{{ */
+{
+  if (flush_window < 0)
+    return (0);
+  return (flush_window);
+} /* }}} int graph_config_get_flush_window */
+
+int graph_config_get_flush_timeout (void) /* {{{ */
+{
+  if (flush_timeout < 0)
+    return (0);
+  return (flush_timeout);
+} /* }}} int graph_config_get_flush_timeout */
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -24,14 +24,60 @@
 #ifndef GRAPH_CONFIG_H
 #define GRAPH_CONFIG_H 1
 
+#include <stddef.h>
+
 #include "oconfig.h"
 
 int graph_read_config (void);
 
 int graph_config_get_string (const oconfig_item_t *ci, char **ret_str);
 int graph_config_get_bool (const oconfig_item_t *ci, _Bool *ret_bool);
+int graph_config_get_int (const oconfig_item_t *ci, int *ret_int);
+
+/* The configuration may be re-read by another thread at any time, so string
+ * options are copied to "buffer". Returns ENAMETOOLONG if the buffer is too
+ * small. */
+int graph_config_get_cache_file (char *buffer, size_t buffer_size);
+
+enum cache_format_e
+{
+  CACHE_FORMAT_BINARY,
+  CACHE_FORMAT_JSON
+};
+typedef enum cache_format_e cache_format_t;
+
+cache_format_t graph_config_get_cache_format (void);
+
+/* Number of threads handling FastCGI requests. Zero or one means requests
+ * are handled by the main thread. */
+int graph_config_get_worker_threads (void);
+
+/* Number of threads reading files in parallel for one request. */
+int graph_config_get_fetch_threads (void);
+
+/* Maximum number of files read at the same time by all requests together. */
+int graph_config_get_fetch_limit (void);
+
+/* Maximum number of bytes used for rendered graphs. Zero disables the
+ * cache. */
+int graph_config_get_render_cache_size (void);
+
+/* Minimum number of seconds by which relative time spans are rounded, so
+ * that requests for "the last day" made at slightly different times share a
+ * cache entry. Time spans are always rounded to the duration of one
+ * pixel. */
+int graph_config_get_render_cache_quantum (void);
+
+/* Path of the UNIX socket of collectd's unixsock plugin. Copied like
+ * "graph_config_get_cache_file". */
+int graph_config_get_collectd_socket (char *buffer, size_t buffer_size);
+
+/* Number of seconds during which an identifier is not flushed again. */
+int graph_config_get_flush_window (void);
 
-const char *graph_config_get_cache_file (void);
+/* Number of milliseconds to wait for collectd to flush before using the data
+ * on disk. */
+int graph_config_get_flush_timeout (void);
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
 #endif /* GRAPH_CONFIG_H */
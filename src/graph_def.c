@@ -149,7 +149,7 @@ static graph_def_t *def_config_get_obj (graph_config_t *cfg, /* {{{ */
 } /* }}} graph_def_t *def_config_get_obj */
 
 static int def_to_json_recursive (const graph_def_t *def, /* {{{ */
-    yajl_gen handler)
+    json_writer_t *handler)
 {
   char color[16];
 
@@ -162,39 +162,35 @@ static int def_to_json_recursive (const graph_def_t *def, /* {{{ */
     strncpy (color, "random", sizeof (color));
   color[sizeof (color) - 1] = 0;
 
-  yajl_gen_map_open (handler);
+  json_map_open (handler);
 
-#define yajl_gen_string_cast(h,p,l) \
-  yajl_gen_string (h, (unsigned char *) p, (unsigned int) l)
-
-  yajl_gen_string_cast (handler, "select", strlen ("select"));
+  JSON_LITERAL (handler, "select");
   ident_to_json (def->select, handler);
   if (def->ds_name != NULL)
   {
-    yajl_gen_string_cast (handler, "ds_name", strlen ("ds_name"));
-    yajl_gen_string_cast (handler, def->ds_name, strlen (def->ds_name));
+    JSON_LITERAL (handler, "ds_name");
+    json_string (handler, def->ds_name);
   }
   if (def->legend != NULL)
   {
-    yajl_gen_string_cast (handler, "legend", strlen ("legend"));
-    yajl_gen_string_cast (handler, def->legend, strlen (def->legend));
+    JSON_LITERAL (handler, "legend");
+    json_string (handler, def->legend);
   }
-  yajl_gen_string_cast (handler, "color", strlen ("color"));
-  yajl_gen_string_cast (handler, color, strlen (color));
-  yajl_gen_string_cast (handler, "stack", strlen ("stack"));
-  yajl_gen_bool   (handler, def->stack);
-  yajl_gen_string_cast (handler, "area", strlen ("area"));
-  yajl_gen_bool   (handler, def->area);
+  JSON_LITERAL (handler, "color");
+  json_string (handler, color);
+  JSON_LITERAL (handler, "stack");
+  json_bool (handler, def->stack);
+  JSON_LITERAL (handler, "area");
+  json_bool (handler, def->area);
   if (def->format != NULL)
   {
-    yajl_gen_string_cast (handler, "format", strlen ("format"));
-    yajl_gen_string_cast (handler, def->format, strlen (def->format));
+    JSON_LITERAL (handler, "format");
+    json_string (handler, def->format);
   }
 
-  yajl_gen_map_close (handler);
+  json_map_close (handler);
 
   return (def_to_json_recursive (def->next, handler));
-#undef yajl_gen_string_cast
 } /* }}} int def_to_json_recursive */
 
 /*
@@ -277,6 +273,47 @@ void def_destroy (graph_def_t *def) /* {{{ */
   def_destroy (next);
 } /* }}} void def_destroy */
 
+graph_def_t *def_clone (const graph_def_t *def) /* {{{ */
+{
+  graph_def_t *head = NULL;
+  graph_def_t *tail = NULL;
+
+  for (; def != NULL; def = def->next)
+  {
+    graph_def_t *copy;
+
+    copy = malloc (sizeof (*copy));
+    if (copy == NULL)
+    {
+      def_destroy (head);
+      return (NULL);
+    }
+    memcpy (copy, def, sizeof (*copy));
+    copy->next = NULL;
+
+    copy->select = ident_clone (def->select);
+    copy->ds_name = strdup (def->ds_name);
+    copy->legend = (def->legend != NULL) ? strdup (def->legend) : NULL;
+    copy->format = (def->format != NULL) ? strdup (def->format) : NULL;
+
+    if (head == NULL)
+      head = copy;
+    else
+      tail->next = copy;
+    tail = copy;
+
+    if ((copy->select == NULL) || (copy->ds_name == NULL)
+        || ((def->legend != NULL) && (copy->legend == NULL))
+        || ((def->format != NULL) && (copy->format == NULL)))
+    {
+      def_destroy (head);
+      return (NULL);
+    }
+  }
+
+  return (head);
+} /* }}} graph_def_t *def_clone */
+
 int def_config (graph_config_t *cfg, const oconfig_item_t *ci) /* {{{ */
 {
   graph_def_t *def;
@@ -471,14 +508,14 @@ int def_get_rrdargs (graph_def_t *def, graph_ident_t *ident, /* {{{ */
 } /* }}} int def_get_rrdargs */
 
 int def_to_json (const graph_def_t *def, /* {{{ */
-    yajl_gen handler)
+    json_writer_t *handler)
 {
   if (handler == NULL)
     return (EINVAL);
 
-  yajl_gen_array_open (handler);
+  json_array_open (handler);
   def_to_json_recursive (def, handler);
-  yajl_gen_array_close (handler);
+  json_array_close (handler);
 
   return (0);
 } /* }}} int def_to_json */
@@ -24,7 +24,7 @@
 #ifndef GRAPH_DEF_H
 #define GRAPH_DEF_H 1
 
-#include <yajl/yajl_gen.h>
+#include "utils_json.h"
 
 #include "graph_types.h"
 #include "utils_array.h"
@@ -36,6 +36,9 @@ graph_def_t *def_create (graph_config_t *cfg, graph_ident_t *ident,
 
 void def_destroy (graph_def_t *def);
 
+/* Returns a copy of the entire list starting at "def". */
+graph_def_t *def_clone (const graph_def_t *def);
+
 int def_config (graph_config_t *cfg, const oconfig_item_t *ci);
 
 int def_append (graph_def_t *head, graph_def_t *def);
@@ -50,7 +53,7 @@ int def_foreach (graph_def_t *def, def_callback_t callback, void *user_data);
 int def_get_rrdargs (graph_def_t *def, graph_ident_t *ident,
     rrd_args_t *args);
 
-int def_to_json (const graph_def_t *def, yajl_gen handler);
+int def_to_json (const graph_def_t *def, json_writer_t *handler);
 
 /* vim: set sw=2 sts=2 et fdm=marker : */
 #endif
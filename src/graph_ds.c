@@ -0,0 +1,245 @@
+/**
+ * collection4 - graph_ds.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "graph_ds.h"
+#include "graph_ident.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+struct gds_entry_s /* {{{ */
+{
+  /* Key of the "gds_index" entry. */
+  graph_ident_t *file;
+
+  uint64_t size;
+  uint64_t inode;
+
+  atom_t *names;
+  atom_t *types;
+  size_t ds_num;
+}; /* }}} struct gds_entry_s */
+typedef struct gds_entry_s gds_entry_t;
+
+static pthread_mutex_t gds_lock = PTHREAD_MUTEX_INITIALIZER;
+static c4_hash_t *gds_index = NULL;
+
+/*
+ * Private functions
+ */
+static atom_t *gds_atoms_copy (const atom_t *atoms, size_t num) /* {{{ */
+{
+  atom_t *copy;
+
+  copy = calloc ((num > 0) ? num : 1, sizeof (*copy));
+  if (copy == NULL)
+    return (NULL);
+
+  if (num > 0)
+    memcpy (copy, atoms, num * sizeof (*copy));
+
+  return (copy);
+} /* }}} atom_t *gds_atoms_copy */
+
+/*
+ * Public functions
+ */
+int gds_set (const graph_ident_t *file, /* {{{ */
+    uint64_t size, uint64_t inode,
+    size_t ds_num, char * const *names, char * const *types)
+{
+  gds_entry_t *e;
+  atom_t *name_atoms;
+  atom_t *type_atoms;
+  size_t i;
+  int status;
+
+  if ((file == NULL) || ((ds_num > 0) && ((names == NULL) || (types == NULL))))
+    return (EINVAL);
+
+  /* Interning doesn't require "gds_lock". */
+  name_atoms = calloc ((ds_num > 0) ? ds_num : 1, sizeof (*name_atoms));
+  type_atoms = calloc ((ds_num > 0) ? ds_num : 1, sizeof (*type_atoms));
+  if ((name_atoms == NULL) || (type_atoms == NULL))
+  {
+    free (name_atoms);
+    free (type_atoms);
+    return (ENOMEM);
+  }
+
+  for (i = 0; i < ds_num; i++)
+  {
+    name_atoms[i] = atom_intern (names[i]);
+    type_atoms[i] = atom_intern (types[i]);
+    if ((name_atoms[i] == ATOM_INVALID) || (type_atoms[i] == ATOM_INVALID))
+    {
+      free (name_atoms);
+      free (type_atoms);
+      return (ENOMEM);
+    }
+  }
+
+  pthread_mutex_lock (&gds_lock);
+
+  if (gds_index == NULL)
+  {
+    gds_index = c4_hash_create (ident_hash, ident_compare_void);
+    if (gds_index == NULL)
+    {
+      pthread_mutex_unlock (&gds_lock);
+      free (name_atoms);
+      free (type_atoms);
+      return (ENOMEM);
+    }
+  }
+
+  e = c4_hash_lookup (gds_index, file);
+  if (e == NULL)
+  {
+    e = malloc (sizeof (*e));
+    if (e == NULL)
+    {
+      pthread_mutex_unlock (&gds_lock);
+      free (name_atoms);
+      free (type_atoms);
+      return (ENOMEM);
+    }
+    memset (e, 0, sizeof (*e));
+
+    e->file = ident_clone (file);
+    if (e->file == NULL)
+      status = ENOMEM;
+    else
+      status = c4_hash_insert (gds_index, e->file, e);
+    if (status != 0)
+    {
+      pthread_mutex_unlock (&gds_lock);
+      ident_destroy (e->file);
+      free (e);
+      free (name_atoms);
+      free (type_atoms);
+      return (status);
+    }
+  }
+
+  free (e->names);
+  free (e->types);
+
+  e->size = size;
+  e->inode = inode;
+  e->names = name_atoms;
+  e->types = type_atoms;
+  e->ds_num = ds_num;
+
+  pthread_mutex_unlock (&gds_lock);
+
+  return (0);
+} /* }}} int gds_set */
+
+int gds_get (const graph_ident_t *file, /* {{{ */
+    uint64_t *ret_size, uint64_t *ret_inode,
+    size_t *ret_ds_num, atom_t **ret_names, atom_t **ret_types)
+{
+  gds_entry_t *e;
+  atom_t *names = NULL;
+  atom_t *types = NULL;
+
+  if (file == NULL)
+    return (EINVAL);
+
+  pthread_mutex_lock (&gds_lock);
+
+  e = NULL;
+  if (gds_index != NULL)
+    e = c4_hash_lookup (gds_index, file);
+  if (e == NULL)
+  {
+    pthread_mutex_unlock (&gds_lock);
+    return (ENOENT);
+  }
+
+  if (ret_names != NULL)
+    names = gds_atoms_copy (e->names, e->ds_num);
+  if (ret_types != NULL)
+    types = gds_atoms_copy (e->types, e->ds_num);
+  if (((ret_names != NULL) && (names == NULL))
+      || ((ret_types != NULL) && (types == NULL)))
+  {
+    pthread_mutex_unlock (&gds_lock);
+    free (names);
+    free (types);
+    return (ENOMEM);
+  }
+
+  if (ret_size != NULL)
+    *ret_size = e->size;
+  if (ret_inode != NULL)
+    *ret_inode = e->inode;
+  if (ret_ds_num != NULL)
+    *ret_ds_num = e->ds_num;
+  if (ret_names != NULL)
+    *ret_names = names;
+  if (ret_types != NULL)
+    *ret_types = types;
+
+  pthread_mutex_unlock (&gds_lock);
+
+  return (0);
+} /* }}} int gds_get */
+
+void gds_remove (const graph_ident_t *file) /* {{{ */
+{
+  gds_entry_t *e;
+
+  if (file == NULL)
+    return;
+
+  pthread_mutex_lock (&gds_lock);
+
+  e = NULL;
+  if (gds_index != NULL)
+    e = c4_hash_lookup (gds_index, file);
+  if (e != NULL)
+    c4_hash_remove (gds_index, e->file);
+
+  pthread_mutex_unlock (&gds_lock);
+
+  if (e == NULL)
+    return;
+
+  ident_destroy (e->file);
+  free (e->names);
+  free (e->types);
+  free (e);
+} /* }}} void gds_remove */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
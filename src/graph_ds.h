@@ -0,0 +1,54 @@
+/**
+ * collection4 - graph_ds.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef GRAPH_DS_H
+#define GRAPH_DS_H 1
+
+#include <stdint.h>
+
+#include "graph_types.h"
+#include "utils_atom.h"
+
+/*
+ * Names and types of the data sources of each file, shared by all threads.
+ * Reading them from an RRD file means parsing its header, so they are
+ * captured when the file is first seen and stored in the cache file. The
+ * size and inode of the file identify the version they were read from: if
+ * either changed, the file has been re-created and has to be read again.
+ */
+
+/* Stores the data sources of "file", replacing any previous ones. */
+int gds_set (const graph_ident_t *file, uint64_t size, uint64_t inode,
+    size_t ds_num, char * const *names, char * const *types);
+
+/* Returns the data sources of "file" as arrays of atoms, which must be freed
+ * by the caller. Any of the return pointers may be NULL. Returns ENOENT if
+ * the file is unknown. */
+int gds_get (const graph_ident_t *file,
+    uint64_t *ret_size, uint64_t *ret_inode,
+    size_t *ret_ds_num, atom_t **ret_names, atom_t **ret_types);
+
+void gds_remove (const graph_ident_t *file);
+
+#endif /* GRAPH_DS_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -34,12 +34,16 @@
 #include <sys/stat.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "graph_ident.h"
 #include "common.h"
 #include "data_provider.h"
 #include "filesystem.h"
 #include "utils_cgi.h"
+#include "utils_atom.h"
+#include "utils_consolidate.h"
+#include "utils_hash.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -47,82 +51,164 @@
 /*
  * Data types
  */
+/* The fields are interned strings, see "utils_atom.h". Identifiers are
+ * therefore small, fixed-size objects which can be copied and compared
+ * cheaply. */
 struct graph_ident_s /* {{{ */
 {
-  char *host;
-  char *plugin;
-  char *plugin_instance;
-  char *type;
-  char *type_instance;
+  atom_t host;
+  atom_t plugin;
+  atom_t plugin_instance;
+  atom_t type;
+  atom_t type_instance;
 }; /* }}} struct graph_ident_s */
 
+/*
+ * Private variables
+ */
+/* Atoms of the ANY_TOKEN and ALL_TOKEN wildcards and of NONE_TOKEN. Set
+ * once by "ident_init_atoms". */
+static atom_t atom_any = ATOM_INVALID;
+static atom_t atom_all = ATOM_INVALID;
+static atom_t atom_none = ATOM_INVALID;
+static pthread_once_t atom_once = PTHREAD_ONCE_INIT;
+
+#define ATOM_IS_WILDCARD(a) (((a) == atom_any) || ((a) == atom_all))
+
 /*
  * Private functions
  */
-static char *part_copy_with_selector (const char *selector, /* {{{ */
-    const char *part, unsigned int flags)
+static void ident_init_atoms (void) /* {{{ */
 {
-  if ((selector == NULL) || (part == NULL))
-    return (NULL);
+  atom_any = atom_intern (ANY_TOKEN);
+  atom_all = atom_intern (ALL_TOKEN);
+  atom_none = atom_intern (NONE_TOKEN);
+} /* }}} void ident_init_atoms */
+
+/* Interns "str". The wildcards are compared case-insensitively, so they are
+ * stored in their canonical spelling. This way a wildcard can be recognized
+ * by comparing atoms. */
+static atom_t ident_intern (const char *str) /* {{{ */
+{
+  pthread_once (&atom_once, ident_init_atoms);
 
-  if ((flags & IDENT_FLAG_REPLACE_ANY) && IS_ANY (part))
-    return (NULL);
+  if (IS_ANY (str))
+    return (atom_any);
+  else if (IS_ALL (str))
+    return (atom_all);
 
-  if ((flags & IDENT_FLAG_REPLACE_ALL) && IS_ALL (part))
-    return (NULL);
+  return (atom_intern (str));
+} /* }}} atom_t ident_intern */
+
+/* Like "ident_intern" but doesn't add "str" to the pool. A string that has
+ * never been interned can't be part of any file or graph, so NONE_TOKEN,
+ * which matches nothing, is returned instead. */
+static atom_t ident_find (const char *str) /* {{{ */
+{
+  atom_t atom;
+
+  pthread_once (&atom_once, ident_init_atoms);
+
+  if (IS_ANY (str))
+    return (atom_any);
+  else if (IS_ALL (str))
+    return (atom_all);
+
+  atom = atom_find (str);
+  if (atom == ATOM_INVALID)
+    return (atom_none);
+
+  return (atom);
+} /* }}} atom_t ident_find */
+
+static atom_t part_copy_with_selector (atom_t selector, /* {{{ */
+    atom_t part, unsigned int flags)
+{
+  if ((selector == ATOM_INVALID) || (part == ATOM_INVALID))
+    return (ATOM_INVALID);
+
+  if ((flags & IDENT_FLAG_REPLACE_ANY) && (part == atom_any))
+    return (ATOM_INVALID);
+
+  if ((flags & IDENT_FLAG_REPLACE_ALL) && (part == atom_all))
+    return (ATOM_INVALID);
 
   /* Replace the ANY and ALL flags if requested and if the selecter actually
    * *is* that flag. */
-  if (IS_ANY (selector))
+  if (selector == atom_any)
   {
     if (flags & IDENT_FLAG_REPLACE_ANY)
-      return (strdup (part));
+      return (part);
     else
-      return (strdup (selector));
+      return (selector);
   }
 
-  if (IS_ALL (selector))
+  if (selector == atom_all)
   {
     if (flags & IDENT_FLAG_REPLACE_ALL)
-      return (strdup (part));
+      return (part);
     else
-      return (strdup (selector));
+      return (selector);
   }
 
-  if (strcmp (selector, part) != 0)
-    return (NULL);
+  if (selector != part)
+    return (ATOM_INVALID);
 
-  /* Otherwise (no replacement), return a copy of the selector. */
-  return (strdup (selector));
-} /* }}} char *part_copy_with_selector */
+  /* Otherwise (no replacement), return the selector. */
+  return (selector);
+} /* }}} atom_t part_copy_with_selector */
 
-static _Bool part_matches (const char *selector, /* {{{ */
-    const char *part)
+static _Bool part_matches (atom_t selector, /* {{{ */
+    atom_t part)
 {
 #if C4_DEBUG
-  if ((selector == NULL) && (part == NULL))
+  if ((selector == ATOM_INVALID) && (part == ATOM_INVALID))
     return (1);
 #endif
 
-  if (selector == NULL) /* && (part != NULL) */
+  if (selector == ATOM_INVALID) /* && (part != ATOM_INVALID) */
     return (0);
 
-  if (IS_ANY(selector) || IS_ALL(selector))
+  if (ATOM_IS_WILDCARD (selector))
     return (1);
 
-  if (part == NULL) /* && (selector != NULL) */
+  if (part == ATOM_INVALID) /* && (selector != ATOM_INVALID) */
     return (0);
 
-  if (strcmp (selector, part) == 0)
+  if (selector == part)
     return (1);
 
   return (0);
 } /* }}} _Bool part_matches */
 
-/*
- * Public functions
- */
-graph_ident_t *ident_create (const char *host, /* {{{ */
+static int part_compare (atom_t a0, atom_t a1) /* {{{ */
+{
+  /* Equal strings share the same atom. Only different strings need to be
+   * compared to determine the (lexicographic) order. */
+  if (a0 == a1)
+    return (0);
+
+  return (strcmp (atom_get (a0), atom_get (a1)));
+} /* }}} int part_compare */
+
+static int part_set (atom_t *part, const char *value, /* {{{ */
+    atom_t (*lookup) (const char *))
+{
+  atom_t tmp;
+
+  if (value == NULL)
+    return (EINVAL);
+
+  tmp = (*lookup) (value);
+  if (tmp == ATOM_INVALID)
+    return (ENOMEM);
+
+  *part = tmp;
+  return (0);
+} /* }}} int part_set */
+
+static graph_ident_t *ident_create_with (atom_t (*lookup) (const char *), /* {{{ */
+    const char *host,
     const char *plugin, const char *plugin_instance,
     const char *type, const char *type_instance)
 {
@@ -138,25 +224,12 @@ graph_ident_t *ident_create (const char *host, /* {{{ */
     return (NULL);
   memset (ret, 0, sizeof (*ret));
 
-  ret->host = NULL;
-  ret->host = NULL;
-  ret->plugin = NULL;
-  ret->plugin_instance = NULL;
-  ret->type = NULL;
-  ret->type_instance = NULL;
-
-#define COPY_PART(p) do {        \
-  ret->p = strdup (p);           \
-  if (ret->p == NULL)            \
-  {                              \
-    free (ret->host);            \
-    free (ret->plugin);          \
-    free (ret->plugin_instance); \
-    free (ret->type);            \
-    free (ret->type_instance);   \
-    free (ret);                  \
-    return (NULL);               \
-  }                              \
+#define COPY_PART(p) do {                \
+  if (part_set (&ret->p, p, lookup) != 0) \
+  {                                      \
+    free (ret);                          \
+    return (NULL);                       \
+  }                                      \
 } while (0)
 
   COPY_PART(host);
@@ -168,13 +241,40 @@ graph_ident_t *ident_create (const char *host, /* {{{ */
 #undef COPY_PART
 
   return (ret);
+} /* }}} graph_ident_t *ident_create_with */
+
+/*
+ * Public functions
+ */
+graph_ident_t *ident_create (const char *host, /* {{{ */
+    const char *plugin, const char *plugin_instance,
+    const char *type, const char *type_instance)
+{
+  return (ident_create_with (ident_intern, host,
+        plugin, plugin_instance, type, type_instance));
 } /* }}} graph_ident_t *ident_create */
 
+graph_ident_t *ident_create_query (const char *host, /* {{{ */
+    const char *plugin, const char *plugin_instance,
+    const char *type, const char *type_instance)
+{
+  return (ident_create_with (ident_find, host,
+        plugin, plugin_instance, type, type_instance));
+} /* }}} graph_ident_t *ident_create_query */
+
 graph_ident_t *ident_clone (const graph_ident_t *ident) /* {{{ */
 {
-  return (ident_create (ident->host,
-        ident->plugin, ident->plugin_instance,
-        ident->type, ident->type_instance));
+  graph_ident_t *ret;
+
+  if (ident == NULL)
+    return (NULL);
+
+  ret = malloc (sizeof (*ret));
+  if (ret == NULL)
+    return (NULL);
+  memcpy (ret, ident, sizeof (*ret));
+
+  return (ret);
 } /* }}} graph_ident_t *ident_clone */
 
 graph_ident_t *ident_copy_with_selector (const graph_ident_t *selector, /* {{{ */
@@ -189,21 +289,12 @@ graph_ident_t *ident_copy_with_selector (const graph_ident_t *selector, /* {{{ *
   if (ret == NULL)
     return (NULL);
   memset (ret, 0, sizeof (*ret));
-  ret->host = NULL;
-  ret->plugin = NULL;
-  ret->plugin_instance = NULL;
-  ret->type = NULL;
-  ret->type_instance = NULL;
 
 #define COPY_PART(p) do {                                  \
   ret->p = part_copy_with_selector (selector->p, ident->p, flags); \
-  if (ret->p == NULL)                                      \
+  if (ret->p == ATOM_INVALID)                              \
   {                                                        \
-    free (ret->host);                                      \
-    free (ret->plugin);                                    \
-    free (ret->plugin_instance);                           \
-    free (ret->type);                                      \
-    free (ret->type_instance);                             \
+    free (ret);                                            \
     return (NULL);                                         \
   }                                                        \
 } while (0)
@@ -224,12 +315,6 @@ void ident_destroy (graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return;
 
-  free (ident->host);
-  free (ident->plugin);
-  free (ident->plugin_instance);
-  free (ident->type);
-  free (ident->type_instance);
-
   free (ident);
 } /* }}} void ident_destroy */
 
@@ -239,7 +324,7 @@ const char *ident_get_host (const graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return (NULL);
 
-  return (ident->host);
+  return (atom_get (ident->host));
 } /* }}} char *ident_get_host */
 
 const char *ident_get_plugin (const graph_ident_t *ident) /* {{{ */
@@ -247,7 +332,7 @@ const char *ident_get_plugin (const graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return (NULL);
 
-  return (ident->plugin);
+  return (atom_get (ident->plugin));
 } /* }}} char *ident_get_plugin */
 
 const char *ident_get_plugin_instance (const graph_ident_t *ident) /* {{{ */
@@ -255,7 +340,7 @@ const char *ident_get_plugin_instance (const graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return (NULL);
 
-  return (ident->plugin_instance);
+  return (atom_get (ident->plugin_instance));
 } /* }}} char *ident_get_plugin_instance */
 
 const char *ident_get_type (const graph_ident_t *ident) /* {{{ */
@@ -263,7 +348,7 @@ const char *ident_get_type (const graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return (NULL);
 
-  return (ident->type);
+  return (atom_get (ident->type));
 } /* }}} char *ident_get_type */
 
 const char *ident_get_type_instance (const graph_ident_t *ident) /* {{{ */
@@ -271,7 +356,7 @@ const char *ident_get_type_instance (const graph_ident_t *ident) /* {{{ */
   if (ident == NULL)
     return (NULL);
 
-  return (ident->type_instance);
+  return (atom_get (ident->type_instance));
 } /* }}} char *ident_get_type_instance */
 
 const char *ident_get_field (const graph_ident_t *ident, /* {{{ */
@@ -281,15 +366,15 @@ const char *ident_get_field (const graph_ident_t *ident, /* {{{ */
     return (NULL);
 
   if (field == GIF_HOST)
-    return (ident->host);
+    return (atom_get (ident->host));
   else if (field == GIF_PLUGIN)
-    return (ident->plugin);
+    return (atom_get (ident->plugin));
   else if (field == GIF_PLUGIN_INSTANCE)
-    return (ident->plugin_instance);
+    return (atom_get (ident->plugin_instance));
   else if (field == GIF_TYPE)
-    return (ident->type);
+    return (atom_get (ident->type));
   else if (field == GIF_TYPE_INSTANCE)
-    return (ident->type_instance);
+    return (atom_get (ident->type_instance));
   else
     return (NULL); /* never reached */
 } /* }}} const char *ident_get_field */
@@ -298,87 +383,42 @@ const char *ident_get_field (const graph_ident_t *ident, /* {{{ */
 /* ident_set_* methods {{{ */
 int ident_set_host (graph_ident_t *ident, const char *host) /* {{{ */
 {
-  char *tmp;
-
-  if ((ident == NULL) || (host == NULL))
+  if (ident == NULL)
     return (EINVAL);
 
-  tmp = strdup (host);
-  if (tmp == NULL)
-    return (ENOMEM);
-
-  free (ident->host);
-  ident->host = tmp;
-
-  return (0);
+  return (part_set (&ident->host, host, ident_intern));
 } /* }}} int ident_set_host */
 
 int ident_set_plugin (graph_ident_t *ident, const char *plugin) /* {{{ */
 {
-  char *tmp;
-
-  if ((ident == NULL) || (plugin == NULL))
+  if (ident == NULL)
     return (EINVAL);
 
-  tmp = strdup (plugin);
-  if (tmp == NULL)
-    return (ENOMEM);
-
-  free (ident->plugin);
-  ident->plugin = tmp;
-
-  return (0);
+  return (part_set (&ident->plugin, plugin, ident_intern));
 } /* }}} int ident_set_plugin */
 
 int ident_set_plugin_instance (graph_ident_t *ident, const char *plugin_instance) /* {{{ */
 {
-  char *tmp;
-
-  if ((ident == NULL) || (plugin_instance == NULL))
+  if (ident == NULL)
     return (EINVAL);
 
-  tmp = strdup (plugin_instance);
-  if (tmp == NULL)
-    return (ENOMEM);
-
-  free (ident->plugin_instance);
-  ident->plugin_instance = tmp;
-
-  return (0);
+  return (part_set (&ident->plugin_instance, plugin_instance, ident_intern));
 } /* }}} int ident_set_plugin_instance */
 
 int ident_set_type (graph_ident_t *ident, const char *type) /* {{{ */
 {
-  char *tmp;
-
-  if ((ident == NULL) || (type == NULL))
+  if (ident == NULL)
     return (EINVAL);
 
-  tmp = strdup (type);
-  if (tmp == NULL)
-    return (ENOMEM);
-
-  free (ident->type);
-  ident->type = tmp;
-
-  return (0);
+  return (part_set (&ident->type, type, ident_intern));
 } /* }}} int ident_set_type */
 
 int ident_set_type_instance (graph_ident_t *ident, const char *type_instance) /* {{{ */
 {
-  char *tmp;
-
-  if ((ident == NULL) || (type_instance == NULL))
+  if (ident == NULL)
     return (EINVAL);
 
-  tmp = strdup (type_instance);
-  if (tmp == NULL)
-    return (ENOMEM);
-
-  free (ident->type_instance);
-  ident->type_instance = tmp;
-
-  return (0);
+  return (part_set (&ident->type_instance, type_instance, ident_intern));
 } /* }}} int ident_set_type_instance */
 
 /* }}} ident_set_* methods */
@@ -389,7 +429,7 @@ int ident_compare (const graph_ident_t *i0, /* {{{ */
   int status;
 
 #define COMPARE_PART(p) do {       \
-  status = strcmp (i0->p, i1->p);  \
+  status = part_compare (i0->p, i1->p); \
   if (status != 0)                 \
     return (status);               \
 } while (0)
@@ -405,6 +445,34 @@ int ident_compare (const graph_ident_t *i0, /* {{{ */
   return (0);
 } /* }}} int ident_compare */
 
+uint32_t ident_hash (const void *ident_ptr) /* {{{ */
+{
+  const graph_ident_t *ident = ident_ptr;
+  uint32_t hash = C4_HASH_INIT;
+
+  /* FNV-1a over the atoms. Equal strings have equal atoms, so this is
+   * consistent with "ident_compare". */
+#define HASH_PART(p) do {          \
+  hash ^= (uint32_t) ident->p;     \
+  hash *= 16777619U;               \
+} while (0)
+
+  HASH_PART (host);
+  HASH_PART (plugin);
+  HASH_PART (plugin_instance);
+  HASH_PART (type);
+  HASH_PART (type_instance);
+
+#undef HASH_PART
+
+  return (hash);
+} /* }}} uint32_t ident_hash */
+
+int ident_compare_void (const void *i0, const void *i1) /* {{{ */
+{
+  return (ident_compare (i0, i1));
+} /* }}} int ident_compare_void */
+
 _Bool ident_matches (const graph_ident_t *selector, /* {{{ */
     const graph_ident_t *ident)
 {
@@ -435,9 +503,8 @@ _Bool ident_intersect (const graph_ident_t *s0, /* {{{ */
     const graph_ident_t *s1)
 {
 #define INTERSECT_PART(p) do {                                               \
-  if (!IS_ANY (s0->p) && !IS_ALL (s0->p)                                     \
-      && !IS_ANY (s1->p) && !IS_ALL (s1->p)                                  \
-      && (strcmp (s0->p, s1->p) != 0))                                       \
+  if (!ATOM_IS_WILDCARD (s0->p) && !ATOM_IS_WILDCARD (s1->p)                 \
+      && (s0->p != s1->p))                                                   \
     return (0);                                                              \
 } while (0)
 
@@ -461,20 +528,20 @@ char *ident_to_string (const graph_ident_t *ident) /* {{{ */
 
   buffer[0] = 0;
 
-  strlcat (buffer, ident->host, sizeof (buffer));
+  strlcat (buffer, atom_get (ident->host), sizeof (buffer));
   strlcat (buffer, "/", sizeof (buffer));
-  strlcat (buffer, ident->plugin, sizeof (buffer));
-  if (ident->plugin_instance[0] != 0)
+  strlcat (buffer, atom_get (ident->plugin), sizeof (buffer));
+  if (atom_get (ident->plugin_instance)[0] != 0)
   {
     strlcat (buffer, "-", sizeof (buffer));
-    strlcat (buffer, ident->plugin_instance, sizeof (buffer));
+    strlcat (buffer, atom_get (ident->plugin_instance), sizeof (buffer));
   }
   strlcat (buffer, "/", sizeof (buffer));
-  strlcat (buffer, ident->type, sizeof (buffer));
-  if (ident->type_instance[0] != 0)
+  strlcat (buffer, atom_get (ident->type), sizeof (buffer));
+  if (atom_get (ident->type_instance)[0] != 0)
   {
     strlcat (buffer, "-", sizeof (buffer));
-    strlcat (buffer, ident->type_instance, sizeof (buffer));
+    strlcat (buffer, atom_get (ident->type_instance), sizeof (buffer));
   }
 
   return (strdup (buffer));
@@ -484,25 +551,29 @@ char *ident_to_file (const graph_ident_t *ident) /* {{{ */
 {
   char buffer[PATH_MAX];
 
+  /* Use the "DataDir" of the data provider owning the file. */
+  if (data_provider_get_ident_file (ident, buffer, sizeof (buffer)) == 0)
+    return (strdup (buffer));
+
   buffer[0] = 0;
 
   strlcat (buffer, DATA_DIR, sizeof (buffer));
   strlcat (buffer, "/", sizeof (buffer));
 
-  strlcat (buffer, ident->host, sizeof (buffer));
+  strlcat (buffer, atom_get (ident->host), sizeof (buffer));
   strlcat (buffer, "/", sizeof (buffer));
-  strlcat (buffer, ident->plugin, sizeof (buffer));
-  if (ident->plugin_instance[0] != 0)
+  strlcat (buffer, atom_get (ident->plugin), sizeof (buffer));
+  if (atom_get (ident->plugin_instance)[0] != 0)
   {
     strlcat (buffer, "-", sizeof (buffer));
-    strlcat (buffer, ident->plugin_instance, sizeof (buffer));
+    strlcat (buffer, atom_get (ident->plugin_instance), sizeof (buffer));
   }
   strlcat (buffer, "/", sizeof (buffer));
-  strlcat (buffer, ident->type, sizeof (buffer));
-  if (ident->type_instance[0] != 0)
+  strlcat (buffer, atom_get (ident->type), sizeof (buffer));
+  if (atom_get (ident->type_instance)[0] != 0)
   {
     strlcat (buffer, "-", sizeof (buffer));
-    strlcat (buffer, ident->type_instance, sizeof (buffer));
+    strlcat (buffer, atom_get (ident->type_instance), sizeof (buffer));
   }
 
   strlcat (buffer, ".rrd", sizeof (buffer));
@@ -511,62 +582,241 @@ char *ident_to_file (const graph_ident_t *ident) /* {{{ */
 } /* }}} char *ident_to_file */
 
 int ident_to_json (const graph_ident_t *ident, /* {{{ */
-    yajl_gen handler)
+    json_writer_t *handler)
 {
-  yajl_gen_status status;
-
   if ((ident == NULL) || (handler == NULL))
     return (EINVAL);
 
-#define ADD_STRING(str) do {                              \
-  status = yajl_gen_string (handler,                      \
-      (unsigned char *) (str),                            \
-      (unsigned int) strlen (str));                       \
-  if (status != yajl_gen_status_ok)                       \
-    return ((int) status);                                \
-} while (0)
-
-  yajl_gen_map_open (handler);
-  ADD_STRING ("host");
-  ADD_STRING (ident->host);
-  ADD_STRING ("plugin");
-  ADD_STRING (ident->plugin);
-  ADD_STRING ("plugin_instance");
-  ADD_STRING (ident->plugin_instance);
-  ADD_STRING ("type");
-  ADD_STRING (ident->type);
-  ADD_STRING ("type_instance");
-  ADD_STRING (ident->type_instance);
-  yajl_gen_map_close (handler);
-
-#undef ADD_FIELD
-
-  return (0);
+  json_map_open (handler);
+  JSON_LITERAL (handler, "host");
+  json_string (handler, atom_get (ident->host));
+  JSON_LITERAL (handler, "plugin");
+  json_string (handler, atom_get (ident->plugin));
+  JSON_LITERAL (handler, "plugin_instance");
+  json_string (handler, atom_get (ident->plugin_instance));
+  JSON_LITERAL (handler, "type");
+  json_string (handler, atom_get (ident->type));
+  JSON_LITERAL (handler, "type_instance");
+  json_string (handler, atom_get (ident->type_instance));
+  return (json_map_close (handler));
 } /* }}} char *ident_to_json */
 
 /* {{{ ident_data_to_json */
+struct ident_data_ds_s
+{
+  char *name;
+  dp_time_t first_value_time;
+  dp_time_t interval;
+  size_t data_points_num;
+  double *data_points;
+};
+typedef struct ident_data_ds_s ident_data_ds_t;
+
+struct ident_data_s
+{
+  graph_ident_t *ident;
+  dp_time_t interval;
+  dp_cf_t cf;
+  downsample_t downsample;
+
+  ident_data_ds_t *ds;
+  size_t ds_num;
+};
+
 struct ident_data_to_json__data_s
 {
-  dp_time_t begin;
-  dp_time_t end;
   dp_time_t interval;
-  yajl_gen handler;
+  dp_cf_t cf;
+  downsample_t downsample;
+  data_columns_t *columns;
+  json_writer_t *handler;
 };
 typedef struct ident_data_to_json__data_s ident_data_to_json__data_t;
 
-#define yajl_gen_string_cast(h,s,l) \
-  yajl_gen_string (h, (unsigned char *) s, (unsigned int) l)
+#define DOWNSAMPLE_OVERSAMPLE 32
 
-static int ident_data_to_json__get_ident_data (
-    __attribute__((unused)) graph_ident_t *ident, /* {{{ */
-    __attribute__((unused)) const char *ds_name,
-    dp_time_t first_value_time, dp_time_t interval,
-    size_t data_points_num, double *data_points,
-    void *user_data)
+/* Appends "value" to the binary columns in little endian byte order, as a
+ * float of "value_size" bytes. */
+static void ident_data_to_json__put_value (data_columns_t *columns, /* {{{ */
+    double value, size_t value_size)
 {
-  ident_data_to_json__data_t *data = user_data;
+  unsigned char *ptr = columns->buffer + columns->buffer_used;
+  uint64_t bits;
   size_t i;
 
+  if (value_size == 4)
+  {
+    float f = (float) value;
+    uint32_t bits32;
+
+    memcpy (&bits32, &f, sizeof (bits32));
+    bits = (uint64_t) bits32;
+  }
+  else
+  {
+    memcpy (&bits, &value, sizeof (bits));
+  }
+
+  for (i = 0; i < value_size; i++)
+    ptr[i] = (unsigned char) (bits >> (8 * i));
+  columns->buffer_used += value_size;
+} /* }}} void ident_data_to_json__put_value */
+
+/* Writes one column, i.e. the "data" or "time" array. With binary columns the
+ * values are appended to the column buffer and only their position is written
+ * to the JSON. NAN values are written as null or NAN, respectively. */
+static int ident_data_to_json__column ( /* {{{ */
+    ident_data_to_json__data_t *data, const char *key,
+    const double *values, size_t values_num, size_t value_size)
+{
+  data_columns_t *columns = data->columns;
+  size_t offset;
+  size_t i;
+
+  json_string (data->handler, key);
+
+  if (columns == NULL)
+  {
+    json_array_open (data->handler);
+    for (i = 0; i < values_num; i++)
+    {
+      if (isnan (values[i]))
+        json_null (data->handler);
+      else
+        json_double (data->handler, values[i]);
+    }
+    json_array_close (data->handler);
+    return (0);
+  }
+
+  /* Align each column to eight bytes, so that it can be used in place. */
+  offset = (columns->buffer_used + 7) & ~((size_t) 7);
+  if ((offset + values_num * value_size) > columns->buffer_size)
+  {
+    unsigned char *tmp;
+    size_t tmp_size;
+
+    tmp_size = 2 * columns->buffer_size;
+    if (tmp_size < (offset + values_num * value_size))
+      tmp_size = offset + values_num * value_size;
+
+    tmp = realloc (columns->buffer, tmp_size);
+    if (tmp == NULL)
+    {
+      json_null (data->handler);
+      return (ENOMEM);
+    }
+    columns->buffer = tmp;
+    columns->buffer_size = tmp_size;
+  }
+  memset (columns->buffer + columns->buffer_used, 0,
+      offset - columns->buffer_used);
+  columns->buffer_used = offset;
+
+  for (i = 0; i < values_num; i++)
+    ident_data_to_json__put_value (columns, values[i], value_size);
+
+  json_map_open (data->handler);
+  JSON_LITERAL (data->handler, "offset");
+  json_integer (data->handler, (int64_t) offset);
+  JSON_LITERAL (data->handler, "length");
+  json_integer (data->handler, (int64_t) values_num);
+  json_map_close (data->handler);
+
+  return (0);
+} /* }}} int ident_data_to_json__column */
+
+/* Consolidates "points_consolidate" values into one with the same function
+ * as the data provider. An incomplete bucket at the beginning is dropped. */
+static int ident_data_to_json__consolidate ( /* {{{ */
+    ident_data_to_json__data_t *data,
+    size_t data_points_num, const double *data_points,
+    size_t points_consolidate)
+{
+  double *values;
+  size_t buckets_num;
+  int status;
+
+  buckets_num = data_points_num / points_consolidate;
+
+  values = calloc (buckets_num + 1, sizeof (*values));
+  if (values == NULL)
+    return (ENOMEM);
+
+  /* Buckets without values are NAN. */
+  consolidate (data_points + (data_points_num % points_consolidate),
+      points_consolidate, buckets_num, /* counts = */ NULL,
+      (data->cf == DP_CF_AVERAGE) ? values : NULL,
+      (data->cf == DP_CF_MIN) ? values : NULL,
+      (data->cf == DP_CF_MAX) ? values : NULL);
+
+  status = ident_data_to_json__column (data, "data", values, buckets_num,
+      (data->columns != NULL) ? data->columns->value_size : 0);
+
+  free (values);
+
+  return (status);
+} /* }}} int ident_data_to_json__consolidate */
+
+/* Selects values with a shape-preserving method. Since the selected values are
+ * not equidistant, their times are returned in the "time" array. */
+static int ident_data_to_json__select ( /* {{{ */
+    ident_data_to_json__data_t *data,
+    size_t data_points_num, const double *data_points,
+    size_t points_consolidate,
+    double first_value_time, double interval)
+{
+  size_t *indices;
+  size_t indices_num;
+  double *values;
+  double *times;
+  size_t i;
+  int status;
+
+  indices_num = downsample_max_selected (data->downsample,
+      data_points_num / points_consolidate);
+  indices = calloc (indices_num + 1, sizeof (*indices));
+  values = calloc (indices_num + 1, sizeof (*values));
+  times = calloc (indices_num + 1, sizeof (*times));
+  if ((indices == NULL) || (values == NULL) || (times == NULL))
+  {
+    free (indices);
+    free (values);
+    free (times);
+    return (ENOMEM);
+  }
+
+  indices_num = downsample_select (data->downsample,
+      data_points, data_points_num, points_consolidate, indices);
+
+  for (i = 0; i < indices_num; i++)
+  {
+    times[i] = first_value_time + ((double) indices[i]) * interval;
+    values[i] = data_points[indices[i]];
+  }
+
+  /* Times need double precision in any case. */
+  status = ident_data_to_json__column (data, "time", times, indices_num,
+      sizeof (double));
+  if (status == 0)
+    status = ident_data_to_json__column (data, "data", values, indices_num,
+        (data->columns != NULL) ? data->columns->value_size : 0);
+
+  free (indices);
+  free (values);
+  free (times);
+
+  return (status);
+} /* }}} int ident_data_to_json__select */
+
+/* Writes one DS. */
+static int ident_data_to_json__ds (ident_data_to_json__data_t *data, /* {{{ */
+    graph_ident_t *ident, const char *ds_name,
+    dp_time_t first_value_time, dp_time_t interval,
+    size_t data_points_num, const double *data_points)
+{
+  int status;
+
   double first_value_time_double;
   double interval_double;
   double interval_requested;
@@ -585,98 +835,203 @@ static int ident_data_to_json__get_ident_data (
     points_consolidate = (size_t) (interval_requested / interval_double);
   assert (points_consolidate >= 1);
 
-  if (points_consolidate > 1)
+  json_map_open (data->handler);
+
+  JSON_LITERAL (data->handler, "file");
+  ident_to_json (ident, data->handler);
+
+  JSON_LITERAL (data->handler, "data_source");
+  json_string (data->handler, ds_name);
+
+  if (data->downsample != DOWNSAMPLE_AVG)
   {
-    size_t offset = data_points_num % points_consolidate;
+    const char *method = downsample_to_string (data->downsample);
+
+    JSON_LITERAL (data->handler, "downsample");
+    json_string (data->handler, method);
+
+    /* The interval of the data the values were selected from. */
+    JSON_LITERAL (data->handler, "first_value_time");
+    json_double (data->handler, first_value_time_double);
+
+    JSON_LITERAL (data->handler, "interval");
+    json_double (data->handler, interval_double);
 
-    first_value_time_double += ((double) offset) * interval_double;
-    interval_double *= ((double) points_consolidate);
+    status = ident_data_to_json__select (data,
+        data_points_num, data_points, points_consolidate,
+        first_value_time_double, interval_double);
   }
+  else
+  {
+    if (points_consolidate > 1)
+    {
+      size_t offset = data_points_num % points_consolidate;
 
-  yajl_gen_map_open (data->handler);
+      first_value_time_double += ((double) offset) * interval_double;
+      interval_double *= ((double) points_consolidate);
+    }
 
-  yajl_gen_string_cast (data->handler, "first_value_time", strlen ("first_value_time"));
-  yajl_gen_double (data->handler, first_value_time_double);
+    JSON_LITERAL (data->handler, "first_value_time");
+    json_double (data->handler, first_value_time_double);
 
-  yajl_gen_string_cast (data->handler, "interval", strlen ("interval"));
-  yajl_gen_double (data->handler, interval_double);
+    JSON_LITERAL (data->handler, "interval");
+    json_double (data->handler, interval_double);
 
-  yajl_gen_string_cast (data->handler, "data", strlen ("data"));
-  yajl_gen_array_open (data->handler);
+    status = ident_data_to_json__consolidate (data,
+        data_points_num, data_points, points_consolidate);
+  }
 
-  for (i = (data_points_num % points_consolidate);
-      i < data_points_num;
-      i += points_consolidate)
-  {
-    size_t j;
+  json_map_close (data->handler);
 
-    double sum = 0.0;
-    long num = 0;
+  return (status);
+} /* }}} int ident_data_to_json__ds */
 
-    for (j = 0; j < points_consolidate; j++)
-    {
-      if (isnan (data_points[i+j]))
-        continue;
+/* Called for each DS. The data points are only valid during the call, so
+ * they're copied. */
+static int ident_data_fetch__callback (graph_ident_t *ident, /* {{{ */
+    const char *ds_name,
+    dp_time_t first_value_time, dp_time_t interval,
+    size_t data_points_num, double *data_points,
+    void *user_data)
+{
+  ident_data_t *data = user_data;
+  ident_data_ds_t *ds;
 
-      sum += data_points[i+j];
-      num++;
-    }
+  ds = realloc (data->ds, (data->ds_num + 1) * sizeof (*data->ds));
+  if (ds == NULL)
+    return (ENOMEM);
+  data->ds = ds;
 
-    if (num == 0)
-      yajl_gen_null (data->handler);
-    else
-      yajl_gen_double (data->handler, sum / ((double) num));
+  ds = data->ds + data->ds_num;
+  memset (ds, 0, sizeof (*ds));
+  ds->name = strdup (ds_name);
+  ds->data_points = malloc ((data_points_num + 1) * sizeof (*ds->data_points));
+  if ((ds->name == NULL) || (ds->data_points == NULL))
+  {
+    free (ds->name);
+    free (ds->data_points);
+    return (ENOMEM);
   }
 
-  yajl_gen_array_close (data->handler);
+  assert (data->ident == ident);
+  ds->first_value_time = first_value_time;
+  ds->interval = interval;
+  ds->data_points_num = data_points_num;
+  memcpy (ds->data_points, data_points,
+      data_points_num * sizeof (*ds->data_points));
+  data->ds_num++;
 
   return (0);
-} /* }}} int ident_data_to_json__get_ident_data */
+} /* }}} int ident_data_fetch__callback */
 
-/* Called for each DS name */
-static int ident_data_to_json__get_ds_name (graph_ident_t *ident, /* {{{ */
-    const char *ds_name, void *user_data)
+int ident_data_fetch (graph_ident_t *ident, /* {{{ */
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, ident_data_t **ret_data)
 {
-  ident_data_to_json__data_t *data = user_data;
+  ident_data_t *data;
+  dp_time_t fetch_res;
   int status;
 
-  yajl_gen_map_open (data->handler);
+  if ((ident == NULL) || (ret_data == NULL))
+    return (EINVAL);
 
-  yajl_gen_string_cast (data->handler, "file", strlen ("file"));
-  ident_to_json (ident, data->handler);
+  *ret_data = NULL;
+
+  data = calloc (1, sizeof (*data));
+  if (data == NULL)
+    return (ENOMEM);
 
-  yajl_gen_string_cast (data->handler, "data_source", strlen ("data_source"));
-  yajl_gen_string_cast (data->handler, ds_name, strlen (ds_name));
+  data->ident = ident;
+  data->interval = res;
+  data->cf = cf;
+  data->downsample = downsample;
 
-  status = data_provider_get_ident_data (ident, ds_name,
-      data->begin, data->end,
-      ident_data_to_json__get_ident_data,
-      data);
+  /* Fetch all DSes at once, at the resolution that will be displayed. The
+   * selecting methods need finer data to pick from, but not more than
+   * DOWNSAMPLE_OVERSAMPLE values per displayed value. */
+  fetch_res = res;
+  if (downsample != DOWNSAMPLE_AVG)
+  {
+    fetch_res.tv_sec = res.tv_sec / DOWNSAMPLE_OVERSAMPLE;
+    fetch_res.tv_nsec = 0;
+    if (fetch_res.tv_sec < 1)
+      fetch_res.tv_sec = 1;
+  }
+
+  status = data_provider_get_ident_data_all (ident, begin, end, fetch_res, cf,
+      ident_data_fetch__callback, data);
+  if (status != 0)
+    fprintf (stderr, "ident_data_fetch: data_provider_get_ident_data_all "
+        "failed with status %i\n", status);
+
+  *ret_data = data;
+  return (status);
+} /* }}} int ident_data_fetch */
+
+int ident_data_write (const ident_data_t *data, /* {{{ */
+    data_columns_t *columns, json_writer_t *handler)
+{
+  ident_data_to_json__data_t write_data;
+  size_t i;
+  int status = 0;
+
+  if ((data == NULL) || (handler == NULL))
+    return (EINVAL);
+
+  write_data.interval = data->interval;
+  write_data.cf = data->cf;
+  write_data.downsample = data->downsample;
+  write_data.columns = columns;
+  write_data.handler = handler;
+
+  for (i = 0; i < data->ds_num; i++)
+  {
+    ident_data_ds_t *ds = data->ds + i;
 
-  yajl_gen_map_close (data->handler);
+    status = ident_data_to_json__ds (&write_data, data->ident, ds->name,
+        ds->first_value_time, ds->interval,
+        ds->data_points_num, ds->data_points);
+    if (status != 0)
+      break;
+  }
 
   return (status);
-} /* }}} int ident_data_to_json__get_ds_name */
+} /* }}} int ident_data_write */
+
+void ident_data_destroy (ident_data_t *data) /* {{{ */
+{
+  size_t i;
+
+  if (data == NULL)
+    return;
+
+  for (i = 0; i < data->ds_num; i++)
+  {
+    free (data->ds[i].name);
+    free (data->ds[i].data_points);
+  }
+  free (data->ds);
+  free (data);
+} /* }}} void ident_data_destroy */
 
 int ident_data_to_json (graph_ident_t *ident, /* {{{ */
-    dp_time_t begin, dp_time_t end, dp_time_t res,
-    yajl_gen handler)
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, data_columns_t *columns, json_writer_t *handler)
 {
-  ident_data_to_json__data_t data;
+  ident_data_t *data = NULL;
   int status;
 
-  data.begin = begin;
-  data.end = end;
-  data.interval = res;
-  data.handler = handler;
+  status = ident_data_fetch (ident, begin, end, res, cf, downsample, &data);
+  if (data != NULL)
+  {
+    int write_status;
 
-  /* Iterate over all DS names */
-  status = data_provider_get_ident_ds_names (ident,
-      ident_data_to_json__get_ds_name, &data);
-  if (status != 0)
-    fprintf (stderr, "ident_data_to_json: data_provider_get_ident_ds_names "
-        "failed with status %i\n", status);
+    write_status = ident_data_write (data, columns, handler);
+    if (status == 0)
+      status = write_status;
+  }
 
+  ident_data_destroy (data);
   return (status);
 } /* }}} int ident_data_to_json */
 /* }}} ident_data_to_json */
@@ -692,11 +1047,13 @@ int ident_describe (const graph_ident_t *ident, /* {{{ */
   buffer[0] = 0;
 
 #define CHECK_FIELD(field) do {                                              \
-  if (strcasecmp (selector->field, ident->field) != 0)                       \
+  if ((selector->field != ident->field)                                       \
+      && (strcasecmp (atom_get (selector->field),                            \
+          atom_get (ident->field)) != 0))                                    \
   {                                                                          \
     if (buffer[0] != 0)                                                      \
       strlcat (buffer, "/", buffer_size);                                    \
-    strlcat (buffer, ident->field, buffer_size);                             \
+    strlcat (buffer, atom_get (ident->field), buffer_size);                  \
   }                                                                          \
 } while (0)
 
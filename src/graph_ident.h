@@ -24,15 +24,20 @@
 #ifndef GRAPH_IDENT_H
 #define GRAPH_IDENT_H 1
 
+#include <stdint.h>
 #include <time.h>
 
-#include <yajl/yajl_gen.h>
+#include "utils_json.h"
 
 #include "graph_types.h"
 #include "data_provider.h"
+#include "utils_consolidate.h"
 
 #define ANY_TOKEN "/any/"
 #define ALL_TOKEN "/all/"
+/* Used by "ident_create_query" for values no file has. Like the wildcards,
+ * it contains slashes and therefore can't be part of a file name. */
+#define NONE_TOKEN "/none/"
 
 #define IS_ANY(str) (((str) != NULL) && (strcasecmp (ANY_TOKEN, (str)) == 0))
 #define IS_ALL(str) (((str) != NULL) && (strcasecmp (ALL_TOKEN, (str)) == 0))
@@ -51,6 +56,13 @@ typedef enum graph_ident_field_e graph_ident_field_t;
 graph_ident_t *ident_create (const char *host,
     const char *plugin, const char *plugin_instance,
     const char *type, const char *type_instance);
+/* Creates an identifier from strings sent by a client, e.g. to select a
+ * graph. Unlike "ident_create" it doesn't add the strings to the atom pool,
+ * which would let clients grow it without bounds. Fields with a value no
+ * file or graph has are set to NONE_TOKEN, which matches nothing. */
+graph_ident_t *ident_create_query (const char *host,
+    const char *plugin, const char *plugin_instance,
+    const char *type, const char *type_instance);
 graph_ident_t *ident_clone (const graph_ident_t *ident);
 
 #define IDENT_FLAG_REPLACE_ALL 0x01
@@ -79,6 +91,12 @@ int ident_set_type_instance (graph_ident_t *ident,
 int ident_compare (const graph_ident_t *i0,
     const graph_ident_t *i1);
 
+/* Hash function consistent with "ident_compare": Identifiers comparing equal
+ * have the same hash value. The "void *" signatures allow using these
+ * functions with "c4_hash_create" directly. */
+uint32_t ident_hash (const void *ident);
+int ident_compare_void (const void *i0, const void *i1);
+
 _Bool ident_matches (const graph_ident_t *selector,
     const graph_ident_t *ident);
 
@@ -91,10 +109,40 @@ _Bool ident_intersect (const graph_ident_t *s0, const graph_ident_t *s1);
 char *ident_to_string (const graph_ident_t *ident);
 char *ident_to_file (const graph_ident_t *ident);
 int ident_to_json (const graph_ident_t *ident,
-    yajl_gen handler);
+    json_writer_t *handler);
+
+/* Binary output of "ident_data_to_json". If passed, the "data" and "time"
+ * arrays are appended to "buffer" as little endian floats, each aligned to
+ * eight bytes. Values are "value_size" (4 or 8) bytes wide, times always
+ * eight bytes. Missing values are NAN. In the JSON, the arrays are replaced
+ * by their position in the buffer, e.g. {"offset":1296,"length":324}. */
+struct data_columns_s
+{
+  size_t value_size;
+  unsigned char *buffer;
+  size_t buffer_size;
+  size_t buffer_used;
+};
+typedef struct data_columns_s data_columns_t;
+
 int ident_data_to_json (graph_ident_t *ident,
-    dp_time_t begin, dp_time_t end, dp_time_t interval,
-    yajl_gen handler);
+    dp_time_t begin, dp_time_t end, dp_time_t interval, dp_cf_t cf,
+    downsample_t downsample, data_columns_t *columns, json_writer_t *handler);
+
+/* "ident_data_to_json" in two steps: "ident_data_fetch" reads the data of all
+ * DSes into memory and "ident_data_write" writes it. Fetching doesn't touch
+ * the writer, so several identifiers can be fetched in parallel and then be
+ * written in order. On error, "*ret_data" holds the DSes read before the
+ * error and must still be destroyed. */
+struct ident_data_s;
+typedef struct ident_data_s ident_data_t;
+
+int ident_data_fetch (graph_ident_t *ident,
+    dp_time_t begin, dp_time_t end, dp_time_t interval, dp_cf_t cf,
+    downsample_t downsample, ident_data_t **ret_data);
+int ident_data_write (const ident_data_t *data,
+    data_columns_t *columns, json_writer_t *handler);
+void ident_data_destroy (ident_data_t *data);
 
 int ident_describe (const graph_ident_t *ident, const graph_ident_t *selector,
     char *buffer, size_t buffer_size);
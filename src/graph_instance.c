@@ -26,14 +26,18 @@
 #include <errno.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "graph_instance.h"
+#include "collectd_flush.h"
 #include "graph.h"
+#include "graph_config.h"
 #include "graph_def.h"
 #include "graph_ident.h"
 #include "graph_list.h"
 #include "common.h"
 #include "utils_cgi.h"
+#include "utils_pool.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -46,6 +50,9 @@ struct graph_instance_s /* {{{ */
   size_t files_num;
 }; /* }}} struct graph_instance_s */
 
+/* Number of files whose data is kept in memory at once. */
+#define INST_DATA_CHUNK_FILES 256
+
 struct def_callback_data_s
 {
   graph_instance_t *inst;
@@ -53,6 +60,24 @@ struct def_callback_data_s
 };
 typedef struct def_callback_data_s def_callback_data_t;
 
+struct inst_data_fetch_s
+{
+  graph_ident_t **files;
+  ident_data_t **data;
+
+  dp_time_t begin;
+  dp_time_t end;
+  dp_time_t res;
+  dp_cf_t cf;
+  downsample_t downsample;
+};
+typedef struct inst_data_fetch_s inst_data_fetch_t;
+
+/* Number of files being read by all requests, see "FetchLimit". */
+static pthread_mutex_t fetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fetch_cond = PTHREAD_COND_INITIALIZER;
+static int fetch_active = 0;
+
 /*
  * Private functions
  */
@@ -169,26 +194,28 @@ static int gl_instance_get_rrdargs_cb (graph_def_t *def, void *user_data) /* {{{
   return (0);
 } /* }}} int gl_instance_get_rrdargs_cb */
 
-static const char *get_part_from_param (const char *prim_key, /* {{{ */
-    const char *sec_key)
+/* Reads the parameter from "pl" or, if that is NULL, from the request. */
+static const char *get_part_from_param (param_list_t *pl, /* {{{ */
+    const char *prim_key, const char *sec_key)
 {
   const char *val;
 
-  val = param (prim_key);
+  val = (pl != NULL) ? param_get (pl, prim_key) : param (prim_key);
   if (val != NULL)
     return (val);
   
-  return (param (sec_key));
+  return ((pl != NULL) ? param_get (pl, sec_key) : param (sec_key));
 } /* }}} const char *get_part_from_param */
 
-static graph_ident_t *inst_get_selector_from_params (void) /* {{{ */
+static graph_ident_t *inst_get_selector_from_params ( /* {{{ */
+    param_list_t *pl)
 {
-  const char *host = get_part_from_param ("inst_host", "host");
-  const char *plugin = get_part_from_param ("inst_plugin", "plugin");
-  const char *plugin_instance = get_part_from_param ("inst_plugin_instance",
-      "plugin_instance");
-  const char *type = get_part_from_param ("inst_type", "type");
-  const char *type_instance = get_part_from_param ("inst_type_instance",
+  const char *host = get_part_from_param (pl, "inst_host", "host");
+  const char *plugin = get_part_from_param (pl, "inst_plugin", "plugin");
+  const char *plugin_instance = get_part_from_param (pl,
+      "inst_plugin_instance", "plugin_instance");
+  const char *type = get_part_from_param (pl, "inst_type", "type");
+  const char *type_instance = get_part_from_param (pl, "inst_type_instance",
       "type_instance");
 
   graph_ident_t *ident;
@@ -201,16 +228,134 @@ static graph_ident_t *inst_get_selector_from_params (void) /* {{{ */
     return (NULL);
   }
 
-  ident = ident_create (host, plugin, plugin_instance, type, type_instance);
+  ident = ident_create_query (host, plugin, plugin_instance,
+      type, type_instance);
   if (ident == NULL)
   {
-    fprintf (stderr, "inst_get_selected: ident_create failed\n");
+    fprintf (stderr, "inst_get_selected: ident_create_query failed\n");
     return (NULL);
   }
 
   return (ident);
 } /* }}} graph_ident_t *inst_get_selector_from_params */
 
+static int inst_data_fetch_task (size_t index, void *user_data) /* {{{ */
+{
+  inst_data_fetch_t *fetch = user_data;
+  int status;
+
+  pthread_mutex_lock (&fetch_lock);
+  while (fetch_active >= graph_config_get_fetch_limit ())
+    pthread_cond_wait (&fetch_cond, &fetch_lock);
+  fetch_active++;
+  pthread_mutex_unlock (&fetch_lock);
+
+  status = ident_data_fetch (fetch->files[index],
+        fetch->begin, fetch->end, fetch->res, fetch->cf, fetch->downsample,
+        fetch->data + index);
+
+  pthread_mutex_lock (&fetch_lock);
+  fetch_active--;
+  pthread_cond_signal (&fetch_cond);
+  pthread_mutex_unlock (&fetch_lock);
+
+  return (status);
+} /* }}} int inst_data_fetch_task */
+
+/* Writes the files of each instance to an array of their own or, if the
+ * instance is NULL, writes null. The files are fetched by up to
+ * "threads_num" threads, INST_DATA_CHUNK_FILES at a time, and written in
+ * order. Files that can't be read are left out. */
+static int inst_data_write (graph_instance_t * const *insts, /* {{{ */
+    size_t insts_num,
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, size_t threads_num,
+    data_columns_t *columns, json_writer_t *handler)
+{
+  inst_data_fetch_t fetch;
+  graph_ident_t **files;
+  size_t files_num;
+  size_t chunk_begin = 0;
+  size_t chunk_end = 0;
+  size_t pos = 0;
+  size_t i;
+  size_t j;
+
+  files_num = 0;
+  for (i = 0; i < insts_num; i++)
+    if (insts[i] != NULL)
+      files_num += insts[i]->files_num;
+
+  memset (&fetch, 0, sizeof (fetch));
+  fetch.begin = begin;
+  fetch.end = end;
+  fetch.res = res;
+  fetch.cf = cf;
+  fetch.downsample = downsample;
+
+  files = calloc (files_num + 1, sizeof (*files));
+  fetch.data = calloc (INST_DATA_CHUNK_FILES, sizeof (*fetch.data));
+  if ((files == NULL) || (fetch.data == NULL))
+  {
+    free (files);
+    free (fetch.data);
+    return (ENOMEM);
+  }
+
+  files_num = 0;
+  for (i = 0; i < insts_num; i++)
+  {
+    if (insts[i] == NULL)
+      continue;
+    for (j = 0; j < insts[i]->files_num; j++)
+      files[files_num++] = insts[i]->files[j];
+  }
+
+  /* Flush all files with one command. Flushing the individual files below
+   * is then skipped. */
+  flush_idents (files, files_num);
+
+  for (i = 0; i < insts_num; i++)
+  {
+    if (insts[i] == NULL)
+    {
+      json_null (handler);
+      continue;
+    }
+
+    json_array_open (handler);
+    for (j = 0; j < insts[i]->files_num; j++)
+    {
+      ident_data_t *data;
+
+      if (pos == chunk_end)
+      {
+        chunk_begin = pos;
+        chunk_end = pos + INST_DATA_CHUNK_FILES;
+        if (chunk_end > files_num)
+          chunk_end = files_num;
+
+        fetch.files = files + chunk_begin;
+        memset (fetch.data, 0, INST_DATA_CHUNK_FILES * sizeof (*fetch.data));
+        pool_run (chunk_end - chunk_begin, threads_num,
+            inst_data_fetch_task, &fetch);
+      }
+
+      data = fetch.data[pos - chunk_begin];
+      if (data != NULL)
+        ident_data_write (data, columns, handler);
+      ident_data_destroy (data);
+      pos++;
+    }
+    json_array_close (handler);
+  }
+
+  free (files);
+  free (fetch.data);
+
+  return (0);
+} /* }}} int inst_data_write */
+
 /*
  * Public functions
  */
@@ -270,6 +415,50 @@ void inst_destroy (graph_instance_t *inst) /* {{{ */
   free (inst);
 } /* }}} void inst_destroy */
 
+graph_instance_t *inst_clone (const graph_instance_t *inst) /* {{{ */
+{
+  graph_instance_t *copy;
+  size_t i;
+
+  if (inst == NULL)
+    return (NULL);
+
+  copy = malloc (sizeof (*copy));
+  if (copy == NULL)
+    return (NULL);
+  memset (copy, 0, sizeof (*copy));
+
+  copy->select = ident_clone (inst->select);
+  if (copy->select == NULL)
+  {
+    free (copy);
+    return (NULL);
+  }
+
+  if (inst->files_num == 0)
+    return (copy);
+
+  copy->files = malloc (sizeof (*copy->files) * inst->files_num);
+  if (copy->files == NULL)
+  {
+    inst_destroy (copy);
+    return (NULL);
+  }
+
+  for (i = 0; i < inst->files_num; i++)
+  {
+    copy->files[i] = ident_clone (inst->files[i]);
+    if (copy->files[i] == NULL)
+    {
+      inst_destroy (copy);
+      return (NULL);
+    }
+    copy->files_num++;
+  }
+
+  return (copy);
+} /* }}} graph_instance_t *inst_clone */
+
 int inst_add_file (graph_instance_t *inst, /* {{{ */
     const graph_ident_t *file)
 {
@@ -289,13 +478,69 @@ int inst_add_file (graph_instance_t *inst, /* {{{ */
   return (0);
 } /* }}} int inst_add_file */
 
+int inst_remove_file (graph_instance_t *inst, /* {{{ */
+    const graph_ident_t *file)
+{
+  size_t i;
+
+  if ((inst == NULL) || (file == NULL))
+    return (EINVAL);
+
+  for (i = 0; i < inst->files_num; i++)
+    if (ident_compare (inst->files[i], file) == 0)
+      break;
+
+  if (i >= inst->files_num)
+    return (ENOENT);
+
+  ident_destroy (inst->files[i]);
+  memmove (inst->files + i, inst->files + i + 1,
+      sizeof (*inst->files) * (inst->files_num - (i + 1)));
+  inst->files_num--;
+
+  return (0);
+} /* }}} int inst_remove_file */
+
+size_t inst_num_files (const graph_instance_t *inst) /* {{{ */
+{
+  if (inst == NULL)
+    return (0);
+
+  return (inst->files_num);
+} /* }}} size_t inst_num_files */
+
+int inst_file_foreach (graph_instance_t *inst, /* {{{ */
+    ident_callback_t cb, void *user_data)
+{
+  size_t i;
+  int status;
+
+  if ((inst == NULL) || (cb == NULL))
+    return (EINVAL);
+
+  for (i = 0; i < inst->files_num; i++)
+  {
+    status = (*cb) (inst->files[i], user_data);
+    if (status != 0)
+      return (status);
+  }
+
+  return (0);
+} /* }}} int inst_file_foreach */
+
 graph_instance_t *inst_get_selected (graph_config_t *cfg) /* {{{ */
+{
+  return (inst_get_selected_from (cfg, /* params = */ NULL));
+} /* }}} graph_instance_t *inst_get_selected */
+
+graph_instance_t *inst_get_selected_from (graph_config_t *cfg, /* {{{ */
+    param_list_t *pl)
 {
   graph_ident_t *ident;
   graph_instance_t *inst;
 
   if (cfg == NULL)
-    cfg = gl_graph_get_selected ();
+    cfg = gl_graph_get_selected_from (pl);
 
   if (cfg == NULL)
   {
@@ -303,7 +548,7 @@ graph_instance_t *inst_get_selected (graph_config_t *cfg) /* {{{ */
     return (NULL);
   }
 
-  ident = inst_get_selector_from_params ();
+  ident = inst_get_selector_from_params (pl);
   if (ident == NULL)
   {
     fprintf (stderr, "inst_get_selected: ident_create failed\n");
@@ -314,7 +559,7 @@ graph_instance_t *inst_get_selected (graph_config_t *cfg) /* {{{ */
 
   ident_destroy (ident);
   return (inst);
-} /* }}} graph_instance_t *inst_get_selected */
+} /* }}} graph_instance_t *inst_get_selected_from */
 
 int inst_get_all_selected (graph_config_t *cfg, /* {{{ */
     graph_inst_callback_t callback, void *user_data)
@@ -325,7 +570,7 @@ int inst_get_all_selected (graph_config_t *cfg, /* {{{ */
   if ((cfg == NULL) || (callback == NULL))
     return (EINVAL);
 
-  ident = inst_get_selector_from_params ();
+  ident = inst_get_selector_from_params (/* params = */ NULL);
   if (ident == NULL)
   {
     fprintf (stderr, "inst_get_all_selected: "
@@ -412,6 +657,14 @@ graph_ident_t *inst_get_selector (graph_instance_t *inst) /* {{{ */
   return (ident_clone (inst->select));
 } /* }}} graph_ident_t *inst_get_selector */
 
+const graph_ident_t *inst_peek_selector (const graph_instance_t *inst) /* {{{ */
+{
+  if (inst == NULL)
+    return (NULL);
+
+  return (inst->select);
+} /* }}} const graph_ident_t *inst_peek_selector */
+
 int inst_get_params (graph_config_t *cfg, graph_instance_t *inst, /* {{{ */
     char *buffer, size_t buffer_size)
 {
@@ -579,7 +832,7 @@ _Bool inst_matches_field (graph_instance_t *inst, /* {{{ */
 } /* }}} _Bool inst_matches_field */
 
 int inst_to_json (const graph_instance_t *inst, /* {{{ */
-    yajl_gen handler)
+    json_writer_t *handler)
 {
   size_t i;
 
@@ -587,37 +840,54 @@ int inst_to_json (const graph_instance_t *inst, /* {{{ */
     return (EINVAL);
 
   /* TODO: error handling */
-  yajl_gen_map_open (handler);
-  yajl_gen_string (handler,
-      (unsigned char *) "select",
-      (unsigned int) strlen ("select"));
+  json_map_open (handler);
+  JSON_LITERAL (handler, "select");
   ident_to_json (inst->select, handler);
-  yajl_gen_string (handler,
-      (unsigned char *) "files",
-      (unsigned int) strlen ("files"));
-  yajl_gen_array_open (handler);
+  JSON_LITERAL (handler, "files");
+  json_array_open (handler);
   for (i = 0; i < inst->files_num; i++)
     ident_to_json (inst->files[i], handler);
-  yajl_gen_array_close (handler);
-  yajl_gen_map_close (handler);
+  json_array_close (handler);
+  json_map_close (handler);
 
   return (0);
 } /* }}} int inst_to_json */
 
 int inst_data_to_json (const graph_instance_t *inst, /* {{{ */
-    dp_time_t begin, dp_time_t end, dp_time_t res,
-    yajl_gen handler)
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, size_t threads_num,
+    data_columns_t *columns, json_writer_t *handler)
 {
-  size_t i;
+  graph_instance_t *insts[1];
 
-  yajl_gen_array_open (handler);
-  for (i = 0; i < inst->files_num; i++)
-    ident_data_to_json (inst->files[i], begin, end, res, handler);
-  yajl_gen_array_close (handler);
+  if (inst == NULL)
+    return (EINVAL);
 
-  return (0);
+  /* The instance isn't modified. */
+  insts[0] = (graph_instance_t *) inst;
+  return (inst_data_write (insts, 1, begin, end, res, cf, downsample,
+        threads_num, columns, handler));
 } /* }}} int inst_data_to_json */
 
+int inst_data_to_json_multi (graph_instance_t * const *insts, /* {{{ */
+    size_t insts_num,
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, size_t threads_num,
+    data_columns_t *columns, json_writer_t *handler)
+{
+  int status;
+
+  if (((insts == NULL) && (insts_num > 0)) || (handler == NULL))
+    return (EINVAL);
+
+  json_array_open (handler);
+  status = inst_data_write (insts, insts_num, begin, end, res, cf, downsample,
+      threads_num, columns, handler);
+  json_array_close (handler);
+
+  return (status);
+} /* }}} int inst_data_to_json_multi */
+
 int inst_describe (graph_config_t *cfg, graph_instance_t *inst, /* {{{ */
     char *buffer, size_t buffer_size)
 {
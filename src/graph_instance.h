@@ -26,13 +26,14 @@
 
 #include <time.h>
 
-#include <yajl/yajl_gen.h>
+#include "utils_json.h"
 
 #include "graph_types.h"
 #include "data_provider.h"
 #include "graph_ident.h"
 #include "rrd_args.h"
 #include "utils_array.h"
+#include "utils_cgi.h"
 
 /*
  * Methods
@@ -42,10 +43,27 @@ graph_instance_t *inst_create (graph_config_t *cfg,
 
 void inst_destroy (graph_instance_t *inst);
 
+/* Returns a copy of "inst", including its files. */
+graph_instance_t *inst_clone (const graph_instance_t *inst);
+
 int inst_add_file (graph_instance_t *inst, const graph_ident_t *file);
 
+/* Removes "file" from the instance. Returns ENOENT if the instance doesn't
+ * contain the file. */
+int inst_remove_file (graph_instance_t *inst, const graph_ident_t *file);
+
+size_t inst_num_files (const graph_instance_t *inst);
+
+/* Calls "cb" for each file of the instance, in the order they were added. */
+int inst_file_foreach (graph_instance_t *inst,
+    ident_callback_t cb, void *user_data);
+
 graph_instance_t *inst_get_selected (graph_config_t *cfg);
 
+/* Like "inst_get_selected", but evaluates the parameters in "pl". */
+graph_instance_t *inst_get_selected_from (graph_config_t *cfg,
+    param_list_t *pl);
+
 int inst_get_all_selected (graph_config_t *cfg,
     graph_inst_callback_t callback, void *user_data);
 
@@ -61,6 +79,10 @@ graph_def_t *inst_get_default_defs (graph_config_t *cfg,
 /* Returns a copy of the selector which must be freed by the caller. */
 graph_ident_t *inst_get_selector (graph_instance_t *inst);
 
+/* Returns the instance's own selector without copying it. The pointer is
+ * valid for as long as the instance exists and must not be freed. */
+const graph_ident_t *inst_peek_selector (const graph_instance_t *inst);
+
 int inst_compare (const graph_instance_t *i0, const graph_instance_t *i1);
 
 int inst_compare_ident (graph_instance_t *inst, const graph_ident_t *ident);
@@ -84,10 +106,21 @@ _Bool inst_matches_string (graph_config_t *cfg, graph_instance_t *inst,
 _Bool inst_matches_field (graph_instance_t *inst,
     graph_ident_field_t field, const char *field_value);
 
-int inst_to_json (const graph_instance_t *inst, yajl_gen handler);
+int inst_to_json (const graph_instance_t *inst, json_writer_t *handler);
+/* Writes an array with the data of each file of the instance. The files are
+ * read in parallel by up to "threads_num" threads and written in order. */
 int inst_data_to_json (const graph_instance_t *inst,
-    dp_time_t begin, dp_time_t end, dp_time_t res,
-    yajl_gen handler);
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, size_t threads_num,
+    data_columns_t *columns, json_writer_t *handler);
+
+/* Writes an array with one element per instance: the array
+ * "inst_data_to_json" writes or, if the instance is NULL, null. The files of
+ * all instances are read in parallel, like "inst_data_to_json" does. */
+int inst_data_to_json_multi (graph_instance_t * const *insts, size_t insts_num,
+    dp_time_t begin, dp_time_t end, dp_time_t res, dp_cf_t cf,
+    downsample_t downsample, size_t threads_num,
+    data_columns_t *columns, json_writer_t *handler);
 
 int inst_describe (graph_config_t *cfg, graph_instance_t *inst,
     char *buffer, size_t buffer_size);
@@ -31,6 +31,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -41,12 +43,16 @@
 #include "data_provider.h"
 #include "filesystem.h"
 #include "graph.h"
+#include "graph_classifier.h"
 #include "graph_config.h"
 #include "graph_def.h"
 #include "graph_ident.h"
 #include "graph_instance.h"
+#include "graph_snapshot.h"
 #include "utils_cgi.h"
+#include "utils_json.h"
 #include "utils_search.h"
+#include "utils_trigram.h"
 
 #include <fcgiapp.h>
 #include <fcgi_stdio.h>
@@ -56,12 +62,20 @@
  */
 #define UPDATE_INTERVAL 900
 
+/* Interval in which the refresh thread applies events and checks whether the
+ * list is due for a refresh, in seconds. */
+#define REFRESH_TICK 1
+
 /*
  * Global variables
  */
 static graph_config_t **gl_active = NULL;
 static size_t gl_active_num = 0;
 
+/* Routes files to the matching graphs in "gl_active". Rebuilt whenever the
+ * configuration is (re-)submitted. */
+static graph_classifier_t *gl_classifier = NULL;
+
 static graph_config_t **gl_staging = NULL;
 static size_t gl_staging_num = 0;
 
@@ -70,11 +84,81 @@ static size_t gl_staging_num = 0;
 static graph_config_t **gl_dynamic = NULL;
 static size_t gl_dynamic_num = 0;
 
-static char **host_list = NULL;
+struct gl_host_s
+{
+  char *name;
+  /* Number of files registered for this host. */
+  size_t files_num;
+};
+typedef struct gl_host_s gl_host_t;
+
+static gl_host_t *host_list = NULL;
 static size_t host_list_len = 0;
 
 static time_t gl_last_update = 0;
 
+/* True if the instances have been built by this process' own scan, so that
+ * the changes reported by the data provider can be applied to them. False if
+ * they have been read from the cache or the configuration changed. */
+static _Bool gl_scan_valid = 0;
+
+/* Serializes modifications of the variables above. */
+static pthread_mutex_t gl_update_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The graph list as seen by the request handlers. The variables above are
+ * only used by "gl_update", which publishes a copy of them after each
+ * change. Readers therefore never wait for an update to finish. The graphs
+ * are read-only copies made by "graph_publish", shared with other lists
+ * until the graph changes. Each thread pins the list it started a request
+ * with until it calls "gl_release"; the last reference frees an old list. */
+struct gl_list_s /* {{{ */
+{
+  graph_config_t **active;
+  size_t active_num;
+
+  graph_config_t **dynamic;
+  size_t dynamic_num;
+
+  gl_host_t *hosts;
+  size_t hosts_num;
+
+  /* See "gl_get_generation". */
+  uint64_t generation;
+
+  /* Search index, see "gl_index_create". Graphs are numbered in the order
+   * of "active" followed by "dynamic", and instances in the order of their
+   * graphs. The instances of graph "i" are numbered from "insts_first[i]" to
+   * "insts_first[i + 1] - 1". NULL if building the index failed. The
+   * instances' descriptions are indexed by the graphs themselves. */
+  trigram_index_t *titles;
+  size_t *insts_first;
+
+  unsigned int refcount;
+}; /* }}} struct gl_list_s */
+typedef struct gl_list_s gl_list_t;
+
+static gl_list_t *gl_published = NULL;
+static pthread_mutex_t gl_published_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The list pinned by the calling thread, if any. */
+static __thread gl_list_t *gl_reader = NULL;
+
+/* Protected by "gl_published_lock". "gl_stats.staleness" is not maintained;
+ * "gl_data_time" is the time the data was last known to be up to date. */
+static gl_stats_t gl_stats;
+static time_t gl_data_time = 0;
+
+/* Generation of the most recently published list. Protected by
+ * "gl_published_lock". */
+static uint64_t gl_generation = 0;
+
+/* The refresh thread, see "gl_refresh_start". */
+static pthread_t gl_refresh_thread;
+static _Bool gl_refresh_running = 0;
+static _Bool gl_refresh_quit = 0;
+static pthread_mutex_t gl_refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gl_refresh_cond = PTHREAD_COND_INITIALIZER;
+
 /*
  * Private functions
  */
@@ -129,35 +213,68 @@ static void gl_destroy (graph_config_t ***gl_array, /* {{{ */
 
 static int gl_register_host (const char *host) /* {{{ */
 {
-  char **tmp;
+  gl_host_t *tmp;
   size_t i;
 
   if (host == NULL)
     return (EINVAL);
 
   for (i = 0; i < host_list_len; i++)
-    if (strcmp (host_list[i], host) == 0)
+  {
+    if (strcmp (host_list[i].name, host) == 0)
+    {
+      host_list[i].files_num++;
       return (0);
+    }
+  }
 
   tmp = realloc (host_list, sizeof (*host_list) * (host_list_len + 1));
   if (tmp == NULL)
     return (ENOMEM);
   host_list = tmp;
 
-  host_list[host_list_len] = strdup (host);
-  if (host_list[host_list_len] == NULL)
+  host_list[host_list_len].name = strdup (host);
+  if (host_list[host_list_len].name == NULL)
     return (ENOMEM);
+  host_list[host_list_len].files_num = 1;
 
   host_list_len++;
   return (0);
 } /* }}} int gl_register_host */
 
+/* Removes the host once its last file has been removed. */
+static int gl_unregister_host (const char *host) /* {{{ */
+{
+  size_t i;
+
+  if (host == NULL)
+    return (EINVAL);
+
+  for (i = 0; i < host_list_len; i++)
+    if (strcmp (host_list[i].name, host) == 0)
+      break;
+
+  if (i >= host_list_len)
+    return (ENOENT);
+
+  host_list[i].files_num--;
+  if (host_list[i].files_num > 0)
+    return (0);
+
+  free (host_list[i].name);
+  memmove (host_list + i, host_list + i + 1,
+      sizeof (*host_list) * (host_list_len - (i + 1)));
+  host_list_len--;
+
+  return (0);
+} /* }}} int gl_unregister_host */
+
 static int gl_clear_hosts (void) /* {{{ */
 {
   size_t i;
 
   for (i = 0; i < host_list_len; i++)
-    free (host_list[i]);
+    free (host_list[i].name);
   free (host_list);
 
   host_list = NULL;
@@ -166,38 +283,442 @@ static int gl_clear_hosts (void) /* {{{ */
   return (0);
 } /* }}} int gl_clear_hosts */
 
-static int gl_compare_hosts (const void *v0, const void *v1) /* {{{ */
+/* gl_index_* {{{ */
+/* Returns graph number "index" of "l", see "gl_list_t". */
+static graph_config_t *gl_index_graph (gl_list_t *l, size_t index) /* {{{ */
 {
-  return (strcmp (*(char * const *) v0, *(char * const *) v1));
-} /* }}} int gl_compare_hosts */
+  if (index < l->active_num)
+    return (l->active[index]);
+  return (l->dynamic[index - l->active_num]);
+} /* }}} graph_config_t *gl_index_graph */
 
-static int gl_register_file (const graph_ident_t *file, /* {{{ */
-    __attribute__((unused)) void *user_data)
+struct gl_index_data_s /* {{{ */
 {
+  gl_list_t *l;
   graph_config_t *cfg;
-  int num_graphs = 0;
+
+  /* Flag for each instance, see "gl_index_search". */
+  unsigned char *matches;
+  size_t index;
+  size_t end;
+
+  search_info_t *si;
+  graph_inst_callback_t callback;
+  void *user_data;
+}; /* }}} struct gl_index_data_s */
+typedef struct gl_index_data_s gl_index_data_t;
+
+static void gl_index_destroy (gl_list_t *l) /* {{{ */
+{
+  tri_destroy (l->titles);
+  l->titles = NULL;
+  free (l->insts_first);
+  l->insts_first = NULL;
+} /* }}} void gl_index_destroy */
+
+/* Indexes the titles of the graphs of "l" and numbers their instances, so
+ * that searches don't have to describe every instance for every search term.
+ * The graphs index the descriptions of their instances when they are
+ * published, so unchanged graphs don't have to be indexed again. Done once
+ * per published list, readers never modify it. */
+static int gl_index_create (gl_list_t *l) /* {{{ */
+{
+  size_t graphs_num;
+  size_t insts_num;
   size_t i;
+  int status;
 
-  for (i = 0; i < gl_active_num; i++)
+  graphs_num = l->active_num + l->dynamic_num;
+
+  l->titles = tri_create ();
+  l->insts_first = calloc (graphs_num + 1, sizeof (*l->insts_first));
+  if ((l->titles == NULL) || (l->insts_first == NULL))
   {
-    graph_config_t *cfg = gl_active[i];
-    int status;
+    gl_index_destroy (l);
+    return (ENOMEM);
+  }
 
-    if (!graph_ident_matches (cfg, file))
-      continue;
+  status = 0;
+  insts_num = 0;
+  for (i = 0; i < graphs_num; i++)
+  {
+    graph_config_t *cfg = gl_index_graph (l, i);
+    char title[1024];
+
+    if (graph_get_title (cfg, title, sizeof (title)) != 0)
+      title[0] = 0;
 
-    status = graph_add_file (cfg, file);
+    status = tri_add (l->titles, title);
     if (status != 0)
+      break;
+
+    l->insts_first[i] = insts_num;
+    insts_num += graph_num_instances (cfg);
+  }
+  l->insts_first[graphs_num] = insts_num;
+
+  if (status == 0)
+    status = tri_finish (l->titles);
+
+  if (status != 0)
+    gl_index_destroy (l);
+
+  return (status);
+} /* }}} int gl_index_create */
+
+static int gl_index_mark_graph (size_t doc, void *user_data) /* {{{ */
+{
+  gl_index_data_t *data = user_data;
+  size_t i;
+
+  for (i = data->l->insts_first[doc]; i < data->l->insts_first[doc + 1]; i++)
+    data->matches[i] = 1;
+
+  return (0);
+} /* }}} int gl_index_mark_graph */
+
+/* "index" is the position of the instance within its graph, which starts at
+ * "data->index". */
+static int gl_index_mark_inst (size_t index, void *user_data) /* {{{ */
+{
+  gl_index_data_t *data = user_data;
+
+  data->matches[data->index + index] = 1;
+
+  return (0);
+} /* }}} int gl_index_mark_inst */
+
+/* Sets the flag of each instance whose description or whose graph's title
+ * contains "term". */
+static int gl_index_mark (gl_index_data_t *data, const char *term) /* {{{ */
+{
+  gl_list_t *l = data->l;
+  size_t graphs_num;
+  size_t i;
+  int status;
+
+  status = tri_search (l->titles, term, gl_index_mark_graph, data);
+
+  graphs_num = l->active_num + l->dynamic_num;
+  for (i = 0; (i < graphs_num) && (status == 0); i++)
+  {
+    data->index = l->insts_first[i];
+    status = graph_search_descriptions (gl_index_graph (l, i), term,
+        gl_index_mark_inst, data);
+  }
+
+  return (status);
+} /* }}} int gl_index_mark */
+
+static int gl_index_report (graph_instance_t *inst, /* {{{ */
+    void *user_data)
+{
+  gl_index_data_t *data = user_data;
+  size_t index;
+
+  index = data->index;
+  data->index++;
+
+  if ((index >= data->end) || !data->matches[index])
+    return (0);
+
+  if ((data->si != NULL) && !search_inst_matches_selector (data->si, inst))
+    return (0);
+
+  return ((*data->callback) (data->cfg, inst, data->user_data));
+} /* }}} int gl_index_report */
+
+/* Calls "callback" for each instance matching all "terms" and, if "si" is
+ * not NULL, its field selections, in the same order as scanning the graphs
+ * would. Like "search_graph_inst_matches", an instance matches a term if its
+ * description or its graph's title contains the term. Graphs contradicting
+ * "selector" are skipped. */
+static int gl_index_search (gl_list_t *l, /* {{{ */
+    char **terms, size_t terms_num,
+    search_info_t *si, const graph_ident_t *selector,
+    graph_inst_callback_t callback, void *user_data)
+{
+  gl_index_data_t data;
+  unsigned char *matches;
+  size_t graphs_num;
+  size_t insts_num;
+  size_t i;
+  int status;
+
+  graphs_num = l->active_num + l->dynamic_num;
+  insts_num = l->insts_first[graphs_num];
+  if ((terms_num < 1) || (insts_num < 1))
+    return (0);
+
+  /* Instances matching the current term and all previous ones. */
+  matches = calloc (2 * insts_num, sizeof (*matches));
+  if (matches == NULL)
+    return (ENOMEM);
+
+  memset (&data, 0, sizeof (data));
+  data.l = l;
+  data.matches = matches;
+  status = gl_index_mark (&data, terms[0]);
+
+  data.matches = matches + insts_num;
+  for (i = 1; (i < terms_num) && (status == 0); i++)
+  {
+    size_t j;
+
+    memset (data.matches, 0, insts_num * sizeof (*data.matches));
+    status = gl_index_mark (&data, terms[i]);
+
+    for (j = 0; j < insts_num; j++)
+      matches[j] &= data.matches[j];
+  }
+
+  data.matches = matches;
+  data.si = si;
+  data.callback = callback;
+  data.user_data = user_data;
+
+  for (i = 0; (i < graphs_num) && (status == 0); i++)
+  {
+    data.index = l->insts_first[i];
+    data.end = l->insts_first[i + 1];
+
+    if (memchr (matches + data.index, 1, data.end - data.index) == NULL)
+      continue;
+
+    data.cfg = gl_index_graph (l, i);
+    if ((selector != NULL) && !graph_ident_intersect (data.cfg, selector))
+      continue;
+
+    status = graph_inst_foreach (data.cfg, gl_index_report, &data);
+  }
+
+  free (matches);
+  return (status);
+} /* }}} int gl_index_search */
+/* }}} gl_index_* */
+
+static void gl_list_destroy (gl_list_t *l) /* {{{ */
+{
+  size_t i;
+
+  if (l == NULL)
+    return;
+
+  for (i = 0; i < l->active_num; i++)
+    graph_unref (l->active[i]);
+  free (l->active);
+
+  for (i = 0; i < l->dynamic_num; i++)
+    graph_unref (l->dynamic[i]);
+  free (l->dynamic);
+
+  for (i = 0; i < l->hosts_num; i++)
+    free (l->hosts[i].name);
+  free (l->hosts);
+
+  gl_index_destroy (l);
+
+  free (l);
+} /* }}} void gl_list_destroy */
+
+static int gl_list_publish_graphs (graph_config_t ***ret_array, /* {{{ */
+    size_t *ret_array_num, graph_config_t **array, size_t array_num)
+{
+  graph_config_t **copy;
+  size_t i;
+
+  if (array_num == 0)
+    return (0);
+
+  copy = calloc (array_num, sizeof (*copy));
+  if (copy == NULL)
+    return (ENOMEM);
+  *ret_array = copy;
+
+  for (i = 0; i < array_num; i++)
+  {
+    copy[i] = graph_publish (array[i]);
+    if (copy[i] == NULL)
+      return (ENOMEM);
+    (*ret_array_num)++;
+  }
+
+  return (0);
+} /* }}} int gl_list_publish_graphs */
+
+/* Copies the graphs and hosts maintained by "gl_update". Graphs that haven't
+ * changed since the previous list are shared with it. */
+static gl_list_t *gl_list_create (void) /* {{{ */
+{
+  gl_list_t *l;
+  size_t i;
+  int status;
+
+  l = calloc (1, sizeof (*l));
+  if (l == NULL)
+    return (NULL);
+
+  status = gl_list_publish_graphs (&l->active, &l->active_num,
+      gl_active, gl_active_num);
+  if (status == 0)
+    status = gl_list_publish_graphs (&l->dynamic, &l->dynamic_num,
+        gl_dynamic, gl_dynamic_num);
+
+  if ((status == 0) && (host_list_len > 0))
+  {
+    l->hosts = calloc (host_list_len, sizeof (*l->hosts));
+    if (l->hosts == NULL)
+      status = ENOMEM;
+
+    for (i = 0; (i < host_list_len) && (status == 0); i++)
     {
-      /* report error */;
+      l->hosts[i].name = strdup (host_list[i].name);
+      if (l->hosts[i].name == NULL)
+        status = ENOMEM;
+      else
+        l->hosts_num++;
+      l->hosts[i].files_num = host_list[i].files_num;
     }
-    else
+  }
+
+  if (status != 0)
+  {
+    gl_list_destroy (l);
+    return (NULL);
+  }
+
+  status = gl_index_create (l);
+  if (status != 0)
+    fprintf (stderr, "gl_list_create: Building the search index failed "
+        "with status %i. Searches will scan all instances.\n", status);
+
+  /* The reference held by "gl_published". */
+  l->refcount = 1;
+  return (l);
+} /* }}} gl_list_t *gl_list_create */
+
+static void gl_list_unref (gl_list_t *l) /* {{{ */
+{
+  _Bool last;
+
+  if (l == NULL)
+    return;
+
+  pthread_mutex_lock (&gl_published_lock);
+  assert (l->refcount > 0);
+  l->refcount--;
+  last = (l->refcount == 0);
+  pthread_mutex_unlock (&gl_published_lock);
+
+  if (last)
+    gl_list_destroy (l);
+} /* }}} void gl_list_unref */
+
+/* Makes a copy of the current graphs and hosts visible to readers. Readers
+ * using the previous list continue to do so until they release it. */
+static int gl_publish (void) /* {{{ */
+{
+  gl_list_t *l;
+  gl_list_t *old;
+
+  l = gl_list_create ();
+  if (l == NULL)
+  {
+    fprintf (stderr, "gl_publish: Copying the graph list failed. "
+        "Keeping the previous list.\n");
+    return (ENOMEM);
+  }
+
+  pthread_mutex_lock (&gl_published_lock);
+  /* Start with the current time so that generations are not reused when the
+   * process is restarted. */
+  if (gl_generation == 0)
+    gl_generation = (uint64_t) time (NULL);
+  l->generation = ++gl_generation;
+  old = gl_published;
+  gl_published = l;
+  gl_data_time = gl_last_update;
+  pthread_mutex_unlock (&gl_published_lock);
+
+  gl_list_unref (old);
+
+  return (0);
+} /* }}} int gl_publish */
+
+/* Returns the list pinned by the calling thread, pinning the most recently
+ * published one if necessary. Returns NULL if no list has been published
+ * yet. */
+static gl_list_t *gl_current (void) /* {{{ */
+{
+  if (gl_reader != NULL)
+    return (gl_reader);
+
+  pthread_mutex_lock (&gl_published_lock);
+  gl_reader = gl_published;
+  if (gl_reader != NULL)
+    gl_reader->refcount++;
+  pthread_mutex_unlock (&gl_published_lock);
+
+  return (gl_reader);
+} /* }}} gl_list_t *gl_current */
+
+static int gl_compare_hosts (const void *v0, const void *v1) /* {{{ */
+{
+  return (strcmp (((const gl_host_t *) v0)->name,
+        ((const gl_host_t *) v1)->name));
+} /* }}} int gl_compare_hosts */
+
+struct gl_register_file_data_s /* {{{ */
+{
+  const graph_ident_t *file;
+  int num_graphs;
+}; /* }}} struct gl_register_file_data_s */
+typedef struct gl_register_file_data_s gl_register_file_data_t;
+
+static int gl_register_file_cb (graph_config_t *cfg, /* {{{ */
+    void *user_data)
+{
+  gl_register_file_data_t *data = user_data;
+  int status;
+
+  status = graph_add_file (cfg, data->file);
+  if (status != 0)
+  {
+    /* report error */;
+  }
+  else
+  {
+    data->num_graphs++;
+  }
+
+  return (0);
+} /* }}} int gl_register_file_cb */
+
+static int gl_register_file (const graph_ident_t *file, /* {{{ */
+    __attribute__((unused)) void *user_data)
+{
+  gl_register_file_data_t data = { file, 0 };
+  graph_config_t *cfg;
+  size_t i;
+
+  if (gl_classifier != NULL)
+  {
+    gc_foreach_match (gl_classifier, file, gl_register_file_cb, &data);
+  }
+  else
+  {
+    /* Fall back to checking each graph in turn, e.g. if building the
+     * classifier failed. */
+    for (i = 0; i < gl_active_num; i++)
     {
-      num_graphs++;
+      if (!graph_ident_matches (gl_active[i], file))
+        continue;
+
+      gl_register_file_cb (gl_active[i], &data);
     }
   }
 
-  if (num_graphs == 0)
+  if (data.num_graphs == 0)
   {
     cfg = graph_create (file);
     gl_add_graph_internal (cfg, &gl_dynamic, &gl_dynamic_num);
@@ -209,24 +730,104 @@ static int gl_register_file (const graph_ident_t *file, /* {{{ */
   return (0);
 } /* }}} int gl_register_file */
 
+static int gl_unregister_file_cb (graph_config_t *cfg, /* {{{ */
+    void *user_data)
+{
+  gl_register_file_data_t *data = user_data;
+
+  if (graph_remove_file (cfg, data->file) == 0)
+    data->num_graphs++;
+
+  return (0);
+} /* }}} int gl_unregister_file_cb */
+
+static int gl_unregister_file (const graph_ident_t *file) /* {{{ */
+{
+  gl_register_file_data_t data = { file, 0 };
+  size_t i;
+
+  if (gl_classifier != NULL)
+  {
+    gc_foreach_match (gl_classifier, file, gl_unregister_file_cb, &data);
+  }
+  else
+  {
+    for (i = 0; i < gl_active_num; i++)
+    {
+      if (!graph_ident_matches (gl_active[i], file))
+        continue;
+
+      gl_unregister_file_cb (gl_active[i], &data);
+    }
+  }
+
+  /* Files not matching any configured graph have a dynamic graph of their
+   * own. */
+  if (data.num_graphs == 0)
+  {
+    for (i = 0; i < gl_dynamic_num; i++)
+    {
+      if (graph_compare (gl_dynamic[i], file) != 0)
+        continue;
+
+      graph_remove_file (gl_dynamic[i], file);
+      if (graph_num_instances (gl_dynamic[i]) == 0)
+      {
+        graph_destroy (gl_dynamic[i]);
+        memmove (gl_dynamic + i, gl_dynamic + i + 1,
+            sizeof (*gl_dynamic) * (gl_dynamic_num - (i + 1)));
+        gl_dynamic_num--;
+      }
+      break;
+    }
+  }
+
+  gl_unregister_host (ident_get_host (file));
+
+  return (0);
+} /* }}} int gl_unregister_file */
+
+struct gl_delta_stats_s /* {{{ */
+{
+  size_t added;
+  size_t removed;
+}; /* }}} struct gl_delta_stats_s */
+typedef struct gl_delta_stats_s gl_delta_stats_t;
+
+static int gl_register_delta (graph_ident_t *ident, /* {{{ */
+    dp_ident_change_t change, void *user_data)
+{
+  gl_delta_stats_t *stats = user_data;
+
+  if (change == DP_IDENT_ADDED)
+  {
+    stats->added++;
+    return (gl_register_file (ident, /* user data = */ NULL));
+  }
+
+  stats->removed++;
+  return (gl_unregister_file (ident));
+} /* }}} int gl_register_delta */
+
 static int gl_register_ident (graph_ident_t *ident, /* {{{ */
     __attribute__((unused)) void *user_data)
 {
-  /* TODO: Check for duplicates if multiple data providers are used. */
-
+  /* Duplicates reported by multiple data providers have been removed by
+   * "data_provider_get_idents". */
   return (gl_register_file (ident, user_data));
 } /* }}} int gl_register_ident */
 
-static const char *get_part_from_param (const char *prim_key, /* {{{ */
-    const char *sec_key)
+/* Reads the parameter from "pl" or, if that is NULL, from the request. */
+static const char *get_part_from_param (param_list_t *pl, /* {{{ */
+    const char *prim_key, const char *sec_key)
 {
   const char *val;
 
-  val = param (prim_key);
+  val = (pl != NULL) ? param_get (pl, prim_key) : param (prim_key);
   if (val != NULL)
     return (val);
   
-  return (param (sec_key));
+  return ((pl != NULL) ? param_get (pl, sec_key) : param (sec_key));
 } /* }}} const char *get_part_from_param */
 
 static int gl_clear_instances (void) /* {{{ */
@@ -239,57 +840,37 @@ static int gl_clear_instances (void) /* {{{ */
   return (0);
 } /* }}} int gl_clear_instances */
 
-static void gl_dump_cb (void *ctx, /* {{{ */
-    const char *str, unsigned int len)
+static int gl_dump_cb (void *user_data, /* {{{ */
+    const char *buffer, size_t buffer_size)
 {
-  int fd = *((int *) ctx);
-  const char *buffer;
-  size_t buffer_size;
+  int fd = *((int *) user_data);
   ssize_t status;
 
-  buffer = str;
-  buffer_size = (size_t) len;
   while (buffer_size > 0)
   {
     status = write (fd, buffer, buffer_size);
     if (status < 0)
     {
-      fprintf (stderr, "write(2) failed with status %i\n", errno);
-      return;
+      status = errno;
+      fprintf (stderr, "write(2) failed with status %i\n", (int) status);
+      return ((int) status);
     }
 
     buffer += status;
     buffer_size -= status;
   }
-} /* }}} void gl_dump_cb */
 
-static int gl_update_cache (void) /* {{{ */
+  return (0);
+} /* }}} int gl_dump_cb */
+
+static int gl_update_cache_json (const char *cache_file) /* {{{ */
 {
   int fd;
-  yajl_gen handler;
-  yajl_gen_config handler_config = { /* pretty = */ 1, /* indent = */ "  " };
-  const char *cache_file = graph_config_get_cache_file ();
+  json_writer_t *handler;
   struct flock lock;
-  struct stat statbuf;
   int status;
   size_t i;
 
-  memset (&statbuf, 0, sizeof (statbuf));
-  status = stat (cache_file, &statbuf);
-  if (status == 0)
-  {
-    if (statbuf.st_mtime >= gl_last_update)
-      /* Not writing to cache because it's at least as new as our internal data */
-      return (0);
-  }
-  else
-  {
-    status = errno;
-    fprintf (stderr, "gl_update_cache: stat(2) failed with status %i\n",
-        status);
-    /* Continue writing the file if possible. */
-  }
-
   fd = open (cache_file, O_WRONLY | O_TRUNC | O_CREAT,
       S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
   if (fd < 0)
@@ -320,8 +901,8 @@ static int gl_update_cache (void) /* {{{ */
     return (errno);
   }
 
-  handler = yajl_gen_alloc2 (gl_dump_cb, &handler_config,
-      /* alloc funcs = */ NULL, /* ctx = */ &fd);
+  handler = json_writer_create (gl_dump_cb, /* user_data = */ &fd,
+      JSON_WRITER_PRETTY);
   if (handler == NULL)
   {
     close (fd);
@@ -331,7 +912,7 @@ static int gl_update_cache (void) /* {{{ */
   fprintf (stderr, "gl_update_cache: Start writing data\n");
   fflush (stderr);
 
-  yajl_gen_array_open (handler);
+  json_array_open (handler);
 
   for (i = 0; i < gl_active_num; i++)
     graph_to_json (gl_active[i], handler);
@@ -339,15 +920,144 @@ static int gl_update_cache (void) /* {{{ */
   for (i = 0; i < gl_dynamic_num; i++)
     graph_to_json (gl_dynamic[i], handler);
 
-  yajl_gen_array_close (handler);
+  json_array_close (handler);
 
-  yajl_gen_free (handler);
+  json_writer_destroy (handler);
   close (fd);
 
   fprintf (stderr, "gl_update_cache: Finished writing data\n");
   fflush (stderr);
 
   return (0);
+} /* }}} int gl_update_cache_json */
+
+/* Writes the snapshot to a temporary file first and renames it into place, so
+ * readers always map a complete file and no locking is required. */
+static int gl_update_cache_binary (const char *cache_file) /* {{{ */
+{
+  char tmp_file[PATH_MAX];
+  snapshot_t *snap;
+  int fd;
+  int status;
+  size_t i;
+
+  status = snprintf (tmp_file, sizeof (tmp_file), "%s.tmp.%li",
+      cache_file, (long) getpid ());
+  if ((status < 0) || (((size_t) status) >= sizeof (tmp_file)))
+  {
+    fprintf (stderr, "gl_update_cache: The name of the temporary file is "
+        "too long.\n");
+    return (ENAMETOOLONG);
+  }
+
+  snap = snapshot_create ();
+  if (snap == NULL)
+    return (ENOMEM);
+
+  fprintf (stderr, "gl_update_cache: Start writing data\n");
+  fflush (stderr);
+
+  status = 0;
+  for (i = 0; (i < gl_active_num) && (status == 0); i++)
+    status = snapshot_add_graph (snap, gl_active[i]);
+
+  for (i = 0; (i < gl_dynamic_num) && (status == 0); i++)
+    status = snapshot_add_graph (snap, gl_dynamic[i]);
+
+  if (status != 0)
+  {
+    fprintf (stderr, "gl_update_cache: snapshot_add_graph failed with "
+        "status %i\n", status);
+    snapshot_destroy (snap);
+    return (status);
+  }
+
+  fd = open (tmp_file, O_WRONLY | O_TRUNC | O_CREAT,
+      S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH);
+  if (fd < 0)
+  {
+    status = errno;
+    fprintf (stderr, "gl_update_cache: open(2) failed with status %i\n",
+        status);
+    snapshot_destroy (snap);
+    return (status);
+  }
+
+  status = snapshot_write (snap, fd);
+  snapshot_destroy (snap);
+
+  if (status != 0)
+  {
+    fprintf (stderr, "gl_update_cache: snapshot_write failed with "
+        "status %i\n", status);
+    close (fd);
+    unlink (tmp_file);
+    return (status);
+  }
+
+  /* Otherwise a crash may leave an empty or partial file behind the new
+   * name. */
+  if (fsync (fd) != 0)
+  {
+    status = errno;
+    fprintf (stderr, "gl_update_cache: fsync(2) failed with status %i\n",
+        status);
+    close (fd);
+    unlink (tmp_file);
+    return (status);
+  }
+  close (fd);
+
+  status = rename (tmp_file, cache_file);
+  if (status != 0)
+  {
+    status = errno;
+    fprintf (stderr, "gl_update_cache: rename(2) failed with status %i\n",
+        status);
+    unlink (tmp_file);
+    return (status);
+  }
+
+  fprintf (stderr, "gl_update_cache: Finished writing data\n");
+  fflush (stderr);
+
+  return (0);
+} /* }}} int gl_update_cache_binary */
+
+static int gl_update_cache (void) /* {{{ */
+{
+  char cache_file[PATH_MAX];
+  struct stat statbuf;
+  int status;
+
+  status = graph_config_get_cache_file (cache_file, sizeof (cache_file));
+  if (status != 0)
+  {
+    fprintf (stderr, "gl_update_cache: The name of the cache file is too "
+        "long.\n");
+    return (status);
+  }
+
+  memset (&statbuf, 0, sizeof (statbuf));
+  status = stat (cache_file, &statbuf);
+  if (status == 0)
+  {
+    if (statbuf.st_mtime >= gl_last_update)
+      /* Not writing to cache because it's at least as new as our internal data */
+      return (0);
+  }
+  else
+  {
+    status = errno;
+    fprintf (stderr, "gl_update_cache: stat(2) failed with status %i\n",
+        status);
+    /* Continue writing the file if possible. */
+  }
+
+  if (graph_config_get_cache_format () == CACHE_FORMAT_JSON)
+    return (gl_update_cache_json (cache_file));
+  else
+    return (gl_update_cache_binary (cache_file));
 } /* }}} int gl_update_cache */
 
 /*
@@ -594,33 +1304,127 @@ static int gl_json_key (void *user_data, /* {{{ */
 
 yajl_callbacks gl_json_callbacks =
 {
-  /*        null = */ NULL,
-  /*     boolean = */ NULL,
-  /*     integer = */ NULL,
-  /*      double = */ NULL,
-  /*      number = */ NULL,
-  /*      string = */ gl_json_string,
-  /*   start_map = */ gl_json_start_map,
-  /*     map_key = */ gl_json_key,
-  /*     end_map = */ gl_json_end_map,
-  /* start_array = */ NULL,
-  /*   end_array = */ gl_json_end_array
-};
+  /*        null = */ NULL,
+  /*     boolean = */ NULL,
+  /*     integer = */ NULL,
+  /*      double = */ NULL,
+  /*      number = */ NULL,
+  /*      string = */ gl_json_string,
+  /*   start_map = */ gl_json_start_map,
+  /*     map_key = */ gl_json_key,
+  /*     end_map = */ gl_json_end_map,
+  /* start_array = */ NULL,
+  /*   end_array = */ gl_json_end_array
+};
+
+static int gl_read_cache_json (int fd) /* {{{ */
+{
+  yajl_handle handle;
+  gl_json_context_t context;
+  yajl_parser_config handle_config = { /* comments = */ 0, /* check UTF-8 */ 0 };
+  int status;
+
+  memset (&context, 0, sizeof (context));
+  context.state = CTX_GRAPH;
+  context.cfg = NULL;
+  context.inst = NULL;
+  context.ident = NULL;
+
+  handle = yajl_alloc (&gl_json_callbacks,
+      &handle_config,
+      /* alloc funcs = */ NULL,
+      &context);
+
+  while (42)
+  {
+    ssize_t rd_status;
+    char buffer[1024*1024];
+
+    rd_status = read (fd, buffer, sizeof (buffer));
+    if (rd_status < 0)
+    {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+
+      status = errno;
+      fprintf (stderr, "gl_read_cache: read(2) failed with status %i\n",
+          status);
+      yajl_free (handle);
+      return (status);
+    }
+    else if (rd_status == 0)
+    {
+      yajl_parse_complete (handle);
+      break;
+    }
+    else
+    {
+      yajl_parse (handle,
+          (unsigned char *) &buffer[0],
+          (unsigned int) rd_status);
+    }
+  }
+
+  yajl_free (handle);
+
+  return (0);
+} /* }}} int gl_read_cache_json */
+
+static graph_config_t *gl_read_cache_graph_cb ( /* {{{ */
+    const graph_ident_t *selector,
+    __attribute__((unused)) void *user_data)
+{
+  graph_config_t *cfg;
+  size_t i;
+
+  for (i = 0; i < gl_active_num; i++)
+    if (graph_compare (gl_active[i], selector) == 0)
+      return (gl_active[i]);
+
+  cfg = graph_create (selector);
+  if (cfg == NULL)
+    return (NULL);
+
+  if (gl_add_graph_internal (cfg, &gl_dynamic, &gl_dynamic_num) != 0)
+  {
+    graph_destroy (cfg);
+    return (NULL);
+  }
+
+  return (cfg);
+} /* }}} graph_config_t *gl_read_cache_graph_cb */
+
+static int gl_read_cache_binary (int fd) /* {{{ */
+{
+  int status;
+
+  status = snapshot_read (fd, gl_read_cache_graph_cb, /* user data = */ NULL);
+  if (status != 0)
+    fprintf (stderr, "gl_read_cache: snapshot_read failed with status %i\n",
+        status);
+
+  return (status);
+} /* }}} int gl_read_cache_binary */
 
 static int gl_read_cache (_Bool block) /* {{{ */
 {
-  yajl_handle handle;
-  gl_json_context_t context;
-  yajl_parser_config handle_config = { /* comments = */ 0, /* check UTF-8 */ 0 };
-
   int fd;
   int cmd;
   struct stat statbuf;
   struct flock lock;
   int status;
   time_t now;
+  char cache_file[PATH_MAX];
+
+  status = graph_config_get_cache_file (cache_file, sizeof (cache_file));
+  if (status != 0)
+  {
+    fprintf (stderr, "gl_read_cache: The name of the cache file is too "
+        "long.\n");
+    return (status);
+  }
 
-  fd = open (graph_config_get_cache_file (), O_RDONLY);
+  fd = open (cache_file, O_RDONLY);
   if (fd < 0)
   {
     fprintf (stderr, "gl_read_cache: open(2) failed with status %i\n", errno);
@@ -699,52 +1503,20 @@ static int gl_read_cache (_Bool block) /* {{{ */
     return (0);
   }
 
-  memset (&context, 0, sizeof (context));
-  context.state = CTX_GRAPH;
-  context.cfg = NULL;
-  context.inst = NULL;
-  context.ident = NULL;
-
-  handle = yajl_alloc (&gl_json_callbacks,
-      &handle_config,
-      /* alloc funcs = */ NULL,
-      &context);
-
   fprintf (stderr, "gl_read_cache: Start parsing data\n");
   fflush (stderr);
 
-  while (42)
-  {
-    ssize_t rd_status;
-    char buffer[1024*1024];
-
-    rd_status = read (fd, buffer, sizeof (buffer));
-    if (rd_status < 0)
-    {
-      if ((errno == EINTR) || (errno == EAGAIN))
-        continue;
+  if (graph_config_get_cache_format () == CACHE_FORMAT_JSON)
+    status = gl_read_cache_json (fd);
+  else
+    status = gl_read_cache_binary (fd);
 
-      status = errno;
-      fprintf (stderr, "gl_read_cache: read(2) failed with status %i\n",
-          status);
-      close (fd);
-      return (status);
-    }
-    else if (rd_status == 0)
-    {
-      yajl_parse_complete (handle);
-      break;
-    }
-    else
-    {
-      yajl_parse (handle,
-          (unsigned char *) &buffer[0],
-          (unsigned int) rd_status);
-    }
+  if (status != 0)
+  {
+    close (fd);
+    return (status);
   }
 
-  yajl_free (handle);
-
   gl_last_update = statbuf.st_mtime;
   close (fd);
 
@@ -776,6 +1548,15 @@ int gl_config_submit (void) /* {{{ */
   gl_staging = NULL;
   gl_staging_num = 0;
 
+  /* The instances belonged to the old graphs. */
+  gl_scan_valid = 0;
+
+  gc_destroy (gl_classifier);
+  gl_classifier = gc_create (gl_active, gl_active_num);
+  if (gl_classifier == NULL)
+    fprintf (stderr, "gl_config_submit: gc_create failed. "
+        "Falling back to linear search.\n");
+
   gl_destroy (&old, &old_num);
 
   return (0);
@@ -784,18 +1565,21 @@ int gl_config_submit (void) /* {{{ */
 int gl_graph_get_all (_Bool include_dynamic, /* {{{ */
     graph_callback_t callback, void *user_data)
 {
+  gl_list_t *l;
   size_t i;
 
   if (callback == NULL)
     return (EINVAL);
 
-  gl_update (/* request served = */ 0);
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
 
-  for (i = 0; i < gl_active_num; i++)
+  for (i = 0; i < l->active_num; i++)
   {
     int status;
 
-    status = (*callback) (gl_active[i], user_data);
+    status = (*callback) (l->active[i], user_data);
     if (status != 0)
       return (status);
   }
@@ -803,11 +1587,11 @@ int gl_graph_get_all (_Bool include_dynamic, /* {{{ */
   if (!include_dynamic)
     return (0);
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; i < l->dynamic_num; i++)
   {
     int status;
 
-    status = (*callback) (gl_dynamic[i], user_data);
+    status = (*callback) (l->dynamic[i], user_data);
     if (status != 0)
       return (status);
   }
@@ -817,12 +1601,18 @@ int gl_graph_get_all (_Bool include_dynamic, /* {{{ */
 
 graph_config_t *gl_graph_get_selected (void) /* {{{ */
 {
-  const char *host = get_part_from_param ("graph_host", "host");
-  const char *plugin = get_part_from_param ("graph_plugin", "plugin");
-  const char *plugin_instance = get_part_from_param ("graph_plugin_instance", "plugin_instance");
-  const char *type = get_part_from_param ("graph_type", "type");
-  const char *type_instance = get_part_from_param ("graph_type_instance", "type_instance");
+  return (gl_graph_get_selected_from (/* params = */ NULL));
+} /* }}} graph_config_t *gl_graph_get_selected */
+
+graph_config_t *gl_graph_get_selected_from (param_list_t *pl) /* {{{ */
+{
+  const char *host = get_part_from_param (pl, "graph_host", "host");
+  const char *plugin = get_part_from_param (pl, "graph_plugin", "plugin");
+  const char *plugin_instance = get_part_from_param (pl, "graph_plugin_instance", "plugin_instance");
+  const char *type = get_part_from_param (pl, "graph_type", "type");
+  const char *type_instance = get_part_from_param (pl, "graph_type_instance", "type_instance");
   graph_ident_t *ident;
+  gl_list_t *l;
   size_t i;
 
   if ((host == NULL)
@@ -830,31 +1620,34 @@ graph_config_t *gl_graph_get_selected (void) /* {{{ */
       || (type == NULL) || (type_instance == NULL))
     return (NULL);
 
-  ident = ident_create (host, plugin, plugin_instance, type, type_instance);
+  l = gl_current ();
+  if (l == NULL)
+    return (NULL);
 
-  gl_update (/* request served = */ 0);
+  ident = ident_create_query (host, plugin, plugin_instance,
+      type, type_instance);
 
-  for (i = 0; i < gl_active_num; i++)
+  for (i = 0; i < l->active_num; i++)
   {
-    if (graph_compare (gl_active[i], ident) != 0)
+    if (graph_compare (l->active[i], ident) != 0)
       continue;
 
     ident_destroy (ident);
-    return (gl_active[i]);
+    return (l->active[i]);
   }
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; i < l->dynamic_num; i++)
   {
-    if (graph_compare (gl_dynamic[i], ident) != 0)
+    if (graph_compare (l->dynamic[i], ident) != 0)
       continue;
 
     ident_destroy (ident);
-    return (gl_dynamic[i]);
+    return (l->dynamic[i]);
   }
 
   ident_destroy (ident);
   return (NULL);
-} /* }}} graph_config_t *gl_graph_get_selected */
+} /* }}} graph_config_t *gl_graph_get_selected_from */
 
 /* gl_instance_get_all, gl_graph_instance_get_all {{{ */
 struct gl_inst_callback_data /* {{{ */
@@ -891,24 +1684,27 @@ int gl_graph_instance_get_all (graph_config_t *cfg, /* {{{ */
 int gl_instance_get_all (graph_inst_callback_t callback, /* {{{ */
     void *user_data)
 {
+  gl_list_t *l;
   size_t i;
 
-  gl_update (/* request served = */ 0);
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
 
-  for (i = 0; i < gl_active_num; i++)
+  for (i = 0; i < l->active_num; i++)
   {
     int status;
 
-    status = gl_graph_instance_get_all (gl_active[i], callback, user_data);
+    status = gl_graph_instance_get_all (l->active[i], callback, user_data);
     if (status != 0)
       return (status);
   }
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; i < l->dynamic_num; i++)
   {
     int status;
 
-    status = gl_graph_instance_get_all (gl_dynamic[i], callback, user_data);
+    status = gl_graph_instance_get_all (l->dynamic[i], callback, user_data);
     if (status != 0)
       return (status);
   }
@@ -920,12 +1716,20 @@ int gl_instance_get_all (graph_inst_callback_t callback, /* {{{ */
 int gl_search (search_info_t *si, /* {{{ */
     graph_inst_callback_t callback, void *user_data)
 {
+  gl_list_t *l;
   size_t i;
   graph_ident_t *ident;
+  char **terms;
+  int terms_num;
+  int status;
 
   if ((si == NULL) || (callback == NULL))
     return (EINVAL);
 
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
+
   if (search_has_selector (si))
   {
     ident = search_to_ident (si);
@@ -940,58 +1744,71 @@ int gl_search (search_info_t *si, /* {{{ */
     ident = NULL;
   }
 
-  for (i = 0; i < gl_active_num; i++)
+  terms = search_get_terms (si, &terms_num);
+  if ((l->titles != NULL) && (terms_num > 0))
   {
-    int status;
+    status = gl_index_search (l, terms, (size_t) terms_num, si, ident,
+        callback, user_data);
+    ident_destroy (ident);
+    return (status);
+  }
 
-    if ((ident != NULL) && !graph_ident_intersect (gl_active[i], ident))
+  status = 0;
+  for (i = 0; (i < l->active_num) && (status == 0); i++)
+  {
+    if ((ident != NULL) && !graph_ident_intersect (l->active[i], ident))
       continue;
 
-    status = graph_search_inst (gl_active[i], si,
+    status = graph_search_inst (l->active[i], si,
         /* callback  = */ callback,
         /* user data = */ user_data);
-    if (status != 0)
-      return (status);
   }
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; (i < l->dynamic_num) && (status == 0); i++)
   {
-    int status;
-
-    if ((ident != NULL) && !graph_ident_intersect (gl_dynamic[i], ident))
+    if ((ident != NULL) && !graph_ident_intersect (l->dynamic[i], ident))
       continue;
 
-    status = graph_search_inst (gl_dynamic[i], si,
+    status = graph_search_inst (l->dynamic[i], si,
         /* callback  = */ callback,
         /* user data = */ user_data);
-    if (status != 0)
-      return (status);
   }
 
-  return (0);
+  ident_destroy (ident);
+  return (status);
 } /* }}} int gl_search */
 
 int gl_search_string (const char *term, graph_inst_callback_t callback, /* {{{ */
     void *user_data)
 {
+  gl_list_t *l;
   size_t i;
 
-  for (i = 0; i < gl_active_num; i++)
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
+
+  if (l->titles != NULL)
+    return (gl_index_search (l, (char **) &term, /* terms_num = */ 1,
+          /* search info = */ NULL, /* selector = */ NULL,
+          callback, user_data));
+
+  for (i = 0; i < l->active_num; i++)
   {
     int status;
 
-    status = graph_search_inst_string (gl_active[i], term,
+    status = graph_search_inst_string (l->active[i], term,
         /* callback  = */ callback,
         /* user data = */ user_data);
     if (status != 0)
       return (status);
   }
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; i < l->dynamic_num; i++)
   {
     int status;
 
-    status = graph_search_inst_string (gl_dynamic[i], term,
+    status = graph_search_inst_string (l->dynamic[i], term,
         /* callback  = */ callback,
         /* user data = */ user_data);
     if (status != 0)
@@ -1005,16 +1822,21 @@ int gl_search_field (graph_ident_field_t field, /* {{{ */
     const char *field_value,
     graph_inst_callback_t callback, void *user_data)
 {
+  gl_list_t *l;
   size_t i;
 
   if ((field_value == NULL) || (callback == NULL))
     return (EINVAL);
 
-  for (i = 0; i < gl_active_num; i++)
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
+
+  for (i = 0; i < l->active_num; i++)
   {
     int status;
 
-    status = graph_inst_search_field (gl_active[i],
+    status = graph_inst_search_field (l->active[i],
         field, field_value,
         /* callback  = */ callback,
         /* user data = */ user_data);
@@ -1022,11 +1844,11 @@ int gl_search_field (graph_ident_field_t field, /* {{{ */
       return (status);
   }
 
-  for (i = 0; i < gl_dynamic_num; i++)
+  for (i = 0; i < l->dynamic_num; i++)
   {
     int status;
 
-    status = graph_inst_search_field (gl_dynamic[i],
+    status = graph_inst_search_field (l->dynamic[i],
         field, field_value,
         /* callback  = */ callback,
         /* user data = */ user_data);
@@ -1040,12 +1862,17 @@ int gl_search_field (graph_ident_field_t field, /* {{{ */
 int gl_foreach_host (int (*callback) (const char *host, void *user_data), /* {{{ */
     void *user_data)
 {
+  gl_list_t *l;
   int status;
   size_t i;
 
-  for (i = 0; i < host_list_len; i++)
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
+
+  for (i = 0; i < l->hosts_num; i++)
   {
-    status = (*callback) (host_list[i], user_data);
+    status = (*callback) (l->hosts[i].name, user_data);
     if (status != 0)
       return (status);
   }
@@ -1053,11 +1880,152 @@ int gl_foreach_host (int (*callback) (const char *host, void *user_data), /* {{{
   return (0);
 } /* }}} int gl_foreach_host */
 
-int gl_update (_Bool request_served) /* {{{ */
+static void gl_sort (void) /* {{{ */
+{
+  size_t i;
+
+  if (host_list_len > 0)
+    qsort (host_list, host_list_len, sizeof (*host_list),
+        gl_compare_hosts);
+
+  for (i = 0; i < gl_active_num; i++)
+    graph_sort_instances (gl_active[i]);
+} /* }}} void gl_sort */
+
+/* Applies the changes the data provider has been notified about, e.g. by
+ * inotify(7). This is cheap if nothing happened. */
+static void gl_update_events (void) /* {{{ */
+{
+  gl_delta_stats_t stats = { 0, 0 };
+  int status;
+
+  if (!gl_scan_valid)
+    return;
+
+  status = data_provider_get_idents_events (gl_register_delta, &stats);
+  if (status == ENOTSUP)
+    return;
+  else if (status != 0)
+  {
+    fprintf (stderr, "gl_update: data_provider_get_idents_events failed "
+        "with status %i\n", status);
+    gl_scan_valid = 0;
+    return;
+  }
+
+  if ((stats.added == 0) && (stats.removed == 0))
+  {
+    /* All changes are reported as events, so the list is up to date. */
+    pthread_mutex_lock (&gl_published_lock);
+    gl_data_time = time (NULL);
+    pthread_mutex_unlock (&gl_published_lock);
+    return;
+  }
+
+  fprintf (stderr, "gl_update: Events: %lu files added, %lu files removed\n",
+      (unsigned long) stats.added, (unsigned long) stats.removed);
+  gl_sort ();
+  gl_publish ();
+
+  pthread_mutex_lock (&gl_published_lock);
+  gl_data_time = time (NULL);
+  pthread_mutex_unlock (&gl_published_lock);
+} /* }}} void gl_update_events */
+
+/* Rebuilds the list from the cache or the data provider. */
+static int gl_refresh (_Bool request_served, time_t now) /* {{{ */
+{
+  int status;
+
+  graph_read_config ();
+
+  /* Apply the changes since our last scan, instead of rebuilding all
+   * instances. */
+  if (gl_scan_valid)
+  {
+    gl_delta_stats_t stats = { 0, 0 };
+
+    status = data_provider_get_idents_delta (gl_register_delta, &stats);
+    if (status == 0)
+    {
+      fprintf (stderr, "gl_update: Incremental scan: %lu files added, "
+          "%lu files removed\n", (unsigned long) stats.added,
+          (unsigned long) stats.removed);
+      gl_last_update = now;
+    }
+    else
+    {
+      if (status != ENOTSUP)
+        fprintf (stderr, "gl_update: data_provider_get_idents_delta failed "
+            "with status %i. Rescanning everything.\n", status);
+      gl_scan_valid = 0;
+    }
+  }
+
+  if (!gl_scan_valid)
+  {
+    /* Clear state */
+    gl_clear_instances ();
+    gl_clear_hosts ();
+    gl_destroy (&gl_dynamic, &gl_dynamic_num);
+
+    status = gl_read_cache (/* block = */ 1);
+    /* We have *something* to work with. Even if it's outdated, just get on
+     * with handling the request and take care of re-reading data later on. */
+    if ((status == 0) && !request_served)
+    {
+      gl_publish ();
+      return (0);
+    }
+
+    if ((status != 0)
+        || ((gl_last_update + UPDATE_INTERVAL) < now))
+    {
+      int scan_status;
+
+      /* Clear state */
+      gl_clear_instances ();
+      gl_clear_hosts ();
+      gl_destroy (&gl_dynamic, &gl_dynamic_num);
+
+      scan_status = data_provider_get_idents (gl_register_ident,
+          /* user data = */ NULL);
+      gl_scan_valid = (scan_status == 0);
+
+      gl_last_update = now;
+    }
+  }
+
+  gl_sort ();
+  gl_publish ();
+
+  if (request_served)
+    gl_update_cache ();
+
+  return (status);
+} /* }}} int gl_refresh */
+
+static double gl_elapsed (const struct timespec *begin) /* {{{ */
+{
+  struct timespec end;
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  return (((double) (end.tv_sec - begin->tv_sec))
+      + (((double) (end.tv_nsec - begin->tv_nsec)) / 1000000000.0));
+} /* }}} double gl_elapsed */
+
+static int gl_update_locked (_Bool request_served) /* {{{ */
 {
+  struct timespec begin;
+  double duration;
   time_t now;
   int status;
-  size_t i;
+
+  /* The refresh thread applies events every REFRESH_TICK seconds. Don't make
+   * requests wait for that. */
+  if (!request_served && !gl_refresh_running)
+    gl_update_events ();
 
   if (!request_served && (gl_last_update > 0))
     return (0);
@@ -1072,43 +2040,150 @@ int gl_update (_Bool request_served) /* {{{ */
     return (0);
   }
 
-  /* Clear state */
-  gl_clear_instances ();
-  gl_clear_hosts ();
-  gl_destroy (&gl_dynamic, &gl_dynamic_num);
+  clock_gettime (CLOCK_MONOTONIC, &begin);
+  status = gl_refresh (request_served, now);
+  duration = gl_elapsed (&begin);
 
-  graph_read_config ();
+  fprintf (stderr, "gl_update: Refresh took %.3f seconds\n", duration);
 
-  status = gl_read_cache (/* block = */ 1);
-  /* We have *something* to work with. Even if it's outdated, just get on with
-   * handling the request and take care of re-reading data later on. */
-  if ((status == 0) && !request_served)
-    return (0);
+  pthread_mutex_lock (&gl_published_lock);
+  gl_stats.refresh_num++;
+  gl_stats.refresh_duration_last = duration;
+  if (gl_stats.refresh_duration_max < duration)
+    gl_stats.refresh_duration_max = duration;
+  pthread_mutex_unlock (&gl_published_lock);
+
+  return (status);
+} /* }}} int gl_update_locked */
 
-  if ((status != 0)
-      || ((gl_last_update + UPDATE_INTERVAL) < now))
+static void *gl_refresh_main (__attribute__((unused)) void *arg) /* {{{ */
+{
+  pthread_mutex_lock (&gl_refresh_lock);
+  while (!gl_refresh_quit)
   {
-    /* Clear state */
-    gl_clear_instances ();
-    gl_clear_hosts ();
-    gl_destroy (&gl_dynamic, &gl_dynamic_num);
+    struct timespec deadline;
+
+    pthread_mutex_unlock (&gl_refresh_lock);
+
+    pthread_mutex_lock (&gl_update_lock);
+    gl_update_events ();
+    gl_update_locked (/* request_served = */ 1);
+    pthread_mutex_unlock (&gl_update_lock);
 
-    data_provider_get_idents (gl_register_ident, /* user data = */ NULL);
+    clock_gettime (CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += REFRESH_TICK;
 
-    gl_last_update = now;
+    pthread_mutex_lock (&gl_refresh_lock);
+    while (!gl_refresh_quit)
+      if (pthread_cond_timedwait (&gl_refresh_cond, &gl_refresh_lock,
+            &deadline) != 0)
+        break;
   }
+  pthread_mutex_unlock (&gl_refresh_lock);
 
-  if (host_list_len > 0)
-    qsort (host_list, host_list_len, sizeof (*host_list),
-        gl_compare_hosts);
+  return (NULL);
+} /* }}} void *gl_refresh_main */
 
-  for (i = 0; i < gl_active_num; i++)
-    graph_sort_instances (gl_active[i]);
+int gl_update (_Bool request_served) /* {{{ */
+{
+  int status;
 
-  if (request_served)
-    gl_update_cache ();
+  /* Refreshing is taken care of by the refresh thread. */
+  if (request_served && gl_refresh_running)
+    return (0);
+
+  if (pthread_mutex_trylock (&gl_update_lock) != 0)
+  {
+    gl_list_t *l;
+
+    /* Another thread is updating the list. Use the current list, unless
+     * there is none yet. */
+    pthread_mutex_lock (&gl_published_lock);
+    l = gl_published;
+    pthread_mutex_unlock (&gl_published_lock);
+
+    if (request_served || (l != NULL))
+      return (0);
+
+    pthread_mutex_lock (&gl_update_lock);
+  }
+
+  status = gl_update_locked (request_served);
+  pthread_mutex_unlock (&gl_update_lock);
 
   return (status);
 } /* }}} int gl_update */
 
+int gl_refresh_start (void) /* {{{ */
+{
+  int status;
+
+  if (gl_refresh_running)
+    return (0);
+
+  gl_refresh_quit = 0;
+  status = pthread_create (&gl_refresh_thread, /* attr = */ NULL,
+      gl_refresh_main, /* arg = */ NULL);
+  if (status != 0)
+  {
+    fprintf (stderr, "gl_refresh_start: pthread_create failed with "
+        "status %i\n", status);
+    return (status);
+  }
+
+  gl_refresh_running = 1;
+  return (0);
+} /* }}} int gl_refresh_start */
+
+void gl_refresh_stop (void) /* {{{ */
+{
+  if (!gl_refresh_running)
+    return;
+
+  pthread_mutex_lock (&gl_refresh_lock);
+  gl_refresh_quit = 1;
+  pthread_cond_signal (&gl_refresh_cond);
+  pthread_mutex_unlock (&gl_refresh_lock);
+
+  pthread_join (gl_refresh_thread, /* retval = */ NULL);
+  gl_refresh_running = 0;
+} /* }}} void gl_refresh_stop */
+
+uint64_t gl_get_generation (void) /* {{{ */
+{
+  gl_list_t *l;
+
+  l = gl_current ();
+  if (l == NULL)
+    return (0);
+
+  return (l->generation);
+} /* }}} uint64_t gl_get_generation */
+
+int gl_get_stats (gl_stats_t *ret_stats) /* {{{ */
+{
+  time_t now;
+
+  if (ret_stats == NULL)
+    return (EINVAL);
+
+  now = time (NULL);
+
+  pthread_mutex_lock (&gl_published_lock);
+  *ret_stats = gl_stats;
+  if (gl_published == NULL)
+    ret_stats->staleness = -1.0;
+  else
+    ret_stats->staleness = difftime (now, gl_data_time);
+  pthread_mutex_unlock (&gl_published_lock);
+
+  return (0);
+} /* }}} int gl_get_stats */
+
+void gl_release (void) /* {{{ */
+{
+  gl_list_unref (gl_reader);
+  gl_reader = NULL;
+} /* }}} void gl_release */
+
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -24,11 +24,28 @@
 #ifndef GRAPH_LIST_H
 #define GRAPH_LIST_H 1
 
+#include <stdint.h>
+
 #include "graph_types.h"
 #include "graph_ident.h"
+#include "utils_cgi.h"
 #include "utils_search.h"
 #include "data_provider.h"
 
+struct gl_stats_s
+{
+  /* Seconds since the data of the current list was last known to be up to
+   * date. Negative if there is no list yet. */
+  double staleness;
+
+  /* Number and duration of refreshes, i.e. reading the cache or scanning the
+   * data provider, in seconds. */
+  uint64_t refresh_num;
+  double refresh_duration_last;
+  double refresh_duration_max;
+};
+typedef struct gl_stats_s gl_stats_t;
+
 /*
  * Functions
  */
@@ -49,6 +66,9 @@ int gl_register_data_provider (const char *name, data_provider_t *p);
  */
 graph_config_t *gl_graph_get_selected (void);
 
+/* Like "gl_graph_get_selected", but evaluates the parameters in "pl". */
+graph_config_t *gl_graph_get_selected_from (param_list_t *pl);
+
 int gl_graph_get_all (_Bool include_dynamic,
     graph_callback_t callback, void *user_data);
 
@@ -69,7 +89,31 @@ int gl_search_field (graph_ident_field_t field, const char *field_value,
 int gl_foreach_host (int (*callback) (const char *host, void *user_data),
     void *user_data);
 
+/* Updates the graph list if necessary. Threads handling other requests
+ * continue to use the previous list in the meantime. */
 int gl_update (_Bool request_served);
 
+/* Starts a thread refreshing the graph list in the background and applying
+ * the events reported by the data provider. Once it is running, requests
+ * don't refresh the list themselves and continue to be served from the
+ * previous list while a refresh is in progress. The thread logs to stderr, so
+ * it must not be used together with "FCGI_Accept", which redirects stderr to
+ * the current request. */
+int gl_refresh_start (void);
+void gl_refresh_stop (void);
+
+int gl_get_stats (gl_stats_t *ret_stats);
+
+/* Returns a number identifying the graph list used by the calling thread.
+ * It changes whenever the list, or the graph configuration, is updated and
+ * can be used as an entity tag for responses derived from the list. Returns
+ * zero if there is no list yet. */
+uint64_t gl_get_generation (void);
+
+/* Releases the graph list used by the calling thread. Graphs and instances
+ * returned by the functions above may not be used afterwards. Must be called
+ * after handling each request. */
+void gl_release (void);
+
 #endif /* GRAPH_LIST_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,891 @@
+/**
+ * collection4 - graph_snapshot.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "graph_snapshot.h"
+#include "graph.h"
+#include "graph_ds.h"
+#include "graph_ident.h"
+#include "graph_instance.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+#define SNAPSHOT_MAGIC      "C4SNAPSH"
+#define SNAPSHOT_VERSION    2
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* Sections are aligned to this many bytes. */
+#define SNAPSHOT_ALIGN 8
+
+/*
+ * On-disk data structures
+ */
+struct snap_header_s /* {{{ */
+{
+  char     magic[8];
+  uint32_t version;
+  /* Written as SNAPSHOT_BYTE_ORDER in host byte order. Files written on a
+   * host with a different byte order are rejected. */
+  uint32_t byte_order;
+  uint64_t file_size;
+
+  uint32_t strings_num;
+  uint32_t idents_num;
+  uint32_t graphs_num;
+  uint32_t instances_num;
+  uint32_t files_num;
+  uint32_t ds_num;
+
+  /* uint32_t[strings_num]: offsets into the string data. */
+  uint64_t strings_offset;
+  /* Null-terminated strings. */
+  uint64_t string_data_offset;
+  uint64_t string_data_size;
+  /* snap_ident_t[idents_num] */
+  uint64_t idents_offset;
+  /* snap_graph_t[graphs_num] */
+  uint64_t graphs_offset;
+  /* snap_inst_t[instances_num] */
+  uint64_t instances_offset;
+  /* uint32_t[files_num]: indices into the ident table. */
+  uint64_t files_offset;
+  /* snap_ident_ds_t[idents_num]: data sources of each identifier. */
+  uint64_t ident_ds_offset;
+  /* snap_ds_t[ds_num] */
+  uint64_t ds_offset;
+}; /* }}} struct snap_header_s */
+typedef struct snap_header_s snap_header_t;
+
+struct snap_ident_s /* {{{ */
+{
+  /* Indices into the string table, in graph_ident_field_t order. */
+  uint32_t fields[_GIF_LAST];
+}; /* }}} struct snap_ident_s */
+typedef struct snap_ident_s snap_ident_t;
+
+/* Data sources of a file, see "graph_ds.h". Zero for identifiers that are
+ * not files or whose data sources are unknown. */
+struct snap_ident_ds_s /* {{{ */
+{
+  uint64_t size;
+  uint64_t inode;
+  uint32_t ds_first;
+  uint32_t ds_num;
+}; /* }}} struct snap_ident_ds_s */
+typedef struct snap_ident_ds_s snap_ident_ds_t;
+
+struct snap_ds_s /* {{{ */
+{
+  /* Indices into the string table. */
+  uint32_t name;
+  uint32_t type;
+}; /* }}} struct snap_ds_s */
+typedef struct snap_ds_s snap_ds_t;
+
+struct snap_graph_s /* {{{ */
+{
+  uint32_t select;
+  uint32_t instances_first;
+  uint32_t instances_num;
+}; /* }}} struct snap_graph_s */
+typedef struct snap_graph_s snap_graph_t;
+
+struct snap_inst_s /* {{{ */
+{
+  uint32_t select;
+  uint32_t files_first;
+  uint32_t files_num;
+}; /* }}} struct snap_inst_s */
+typedef struct snap_inst_s snap_inst_t;
+
+/*
+ * In-memory representation used while building a snapshot
+ */
+struct snapshot_s /* {{{ */
+{
+  /* Maps strings to (index + 1). The keys are the interned strings returned
+   * by "ident_get_field", which stay valid. */
+  c4_hash_t *strings_index;
+  uint32_t *strings;
+  size_t strings_num;
+  size_t strings_size;
+
+  char *string_data;
+  size_t string_data_num;
+  size_t string_data_size;
+
+  /* Maps file and instance identifiers to (index + 1). The keys belong to
+   * the graphs' instances, hence the graphs may not be modified while the
+   * snapshot is being built. */
+  c4_hash_t *idents_index;
+  snap_ident_t *idents;
+  size_t idents_num;
+  size_t idents_size;
+
+  /* Parallel to "idents". */
+  snap_ident_ds_t *ident_ds;
+  size_t ident_ds_size;
+
+  snap_ds_t *ds;
+  size_t ds_num;
+  size_t ds_size;
+
+  snap_graph_t *graphs;
+  size_t graphs_num;
+  size_t graphs_size;
+
+  snap_inst_t *instances;
+  size_t instances_num;
+  size_t instances_size;
+
+  uint32_t *files;
+  size_t files_num;
+  size_t files_size;
+}; /* }}} struct snapshot_s */
+
+/* Makes sure "array" has room for at least "want" elements, doubling its
+ * size as necessary. */
+#define SNAP_RESERVE(array, num, size, want) do {                           \
+  if ((want) > (size))                                                       \
+  {                                                                          \
+    size_t new_size = ((size) > 0) ? (2 * (size)) : 64;                      \
+    void *tmp;                                                               \
+    while (new_size < (want))                                                \
+      new_size *= 2;                                                         \
+    tmp = realloc ((array), new_size * sizeof (*(array)));                   \
+    if (tmp == NULL)                                                         \
+      return (ENOMEM);                                                       \
+    (array) = tmp;                                                           \
+    (size) = new_size;                                                       \
+  }                                                                          \
+} while (0)
+
+/*
+ * Private functions
+ */
+static int snap_add_string (snapshot_t *snap, const char *str, /* {{{ */
+    uint32_t *ret_index)
+{
+  uintptr_t index;
+  size_t len;
+  int status;
+
+  index = (uintptr_t) c4_hash_lookup (snap->strings_index, str);
+  if (index != 0)
+  {
+    *ret_index = (uint32_t) (index - 1);
+    return (0);
+  }
+
+  len = strlen (str) + 1;
+  if ((snap->strings_num >= UINT32_MAX)
+      || ((snap->string_data_num + len) > UINT32_MAX))
+    return (EOVERFLOW);
+
+  SNAP_RESERVE (snap->strings, snap->strings_num, snap->strings_size,
+      snap->strings_num + 1);
+  SNAP_RESERVE (snap->string_data, snap->string_data_num,
+      snap->string_data_size, snap->string_data_num + len);
+
+  status = c4_hash_insert (snap->strings_index, str,
+      (void *) (uintptr_t) (snap->strings_num + 1));
+  if (status != 0)
+    return (status);
+
+  memcpy (snap->string_data + snap->string_data_num, str, len);
+  snap->strings[snap->strings_num] = (uint32_t) snap->string_data_num;
+  snap->string_data_num += len;
+
+  *ret_index = (uint32_t) snap->strings_num;
+  snap->strings_num++;
+
+  return (0);
+} /* }}} int snap_add_string */
+
+/* Adds "ident" to the ident table. If "dedup" is true, "ident" is remembered
+ * and equal identifiers added later on reuse the entry. */
+static int snap_add_ident (snapshot_t *snap, /* {{{ */
+    const graph_ident_t *ident, _Bool dedup, uint32_t *ret_index)
+{
+  snap_ident_t *si;
+  uintptr_t index;
+  int status;
+  int i;
+
+  if (dedup)
+  {
+    index = (uintptr_t) c4_hash_lookup (snap->idents_index, ident);
+    if (index != 0)
+    {
+      *ret_index = (uint32_t) (index - 1);
+      return (0);
+    }
+  }
+
+  if (snap->idents_num >= UINT32_MAX)
+    return (EOVERFLOW);
+
+  SNAP_RESERVE (snap->idents, snap->idents_num, snap->idents_size,
+      snap->idents_num + 1);
+  SNAP_RESERVE (snap->ident_ds, snap->idents_num, snap->ident_ds_size,
+      snap->idents_num + 1);
+  si = snap->idents + snap->idents_num;
+  memset (snap->ident_ds + snap->idents_num, 0, sizeof (*snap->ident_ds));
+
+  for (i = 0; i < _GIF_LAST; i++)
+  {
+    const char *str = ident_get_field (ident, (graph_ident_field_t) i);
+
+    if (str == NULL)
+      return (EINVAL);
+
+    status = snap_add_string (snap, str, &si->fields[i]);
+    if (status != 0)
+      return (status);
+  }
+
+  if (dedup)
+  {
+    status = c4_hash_insert (snap->idents_index, ident,
+        (void *) (uintptr_t) (snap->idents_num + 1));
+    if (status != 0)
+      return (status);
+  }
+
+  *ret_index = (uint32_t) snap->idents_num;
+  snap->idents_num++;
+
+  return (0);
+} /* }}} int snap_add_ident */
+
+/* Adds the data sources of the file "index", if they are known. */
+static int snap_add_ds (snapshot_t *snap, /* {{{ */
+    const graph_ident_t *file, uint32_t index)
+{
+  snap_ident_ds_t *sid = snap->ident_ds + index;
+  atom_t *names = NULL;
+  atom_t *types = NULL;
+  size_t ds_num = 0;
+  size_t i;
+  int status;
+
+  status = gds_get (file, &sid->size, &sid->inode, &ds_num, &names, &types);
+  if (status == ENOENT)
+    return (0);
+  else if (status != 0)
+    return (status);
+
+#define BAIL_OUT(ret_status) do { \
+  free (names);                   \
+  free (types);                   \
+  return (ret_status);            \
+} while (0)
+
+  if ((snap->ds_num + ds_num) > UINT32_MAX)
+    BAIL_OUT (EOVERFLOW);
+
+  SNAP_RESERVE (snap->ds, snap->ds_num, snap->ds_size,
+      snap->ds_num + ds_num);
+
+  for (i = 0; i < ds_num; i++)
+  {
+    snap_ds_t *sd = snap->ds + snap->ds_num + i;
+
+    status = snap_add_string (snap, atom_get (names[i]), &sd->name);
+    if (status == 0)
+      status = snap_add_string (snap, atom_get (types[i]), &sd->type);
+    if (status != 0)
+      BAIL_OUT (status);
+  }
+
+  sid->ds_first = (uint32_t) snap->ds_num;
+  sid->ds_num = (uint32_t) ds_num;
+  snap->ds_num += ds_num;
+
+  BAIL_OUT (0);
+#undef BAIL_OUT
+} /* }}} int snap_add_ds */
+
+static int snap_add_file_cb (const graph_ident_t *file, /* {{{ */
+    void *user_data)
+{
+  snapshot_t *snap = user_data;
+  uint32_t index;
+  int status;
+
+  if (snap->files_num >= UINT32_MAX)
+    return (EOVERFLOW);
+
+  status = snap_add_ident (snap, file, /* dedup = */ 1, &index);
+  if (status != 0)
+    return (status);
+
+  /* The identifier may have been added before, e.g. as the selector of an
+   * instance or as a file of another graph. */
+  if ((snap->ident_ds[index].ds_num == 0)
+      && (snap->ident_ds[index].inode == 0))
+  {
+    status = snap_add_ds (snap, file, index);
+    if (status != 0)
+      return (status);
+  }
+
+  SNAP_RESERVE (snap->files, snap->files_num, snap->files_size,
+      snap->files_num + 1);
+  snap->files[snap->files_num] = index;
+  snap->files_num++;
+
+  return (0);
+} /* }}} int snap_add_file_cb */
+
+static int snap_add_inst_cb (graph_instance_t *inst, /* {{{ */
+    void *user_data)
+{
+  snapshot_t *snap = user_data;
+  snap_inst_t si;
+  int status;
+
+  if (snap->instances_num >= UINT32_MAX)
+    return (EOVERFLOW);
+
+  memset (&si, 0, sizeof (si));
+
+  status = snap_add_ident (snap, inst_peek_selector (inst),
+      /* dedup = */ 1, &si.select);
+  if (status != 0)
+    return (status);
+
+  si.files_first = (uint32_t) snap->files_num;
+
+  status = inst_file_foreach (inst, snap_add_file_cb, snap);
+  if (status != 0)
+    return (status);
+
+  si.files_num = (uint32_t) (snap->files_num - si.files_first);
+
+  SNAP_RESERVE (snap->instances, snap->instances_num, snap->instances_size,
+      snap->instances_num + 1);
+  snap->instances[snap->instances_num] = si;
+  snap->instances_num++;
+
+  return (0);
+} /* }}} int snap_add_inst_cb */
+
+static int snap_write_all (int fd, const void *buffer, /* {{{ */
+    size_t buffer_size)
+{
+  const char *ptr = buffer;
+
+  while (buffer_size > 0)
+  {
+    ssize_t status;
+
+    status = write (fd, ptr, buffer_size);
+    if (status < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return (errno);
+    }
+
+    ptr += status;
+    buffer_size -= (size_t) status;
+  }
+
+  return (0);
+} /* }}} int snap_write_all */
+
+/* Writes "size" bytes from "buffer" and pads the section to SNAPSHOT_ALIGN
+ * bytes. */
+static int snap_write_section (int fd, const void *buffer, /* {{{ */
+    size_t size)
+{
+  char padding[SNAPSHOT_ALIGN];
+  int status;
+
+  if (size > 0)
+  {
+    status = snap_write_all (fd, buffer, size);
+    if (status != 0)
+      return (status);
+  }
+
+  if ((size % SNAPSHOT_ALIGN) == 0)
+    return (0);
+
+  memset (padding, 0, sizeof (padding));
+  return (snap_write_all (fd, padding,
+        SNAPSHOT_ALIGN - (size % SNAPSHOT_ALIGN)));
+} /* }}} int snap_write_section */
+
+static uint64_t snap_align (uint64_t size) /* {{{ */
+{
+  return ((size + (SNAPSHOT_ALIGN - 1)) & ~((uint64_t) (SNAPSHOT_ALIGN - 1)));
+} /* }}} uint64_t snap_align */
+
+/* Returns true if the array of "num" elements of "size" bytes at "offset"
+ * lies within the file. */
+static _Bool snap_section_valid (const snap_header_t *hdr, /* {{{ */
+    uint64_t offset, uint64_t num, size_t size)
+{
+  if ((offset % SNAPSHOT_ALIGN) != 0)
+    return (0);
+
+  if (offset > hdr->file_size)
+    return (0);
+
+  if (num > ((hdr->file_size - offset) / size))
+    return (0);
+
+  return (1);
+} /* }}} _Bool snap_section_valid */
+
+static int snap_validate (const char *data, size_t data_size) /* {{{ */
+{
+  const snap_header_t *hdr = (const snap_header_t *) data;
+  const uint32_t *strings;
+  const char *string_data;
+  uint64_t i;
+
+  if (data_size < sizeof (*hdr))
+    return (EINVAL);
+
+  if ((memcmp (hdr->magic, SNAPSHOT_MAGIC, sizeof (hdr->magic)) != 0)
+      || (hdr->version != SNAPSHOT_VERSION)
+      || (hdr->byte_order != SNAPSHOT_BYTE_ORDER)
+      || (hdr->file_size != (uint64_t) data_size))
+    return (EINVAL);
+
+  if (!snap_section_valid (hdr, hdr->strings_offset,
+        hdr->strings_num, sizeof (uint32_t))
+      || !snap_section_valid (hdr, hdr->string_data_offset,
+        hdr->string_data_size, 1)
+      || !snap_section_valid (hdr, hdr->idents_offset,
+        hdr->idents_num, sizeof (snap_ident_t))
+      || !snap_section_valid (hdr, hdr->graphs_offset,
+        hdr->graphs_num, sizeof (snap_graph_t))
+      || !snap_section_valid (hdr, hdr->instances_offset,
+        hdr->instances_num, sizeof (snap_inst_t))
+      || !snap_section_valid (hdr, hdr->files_offset,
+        hdr->files_num, sizeof (uint32_t))
+      || !snap_section_valid (hdr, hdr->ident_ds_offset,
+        hdr->idents_num, sizeof (snap_ident_ds_t))
+      || !snap_section_valid (hdr, hdr->ds_offset,
+        hdr->ds_num, sizeof (snap_ds_t)))
+    return (EINVAL);
+
+  /* Every string must be terminated within the string data. Since the last
+   * byte is a null byte, it's sufficient to check the offsets. */
+  string_data = data + hdr->string_data_offset;
+  if ((hdr->string_data_size > 0)
+      && (string_data[hdr->string_data_size - 1] != 0))
+    return (EINVAL);
+
+  strings = (const uint32_t *) (data + hdr->strings_offset);
+  for (i = 0; i < hdr->strings_num; i++)
+    if (strings[i] >= hdr->string_data_size)
+      return (EINVAL);
+
+  return (0);
+} /* }}} int snap_validate */
+
+/* Stores the data sources of "file" with "gds_set". */
+static int snap_read_ds (const snap_header_t *hdr, /* {{{ */
+    const uint32_t *strings, const char *string_data,
+    const snap_ds_t *ds, const graph_ident_t *file,
+    const snap_ident_ds_t *sid)
+{
+  char **names;
+  char **types;
+  uint32_t i;
+  int status;
+
+  if ((sid->ds_first > hdr->ds_num)
+      || (sid->ds_num > (hdr->ds_num - sid->ds_first)))
+    return (EINVAL);
+
+  names = calloc (sid->ds_num, sizeof (*names));
+  types = calloc (sid->ds_num, sizeof (*types));
+  if ((names == NULL) || (types == NULL))
+  {
+    free (names);
+    free (types);
+    return (ENOMEM);
+  }
+
+  status = 0;
+  for (i = 0; i < sid->ds_num; i++)
+  {
+    const snap_ds_t *sd = ds + sid->ds_first + i;
+
+    if ((sd->name >= hdr->strings_num) || (sd->type >= hdr->strings_num))
+    {
+      status = EINVAL;
+      break;
+    }
+
+    /* "gds_set" copies the strings, so pointing into the mapping is fine. */
+    names[i] = (char *) (string_data + strings[sd->name]);
+    types[i] = (char *) (string_data + strings[sd->type]);
+  }
+
+  if (status == 0)
+    status = gds_set (file, sid->size, sid->inode,
+        (size_t) sid->ds_num, names, types);
+
+  free (names);
+  free (types);
+
+  return (status);
+} /* }}} int snap_read_ds */
+
+/*
+ * Public functions
+ */
+snapshot_t *snapshot_create (void) /* {{{ */
+{
+  snapshot_t *snap;
+
+  snap = malloc (sizeof (*snap));
+  if (snap == NULL)
+    return (NULL);
+  memset (snap, 0, sizeof (*snap));
+
+  snap->strings_index = c4_hash_create (c4_hash_string,
+      c4_hash_compare_string);
+  snap->idents_index = c4_hash_create (ident_hash, ident_compare_void);
+  if ((snap->strings_index == NULL) || (snap->idents_index == NULL))
+  {
+    snapshot_destroy (snap);
+    return (NULL);
+  }
+
+  return (snap);
+} /* }}} snapshot_t *snapshot_create */
+
+void snapshot_destroy (snapshot_t *snap) /* {{{ */
+{
+  if (snap == NULL)
+    return;
+
+  c4_hash_destroy (snap->strings_index);
+  c4_hash_destroy (snap->idents_index);
+
+  free (snap->strings);
+  free (snap->string_data);
+  free (snap->idents);
+  free (snap->ident_ds);
+  free (snap->ds);
+  free (snap->graphs);
+  free (snap->instances);
+  free (snap->files);
+
+  free (snap);
+} /* }}} void snapshot_destroy */
+
+int snapshot_add_graph (snapshot_t *snap, graph_config_t *cfg) /* {{{ */
+{
+  graph_ident_t *selector;
+  snap_graph_t sg;
+  int status;
+
+  if ((snap == NULL) || (cfg == NULL))
+    return (EINVAL);
+
+  if (snap->graphs_num >= UINT32_MAX)
+    return (EOVERFLOW);
+
+  memset (&sg, 0, sizeof (sg));
+
+  selector = graph_get_selector (cfg);
+  if (selector == NULL)
+    return (ENOMEM);
+
+  /* "selector" is a temporary copy, so it must not end up in the index. */
+  status = snap_add_ident (snap, selector, /* dedup = */ 0, &sg.select);
+  ident_destroy (selector);
+  if (status != 0)
+    return (status);
+
+  sg.instances_first = (uint32_t) snap->instances_num;
+
+  status = graph_inst_foreach (cfg, snap_add_inst_cb, snap);
+  if (status != 0)
+    return (status);
+
+  sg.instances_num = (uint32_t) (snap->instances_num - sg.instances_first);
+
+  SNAP_RESERVE (snap->graphs, snap->graphs_num, snap->graphs_size,
+      snap->graphs_num + 1);
+  snap->graphs[snap->graphs_num] = sg;
+  snap->graphs_num++;
+
+  return (0);
+} /* }}} int snapshot_add_graph */
+
+int snapshot_write (snapshot_t *snap, int fd) /* {{{ */
+{
+  snap_header_t hdr;
+  uint64_t offset;
+  int status;
+
+  if (snap == NULL)
+    return (EINVAL);
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, SNAPSHOT_MAGIC, sizeof (hdr.magic));
+  hdr.version = SNAPSHOT_VERSION;
+  hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+
+  hdr.strings_num = (uint32_t) snap->strings_num;
+  hdr.idents_num = (uint32_t) snap->idents_num;
+  hdr.graphs_num = (uint32_t) snap->graphs_num;
+  hdr.instances_num = (uint32_t) snap->instances_num;
+  hdr.files_num = (uint32_t) snap->files_num;
+  hdr.ds_num = (uint32_t) snap->ds_num;
+
+  offset = snap_align (sizeof (hdr));
+
+  hdr.strings_offset = offset;
+  offset = snap_align (offset + (snap->strings_num * sizeof (uint32_t)));
+
+  hdr.string_data_offset = offset;
+  hdr.string_data_size = snap->string_data_num;
+  offset = snap_align (offset + snap->string_data_num);
+
+  hdr.idents_offset = offset;
+  offset = snap_align (offset + (snap->idents_num * sizeof (snap_ident_t)));
+
+  hdr.graphs_offset = offset;
+  offset = snap_align (offset + (snap->graphs_num * sizeof (snap_graph_t)));
+
+  hdr.instances_offset = offset;
+  offset = snap_align (offset + (snap->instances_num * sizeof (snap_inst_t)));
+
+  hdr.files_offset = offset;
+  offset = snap_align (offset + (snap->files_num * sizeof (uint32_t)));
+
+  hdr.ident_ds_offset = offset;
+  offset = snap_align (offset
+      + (snap->idents_num * sizeof (snap_ident_ds_t)));
+
+  hdr.ds_offset = offset;
+  offset = snap_align (offset + (snap->ds_num * sizeof (snap_ds_t)));
+
+  hdr.file_size = offset;
+
+#define WRITE_SECTION(ptr, size) do {                \
+  status = snap_write_section (fd, (ptr), (size));   \
+  if (status != 0)                                   \
+    return (status);                                 \
+} while (0)
+
+  WRITE_SECTION (&hdr, sizeof (hdr));
+  WRITE_SECTION (snap->strings, snap->strings_num * sizeof (uint32_t));
+  WRITE_SECTION (snap->string_data, snap->string_data_num);
+  WRITE_SECTION (snap->idents, snap->idents_num * sizeof (snap_ident_t));
+  WRITE_SECTION (snap->graphs, snap->graphs_num * sizeof (snap_graph_t));
+  WRITE_SECTION (snap->instances,
+      snap->instances_num * sizeof (snap_inst_t));
+  WRITE_SECTION (snap->files, snap->files_num * sizeof (uint32_t));
+  WRITE_SECTION (snap->ident_ds,
+      snap->idents_num * sizeof (snap_ident_ds_t));
+  WRITE_SECTION (snap->ds, snap->ds_num * sizeof (snap_ds_t));
+
+#undef WRITE_SECTION
+
+  return (0);
+} /* }}} int snapshot_write */
+
+int snapshot_read (int fd, snapshot_graph_callback_t callback, /* {{{ */
+    void *user_data)
+{
+  struct stat statbuf;
+  char *data;
+  size_t data_size;
+
+  const snap_header_t *hdr;
+  const uint32_t *strings;
+  const char *string_data;
+  const snap_ident_t *idents;
+  const snap_graph_t *graphs;
+  const snap_inst_t *instances;
+  const uint32_t *files;
+  const snap_ident_ds_t *ident_ds;
+  const snap_ds_t *ds;
+
+  graph_ident_t **ident_objs;
+  uint32_t i;
+  int status;
+
+  if (callback == NULL)
+    return (EINVAL);
+
+  memset (&statbuf, 0, sizeof (statbuf));
+  status = fstat (fd, &statbuf);
+  if (status != 0)
+    return (errno);
+
+  if (statbuf.st_size < (off_t) sizeof (snap_header_t))
+    return (EINVAL);
+  data_size = (size_t) statbuf.st_size;
+
+  data = mmap (/* addr = */ NULL, data_size, PROT_READ, MAP_PRIVATE,
+      fd, /* offset = */ 0);
+  if (data == MAP_FAILED)
+    return (errno);
+
+  status = snap_validate (data, data_size);
+  if (status != 0)
+  {
+    fprintf (stderr, "snapshot_read: Not a valid snapshot file.\n");
+    munmap (data, data_size);
+    return (status);
+  }
+
+  hdr = (const snap_header_t *) data;
+  strings = (const uint32_t *) (data + hdr->strings_offset);
+  string_data = data + hdr->string_data_offset;
+  idents = (const snap_ident_t *) (data + hdr->idents_offset);
+  graphs = (const snap_graph_t *) (data + hdr->graphs_offset);
+  instances = (const snap_inst_t *) (data + hdr->instances_offset);
+  files = (const uint32_t *) (data + hdr->files_offset);
+  ident_ds = (const snap_ident_ds_t *) (data + hdr->ident_ds_offset);
+  ds = (const snap_ds_t *) (data + hdr->ds_offset);
+
+  ident_objs = calloc ((size_t) hdr->idents_num + 1, sizeof (*ident_objs));
+  if (ident_objs == NULL)
+  {
+    munmap (data, data_size);
+    return (ENOMEM);
+  }
+
+#define BAIL_OUT(ret_status) do {                    \
+  for (i = 0; i < hdr->idents_num; i++)              \
+    ident_destroy (ident_objs[i]);                   \
+  free (ident_objs);                                 \
+  munmap (data, data_size);                          \
+  return (ret_status);                               \
+} while (0)
+
+  /* Create each identifier once. Instances copy the files they are given. */
+  for (i = 0; i < hdr->idents_num; i++)
+  {
+    const char *fields[_GIF_LAST];
+    int j;
+
+    for (j = 0; j < _GIF_LAST; j++)
+    {
+      if (idents[i].fields[j] >= hdr->strings_num)
+        BAIL_OUT (EINVAL);
+      fields[j] = string_data + strings[idents[i].fields[j]];
+    }
+
+    ident_objs[i] = ident_create (fields[GIF_HOST],
+        fields[GIF_PLUGIN], fields[GIF_PLUGIN_INSTANCE],
+        fields[GIF_TYPE], fields[GIF_TYPE_INSTANCE]);
+    if (ident_objs[i] == NULL)
+      BAIL_OUT (ENOMEM);
+
+    if (ident_ds[i].ds_num > 0)
+    {
+      status = snap_read_ds (hdr, strings, string_data, ds,
+          ident_objs[i], ident_ds + i);
+      if (status != 0)
+        BAIL_OUT (status);
+    }
+  }
+
+  for (i = 0; i < hdr->graphs_num; i++)
+  {
+    const snap_graph_t *sg = graphs + i;
+    graph_config_t *cfg;
+    uint32_t j;
+
+    if ((sg->select >= hdr->idents_num)
+        || (sg->instances_first > hdr->instances_num)
+        || (sg->instances_num > (hdr->instances_num - sg->instances_first)))
+      BAIL_OUT (EINVAL);
+
+    cfg = (*callback) (ident_objs[sg->select], user_data);
+    if (cfg == NULL)
+      continue;
+
+    for (j = sg->instances_first;
+        j < (sg->instances_first + sg->instances_num);
+        j++)
+    {
+      const snap_inst_t *si = instances + j;
+      graph_instance_t *inst;
+      uint32_t k;
+
+      if ((si->select >= hdr->idents_num)
+          || (si->files_first > hdr->files_num)
+          || (si->files_num > (hdr->files_num - si->files_first)))
+        BAIL_OUT (EINVAL);
+
+      inst = inst_create (cfg, ident_objs[si->select]);
+      if (inst == NULL)
+        BAIL_OUT (ENOMEM);
+
+      for (k = si->files_first; k < (si->files_first + si->files_num); k++)
+      {
+        if (files[k] >= hdr->idents_num)
+        {
+          inst_destroy (inst);
+          BAIL_OUT (EINVAL);
+        }
+
+        status = inst_add_file (inst, ident_objs[files[k]]);
+        if (status != 0)
+        {
+          inst_destroy (inst);
+          BAIL_OUT (status);
+        }
+      }
+
+      status = graph_add_inst (cfg, inst);
+      if (status != 0)
+      {
+        inst_destroy (inst);
+        BAIL_OUT (status);
+      }
+    }
+  }
+
+  BAIL_OUT (0);
+#undef BAIL_OUT
+} /* }}} int snapshot_read */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,66 @@
+/**
+ * collection4 - graph_snapshot.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef GRAPH_SNAPSHOT_H
+#define GRAPH_SNAPSHOT_H 1
+
+#include "graph_types.h"
+
+/*
+ * Binary snapshot of the graph list, used as cache file.
+ *
+ * The file consists of a fixed header followed by flat arrays: a string
+ * table, an identifier table referencing the strings by index, and the graph,
+ * instance and file tables referencing identifiers and ranges of the
+ * following table by index. The data sources of each file, see
+ * "graph_ds.h", are stored in two more tables. All references are indices or offsets relative to
+ * the beginning of the file, so the file can be mapped into memory at any
+ * address and read in place, without parsing.
+ */
+
+struct snapshot_s;
+typedef struct snapshot_s snapshot_t;
+
+snapshot_t *snapshot_create (void);
+void snapshot_destroy (snapshot_t *snap);
+
+/* Adds the graph with all its instances and files to the snapshot. The graph
+ * and its instances must not be modified until the snapshot has been
+ * written. */
+int snapshot_add_graph (snapshot_t *snap, graph_config_t *cfg);
+
+int snapshot_write (snapshot_t *snap, int fd);
+
+/* Called by "snapshot_read" for each graph in the snapshot. Returns the graph
+ * the instances should be added to, or NULL to skip the graph. */
+typedef graph_config_t *(*snapshot_graph_callback_t) (
+    const graph_ident_t *selector, void *user_data);
+
+/* Maps the snapshot in "fd" into memory and adds the instances and files it
+ * contains to the graphs returned by "callback". Returns an error if the file
+ * is not a valid snapshot. */
+int snapshot_read (int fd, snapshot_graph_callback_t callback,
+    void *user_data);
+
+#endif /* GRAPH_SNAPSHOT_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
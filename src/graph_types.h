@@ -54,5 +54,8 @@ typedef int (*def_callback_t) (graph_def_t *def,
 typedef int (*inst_callback_t) (graph_instance_t *inst,
 		void *user_data);
 
+typedef int (*ident_callback_t) (const graph_ident_t *ident,
+    void *user_data);
+
 #endif /* GRAPH_TYPES_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <strings.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -33,6 +34,7 @@
 #include <dirent.h>
 
 #include "common.h"
+#include "graph_config.h"
 #include "graph_list.h"
 #include "utils_cgi.h"
 
@@ -43,6 +45,7 @@
 #include "action_list_graphs_json.h"
 #include "action_list_hosts.h"
 #include "action_list_hosts_json.h"
+#include "action_metrics.h"
 #include "action_search.h"
 #include "action_search_json.h"
 #include "action_show_graph.h"
@@ -67,11 +70,13 @@ static const action_t actions[] =
 {
   { "graph",       action_graph },
   { "instance_data_json", action_instance_data_json },
+  { "instances_data_json", action_instances_data_json },
   { "graph_def_json", action_graph_def_json },
   { "list_graphs", action_list_graphs },
   { "list_graphs_json", action_list_graphs_json },
   { "list_hosts",  action_list_hosts },
   { "list_hosts_json",  action_list_hosts_json },
+  { "metrics",     action_metrics },
   { "search",      action_search },
   { "search_json", action_search_json },
   { "show_graph",  action_show_graph },
@@ -81,44 +86,51 @@ static const action_t actions[] =
 };
 static const size_t actions_num = sizeof (actions) / sizeof (actions[0]);
 
+/* Serializes FCGX_Accept_r(), which not all platforms allow to be called
+ * concurrently. */
+static pthread_mutex_t accept_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 static int action_usage (void) /* {{{ */
 {
   size_t i;
 
-  printf ("Content-Type: text/plain\n\n");
+  cgi_printf ("Content-Type: text/plain\n\n");
 
-  printf ("Usage:\n"
+  cgi_printf ("Usage:\n"
       "\n"
       "  Available actions:\n"
       "\n");
 
   for (i = 0; i < actions_num; i++)
-    printf ("  * %s\n", actions[i].name);
+    cgi_printf ("  * %s\n", actions[i].name);
 
-  printf ("\n");
+  cgi_printf ("\n");
 
   return (0);
 } /* }}} int action_usage */
 
+/* Handles and finishes one request, including releasing the graph list and
+ * the parameters. */
 static int handle_request (void) /* {{{ */
 {
   const char *action;
+  int status;
 
   param_init ();
 
+  gl_update (/* request_served = */ 0);
+
   action = param ("action");
   if (action == NULL)
   {
-    return (action_list_graphs ());
+    status = action_list_graphs ();
   }
   else
   {
     size_t i;
-    int status = ENOENT;
-
-    gl_update (/* request_served = */ 0);
 
+    status = ENOENT;
     for (i = 0; i < actions_num; i++)
     {
       if (strcmp (action, actions[i].name) == 0)
@@ -130,27 +142,104 @@ static int handle_request (void) /* {{{ */
 
     if (i >= actions_num)
       status = action_usage ();
+  }
 
-    /* Call finish before updating the graph list, so clients don't wait for
-     * the update to finish. */
-    FCGI_Finish ();
+  /* Call finish before updating the graph list, so clients don't wait for
+   * the update to finish. */
+  cgi_request_finish ();
+  gl_release ();
+  param_finish ();
 
-    gl_update (/* request_served = */ 1);
+  gl_update (/* request_served = */ 1);
 
-    return (status);
-  }
+  return (status);
 } /* }}} int handle_request */
 
 static int run (void) /* {{{ */
 {
   while (FCGI_Accept() >= 0)
+    handle_request ();
+
+  return (0);
+} /* }}} int run */
+
+static void *worker_thread (__attribute__((unused)) void *arg) /* {{{ */
+{
+  FCGX_Request request;
+  int status;
+
+  status = FCGX_InitRequest (&request, /* sock = */ 0, /* flags = */ 0);
+  if (status != 0)
+  {
+    fprintf (stderr, "worker_thread: FCGX_InitRequest failed with "
+        "status %i\n", status);
+    return (NULL);
+  }
+
+  cgi_request_set (&request);
+
+  while (42)
   {
+    pthread_mutex_lock (&accept_lock);
+    status = FCGX_Accept_r (&request);
+    pthread_mutex_unlock (&accept_lock);
+
+    if (status < 0)
+      break;
+
     handle_request ();
-    param_finish ();
   }
 
+  cgi_request_set (NULL);
+  return (NULL);
+} /* }}} void *worker_thread */
+
+/* Handles requests with "threads_num" threads, each accepting requests on
+ * its own. The graph list is shared by all threads. */
+static int run_threads (int threads_num) /* {{{ */
+{
+  pthread_t *threads;
+  int threads_started;
+  int i;
+
+  if (FCGX_Init () != 0)
+  {
+    fprintf (stderr, "run_threads: FCGX_Init failed.\n");
+    return (-1);
+  }
+
+  threads = calloc ((size_t) threads_num, sizeof (*threads));
+  if (threads == NULL)
+    return (ENOMEM);
+
+  threads_started = 0;
+  for (i = 0; i < threads_num; i++)
+  {
+    int status;
+
+    status = pthread_create (&threads[threads_started],
+        /* attr = */ NULL, worker_thread, /* arg = */ NULL);
+    if (status != 0)
+    {
+      fprintf (stderr, "run_threads: pthread_create failed with "
+          "status %i\n", status);
+      continue;
+    }
+    threads_started++;
+  }
+
+  if (threads_started == 0)
+  {
+    free (threads);
+    return (-1);
+  }
+
+  for (i = 0; i < threads_started; i++)
+    pthread_join (threads[i], /* retval = */ NULL);
+
+  free (threads);
   return (0);
-} /* }}} int run */
+} /* }}} int run_threads */
 
 int main (int argc, char **argv) /* {{{ */
 {
@@ -160,9 +249,33 @@ int main (int argc, char **argv) /* {{{ */
   argv = NULL;
 
   if (FCGX_IsCGI ())
+  {
     status = handle_request ();
+  }
   else
-    status = run ();
+  {
+    int threads_num;
+
+    /* The number of threads must be known before accepting requests. */
+    graph_read_config ();
+    threads_num = graph_config_get_worker_threads ();
+
+    if (threads_num > 1)
+    {
+      /* Keep refreshing the graph list in the background, so that no
+       * request has to wait for it. This is only safe with worker threads:
+       * "FCGI_Accept" binds stderr to the current request, which the
+       * refresh thread would then write to. Otherwise the list is refreshed
+       * after handling a request. */
+      gl_refresh_start ();
+      status = run_threads (threads_num);
+      gl_refresh_stop ();
+    }
+    else
+    {
+      status = run ();
+    }
+  }
 
   exit ((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 } /* }}} int main */
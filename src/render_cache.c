@@ -0,0 +1,288 @@
+/**
+ * collection4 - render_cache.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "render_cache.h"
+#include "graph_config.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+struct rc_entry_s;
+typedef struct rc_entry_s rc_entry_t;
+
+struct rc_entry_s /* {{{ */
+{
+  char *key;
+
+  void *data;
+  size_t size;
+
+  time_t mtime;
+  time_t valid_until;
+
+  /* Least recently used list. "rc_head" is the most recently used entry. */
+  rc_entry_t *prev;
+  rc_entry_t *next;
+}; /* }}} struct rc_entry_s */
+
+static pthread_mutex_t rc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static c4_hash_t *rc_index = NULL;
+static rc_entry_t *rc_head = NULL;
+static rc_entry_t *rc_tail = NULL;
+
+static rc_stats_t rc_stats;
+
+/*
+ * Private functions
+ */
+static void rc_unlink (rc_entry_t *e) /* {{{ */
+{
+  if (e->prev != NULL)
+    e->prev->next = e->next;
+  else
+    rc_head = e->next;
+
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  else
+    rc_tail = e->prev;
+
+  e->prev = NULL;
+  e->next = NULL;
+} /* }}} void rc_unlink */
+
+static void rc_link_head (rc_entry_t *e) /* {{{ */
+{
+  e->prev = NULL;
+  e->next = rc_head;
+  if (rc_head != NULL)
+    rc_head->prev = e;
+  rc_head = e;
+  if (rc_tail == NULL)
+    rc_tail = e;
+} /* }}} void rc_link_head */
+
+/* Removes "e" from the cache and frees it. */
+static void rc_remove (rc_entry_t *e) /* {{{ */
+{
+  c4_hash_remove (rc_index, e->key);
+  rc_unlink (e);
+
+  rc_stats.entries_num--;
+  rc_stats.size -= e->size;
+
+  free (e->key);
+  free (e->data);
+  free (e);
+} /* }}} void rc_remove */
+
+/* Evicts the least recently used entries until "size" more bytes fit into
+ * "size_max". */
+static void rc_make_room (size_t size, size_t size_max) /* {{{ */
+{
+  while ((rc_tail != NULL) && ((rc_stats.size + size) > size_max))
+  {
+    rc_remove (rc_tail);
+    rc_stats.evictions++;
+  }
+} /* }}} void rc_make_room */
+
+/*
+ * Public functions
+ */
+char *rc_key (int argc, char **argv) /* {{{ */
+{
+  char *key;
+  size_t key_len;
+  size_t offset;
+  int i;
+
+  if ((argc < 1) || (argv == NULL))
+    return (NULL);
+
+  key_len = 0;
+  for (i = 0; i < argc; i++)
+    key_len += strlen (argv[i]) + 1;
+
+  key = malloc (key_len);
+  if (key == NULL)
+    return (NULL);
+
+  /* Separate the arguments with newlines, which don't appear in them. */
+  offset = 0;
+  for (i = 0; i < argc; i++)
+  {
+    size_t len = strlen (argv[i]);
+
+    memcpy (key + offset, argv[i], len);
+    offset += len;
+    key[offset] = '\n';
+    offset++;
+  }
+  key[key_len - 1] = 0;
+
+  return (key);
+} /* }}} char *rc_key */
+
+int rc_get (const char *key, time_t now, time_t mtime, /* {{{ */
+    void **ret_data, size_t *ret_size, time_t *ret_mtime)
+{
+  rc_entry_t *e;
+  void *data;
+
+  if ((key == NULL) || (ret_data == NULL) || (ret_size == NULL))
+    return (EINVAL);
+
+  pthread_mutex_lock (&rc_lock);
+
+  e = c4_hash_lookup (rc_index, key);
+  if ((e != NULL)
+      && (((e->valid_until != 0) && (now >= e->valid_until))
+        || ((mtime != 0) && (mtime > e->mtime))))
+  {
+    rc_remove (e);
+    e = NULL;
+  }
+
+  if (e == NULL)
+  {
+    rc_stats.misses++;
+    pthread_mutex_unlock (&rc_lock);
+    return (ENOENT);
+  }
+
+  data = malloc (e->size);
+  if (data == NULL)
+  {
+    pthread_mutex_unlock (&rc_lock);
+    return (ENOMEM);
+  }
+  memcpy (data, e->data, e->size);
+
+  *ret_data = data;
+  *ret_size = e->size;
+  if (ret_mtime != NULL)
+    *ret_mtime = e->mtime;
+
+  rc_unlink (e);
+  rc_link_head (e);
+  rc_stats.hits++;
+
+  pthread_mutex_unlock (&rc_lock);
+  return (0);
+} /* }}} int rc_get */
+
+int rc_put (const char *key, const void *data, size_t size, /* {{{ */
+    time_t mtime, time_t valid_until)
+{
+  rc_entry_t *e;
+  rc_entry_t *old;
+  size_t size_max;
+  int status;
+
+  if ((key == NULL) || (data == NULL) || (size == 0))
+    return (EINVAL);
+
+  size_max = (size_t) graph_config_get_render_cache_size ();
+  if (size > size_max)
+    return (ENOSPC);
+
+  e = calloc (1, sizeof (*e));
+  if (e == NULL)
+    return (ENOMEM);
+
+  e->key = strdup (key);
+  e->data = malloc (size);
+  if ((e->key == NULL) || (e->data == NULL))
+  {
+    free (e->key);
+    free (e->data);
+    free (e);
+    return (ENOMEM);
+  }
+  memcpy (e->data, data, size);
+  e->size = size;
+  e->mtime = mtime;
+  e->valid_until = valid_until;
+
+  pthread_mutex_lock (&rc_lock);
+
+  if (rc_index == NULL)
+  {
+    rc_index = c4_hash_create (c4_hash_string, c4_hash_compare_string);
+    if (rc_index == NULL)
+    {
+      pthread_mutex_unlock (&rc_lock);
+      free (e->key);
+      free (e->data);
+      free (e);
+      return (ENOMEM);
+    }
+  }
+
+  /* Another thread may have rendered the same graph in the meantime. */
+  old = c4_hash_lookup (rc_index, key);
+  if (old != NULL)
+    rc_remove (old);
+
+  rc_make_room (size, size_max);
+
+  status = c4_hash_insert (rc_index, e->key, e);
+  if (status != 0)
+  {
+    pthread_mutex_unlock (&rc_lock);
+    free (e->key);
+    free (e->data);
+    free (e);
+    return (status);
+  }
+
+  rc_link_head (e);
+  rc_stats.entries_num++;
+  rc_stats.size += size;
+
+  pthread_mutex_unlock (&rc_lock);
+  return (0);
+} /* }}} int rc_put */
+
+int rc_get_stats (rc_stats_t *ret_stats) /* {{{ */
+{
+  if (ret_stats == NULL)
+    return (EINVAL);
+
+  pthread_mutex_lock (&rc_lock);
+  *ret_stats = rc_stats;
+  pthread_mutex_unlock (&rc_lock);
+
+  return (0);
+} /* }}} int rc_get_stats */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,66 @@
+/**
+ * collection4 - render_cache.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+/* Cache for rendered graphs, shared by all threads. Entries are identified
+ * by the complete rrd_graph argument vector, see "rc_key". The cache is
+ * limited to the number of bytes configured with "RenderCacheSize"; the
+ * least recently used entries are evicted first. */
+
+struct rc_stats_s
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  size_t entries_num;
+  /* Bytes used by cached images. */
+  size_t size;
+};
+typedef struct rc_stats_s rc_stats_t;
+
+/* Returns the key for the given argument vector. The returned string must be
+ * freed by the caller. */
+char *rc_key (int argc, char **argv);
+
+/* Looks up "key" and returns a copy of the image in "ret_data", which must be
+ * freed by the caller. An entry is stale if "now" is after the time it is
+ * valid until or, if "mtime" is non-zero, if the data has been modified
+ * after the image was rendered. Returns ENOENT if there is no valid entry. */
+int rc_get (const char *key, time_t now, time_t mtime,
+    void **ret_data, size_t *ret_size, time_t *ret_mtime);
+
+/* Adds the image "data" to the cache. "mtime" is the modification time of
+ * the data it was rendered from. If "valid_until" is non-zero, the entry is
+ * stale after that time, regardless of the data's modification time. */
+int rc_put (const char *key, const void *data, size_t size,
+    time_t mtime, time_t valid_until);
+
+int rc_get_stats (rc_stats_t *ret_stats);
+
+#endif /* RENDER_CACHE_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,682 @@
+/**
+ * collection4 - rrd_reader.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rrd_reader.h"
+#include "utils_hash.h"
+
+#include <fcgiapp.h>
+#include <fcgi_stdio.h>
+
+/* Maximum number of files kept mapped. */
+#ifndef RRDR_CACHE_SIZE
+# define RRDR_CACHE_SIZE 1024
+#endif
+
+/* The on-disk format, as defined in rrdtool's "rrd_format.h". The files are
+ * written by dumping these structures, so the layout depends on the
+ * architecture; the "float cookie" and the file size are used to detect
+ * files written elsewhere. */
+#define RRDR_COOKIE "RRD"
+#define RRDR_FLOAT_COOKIE ((double) 8.642135E130)
+
+union rrdr_unival_u
+{
+  unsigned long u_cnt;
+  double u_val;
+};
+typedef union rrdr_unival_u rrdr_unival_t;
+
+struct rrdr_stat_head_s
+{
+  char cookie[4];
+  char version[5];
+  double float_cookie;
+  unsigned long ds_cnt;
+  unsigned long rra_cnt;
+  unsigned long pdp_step;
+  rrdr_unival_t par[10];
+};
+typedef struct rrdr_stat_head_s rrdr_stat_head_t;
+
+struct rrdr_ds_def_s
+{
+  char ds_nam[20];
+  char dst[20];
+  rrdr_unival_t par[10];
+};
+typedef struct rrdr_ds_def_s rrdr_ds_def_t;
+
+struct rrdr_rra_def_s
+{
+  char cf_nam[20];
+  unsigned long row_cnt;
+  unsigned long pdp_cnt;
+  rrdr_unival_t par[10];
+};
+typedef struct rrdr_rra_def_s rrdr_rra_def_t;
+
+/* Version 3 and later. */
+struct rrdr_live_head_s
+{
+  time_t last_up;
+  long last_up_usec;
+};
+typedef struct rrdr_live_head_s rrdr_live_head_t;
+
+struct rrdr_pdp_prep_s
+{
+  char last_ds[30];
+  rrdr_unival_t scratch[10];
+};
+typedef struct rrdr_pdp_prep_s rrdr_pdp_prep_t;
+
+struct rrdr_cdp_prep_s
+{
+  rrdr_unival_t scratch[10];
+};
+typedef struct rrdr_cdp_prep_s rrdr_cdp_prep_t;
+
+struct rrdr_rra_ptr_s
+{
+  unsigned long cur_row;
+};
+typedef struct rrdr_rra_ptr_s rrdr_rra_ptr_t;
+
+struct rrdr_map_s /* {{{ */
+{
+  /* Key of the "rrdr_maps" entry. */
+  char *file;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+
+  void *addr;
+  size_t addr_size;
+
+  /* Pointers into the mapped file. The definitions don't change, the live
+   * header and the RRA pointers are updated by writers. */
+  const rrdr_stat_head_t *stat_head;
+  const rrdr_ds_def_t *ds_def;
+  const rrdr_rra_def_t *rra_def;
+  const rrdr_live_head_t *live_head;
+  const rrdr_rra_ptr_t *rra_ptr;
+  /* First value of each RRA. */
+  const double **rra_data;
+
+  /* Number of views using the map, plus one while it is cached. */
+  unsigned int refs;
+
+  /* Least recently used list. */
+  rrdr_map_t *prev;
+  rrdr_map_t *next;
+}; /* }}} struct rrdr_map_s */
+
+static pthread_mutex_t rrdr_lock = PTHREAD_MUTEX_INITIALIZER;
+static c4_hash_t *rrdr_maps = NULL;
+static rrdr_map_t *rrdr_lru_head = NULL;
+static rrdr_map_t *rrdr_lru_tail = NULL;
+
+/*
+ * Private functions
+ */
+static void rrdr_map_destroy (rrdr_map_t *map) /* {{{ */
+{
+  if (map == NULL)
+    return;
+
+  if (map->addr != NULL)
+    munmap (map->addr, map->addr_size);
+  free (map->rra_data);
+  free (map->file);
+  free (map);
+} /* }}} void rrdr_map_destroy */
+
+/* Must be called with "rrdr_lock" held. */
+static void rrdr_map_unref (rrdr_map_t *map) /* {{{ */
+{
+  map->refs--;
+  if (map->refs == 0)
+    rrdr_map_destroy (map);
+} /* }}} void rrdr_map_unref */
+
+/* Must be called with "rrdr_lock" held. */
+static void rrdr_lru_unlink (rrdr_map_t *map) /* {{{ */
+{
+  if (map->prev != NULL)
+    map->prev->next = map->next;
+  else
+    rrdr_lru_head = map->next;
+
+  if (map->next != NULL)
+    map->next->prev = map->prev;
+  else
+    rrdr_lru_tail = map->prev;
+
+  map->prev = NULL;
+  map->next = NULL;
+} /* }}} void rrdr_lru_unlink */
+
+/* Must be called with "rrdr_lock" held. */
+static void rrdr_lru_push (rrdr_map_t *map) /* {{{ */
+{
+  map->prev = NULL;
+  map->next = rrdr_lru_head;
+  if (rrdr_lru_head != NULL)
+    rrdr_lru_head->prev = map;
+  rrdr_lru_head = map;
+  if (rrdr_lru_tail == NULL)
+    rrdr_lru_tail = map;
+} /* }}} void rrdr_lru_push */
+
+/* Removes "map" from the cache. Must be called with "rrdr_lock" held. */
+static void rrdr_uncache (rrdr_map_t *map) /* {{{ */
+{
+  c4_hash_remove (rrdr_maps, map->file);
+  rrdr_lru_unlink (map);
+  rrdr_map_unref (map);
+} /* }}} void rrdr_uncache */
+
+/* Multiplies "a" and "b", adding the result to "*sum". Returns non-zero on
+ * overflow. */
+static int rrdr_add_product (size_t *sum, size_t a, size_t b) /* {{{ */
+{
+  if ((b != 0) && (a > (SIZE_MAX / b)))
+    return (-1);
+  if ((a * b) > (SIZE_MAX - *sum))
+    return (-1);
+
+  *sum += a * b;
+  return (0);
+} /* }}} int rrdr_add_product */
+
+/* Checks the header of "map" and sets up the pointers into the file. Returns
+ * ENOTSUP if the file can't be read. */
+static int rrdr_map_parse (rrdr_map_t *map) /* {{{ */
+{
+  const char *ptr = map->addr;
+  const rrdr_stat_head_t *sh;
+  size_t header_len;
+  size_t data_len;
+  size_t offset;
+  unsigned long i;
+
+  if (map->addr_size < sizeof (*sh))
+    return (ENOTSUP);
+
+  sh = (const rrdr_stat_head_t *) ptr;
+  if ((memcmp (sh->cookie, RRDR_COOKIE, sizeof (RRDR_COOKIE)) != 0)
+      || ((memcmp (sh->version, "0003", 5) != 0)
+        && (memcmp (sh->version, "0004", 5) != 0))
+      || (sh->float_cookie != RRDR_FLOAT_COOKIE)
+      || (sh->ds_cnt < 1) || (sh->rra_cnt < 1) || (sh->pdp_step < 1)
+      || (sh->ds_cnt > (map->addr_size / sizeof (rrdr_ds_def_t)))
+      || (sh->rra_cnt > (map->addr_size / sizeof (rrdr_rra_def_t))))
+    return (ENOTSUP);
+
+  header_len = sizeof (*sh);
+  if ((rrdr_add_product (&header_len, sh->ds_cnt,
+          sizeof (rrdr_ds_def_t) + sizeof (rrdr_pdp_prep_t)) != 0)
+      || (rrdr_add_product (&header_len, sh->rra_cnt,
+          sizeof (rrdr_rra_def_t) + sizeof (rrdr_rra_ptr_t)) != 0)
+      || (rrdr_add_product (&header_len, sh->rra_cnt * sh->ds_cnt,
+          sizeof (rrdr_cdp_prep_t)) != 0)
+      || (rrdr_add_product (&header_len, 1, sizeof (rrdr_live_head_t)) != 0)
+      || (header_len > map->addr_size))
+    return (ENOTSUP);
+
+  map->stat_head = sh;
+  offset = sizeof (*sh);
+  map->ds_def = (const rrdr_ds_def_t *) (ptr + offset);
+  offset += sh->ds_cnt * sizeof (rrdr_ds_def_t);
+  map->rra_def = (const rrdr_rra_def_t *) (ptr + offset);
+  offset += sh->rra_cnt * sizeof (rrdr_rra_def_t);
+  map->live_head = (const rrdr_live_head_t *) (ptr + offset);
+  offset += sizeof (rrdr_live_head_t);
+  offset += sh->ds_cnt * sizeof (rrdr_pdp_prep_t);
+  offset += sh->rra_cnt * sh->ds_cnt * sizeof (rrdr_cdp_prep_t);
+  map->rra_ptr = (const rrdr_rra_ptr_t *) (ptr + offset);
+
+  for (i = 0; i < sh->ds_cnt; i++)
+    if (memchr (map->ds_def[i].ds_nam, 0,
+          sizeof (map->ds_def[i].ds_nam)) == NULL)
+      return (ENOTSUP);
+
+  map->rra_data = calloc (sh->rra_cnt, sizeof (*map->rra_data));
+  if (map->rra_data == NULL)
+    return (ENOMEM);
+
+  data_len = 0;
+  for (i = 0; i < sh->rra_cnt; i++)
+  {
+    const rrdr_rra_def_t *rra = map->rra_def + i;
+
+    if ((rra->row_cnt < 1) || (rra->pdp_cnt < 1)
+        || (memchr (rra->cf_nam, 0, sizeof (rra->cf_nam)) == NULL))
+      return (ENOTSUP);
+
+    map->rra_data[i] = (const double *) (ptr + header_len
+        + (data_len * sizeof (double)));
+
+    if (rrdr_add_product (&data_len, rra->row_cnt, sh->ds_cnt) != 0)
+      return (ENOTSUP);
+  }
+
+  /* Files written with a different layout, e.g. on a 32 bit system, have a
+   * different size. */
+  if ((data_len > ((SIZE_MAX - header_len) / sizeof (double)))
+      || ((header_len + (data_len * sizeof (double))) != map->addr_size))
+    return (ENOTSUP);
+
+  return (0);
+} /* }}} int rrdr_map_parse */
+
+static rrdr_map_t *rrdr_map_create (const char *file) /* {{{ */
+{
+  rrdr_map_t *map;
+  struct stat statbuf;
+  int fd;
+
+  fd = open (file, O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+
+  memset (&statbuf, 0, sizeof (statbuf));
+  if ((fstat (fd, &statbuf) != 0) || (statbuf.st_size <= 0))
+  {
+    close (fd);
+    return (NULL);
+  }
+
+  map = calloc (1, sizeof (*map));
+  if (map == NULL)
+  {
+    close (fd);
+    return (NULL);
+  }
+
+  map->file = strdup (file);
+  map->dev = statbuf.st_dev;
+  map->ino = statbuf.st_ino;
+  map->size = statbuf.st_size;
+  map->addr_size = (size_t) statbuf.st_size;
+
+  /* A shared mapping sees the updates written by collectd. */
+  map->addr = mmap (/* addr = */ NULL, map->addr_size, PROT_READ, MAP_SHARED,
+      fd, /* offset = */ 0);
+  close (fd);
+  if (map->addr == MAP_FAILED)
+  {
+    map->addr = NULL;
+    rrdr_map_destroy (map);
+    return (NULL);
+  }
+
+  if ((map->file == NULL) || (rrdr_map_parse (map) != 0))
+  {
+    rrdr_map_destroy (map);
+    return (NULL);
+  }
+
+  return (map);
+} /* }}} rrdr_map_t *rrdr_map_create */
+
+/* Returns the mapping of "file", creating it if necessary. The returned map
+ * must be released with "rrdr_map_unref". */
+static rrdr_map_t *rrdr_map_get (const char *file) /* {{{ */
+{
+  rrdr_map_t *map;
+  rrdr_map_t *old;
+  struct stat statbuf;
+
+  memset (&statbuf, 0, sizeof (statbuf));
+  if (stat (file, &statbuf) != 0)
+    return (NULL);
+
+  pthread_mutex_lock (&rrdr_lock);
+  map = NULL;
+  if (rrdr_maps != NULL)
+    map = c4_hash_lookup (rrdr_maps, file);
+  /* The file has been replaced, e.g. after "rrdtool resize". Existing
+   * files are never truncated, so mapping them stays safe. */
+  if ((map != NULL)
+      && ((map->dev != statbuf.st_dev) || (map->ino != statbuf.st_ino)
+        || (map->size != statbuf.st_size)))
+  {
+    rrdr_uncache (map);
+    map = NULL;
+  }
+
+  if (map != NULL)
+  {
+    map->refs++;
+    rrdr_lru_unlink (map);
+    rrdr_lru_push (map);
+    pthread_mutex_unlock (&rrdr_lock);
+    return (map);
+  }
+  pthread_mutex_unlock (&rrdr_lock);
+
+  /* Map the file without holding the lock. */
+  map = rrdr_map_create (file);
+  if (map == NULL)
+    return (NULL);
+  map->refs = 1;
+
+  pthread_mutex_lock (&rrdr_lock);
+  if (rrdr_maps == NULL)
+    rrdr_maps = c4_hash_create (c4_hash_string, c4_hash_compare_string);
+  if (rrdr_maps == NULL)
+  {
+    pthread_mutex_unlock (&rrdr_lock);
+    return (map);
+  }
+
+  /* Another thread may have mapped the file in the meantime. */
+  old = c4_hash_lookup (rrdr_maps, file);
+  if (old != NULL)
+    rrdr_uncache (old);
+
+  if (c4_hash_insert (rrdr_maps, map->file, map) == 0)
+  {
+    map->refs++;
+    rrdr_lru_push (map);
+  }
+
+  while ((c4_hash_size (rrdr_maps) > RRDR_CACHE_SIZE)
+      && (rrdr_lru_tail != NULL))
+    rrdr_uncache (rrdr_lru_tail);
+  pthread_mutex_unlock (&rrdr_lock);
+
+  return (map);
+} /* }}} rrdr_map_t *rrdr_map_get */
+
+/* Picks the RRA like rrd_fetch_fn() does: the RRA with the requested
+ * consolidation function covering the whole time span with the resolution
+ * closest to "step" or, if no RRA covers all of it, the one covering the
+ * most. */
+static long rrdr_choose_rra (const rrdr_map_t *map, const char *cf, /* {{{ */
+    time_t start, time_t end, unsigned long step)
+{
+  const rrdr_stat_head_t *sh = map->stat_head;
+  time_t last_up = map->live_head->last_up;
+  long best_full = -1;
+  long best_part = -1;
+  long best_full_step_diff = 0;
+  long best_part_step_diff = 0;
+  long best_match = 0;
+  unsigned long i;
+
+  for (i = 0; i < sh->rra_cnt; i++)
+  {
+    const rrdr_rra_def_t *rra = map->rra_def + i;
+    long rra_step;
+    long step_diff;
+    time_t cal_end;
+    time_t cal_start;
+
+    if (strcmp (rra->cf_nam, cf) != 0)
+      continue;
+
+    rra_step = (long) (sh->pdp_step * rra->pdp_cnt);
+    cal_end = last_up - (last_up % rra_step);
+    cal_start = cal_end - (rra_step * (long) rra->row_cnt);
+    step_diff = labs ((long) step - rra_step);
+
+    if (cal_start <= start)
+    {
+      if ((best_full < 0) || (step_diff < best_full_step_diff))
+      {
+        best_full = (long) i;
+        best_full_step_diff = step_diff;
+      }
+    }
+    else
+    {
+      long match = (long) (end - start) - (long) (cal_start - start);
+
+      if ((best_part < 0) || (best_match < match)
+          || ((best_match == match) && (step_diff < best_part_step_diff)))
+      {
+        best_part = (long) i;
+        best_match = match;
+        best_part_step_diff = step_diff;
+      }
+    }
+  }
+
+  if (best_full >= 0)
+    return (best_full);
+  return (best_part);
+} /* }}} long rrdr_choose_rra */
+
+/*
+ * Public functions
+ */
+int rrdr_fetch (const char *file, const char *cf, /* {{{ */
+    time_t start, time_t end, unsigned long step,
+    rrdr_view_t *ret_view)
+{
+  rrdr_map_t *map;
+  const rrdr_rra_def_t *rra;
+  time_t last_up;
+  unsigned long cur_row;
+  long rra_index;
+  long rra_step;
+  time_t rra_end;
+  time_t rra_start;
+  long start_offset;
+  long rows_num;
+  long valid_begin;
+  long valid_end;
+  long first_row;
+
+  if ((file == NULL) || (cf == NULL) || (ret_view == NULL))
+    return (EINVAL);
+
+  /* Let librrd report the error. */
+  if ((start > end) || (start < 0))
+    return (ENOTSUP);
+
+  map = rrdr_map_get (file);
+  if (map == NULL)
+    return (ENOTSUP);
+
+  rra_index = rrdr_choose_rra (map, cf, start, end, step);
+  if (rra_index < 0)
+  {
+    pthread_mutex_lock (&rrdr_lock);
+    rrdr_map_unref (map);
+    pthread_mutex_unlock (&rrdr_lock);
+    return (ENOTSUP);
+  }
+  rra = map->rra_def + rra_index;
+
+  /* Written by collectd while we're reading. */
+  last_up = map->live_head->last_up;
+  cur_row = map->rra_ptr[rra_index].cur_row;
+  if (cur_row >= rra->row_cnt)
+  {
+    pthread_mutex_lock (&rrdr_lock);
+    rrdr_map_unref (map);
+    pthread_mutex_unlock (&rrdr_lock);
+    return (ENOTSUP);
+  }
+
+  rra_step = (long) (map->stat_head->pdp_step * rra->pdp_cnt);
+  start -= start % rra_step;
+  end += rra_step - (end % rra_step);
+  rows_num = (long) ((end - start) / rra_step);
+
+  /* Row "i" of the RRA, counted from the oldest row, holds the value for
+   * "rra_start + i * rra_step". The first row returned is the one following
+   * "start". */
+  rra_end = last_up - (last_up % rra_step);
+  rra_start = rra_end - (rra_step * ((long) rra->row_cnt - 1));
+  start_offset = ((long) start + rra_step - (long) rra_start) / rra_step;
+
+  valid_begin = (start_offset < 0) ? -start_offset : 0;
+  valid_end = (long) rra->row_cnt - start_offset;
+  if (valid_begin > rows_num)
+    valid_begin = rows_num;
+  if (valid_end > rows_num)
+    valid_end = rows_num;
+  if (valid_end < valid_begin)
+    valid_end = valid_begin;
+
+  first_row = ((long) cur_row + 1 + start_offset) % (long) rra->row_cnt;
+  if (first_row < 0)
+    first_row += (long) rra->row_cnt;
+
+  memset (ret_view, 0, sizeof (*ret_view));
+  ret_view->map = map;
+  ret_view->start = start;
+  ret_view->end = end;
+  ret_view->step = (unsigned long) rra_step;
+  ret_view->ds_count = map->stat_head->ds_cnt;
+  ret_view->rows_num = (size_t) rows_num;
+  ret_view->rra = map->rra_data[rra_index];
+  ret_view->rra_rows = rra->row_cnt;
+  ret_view->first_row = (unsigned long) first_row;
+  ret_view->valid_begin = (size_t) valid_begin;
+  ret_view->valid_end = (size_t) valid_end;
+
+  return (0);
+} /* }}} int rrdr_fetch */
+
+int rrdr_get_step (const char *file, const char *cf, /* {{{ */
+    time_t start, time_t end, unsigned long resolution,
+    unsigned long *ret_step)
+{
+  rrdr_map_t *map;
+  time_t last_up;
+  unsigned long best_step = 0;
+  unsigned long i;
+
+  if ((file == NULL) || (cf == NULL) || (ret_step == NULL))
+    return (EINVAL);
+
+  if (start > end)
+    return (ENOENT);
+
+  map = rrdr_map_get (file);
+  if (map == NULL)
+    return (ENOTSUP);
+
+  last_up = map->live_head->last_up;
+  for (i = 0; i < map->stat_head->rra_cnt; i++)
+  {
+    const rrdr_rra_def_t *rra = map->rra_def + i;
+    unsigned long rra_step;
+    time_t cal_end;
+    time_t cal_start;
+
+    if (strcmp (rra->cf_nam, cf) != 0)
+      continue;
+
+    rra_step = map->stat_head->pdp_step * rra->pdp_cnt;
+    if ((rra_step > resolution) || (rra_step <= best_step))
+      continue;
+
+    /* Same as in "rrdr_choose_rra". */
+    cal_end = last_up - (last_up % (time_t) rra_step);
+    cal_start = cal_end - ((time_t) rra_step * (time_t) rra->row_cnt);
+    if (cal_start > start)
+      continue;
+
+    best_step = rra_step;
+  }
+
+  pthread_mutex_lock (&rrdr_lock);
+  rrdr_map_unref (map);
+  pthread_mutex_unlock (&rrdr_lock);
+
+  if (best_step == 0)
+    return (ENOENT);
+
+  *ret_step = best_step;
+  return (0);
+} /* }}} int rrdr_get_step */
+
+const char *rrdr_ds_name (const rrdr_view_t *view, /* {{{ */
+    unsigned long ds_index)
+{
+  if ((view == NULL) || (view->map == NULL)
+      || (ds_index >= view->ds_count))
+    return (NULL);
+
+  return (view->map->ds_def[ds_index].ds_nam);
+} /* }}} const char *rrdr_ds_name */
+
+void rrdr_get_column (const rrdr_view_t *view, /* {{{ */
+    unsigned long ds_index, double *buffer)
+{
+  unsigned long row;
+  size_t i;
+
+  for (i = 0; i < view->valid_begin; i++)
+    buffer[i] = NAN;
+
+  row = (unsigned long) ((view->first_row + view->valid_begin)
+      % view->rra_rows);
+  for (i = view->valid_begin; i < view->valid_end; i++)
+  {
+    buffer[i] = view->rra[(row * view->ds_count) + ds_index];
+
+    row++;
+    if (row >= view->rra_rows)
+      row = 0;
+  }
+
+  for (i = view->valid_end; i < view->rows_num; i++)
+    buffer[i] = NAN;
+} /* }}} void rrdr_get_column */
+
+void rrdr_release (rrdr_view_t *view) /* {{{ */
+{
+  if ((view == NULL) || (view->map == NULL))
+    return;
+
+  pthread_mutex_lock (&rrdr_lock);
+  rrdr_map_unref (view->map);
+  pthread_mutex_unlock (&rrdr_lock);
+
+  view->map = NULL;
+} /* }}} void rrdr_release */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,92 @@
+/**
+ * collection4 - rrd_reader.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef RRD_READER_H
+#define RRD_READER_H 1
+
+#include <time.h>
+
+/* Reads RRD files without librrd. Files are mapped into memory and the
+ * mappings are kept, so that fetching data from a file read before takes a
+ * stat(2) call and no copying besides gathering the requested column.
+ * Only files in format version 3 and 4 written on this architecture are
+ * supported; ENOTSUP is returned for all other files, which must then be
+ * read with rrd_fetch_r(). */
+
+struct rrdr_map_s;
+typedef struct rrdr_map_s rrdr_map_t;
+
+/* Result of "rrdr_fetch". Refers to the mapped file until it is released
+ * with "rrdr_release". */
+struct rrdr_view_s
+{
+  rrdr_map_t *map;
+
+  /* Time span and resolution, as returned by rrd_fetch_r(). */
+  time_t start;
+  time_t end;
+  unsigned long step;
+
+  unsigned long ds_count;
+  /* Number of rows, i.e. (end - start) / step. */
+  size_t rows_num;
+
+  /* The rows of the chosen RRA, "ds_count" values each. Row "i" of the
+   * result is row "(first_row + i) % rra_rows" of the RRA, if "i" is in
+   * [valid_begin, valid_end), and NaN otherwise. */
+  const double *rra;
+  unsigned long rra_rows;
+  unsigned long first_row;
+  size_t valid_begin;
+  size_t valid_end;
+};
+typedef struct rrdr_view_s rrdr_view_t;
+
+/* Equivalent to rrd_fetch_r(). Picks the same RRA and sets "start", "end"
+ * and "step" in "ret_view" to the same values. Returns ENOTSUP if the file
+ * can't be read; call rrd_fetch_r() instead. */
+int rrdr_fetch (const char *file, const char *cf,
+    time_t start, time_t end, unsigned long step,
+    rrdr_view_t *ret_view);
+
+/* Returns the step of the coarsest RRA with consolidation function "cf"
+ * whose step is at most "resolution" and which covers all of [start, end].
+ * Passing that step to "rrdr_fetch" or rrd_fetch_r() selects this RRA.
+ * Returns ENOENT if there is no such RRA. */
+int rrdr_get_step (const char *file, const char *cf,
+    time_t start, time_t end, unsigned long resolution,
+    unsigned long *ret_step);
+
+/* Returns the name of data source "ds_index", valid until the view is
+ * released. */
+const char *rrdr_ds_name (const rrdr_view_t *view, unsigned long ds_index);
+
+/* Copies the column of data source "ds_index" to "buffer", which must hold
+ * "view->rows_num" values. */
+void rrdr_get_column (const rrdr_view_t *view, unsigned long ds_index,
+    double *buffer);
+
+void rrdr_release (rrdr_view_t *view);
+
+#endif /* RRD_READER_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,488 @@
+/**
+ * collection4 - test_collectd_flush.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Checks "flush_idents" against a fake collectd listening on a temporary
+ * UNIX socket: long batches are split into several FLUSH commands,
+ * identifiers flushed within "FlushWindow" are skipped, a server that doesn't
+ * answer runs into "FlushTimeout" and the connection is dropped, and negative
+ * replies are counted. The configuration getters are provided below instead
+ * of reading a config file. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "collectd_flush.h"
+#include "data_provider.h"
+#include "graph_config.h"
+#include "graph_ident.h"
+
+/* "FLUSH_LINE_MAX" in "collectd_flush.c", which leaves some room below the
+ * 1024 byte input buffer of collectd's unixsock plugin. */
+#define TEST_LINE_MAX 1000
+#define TEST_LINES_MAX 64
+
+enum test_reply_e
+{
+  TEST_REPLY_OK,
+  TEST_REPLY_ERROR,
+  TEST_REPLY_NONE
+};
+typedef enum test_reply_e test_reply_t;
+
+/* State of the fake collectd, protected by "test_lock". */
+static pthread_mutex_t test_lock = PTHREAD_MUTEX_INITIALIZER;
+static test_reply_t test_reply = TEST_REPLY_OK;
+static char *test_lines[TEST_LINES_MAX];
+static size_t test_lines_num = 0;
+static unsigned int test_connections = 0;
+static unsigned int test_disconnects = 0;
+static _Bool test_quit = 0;
+/* Malformed commands seen by the server. Read after the thread exited. */
+static int test_server_errors = 0;
+
+static char test_dir[] = "test_collectd_flush.XXXXXX";
+static char test_socket[256];
+static int test_window = 10;
+static int test_timeout = 1000;
+
+static int test_errors = 0;
+
+/*
+ * The configuration used by "flush_idents".
+ */
+int graph_config_get_collectd_socket (char *buffer, /* {{{ */
+    size_t buffer_size)
+{
+  if (strlen (test_socket) >= buffer_size)
+    return (ENAMETOOLONG);
+  memcpy (buffer, test_socket, strlen (test_socket) + 1);
+  return (0);
+} /* }}} int graph_config_get_collectd_socket */
+
+int graph_config_get_flush_window (void) /* {{{ */
+{
+  return (test_window);
+} /* }}} int graph_config_get_flush_window */
+
+int graph_config_get_flush_timeout (void) /* {{{ */
+{
+  return (test_timeout);
+} /* }}} int graph_config_get_flush_timeout */
+
+/* Used by "graph_ident.c", but not by this test. */
+int data_provider_get_ident_data_all ( /* {{{ */
+    __attribute__((unused)) graph_ident_t *ident,
+    __attribute__((unused)) dp_time_t begin,
+    __attribute__((unused)) dp_time_t end,
+    __attribute__((unused)) dp_time_t resolution,
+    __attribute__((unused)) dp_cf_t cf,
+    __attribute__((unused)) dp_get_ident_data_callback callback,
+    __attribute__((unused)) void *user_data)
+{
+  return (ENOTSUP);
+} /* }}} int data_provider_get_ident_data_all */
+
+int data_provider_get_ident_file ( /* {{{ */
+    __attribute__((unused)) const graph_ident_t *ident,
+    __attribute__((unused)) char *buffer,
+    __attribute__((unused)) size_t buffer_size)
+{
+  return (ENOTSUP);
+} /* }}} int data_provider_get_ident_file */
+
+/*
+ * The fake collectd.
+ */
+static void test_server_line (int fd, const char *line) /* {{{ */
+{
+  test_reply_t reply;
+
+  /* Including the newline. */
+  if ((strlen (line) + 1) > TEST_LINE_MAX)
+  {
+    fprintf (stderr, "Received a command of %zu bytes.\n", strlen (line) + 1);
+    test_server_errors++;
+  }
+
+  pthread_mutex_lock (&test_lock);
+  if (test_lines_num < TEST_LINES_MAX)
+  {
+    test_lines[test_lines_num] = strdup (line);
+    test_lines_num++;
+  }
+  reply = test_reply;
+  pthread_mutex_unlock (&test_lock);
+
+  if (reply == TEST_REPLY_OK)
+    send (fd, "0 Done\n", strlen ("0 Done\n"), MSG_NOSIGNAL);
+  else if (reply == TEST_REPLY_ERROR)
+    send (fd, "-1 No such value\n", strlen ("-1 No such value\n"),
+        MSG_NOSIGNAL);
+} /* }}} void test_server_line */
+
+/* Accepts one connection at a time and handles each line like the unixsock
+ * plugin, except that the reply depends on "test_reply". */
+static void *test_server (void *arg) /* {{{ */
+{
+  int listen_fd = *((int *) arg);
+  int fd = -1;
+  char buffer[2 * TEST_LINE_MAX];
+  size_t buffer_fill = 0;
+
+  while (42)
+  {
+    struct pollfd pfd;
+    ssize_t status;
+    char *newline;
+
+    pthread_mutex_lock (&test_lock);
+    if (test_quit)
+    {
+      pthread_mutex_unlock (&test_lock);
+      break;
+    }
+    pthread_mutex_unlock (&test_lock);
+
+    memset (&pfd, 0, sizeof (pfd));
+    pfd.fd = (fd >= 0) ? fd : listen_fd;
+    pfd.events = POLLIN;
+    if (poll (&pfd, 1, /* timeout = */ 50) <= 0)
+      continue;
+
+    if (fd < 0)
+    {
+      fd = accept (listen_fd, NULL, NULL);
+      if (fd >= 0)
+      {
+        pthread_mutex_lock (&test_lock);
+        test_connections++;
+        pthread_mutex_unlock (&test_lock);
+        buffer_fill = 0;
+      }
+      continue;
+    }
+
+    status = recv (fd, buffer + buffer_fill,
+        sizeof (buffer) - buffer_fill - 1, /* flags = */ 0);
+    if (status <= 0)
+    {
+      close (fd);
+      fd = -1;
+
+      pthread_mutex_lock (&test_lock);
+      test_disconnects++;
+      pthread_mutex_unlock (&test_lock);
+      continue;
+    }
+    buffer_fill += (size_t) status;
+    buffer[buffer_fill] = 0;
+
+    while ((newline = strchr (buffer, '\n')) != NULL)
+    {
+      size_t len = (size_t) (newline - buffer) + 1;
+
+      *newline = 0;
+      test_server_line (fd, buffer);
+      memmove (buffer, buffer + len, buffer_fill - len + 1);
+      buffer_fill -= len;
+    }
+
+    /* Longer than collectd would accept. */
+    if (buffer_fill >= TEST_LINE_MAX)
+    {
+      fprintf (stderr, "Received a command of more than %i bytes.\n",
+          TEST_LINE_MAX);
+      test_server_errors++;
+      buffer_fill = 0;
+    }
+  }
+
+  if (fd >= 0)
+    close (fd);
+  return (NULL);
+} /* }}} void *test_server */
+
+static int test_listen (void) /* {{{ */
+{
+  struct sockaddr_un sa;
+  int fd;
+
+  snprintf (test_socket, sizeof (test_socket), "%s/unixsock", test_dir);
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sun_family = AF_UNIX;
+  if (graph_config_get_collectd_socket (sa.sun_path,
+        sizeof (sa.sun_path)) != 0)
+    return (-1);
+
+  fd = socket (AF_UNIX, SOCK_STREAM, /* protocol = */ 0);
+  if (fd < 0)
+    return (-1);
+
+  if ((bind (fd, (struct sockaddr *) &sa, sizeof (sa)) != 0)
+      || (listen (fd, /* backlog = */ 4) != 0))
+  {
+    close (fd);
+    return (-1);
+  }
+
+  return (fd);
+} /* }}} int test_listen */
+
+/*
+ * Helper functions
+ */
+static double test_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double test_now */
+
+/* Returns the number of lines received since the last call, checking that
+ * they are FLUSH commands, and the number of identifiers in them. */
+static size_t test_take_lines (size_t *ret_idents_num) /* {{{ */
+{
+  size_t lines_num;
+  size_t idents_num = 0;
+  size_t i;
+
+  pthread_mutex_lock (&test_lock);
+  lines_num = test_lines_num;
+  for (i = 0; i < test_lines_num; i++)
+  {
+    const char *ptr = test_lines[i];
+
+    if (strncmp ("FLUSH identifier=\"", ptr, strlen ("FLUSH identifier=\""))
+        != 0)
+    {
+      fprintf (stderr, "Unexpected command: %s\n", ptr);
+      test_errors++;
+    }
+
+    while ((ptr = strstr (ptr, " identifier=\"")) != NULL)
+    {
+      idents_num++;
+      ptr++;
+    }
+
+    free (test_lines[i]);
+  }
+  test_lines_num = 0;
+  pthread_mutex_unlock (&test_lock);
+
+  if (ret_idents_num != NULL)
+    *ret_idents_num = idents_num;
+  return (lines_num);
+} /* }}} size_t test_take_lines */
+
+/* Waits up to one second for the server to notice a closed connection. */
+static unsigned int test_wait_disconnects (unsigned int want) /* {{{ */
+{
+  double deadline = test_now () + 1.0;
+  unsigned int disconnects;
+
+  while (42)
+  {
+    pthread_mutex_lock (&test_lock);
+    disconnects = test_disconnects;
+    pthread_mutex_unlock (&test_lock);
+
+    if ((disconnects >= want) || (test_now () > deadline))
+      return (disconnects);
+    usleep (10000);
+  }
+} /* }}} unsigned int test_wait_disconnects */
+
+static void test_set_reply (test_reply_t reply) /* {{{ */
+{
+  pthread_mutex_lock (&test_lock);
+  test_reply = reply;
+  pthread_mutex_unlock (&test_lock);
+} /* }}} void test_set_reply */
+
+#define TEST_CHECK(cond) do { \
+  if (!(cond)) { \
+    fprintf (stderr, "%s:%i: Check failed: %s\n", \
+        __FILE__, __LINE__, #cond); \
+    test_errors++; \
+  } \
+} while (0)
+
+/*
+ * Tests
+ */
+#define TEST_IDENTS 40
+
+static void test_flush (graph_ident_t **idents) /* {{{ */
+{
+  flush_stats_t stats;
+  size_t lines_num;
+  size_t idents_num;
+  graph_ident_t *single;
+  double t0;
+  int status;
+
+  /* Forty identifiers of about 70 bytes don't fit into one command. */
+  status = flush_idents (idents, TEST_IDENTS);
+  TEST_CHECK (status == 0);
+  lines_num = test_take_lines (&idents_num);
+  printf ("%i identifiers sent in %zu command(s)\n", TEST_IDENTS, lines_num);
+  TEST_CHECK (lines_num >= 2);
+  TEST_CHECK (idents_num == TEST_IDENTS);
+
+  /* Everything has been flushed within the window. */
+  status = flush_idents (idents, TEST_IDENTS);
+  TEST_CHECK (status == 0);
+  TEST_CHECK (test_take_lines (NULL) == 0);
+
+  /* Duplicates within one batch are sent once. */
+  single = ident_create ("dup.example.com", "cpu", "0", "cpu", "idle");
+  {
+    graph_ident_t *dups[3] = { single, single, single };
+
+    status = flush_idents (dups, 3);
+    TEST_CHECK (status == 0);
+    TEST_CHECK ((test_take_lines (&idents_num) == 1) && (idents_num == 1));
+  }
+
+  memset (&stats, 0, sizeof (stats));
+  flush_get_stats (&stats);
+  TEST_CHECK (stats.flushed == TEST_IDENTS + 1);
+  TEST_CHECK (stats.skipped == TEST_IDENTS + 2);
+
+  /* Without a window, everything is flushed again. */
+  test_window = 0;
+  status = flush_idents (&single, 1);
+  TEST_CHECK (status == 0);
+  TEST_CHECK (test_take_lines (NULL) == 1);
+
+  /* Negative replies are counted, but don't fail the flush. */
+  test_set_reply (TEST_REPLY_ERROR);
+  status = flush_idents (idents, TEST_IDENTS);
+  TEST_CHECK (status == 0);
+  lines_num = test_take_lines (NULL);
+  memset (&stats, 0, sizeof (stats));
+  flush_get_stats (&stats);
+  TEST_CHECK (stats.rejected == lines_num);
+  TEST_CHECK (stats.errors == 0);
+
+  /* A server that doesn't answer: "flush_idents" gives up after the timeout
+   * and drops the connection. */
+  test_set_reply (TEST_REPLY_NONE);
+  test_timeout = 200;
+  TEST_CHECK (test_wait_disconnects (0) == 0);
+  t0 = test_now ();
+  status = flush_idents (&single, 1);
+  t0 = test_now () - t0;
+  printf ("silent server: status %i after %.3f s\n", status, t0);
+  TEST_CHECK (status == ETIMEDOUT);
+  TEST_CHECK ((t0 >= 0.19) && (t0 < 1.0));
+  TEST_CHECK (test_wait_disconnects (1) == 1);
+  test_take_lines (NULL);
+
+  memset (&stats, 0, sizeof (stats));
+  flush_get_stats (&stats);
+  TEST_CHECK (stats.timeouts == 1);
+
+  /* The next flush connects again. */
+  test_set_reply (TEST_REPLY_OK);
+  status = flush_idents (&single, 1);
+  TEST_CHECK (status == 0);
+  TEST_CHECK (test_take_lines (NULL) == 1);
+  pthread_mutex_lock (&test_lock);
+  TEST_CHECK (test_connections == 2);
+  pthread_mutex_unlock (&test_lock);
+
+  ident_destroy (single);
+} /* }}} void test_flush */
+
+int main (void) /* {{{ */
+{
+  graph_ident_t *idents[TEST_IDENTS];
+  pthread_t thread;
+  int listen_fd;
+  int i;
+
+  if (mkdtemp (test_dir) == NULL)
+  {
+    perror ("mkdtemp");
+    return (1);
+  }
+
+  listen_fd = test_listen ();
+  if (listen_fd < 0)
+  {
+    perror ("test_listen");
+    rmdir (test_dir);
+    return (1);
+  }
+
+  if (pthread_create (&thread, NULL, test_server, &listen_fd) != 0)
+  {
+    fprintf (stderr, "pthread_create failed\n");
+    return (1);
+  }
+
+  for (i = 0; i < TEST_IDENTS; i++)
+  {
+    char host[64];
+
+    snprintf (host, sizeof (host), "host%02i.a-rather-long-domain.example.com",
+        i);
+    idents[i] = ident_create (host, "interface", "eth0", "if_octets", "");
+  }
+
+  test_flush (idents);
+
+  for (i = 0; i < TEST_IDENTS; i++)
+    ident_destroy (idents[i]);
+
+  pthread_mutex_lock (&test_lock);
+  test_quit = 1;
+  pthread_mutex_unlock (&test_lock);
+  pthread_join (thread, NULL);
+
+  test_errors += test_server_errors;
+
+  close (listen_fd);
+  unlink (test_socket);
+  rmdir (test_dir);
+
+  printf ("test_collectd_flush: %i errors\n", test_errors);
+  return ((test_errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
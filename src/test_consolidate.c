@@ -0,0 +1,232 @@
+/**
+ * collection4 - test_consolidate.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Checks that "consolidate" returns the same results as
+ * "consolidate_scalar", bit for bit, for random values including NAN,
+ * infinities and signed zeros. Then measures the throughput of both. The
+ * optional argument is the number of repetitions of the benchmark, zero
+ * skips it. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "utils_consolidate.h"
+
+#define TEST_CASES 20000
+#define TEST_BUCKETS_MAX 64
+#define TEST_BUCKET_SIZE_MAX 40
+
+#define BENCH_VALUES (1 << 15)
+
+static uint64_t test_state = 88172645463325252ULL;
+
+static uint64_t test_random (void) /* {{{ */
+{
+  test_state ^= test_state << 13;
+  test_state ^= test_state >> 7;
+  test_state ^= test_state << 17;
+
+  return (test_state);
+} /* }}} uint64_t test_random */
+
+static double test_random_value (void) /* {{{ */
+{
+  uint64_t bits;
+  double value;
+
+  switch (test_random () % 10)
+  {
+    case 0:
+      return (NAN);
+    case 1:
+      return (-0.0);
+    case 2:
+      return (0.0);
+    case 3:
+      return ((test_random () % 2) ? INFINITY : -INFINITY);
+    case 4:
+      /* Any bit pattern, including NANs with a payload and denormals. */
+      bits = test_random ();
+      memcpy (&value, &bits, sizeof (value));
+      return (value);
+    default:
+      return (((double) (int64_t) test_random ())
+          / (double) (test_random () | 1));
+  }
+} /* }}} double test_random_value */
+
+static double test_now (void) /* {{{ */
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0));
+} /* }}} double test_now */
+
+/* Returns the number of differences. */
+static int test_compare (void) /* {{{ */
+{
+  double values[TEST_BUCKETS_MAX * TEST_BUCKET_SIZE_MAX];
+  uint32_t count[2][TEST_BUCKETS_MAX];
+  double avg[2][TEST_BUCKETS_MAX];
+  double min[2][TEST_BUCKETS_MAX];
+  double max[2][TEST_BUCKETS_MAX];
+  size_t bucket_size;
+  size_t buckets_num;
+  size_t values_num;
+  _Bool sparse;
+  size_t i;
+  int errors = 0;
+
+  bucket_size = 1 + (size_t) (test_random () % TEST_BUCKET_SIZE_MAX);
+  buckets_num = 1 + (size_t) (test_random () % TEST_BUCKETS_MAX);
+  values_num = bucket_size * buckets_num;
+
+  /* Mostly NAN, so that some buckets have no values at all. */
+  sparse = ((test_random () % 8) == 0);
+  for (i = 0; i < values_num; i++)
+    values[i] = (sparse && (test_random () % 2))
+      ? NAN : test_random_value ();
+
+  consolidate_scalar (values, bucket_size, buckets_num,
+      count[0], avg[0], min[0], max[0]);
+  consolidate (values, bucket_size, buckets_num,
+      count[1], avg[1], min[1], max[1]);
+
+  if ((memcmp (count[0], count[1], buckets_num * sizeof (count[0][0])) != 0)
+      || (memcmp (avg[0], avg[1], buckets_num * sizeof (avg[0][0])) != 0)
+      || (memcmp (min[0], min[1], buckets_num * sizeof (min[0][0])) != 0)
+      || (memcmp (max[0], max[1], buckets_num * sizeof (max[0][0])) != 0))
+  {
+    fprintf (stderr, "%zu buckets of %zu values: results differ\n",
+        buckets_num, bucket_size);
+    errors++;
+  }
+
+  /* Only some of the results. */
+  memset (min[1], 0, sizeof (min[1]));
+  consolidate (values, bucket_size, buckets_num,
+      /* count = */ NULL, /* avg = */ NULL, min[1], /* max = */ NULL);
+  if (memcmp (min[0], min[1], buckets_num * sizeof (min[0][0])) != 0)
+  {
+    fprintf (stderr, "%zu buckets of %zu values: minimum alone differs\n",
+        buckets_num, bucket_size);
+    errors++;
+  }
+
+  return (errors);
+} /* }}} int test_compare */
+
+static void test_bench (unsigned long repetitions) /* {{{ */
+{
+  static const size_t bucket_sizes[] = { 2, 4, 8, 16, 64, 256 };
+  double *values;
+  uint32_t *count;
+  double *avg;
+  double *min;
+  double *max;
+  size_t i;
+
+  values = calloc (BENCH_VALUES, sizeof (*values));
+  count = calloc (BENCH_VALUES, sizeof (*count));
+  avg = calloc (BENCH_VALUES, sizeof (*avg));
+  min = calloc (BENCH_VALUES, sizeof (*min));
+  max = calloc (BENCH_VALUES, sizeof (*max));
+  if ((values == NULL) || (count == NULL) || (avg == NULL)
+      || (min == NULL) || (max == NULL))
+  {
+    free (values);
+    free (count);
+    free (avg);
+    free (min);
+    free (max);
+    return;
+  }
+
+  /* Typical data: 5% gaps. */
+  for (i = 0; i < BENCH_VALUES; i++)
+    values[i] = ((test_random () % 20) == 0)
+      ? NAN : ((double) (test_random () % 100000)) / 7.0;
+
+  for (i = 0; i < (sizeof (bucket_sizes) / sizeof (bucket_sizes[0])); i++)
+  {
+    size_t bucket_size = bucket_sizes[i];
+    size_t buckets_num = BENCH_VALUES / bucket_size;
+    double points;
+    double t0;
+    double t1;
+    double t2;
+    unsigned long j;
+
+    t0 = test_now ();
+    for (j = 0; j < repetitions; j++)
+      consolidate_scalar (values, bucket_size, buckets_num,
+          count, avg, min, max);
+    t1 = test_now ();
+    for (j = 0; j < repetitions; j++)
+      consolidate (values, bucket_size, buckets_num,
+          count, avg, min, max);
+    t2 = test_now ();
+
+    points = ((double) repetitions) * ((double) BENCH_VALUES) / 1000000.0;
+    printf ("bucket size %4zu: scalar %8.1f Mpoints/s, %s %8.1f Mpoints/s, "
+        "speedup %.2f\n", bucket_size, points / (t1 - t0),
+        consolidate_impl_name (), points / (t2 - t1),
+        (t1 - t0) / (t2 - t1));
+  }
+
+  free (values);
+  free (count);
+  free (avg);
+  free (min);
+  free (max);
+} /* }}} void test_bench */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  unsigned long repetitions = 200;
+  int errors = 0;
+  int i;
+
+  if (argc > 1)
+    repetitions = strtoul (argv[1], NULL, 0);
+
+  for (i = 0; i < TEST_CASES; i++)
+    errors += test_compare ();
+
+  printf ("test_consolidate: %s: %i cases, %i errors\n",
+      consolidate_impl_name (), TEST_CASES, errors);
+
+  if (repetitions > 0)
+    test_bench (repetitions);
+
+  return ((errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,492 @@
+/**
+ * collection4 - test_rrd_reader.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Compares "rrdr_fetch" and "rrdr_get_step" with rrd_fetch_r() from librrd.
+ * Writes RRD files with random layouts, row pointers and values, fetches
+ * random time spans from them with both and checks that the results are
+ * identical, bit for bit. Takes an optional seed as argument. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rrd.h>
+
+#include "rrd_reader.h"
+
+#define TEST_FILES 500
+#define TEST_QUERIES 10
+
+/* The on-disk format, as defined in rrdtool's "rrd_format.h". */
+union test_unival_u
+{
+  unsigned long u_cnt;
+  double u_val;
+};
+typedef union test_unival_u test_unival_t;
+
+struct test_stat_head_s
+{
+  char cookie[4];
+  char version[5];
+  double float_cookie;
+  unsigned long ds_cnt;
+  unsigned long rra_cnt;
+  unsigned long pdp_step;
+  test_unival_t par[10];
+};
+
+struct test_ds_def_s
+{
+  char ds_nam[20];
+  char dst[20];
+  test_unival_t par[10];
+};
+
+struct test_rra_def_s
+{
+  char cf_nam[20];
+  unsigned long row_cnt;
+  unsigned long pdp_cnt;
+  test_unival_t par[10];
+};
+
+struct test_live_head_s
+{
+  time_t last_up;
+  long last_up_usec;
+};
+
+struct test_pdp_prep_s
+{
+  char last_ds[30];
+  test_unival_t scratch[10];
+};
+
+struct test_cdp_prep_s
+{
+  test_unival_t scratch[10];
+};
+
+#define TEST_DS_MAX 3
+#define TEST_RRA_MAX 5
+
+/* Layout of a generated file. */
+struct test_file_s /* {{{ */
+{
+  char name[64];
+
+  unsigned long ds_cnt;
+  unsigned long rra_cnt;
+  unsigned long pdp_step;
+  time_t last_up;
+
+  struct test_rra_def_s rra_def[TEST_RRA_MAX];
+}; /* }}} struct test_file_s */
+typedef struct test_file_s test_file_t;
+
+static const char *test_cfs[] = { "AVERAGE", "AVERAGE", "MAX", "MIN" };
+
+static uint64_t test_state = 1;
+
+/* xorshift64*, so that the cases don't depend on the C library. */
+static unsigned long test_random (unsigned long max) /* {{{ */
+{
+  test_state ^= test_state >> 12;
+  test_state ^= test_state << 25;
+  test_state ^= test_state >> 27;
+
+  return ((unsigned long) (((test_state * 2685821657736338717ULL) >> 11)
+        % (uint64_t) (max + 1)));
+} /* }}} unsigned long test_random */
+
+static double test_random_value (void) /* {{{ */
+{
+  switch (test_random (7))
+  {
+    case 0:
+    case 1:
+      return (NAN);
+    case 2:
+      return (-0.0);
+    case 3:
+      return ((double) test_random (10));
+    default:
+      return ((((double) test_random (2000000)) - 1000000.0) / 7.0);
+  }
+} /* }}} double test_random_value */
+
+static int test_write_file (test_file_t *f) /* {{{ */
+{
+  struct test_stat_head_s sh;
+  struct test_live_head_s lh;
+  FILE *fh;
+  unsigned long i;
+  unsigned long j;
+
+  memset (&sh, 0, sizeof (sh));
+  memcpy (sh.cookie, "RRD", 4);
+  memcpy (sh.version, test_random (1) ? "0003" : "0004", 5);
+  sh.float_cookie = 8.642135E130;
+  sh.ds_cnt = f->ds_cnt;
+  sh.rra_cnt = f->rra_cnt;
+  sh.pdp_step = f->pdp_step;
+
+  fh = fopen (f->name, "w");
+  if (fh == NULL)
+    return (errno);
+
+  fwrite (&sh, sizeof (sh), 1, fh);
+
+  for (i = 0; i < f->ds_cnt; i++)
+  {
+    struct test_ds_def_s ds;
+
+    memset (&ds, 0, sizeof (ds));
+    snprintf (ds.ds_nam, sizeof (ds.ds_nam), "ds%u", (unsigned int) i);
+    strncpy (ds.dst, "GAUGE", sizeof (ds.dst));
+    ds.par[0].u_cnt = 600;
+    ds.par[1].u_val = NAN;
+    ds.par[2].u_val = NAN;
+    fwrite (&ds, sizeof (ds), 1, fh);
+  }
+
+  fwrite (f->rra_def, sizeof (f->rra_def[0]), f->rra_cnt, fh);
+
+  memset (&lh, 0, sizeof (lh));
+  lh.last_up = f->last_up;
+  fwrite (&lh, sizeof (lh), 1, fh);
+
+  for (i = 0; i < f->ds_cnt; i++)
+  {
+    struct test_pdp_prep_s pdp;
+
+    memset (&pdp, 0, sizeof (pdp));
+    strncpy (pdp.last_ds, "U", sizeof (pdp.last_ds));
+    fwrite (&pdp, sizeof (pdp), 1, fh);
+  }
+
+  for (i = 0; i < (f->rra_cnt * f->ds_cnt); i++)
+  {
+    struct test_cdp_prep_s cdp;
+
+    memset (&cdp, 0, sizeof (cdp));
+    cdp.scratch[0].u_val = NAN;
+    fwrite (&cdp, sizeof (cdp), 1, fh);
+  }
+
+  for (i = 0; i < f->rra_cnt; i++)
+  {
+    unsigned long cur_row = test_random (f->rra_def[i].row_cnt - 1);
+    fwrite (&cur_row, sizeof (cur_row), 1, fh);
+  }
+
+  for (i = 0; i < f->rra_cnt; i++)
+    for (j = 0; j < (f->rra_def[i].row_cnt * f->ds_cnt); j++)
+    {
+      double value = test_random_value ();
+      fwrite (&value, sizeof (value), 1, fh);
+    }
+
+  if (fclose (fh) != 0)
+    return (errno);
+  return (0);
+} /* }}} int test_write_file */
+
+static void test_create_file (test_file_t *f, /* {{{ */
+    const char *dir, unsigned int num)
+{
+  static const unsigned long pdp_steps[] = { 1, 10, 60 };
+  static const unsigned long pdp_cnts[] = { 1, 2, 3, 6, 10 };
+  unsigned long i;
+
+  memset (f, 0, sizeof (*f));
+  snprintf (f->name, sizeof (f->name), "%s/%u.rrd", dir, num);
+
+  f->ds_cnt = 1 + test_random (TEST_DS_MAX - 1);
+  f->rra_cnt = 1 + test_random (TEST_RRA_MAX - 1);
+  f->pdp_step = pdp_steps[test_random (2)];
+  f->last_up = (time_t) (1000000 + test_random (1000000));
+
+  for (i = 0; i < f->rra_cnt; i++)
+  {
+    struct test_rra_def_s *rra = f->rra_def + i;
+
+    strncpy (rra->cf_nam, test_cfs[test_random (2)], sizeof (rra->cf_nam));
+    rra->row_cnt = 1 + test_random (39);
+    rra->pdp_cnt = pdp_cnts[test_random (4)];
+    rra->par[0].u_val = 0.5;
+  }
+} /* }}} void test_create_file */
+
+static _Bool test_same (double a, double b) /* {{{ */
+{
+  if (isnan (a) || isnan (b))
+    return (isnan (a) && isnan (b));
+  return (memcmp (&a, &b, sizeof (a)) == 0);
+} /* }}} _Bool test_same */
+
+static void test_free_fetch (unsigned long ds_cnt, /* {{{ */
+    char **ds_namv, rrd_value_t *data)
+{
+  unsigned long i;
+
+  if (ds_namv != NULL)
+    for (i = 0; i < ds_cnt; i++)
+      free (ds_namv[i]);
+  free (ds_namv);
+  free (data);
+} /* }}} void test_free_fetch */
+
+/* Fetches [start, end] with both readers. Returns the number of
+ * differences. */
+static int test_fetch (const test_file_t *f, const char *cf, /* {{{ */
+    time_t start, time_t end, unsigned long step)
+{
+  time_t rrd_start = start;
+  time_t rrd_end = end;
+  unsigned long rrd_step = step;
+  unsigned long ds_cnt = 0;
+  char **ds_namv = NULL;
+  rrd_value_t *data = NULL;
+  rrdr_view_t view;
+  double *column;
+  size_t rows_num;
+  unsigned long i;
+  size_t j;
+  int rrd_status;
+  int status;
+  int errors = 0;
+
+  rrd_status = rrd_fetch_r (f->name, cf, &rrd_start, &rrd_end, &rrd_step,
+      &ds_cnt, &ds_namv, &data);
+  status = rrdr_fetch (f->name, cf, start, end, step, &view);
+
+  /* If librrd fails, e.g. because there is no RRA with "cf", "rrdr_fetch"
+   * must fail, too. ENOTSUP is fine, since dp_rrdtool would then call
+   * rrd_fetch_r(). */
+  if ((rrd_status == 0) != (status == 0))
+  {
+    fprintf (stderr, "%s: %s %li %li %lu: rrd_fetch_r returned %i (%s), "
+        "rrdr_fetch returned %i\n", f->name, cf, (long) start, (long) end,
+        step, rrd_status, (rrd_status != 0) ? rrd_get_error () : "",
+        status);
+    rrd_clear_error ();
+    if (rrd_status == 0)
+      test_free_fetch (ds_cnt, ds_namv, data);
+    if (status == 0)
+      rrdr_release (&view);
+    return (1);
+  }
+
+  if (rrd_status != 0)
+  {
+    rrd_clear_error ();
+    return (0);
+  }
+
+  if ((view.start != rrd_start) || (view.end != rrd_end)
+      || (view.step != rrd_step) || (view.ds_count != ds_cnt))
+  {
+    fprintf (stderr, "%s: %s %li %li %lu: rrd_fetch_r returned "
+        "%li %li %lu %lu, rrdr_fetch returned %li %li %lu %lu\n",
+        f->name, cf, (long) start, (long) end, step,
+        (long) rrd_start, (long) rrd_end, rrd_step, ds_cnt,
+        (long) view.start, (long) view.end, view.step, view.ds_count);
+    test_free_fetch (ds_cnt, ds_namv, data);
+    rrdr_release (&view);
+    return (1);
+  }
+
+  rows_num = (size_t) ((rrd_end - rrd_start) / (time_t) rrd_step);
+  if (view.rows_num != rows_num)
+  {
+    fprintf (stderr, "%s: %s %li %li %lu: %lu rows instead of %lu\n",
+        f->name, cf, (long) start, (long) end, step,
+        (unsigned long) view.rows_num, (unsigned long) rows_num);
+    test_free_fetch (ds_cnt, ds_namv, data);
+    rrdr_release (&view);
+    return (1);
+  }
+
+  column = calloc (rows_num + 1, sizeof (*column));
+  if (column == NULL)
+  {
+    test_free_fetch (ds_cnt, ds_namv, data);
+    rrdr_release (&view);
+    return (1);
+  }
+
+  for (i = 0; i < ds_cnt; i++)
+  {
+    if (strcmp (ds_namv[i], rrdr_ds_name (&view, i)) != 0)
+    {
+      fprintf (stderr, "%s: data source %lu is called \"%s\", not \"%s\"\n",
+          f->name, i, rrdr_ds_name (&view, i), ds_namv[i]);
+      errors++;
+    }
+
+    rrdr_get_column (&view, i, column);
+    for (j = 0; j < rows_num; j++)
+    {
+      if (test_same (column[j], (double) data[(j * ds_cnt) + i]))
+        continue;
+
+      fprintf (stderr, "%s: %s %li %li %lu: row %lu of %s is %.17g "
+          "instead of %.17g\n", f->name, cf, (long) start, (long) end, step,
+          (unsigned long) j, ds_namv[i], column[j],
+          (double) data[(j * ds_cnt) + i]);
+      errors++;
+      break;
+    }
+  }
+
+  free (column);
+  test_free_fetch (ds_cnt, ds_namv, data);
+  rrdr_release (&view);
+
+  return (errors);
+} /* }}} int test_fetch */
+
+/* Checks that passing the step returned by "rrdr_get_step" makes librrd
+ * choose an RRA with that step. Returns the number of differences. */
+static int test_get_step (const test_file_t *f, const char *cf, /* {{{ */
+    time_t start, time_t end, unsigned long resolution)
+{
+  time_t rrd_start = start;
+  time_t rrd_end = end;
+  unsigned long rrd_step;
+  unsigned long ds_cnt = 0;
+  char **ds_namv = NULL;
+  rrd_value_t *data = NULL;
+  unsigned long step = 0;
+  int status;
+
+  status = rrdr_get_step (f->name, cf, start, end, resolution, &step);
+  if (status == ENOENT)
+    return (0);
+  else if (status != 0)
+  {
+    fprintf (stderr, "%s: rrdr_get_step returned %i\n", f->name, status);
+    return (1);
+  }
+
+  if (step > resolution)
+  {
+    fprintf (stderr, "%s: %s %li %li %lu: rrdr_get_step returned step %lu\n",
+        f->name, cf, (long) start, (long) end, resolution, step);
+    return (1);
+  }
+
+  rrd_step = step;
+  status = rrd_fetch_r (f->name, cf, &rrd_start, &rrd_end, &rrd_step,
+      &ds_cnt, &ds_namv, &data);
+  if (status != 0)
+  {
+    fprintf (stderr, "%s: rrd_fetch_r failed: %s\n", f->name,
+        rrd_get_error ());
+    rrd_clear_error ();
+    return (1);
+  }
+  test_free_fetch (ds_cnt, ds_namv, data);
+
+  if (rrd_step != step)
+  {
+    fprintf (stderr, "%s: %s %li %li %lu: rrdr_get_step returned step %lu, "
+        "rrd_fetch_r chose step %lu\n", f->name, cf, (long) start,
+        (long) end, resolution, step, rrd_step);
+    return (1);
+  }
+
+  return (0);
+} /* }}} int test_get_step */
+
+int main (int argc, char **argv) /* {{{ */
+{
+  char dir[] = "test_rrd_reader.XXXXXX";
+  unsigned int cases = 0;
+  unsigned int errors = 0;
+  unsigned int i;
+
+  if (argc > 1)
+    test_state = strtoull (argv[1], NULL, 0);
+  if (test_state == 0)
+    test_state = 1;
+
+  if (mkdtemp (dir) == NULL)
+  {
+    perror ("mkdtemp");
+    return (1);
+  }
+
+  for (i = 0; i < TEST_FILES; i++)
+  {
+    test_file_t f;
+    unsigned int j;
+    int status;
+
+    test_create_file (&f, dir, i);
+    status = test_write_file (&f);
+    if (status != 0)
+    {
+      fprintf (stderr, "Writing %s failed: %s\n", f.name, strerror (status));
+      errors++;
+      break;
+    }
+
+    for (j = 0; j < TEST_QUERIES; j++)
+    {
+      const char *cf = test_cfs[test_random (3)];
+      time_t end = f.last_up + (time_t) test_random (3300) - 3000;
+      time_t start = end - (time_t) test_random (3000);
+      unsigned long step;
+
+      if (test_random (1))
+        step = 0;
+      else if (test_random (1))
+        step = 1 + test_random (600);
+      else
+        step = f.pdp_step * f.rra_def[test_random (f.rra_cnt - 1)].pdp_cnt;
+
+      errors += test_fetch (&f, cf, start, end, step);
+      errors += test_get_step (&f, cf, start, end, 1 + test_random (1200));
+      cases++;
+    }
+
+    unlink (f.name);
+  }
+
+  rmdir (dir);
+
+  printf ("test_rrd_reader: %u cases, %u errors\n", cases, errors);
+  return ((errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,367 @@
+/**
+ * collection4 - test_watch.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+/* Checks the changes the rrdtool data provider reports while files and
+ * directories are created and removed in a temporary data directory. This is
+ * done twice: once with inotify watches and once with a "WatchLimit" below
+ * the number of directories, so that the provider has to fall back to
+ * stat(2)ing all directories. */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "data_provider.h"
+#include "dp_rrdtool.h"
+#include "filesystem.h"
+#include "graph_ident.h"
+#include "oconfig.h"
+
+#define TEST_CHANGES_MAX 64
+
+static char test_dir[] = "test_watch.XXXXXX";
+
+static char *test_changes[TEST_CHANGES_MAX];
+static size_t test_changes_num = 0;
+
+static int test_errors = 0;
+
+static void test_record (char sign, const graph_ident_t *ident) /* {{{ */
+{
+  char buffer[1024];
+  char *str;
+
+  str = ident_to_string (ident);
+  snprintf (buffer, sizeof (buffer), "%c%s", sign,
+      (str != NULL) ? str : "(null)");
+  free (str);
+
+  if (test_changes_num < TEST_CHANGES_MAX)
+  {
+    test_changes[test_changes_num] = strdup (buffer);
+    test_changes_num++;
+  }
+} /* }}} void test_record */
+
+static int test_idents_cb (graph_ident_t *ident, /* {{{ */
+    __attribute__((unused)) void *user_data)
+{
+  test_record ('+', ident);
+  return (0);
+} /* }}} int test_idents_cb */
+
+static int test_delta_cb (graph_ident_t *ident, /* {{{ */
+    dp_ident_change_t change, __attribute__((unused)) void *user_data)
+{
+  test_record ((change == DP_IDENT_ADDED) ? '+' : '-', ident);
+  return (0);
+} /* }}} int test_delta_cb */
+
+static int test_compare_strings (const void *s0, const void *s1) /* {{{ */
+{
+  return (strcmp (*(char * const *) s0, *(char * const *) s1));
+} /* }}} int test_compare_strings */
+
+/* Compares the recorded changes with "expected", a NULL terminated list, in
+ * any order. Then forgets the changes. */
+static void test_expect (const char *step, int status, /* {{{ */
+    const char **expected)
+{
+  const char *sorted[TEST_CHANGES_MAX];
+  size_t expected_num;
+  size_t i;
+  _Bool equal;
+
+  for (expected_num = 0; expected[expected_num] != NULL; expected_num++)
+    sorted[expected_num] = expected[expected_num];
+
+  qsort (sorted, expected_num, sizeof (*sorted), test_compare_strings);
+  qsort (test_changes, test_changes_num, sizeof (*test_changes),
+      test_compare_strings);
+
+  equal = (status == 0) && (expected_num == test_changes_num);
+  for (i = 0; equal && (i < expected_num); i++)
+    if (strcmp (sorted[i], test_changes[i]) != 0)
+      equal = 0;
+
+  if (!equal)
+  {
+    fprintf (stderr, "%s: status %i, expected %zu change(s):\n",
+        step, status, expected_num);
+    for (i = 0; i < expected_num; i++)
+      fprintf (stderr, "  %s\n", sorted[i]);
+    fprintf (stderr, "got %zu change(s):\n", test_changes_num);
+    for (i = 0; i < test_changes_num; i++)
+      fprintf (stderr, "  %s\n", test_changes[i]);
+    test_errors++;
+  }
+
+  for (i = 0; i < test_changes_num; i++)
+    free (test_changes[i]);
+  test_changes_num = 0;
+} /* }}} void test_expect */
+
+static void test_mkdir (const char *name) /* {{{ */
+{
+  char path[1024];
+
+  snprintf (path, sizeof (path), "%s/%s", test_dir, name);
+  if (mkdir (path, 0755) != 0)
+  {
+    fprintf (stderr, "mkdir (%s) failed: %s\n", path, strerror (errno));
+    test_errors++;
+  }
+} /* }}} void test_mkdir */
+
+static void test_touch (const char *name) /* {{{ */
+{
+  char path[1024];
+  int fd;
+
+  snprintf (path, sizeof (path), "%s/%s", test_dir, name);
+  fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    fprintf (stderr, "open (%s) failed: %s\n", path, strerror (errno));
+    test_errors++;
+    return;
+  }
+  close (fd);
+} /* }}} void test_touch */
+
+static int test_remove_path (const char *path);
+
+static int test_remove_cb (int dir_fd, const char *entry, /* {{{ */
+    fs_type_t type, void *user_data)
+{
+  const char *dir = user_data;
+  char path[1024];
+
+  snprintf (path, sizeof (path), "%s/%s", dir, entry);
+
+  if (type == FS_TYPE_UNKNOWN)
+    type = fs_entry_type (dir_fd, entry);
+
+  if (type == FS_TYPE_DIR)
+    return (test_remove_path (path));
+
+  if (unlink (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int test_remove_cb */
+
+static int test_remove_path (const char *path) /* {{{ */
+{
+  struct stat statbuf;
+  int status;
+
+  if (lstat (path, &statbuf) != 0)
+    return (errno);
+
+  if (!S_ISDIR (statbuf.st_mode))
+    return ((unlink (path) == 0) ? 0 : errno);
+
+  status = fs_foreach_entry (path, test_remove_cb, (void *) path);
+  if (status != 0)
+    return (status);
+
+  if (rmdir (path) != 0)
+    return (errno);
+  return (0);
+} /* }}} int test_remove_path */
+
+/* Removes "name", which may be a directory, with everything below it. */
+static void test_remove (const char *name) /* {{{ */
+{
+  char path[1024];
+  int status;
+
+  snprintf (path, sizeof (path), "%s/%s", test_dir, name);
+  status = test_remove_path (path);
+  if (status != 0)
+  {
+    fprintf (stderr, "Removing %s failed: %s\n", path, strerror (status));
+    test_errors++;
+  }
+} /* }}} void test_remove */
+
+/* Configures a new rrdtool data provider for "test_dir", replacing the
+ * previous one. */
+static int test_configure (int watch_limit) /* {{{ */
+{
+  oconfig_value_t values[3];
+  oconfig_item_t children[3];
+  oconfig_item_t ci;
+  int status;
+
+  memset (values, 0, sizeof (values));
+  memset (children, 0, sizeof (children));
+  memset (&ci, 0, sizeof (ci));
+
+  values[0].type = OCONFIG_TYPE_STRING;
+  values[0].value.string = test_dir;
+  children[0].key = "DataDir";
+
+  values[1].type = OCONFIG_TYPE_BOOLEAN;
+  values[1].value.boolean = 1;
+  children[1].key = "Watch";
+
+  values[2].type = OCONFIG_TYPE_NUMBER;
+  values[2].value.number = (double) watch_limit;
+  children[2].key = "WatchLimit";
+
+  children[0].values = values + 0;
+  children[1].values = values + 1;
+  children[2].values = values + 2;
+  children[0].values_num = 1;
+  children[1].values_num = 1;
+  children[2].values_num = 1;
+
+  ci.key = "DataProvider";
+  ci.children = children;
+  ci.children_num = 3;
+
+  status = dp_rrdtool_config (&ci);
+  if (status == 0)
+    status = data_provider_config_submit ();
+
+  return (status);
+} /* }}} int test_configure */
+
+/* Reports the changes since the last scan: from the pending inotify events if
+ * "watching", by stat(2)ing all directories otherwise. */
+static int test_scan (_Bool watching) /* {{{ */
+{
+  if (watching)
+    return (data_provider_get_idents_events (test_delta_cb, NULL));
+  return (data_provider_get_idents_delta (test_delta_cb, NULL));
+} /* }}} int test_scan */
+
+/* The tree has seven directories: the data directory, two hosts with two
+ * plugins each. */
+static void test_run (int watch_limit, _Bool watching) /* {{{ */
+{
+  const char *initial[] = { "+alpha/cpu-0/cpu-idle", "+alpha/cpu-0/cpu-user",
+    "+alpha/load/load", "+beta/cpu-0/cpu-idle", "+beta/cpu-0/cpu-user",
+    "+beta/load/load", NULL };
+  const char *none[] = { NULL };
+  const char *added_file[] = { "+alpha/cpu-0/cpu-system", NULL };
+  const char *removed_file[] = { "-alpha/load/load", NULL };
+  const char *added_host[] = { "+gamma/memory/memory-used", NULL };
+  const char *removed_host[] = { "-beta/cpu-0/cpu-idle",
+    "-beta/cpu-0/cpu-user", "-beta/load/load", NULL };
+  const char *final[] = { "+alpha/cpu-0/cpu-idle", "+alpha/cpu-0/cpu-user",
+    "+alpha/cpu-0/cpu-system", "+gamma/memory/memory-used", NULL };
+  int status;
+
+  printf ("test_watch: WatchLimit %i\n", watch_limit);
+
+  test_mkdir ("alpha");
+  test_mkdir ("alpha/cpu-0");
+  test_mkdir ("alpha/load");
+  test_mkdir ("beta");
+  test_mkdir ("beta/cpu-0");
+  test_mkdir ("beta/load");
+  test_touch ("alpha/cpu-0/cpu-idle.rrd");
+  test_touch ("alpha/cpu-0/cpu-user.rrd");
+  test_touch ("alpha/load/load.rrd");
+  test_touch ("beta/cpu-0/cpu-idle.rrd");
+  test_touch ("beta/cpu-0/cpu-user.rrd");
+  test_touch ("beta/load/load.rrd");
+  /* Not an RRD file. */
+  test_touch ("alpha/load/README");
+
+  status = test_configure (watch_limit);
+  if (status != 0)
+  {
+    fprintf (stderr, "test_configure failed with status %i\n", status);
+    test_errors++;
+    return;
+  }
+
+  status = data_provider_get_idents (test_idents_cb, NULL);
+  test_expect ("get_idents", status, initial);
+
+  /* Without watches, the provider can't report events and the caller has to
+   * scan. */
+  status = data_provider_get_idents_events (test_delta_cb, NULL);
+  if (watching)
+    test_expect ("no events", status, none);
+  else if (status != ENOTSUP)
+  {
+    fprintf (stderr, "get_idents_events returned %i instead of ENOTSUP "
+        "after reaching the WatchLimit\n", status);
+    test_errors++;
+  }
+
+  test_touch ("alpha/cpu-0/cpu-system.rrd");
+  test_touch ("alpha/cpu-0/notes.txt");
+  test_expect ("added file", test_scan (watching), added_file);
+
+  test_remove ("alpha/load/load.rrd");
+  test_expect ("removed file", test_scan (watching), removed_file);
+
+  test_mkdir ("gamma");
+  test_mkdir ("gamma/memory");
+  test_touch ("gamma/memory/memory-used.rrd");
+  test_expect ("added host", test_scan (watching), added_host);
+
+  test_remove ("beta");
+  test_expect ("removed host", test_scan (watching), removed_host);
+
+  test_expect ("unchanged", test_scan (watching), none);
+
+  status = data_provider_get_idents (test_idents_cb, NULL);
+  test_expect ("get_idents again", status, final);
+
+  test_remove ("alpha");
+  test_remove ("gamma");
+} /* }}} void test_run */
+
+int main (void) /* {{{ */
+{
+  if (mkdtemp (test_dir) == NULL)
+  {
+    perror ("mkdtemp");
+    return (1);
+  }
+
+#if HAVE_SYS_INOTIFY_H
+  test_run (/* watch limit = */ 64, /* watching = */ 1);
+#endif
+  test_run (/* watch limit = */ 3, /* watching = */ 0);
+
+  rmdir (test_dir);
+
+  printf ("test_watch: %i errors\n", test_errors);
+  return ((test_errors == 0) ? 0 : 1);
+} /* }}} int main */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
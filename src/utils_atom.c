@@ -0,0 +1,211 @@
+/**
+ * collection4 - utils_atom.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "utils_atom.h"
+#include "utils_hash.h"
+
+/* Strings are copied into chunks of this size. Longer strings get a chunk of
+ * their own. */
+#define ARENA_CHUNK_SIZE 65536
+
+/* The atom to string mapping is kept in fixed-size pages, so that growing the
+ * table never moves existing entries. */
+#define ATOM_PAGE_BITS 16
+#define ATOM_PAGE_SIZE (1 << ATOM_PAGE_BITS)
+#define ATOM_PAGES_NUM 65536
+
+struct arena_chunk_s;
+typedef struct arena_chunk_s arena_chunk_t;
+struct arena_chunk_s
+{
+  arena_chunk_t *next;
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+static arena_chunk_t *arena = NULL;
+
+static const char **atom_pages[ATOM_PAGES_NUM];
+/* Atom zero is reserved for ATOM_INVALID. Written with release semantics
+ * after the new entry has been stored, so that "atom_get" can read the
+ * tables without holding the lock. */
+static atom_t atom_next = 1;
+
+/* Protects everything but reading existing entries. */
+static pthread_mutex_t atom_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Maps strings (stored in the arena) to atoms, cast to pointers. */
+static c4_hash_t *atom_index = NULL;
+
+/*
+ * Private functions
+ */
+static char *arena_strdup (const char *str) /* {{{ */
+{
+  size_t len = strlen (str) + 1;
+  char *ret;
+
+  if ((arena == NULL) || ((arena->size - arena->used) < len))
+  {
+    arena_chunk_t *chunk;
+    size_t size = ARENA_CHUNK_SIZE;
+
+    if (len > size)
+      size = len;
+
+    chunk = malloc (sizeof (*chunk) + size);
+    if (chunk == NULL)
+      return (NULL);
+
+    chunk->size = size;
+    chunk->used = 0;
+
+    /* Only the first chunk is ever appended to. If a long string required a
+     * chunk of its own, put it behind the current one so the remaining space
+     * in the current chunk isn't wasted. */
+    if ((arena != NULL) && (len > ARENA_CHUNK_SIZE))
+    {
+      chunk->next = arena->next;
+      arena->next = chunk;
+    }
+    else
+    {
+      chunk->next = arena;
+      arena = chunk;
+    }
+
+    ret = chunk->data;
+    chunk->used += len;
+    memcpy (ret, str, len);
+    return (ret);
+  }
+
+  ret = arena->data + arena->used;
+  arena->used += len;
+  memcpy (ret, str, len);
+
+  return (ret);
+} /* }}} char *arena_strdup */
+
+static atom_t atom_intern_locked (const char *str) /* {{{ */
+{
+  const char ***page;
+  char *copy;
+  atom_t atom;
+  int status;
+
+  if (atom_index == NULL)
+  {
+    atom_index = c4_hash_create (c4_hash_string, c4_hash_compare_string);
+    if (atom_index == NULL)
+      return (ATOM_INVALID);
+  }
+
+  atom = (atom_t) (uintptr_t) c4_hash_lookup (atom_index, str);
+  if (atom != ATOM_INVALID)
+    return (atom);
+
+  if (atom_next == UINT32_MAX)
+  {
+    fprintf (stderr, "atom_intern: Too many distinct strings.\n");
+    return (ATOM_INVALID);
+  }
+
+  page = &atom_pages[atom_next >> ATOM_PAGE_BITS];
+  if (*page == NULL)
+  {
+    *page = calloc (ATOM_PAGE_SIZE, sizeof (**page));
+    if (*page == NULL)
+      return (ATOM_INVALID);
+  }
+
+  copy = arena_strdup (str);
+  if (copy == NULL)
+    return (ATOM_INVALID);
+
+  atom = atom_next;
+  status = c4_hash_insert (atom_index, copy, (void *) (uintptr_t) atom);
+  if (status != 0)
+    /* The copy stays in the arena. We can't hand it out as an atom, though,
+     * or the next call would create a second atom for the same string. */
+    return (ATOM_INVALID);
+
+  (*page)[atom & (ATOM_PAGE_SIZE - 1)] = copy;
+  __atomic_store_n (&atom_next, atom + 1, __ATOMIC_RELEASE);
+
+  return (atom);
+} /* }}} atom_t atom_intern_locked */
+
+/*
+ * Public functions
+ */
+atom_t atom_intern (const char *str) /* {{{ */
+{
+  atom_t atom;
+
+  if (str == NULL)
+    return (ATOM_INVALID);
+
+  pthread_mutex_lock (&atom_lock);
+  atom = atom_intern_locked (str);
+  pthread_mutex_unlock (&atom_lock);
+
+  return (atom);
+} /* }}} atom_t atom_intern */
+
+atom_t atom_find (const char *str) /* {{{ */
+{
+  atom_t atom = ATOM_INVALID;
+
+  if (str == NULL)
+    return (ATOM_INVALID);
+
+  pthread_mutex_lock (&atom_lock);
+  if (atom_index != NULL)
+    atom = (atom_t) (uintptr_t) c4_hash_lookup (atom_index, str);
+  pthread_mutex_unlock (&atom_lock);
+
+  return (atom);
+} /* }}} atom_t atom_find */
+
+const char *atom_get (atom_t atom) /* {{{ */
+{
+  const char **page;
+
+  if ((atom == ATOM_INVALID)
+      || (atom >= __atomic_load_n (&atom_next, __ATOMIC_ACQUIRE)))
+    return (NULL);
+
+  page = atom_pages[atom >> ATOM_PAGE_BITS];
+  return (page[atom & (ATOM_PAGE_SIZE - 1)]);
+} /* }}} const char *atom_get */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,57 @@
+/**
+ * collection4 - utils_atom.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_ATOM_H
+#define UTILS_ATOM_H 1
+
+#include <stdint.h>
+
+/*
+ * Process-wide string interning. Each distinct string is stored exactly once
+ * in an append-only arena and identified by a 32 bit "atom". Two strings are
+ * equal (in the "strcmp" sense) if and only if their atoms are equal. Atoms
+ * are never freed, so the pointers returned by "atom_get" remain valid for
+ * the lifetime of the process.
+ *
+ * "atom_intern" and "atom_find" may be called from multiple threads.
+ * "atom_get" doesn't take a lock.
+ */
+typedef uint32_t atom_t;
+
+/* Never returned by "atom_intern" for a valid string. */
+#define ATOM_INVALID ((atom_t) 0)
+
+/* Returns the atom for "str", adding the string to the pool if necessary.
+ * Returns ATOM_INVALID if "str" is NULL or memory is exhausted. */
+atom_t atom_intern (const char *str);
+
+/* Returns the atom for "str" if the string has been interned before, and
+ * ATOM_INVALID otherwise. Never adds to the pool, so it is safe to use with
+ * strings sent by clients. */
+atom_t atom_find (const char *str);
+
+/* Returns the string of the given atom or NULL if the atom is invalid. */
+const char *atom_get (atom_t atom);
+
+#endif /* UTILS_ATOM_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
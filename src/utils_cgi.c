@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
@@ -50,7 +51,16 @@ struct param_list_s
   size_t parameters_num;
 };
 
-static param_list_t *pl_global = NULL;
+/* State of the request handled by a thread. The "fcgx" member is NULL in the
+ * single threaded mode, which uses the <fcgi_stdio.h> globals. */
+struct cgi_request_s
+{
+  FCGX_Request *fcgx;
+  param_list_t *params;
+};
+typedef struct cgi_request_s cgi_request_t;
+
+static __thread cgi_request_t cgi_current = { NULL, NULL };
 
 static char *uri_unescape_copy (char *dest, const char *src, size_t n) /* {{{ */
 {
@@ -164,12 +174,13 @@ static int parse_query_string (param_list_t *pl, /* {{{ */
 {
   char *dummy;
   char *keyval;
+  char *saveptr = NULL;
 
   if ((pl == NULL) || (query_string == NULL))
     return (EINVAL);
 
   dummy = query_string;
-  while ((keyval = strtok (dummy, ";&")) != NULL)
+  while ((keyval = strtok_r (dummy, ";&", &saveptr)) != NULL)
   {
     dummy = NULL;
     param_parse_keyval (pl, keyval);
@@ -178,13 +189,65 @@ static int parse_query_string (param_list_t *pl, /* {{{ */
   return (0);
 } /* }}} int parse_query_string */
 
+void cgi_request_set (FCGX_Request *fcgx) /* {{{ */
+{
+  cgi_current.fcgx = fcgx;
+} /* }}} void cgi_request_set */
+
+void cgi_request_finish (void) /* {{{ */
+{
+  if (cgi_current.fcgx != NULL)
+    FCGX_Finish_r (cgi_current.fcgx);
+  else
+    FCGI_Finish ();
+} /* }}} void cgi_request_finish */
+
+const char *cgi_getenv (const char *name) /* {{{ */
+{
+  if (cgi_current.fcgx != NULL)
+    return (FCGX_GetParam (name, cgi_current.fcgx->envp));
+
+  return (getenv (name));
+} /* }}} const char *cgi_getenv */
+
+int cgi_printf (const char *format, ...) /* {{{ */
+{
+  va_list ap;
+  int status;
+
+  va_start (ap, format);
+  if (cgi_current.fcgx != NULL)
+    status = FCGX_VFPrintF (cgi_current.fcgx->out, format, ap);
+  else
+    status = vprintf (format, ap);
+  va_end (ap);
+
+  return (status);
+} /* }}} int cgi_printf */
+
+int cgi_write (const void *buffer, size_t buffer_size) /* {{{ */
+{
+  if (cgi_current.fcgx != NULL)
+  {
+    if (FCGX_PutStr (buffer, (int) buffer_size, cgi_current.fcgx->out)
+        != (int) buffer_size)
+      return (EIO);
+    return (0);
+  }
+
+  if ((buffer_size > 0)
+      && (fwrite (buffer, buffer_size, /* nmemb = */ 1, stdout) != 1))
+    return (EIO);
+  return (0);
+} /* }}} int cgi_write */
+
 int param_init (void) /* {{{ */
 {
-  if (pl_global != NULL)
+  if (cgi_current.params != NULL)
     return (0);
 
-  pl_global = param_create (/* query string = */ NULL);
-  if (pl_global == NULL)
+  cgi_current.params = param_create (/* query string = */ NULL);
+  if (cgi_current.params == NULL)
     return (ENOMEM);
 
   return (0);
@@ -192,15 +255,15 @@ int param_init (void) /* {{{ */
 
 void param_finish (void) /* {{{ */
 {
-  param_destroy (pl_global);
-  pl_global = NULL;
+  param_destroy (cgi_current.params);
+  cgi_current.params = NULL;
 } /* }}} void param_finish */
 
 const char *param (const char *key) /* {{{ */
 {
   param_init ();
 
-  return (param_get (pl_global, key));
+  return (param_get (cgi_current.params, key));
 } /* }}} const char *param */
 
 param_list_t *param_create (const char *query_string) /* {{{ */
@@ -209,7 +272,7 @@ param_list_t *param_create (const char *query_string) /* {{{ */
   param_list_t *pl;
 
   if (query_string == NULL)
-    query_string = getenv ("QUERY_STRING");
+    query_string = cgi_getenv ("QUERY_STRING");
 
   if (query_string == NULL)
     return (NULL);
@@ -410,7 +473,7 @@ int param_print_hidden (param_list_t *pl) /* {{{ */
     html_escape_copy (key, pl->parameters[i].key, sizeof (key));
     html_escape_copy (value, pl->parameters[i].value, sizeof (value));
 
-    printf ("  <input type=\"hidden\" name=\"%s\" value=\"%s\" />\n",
+    cgi_printf ("  <input type=\"hidden\" name=\"%s\" value=\"%s\" />\n",
         key, value);
   }
 
@@ -576,9 +639,9 @@ char *json_escape (const char *string) /* {{{ */
 
 const char *script_name (void) /* {{{ */
 {
-  char *ret;
+  const char *ret;
 
-  ret = getenv ("SCRIPT_NAME");
+  ret = cgi_getenv ("SCRIPT_NAME");
   if (ret == NULL)
     ret = "collection4.fcgi";
 
@@ -603,6 +666,89 @@ int time_to_rfc1123 (time_t t, char *buffer, size_t buffer_size) /* {{{ */
   return (0);
 } /* }}} int time_to_rfc1123 */
 
+/* Returns true if "etag" is contained in the list of entity tags "list", as
+ * sent in an "If-None-Match" header. Weak tags match, too. */
+static _Bool etag_list_contains (const char *list, const char *etag) /* {{{ */
+{
+  size_t etag_len = strlen (etag);
+  const char *ptr = list;
+
+  while (*ptr != 0)
+  {
+    size_t len;
+
+    while ((*ptr == ' ') || (*ptr == '\t') || (*ptr == ','))
+      ptr++;
+
+    if (*ptr == '*')
+      return (1);
+
+    if ((ptr[0] == 'W') && (ptr[1] == '/'))
+      ptr += 2;
+
+    len = strcspn (ptr, ", \t");
+    if ((len == etag_len) && (strncmp (ptr, etag, len) == 0))
+      return (1);
+    ptr += len;
+  }
+
+  return (0);
+} /* }}} _Bool etag_list_contains */
+
+_Bool cgi_not_modified (const char *etag, time_t mtime) /* {{{ */
+{
+  const char *tmp;
+  char time_buffer[128];
+
+  tmp = cgi_getenv ("HTTP_IF_NONE_MATCH");
+  if (tmp != NULL)
+  {
+    /* If-Modified-Since must be ignored if If-None-Match is present, see
+     * RFC 7232, section 6. */
+    if (etag == NULL)
+      return (0);
+    return (etag_list_contains (tmp, etag));
+  }
+
+  tmp = cgi_getenv ("HTTP_IF_MODIFIED_SINCE");
+  if ((tmp == NULL) || (mtime <= 0))
+    return (0);
+
+  /* Clients send back the Last-Modified header verbatim, so an exact match
+   * is sufficient and doesn't require parsing dates. */
+  if (time_to_rfc1123 (mtime, time_buffer, sizeof (time_buffer)) != 0)
+    return (0);
+
+  return (strcmp (tmp, time_buffer) == 0);
+} /* }}} _Bool cgi_not_modified */
+
+void cgi_print_validators (const char *etag, time_t mtime) /* {{{ */
+{
+  char time_buffer[128];
+
+  if (etag != NULL)
+    cgi_printf ("ETag: %s\n", etag);
+
+  if ((mtime > 0)
+      && (time_to_rfc1123 (mtime, time_buffer, sizeof (time_buffer)) == 0))
+    cgi_printf ("Last-Modified: %s\n", time_buffer);
+} /* }}} void cgi_print_validators */
+
+void cgi_print_not_modified (const char *etag, time_t mtime, /* {{{ */
+    time_t expires)
+{
+  char time_buffer[128];
+
+  cgi_printf ("Status: 304 Not Modified\n");
+  cgi_print_validators (etag, mtime);
+  if ((expires > 0)
+      && (time_to_rfc1123 (expires, time_buffer, sizeof (time_buffer)) == 0))
+    cgi_printf ("Expires: %s\n"
+        "Cache-Control: public\n",
+        time_buffer);
+  cgi_printf ("\n");
+} /* }}} void cgi_print_not_modified */
+
 #define COPY_ENTITY(e) do {    \
   size_t len = strlen (e);     \
   if (dest_size < (len + 1))   \
@@ -675,7 +821,7 @@ int html_print_page (const char *title, /* {{{ */
 {
   char *title_html;
 
-  printf ("Content-Type: text/html\n"
+  cgi_printf ("Content-Type: text/html\n"
       "X-Generator: "PACKAGE_STRING"\n"
       "\n\n");
 
@@ -684,7 +830,7 @@ int html_print_page (const char *title, /* {{{ */
 
   title_html = html_escape (title);
 
-  printf ("<html>\n"
+  cgi_printf ("<html>\n"
       "  <head>\n"
       "    <title>%s</title>\n"
       "    <link rel=\"stylesheet\" type=\"text/css\" href=\"../../share/"PACKAGE"/style.css\" />\n"
@@ -700,7 +846,7 @@ int html_print_page (const char *title, /* {{{ */
       "  </head>\n",
       title_html);
 
-  printf ("  <body>\n"
+  cgi_printf ("  <body>\n"
       "    <table id=\"layout-table\">\n"
       "      <tr id=\"layout-top\">\n"
       "        <td id=\"layout-top-left\">");
@@ -708,45 +854,45 @@ int html_print_page (const char *title, /* {{{ */
     (*cb->top_left) (user_data);
   else
     html_print_logo (NULL);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-top-center\">");
   if (cb->top_center != NULL)
     (*cb->top_center) (user_data);
   else
-    printf ("<h1>%s</h1>", title_html);
-  printf ("</td>\n"
+    cgi_printf ("<h1>%s</h1>", title_html);
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-top-right\">");
   if (cb->top_right != NULL)
     (*cb->top_right) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "      </tr>\n"
       "      <tr id=\"layout-middle\">\n"
       "        <td id=\"layout-middle-left\">");
   if (cb->middle_left != NULL)
     (*cb->middle_left) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-middle-center\">");
   if (cb->middle_center != NULL)
     (*cb->middle_center) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-middle-right\">");
   if (cb->middle_right != NULL)
     (*cb->middle_right) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "      </tr>\n"
       "      <tr id=\"layout-bottom\">\n"
       "        <td id=\"layout-bottom-left\">");
   if (cb->bottom_left != NULL)
     (*cb->bottom_left) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-bottom-center\">");
   if (cb->bottom_center != NULL)
     (*cb->bottom_center) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "        <td id=\"layout-bottom-right\">");
   if (cb->bottom_right != NULL)
     (*cb->bottom_right) (user_data);
-  printf ("</td>\n"
+  cgi_printf ("</td>\n"
       "      </tr>\n"
       "    </table>\n"
       "    <div class=\"footer\"><a href=\"http://octo.it/c4/\">"PACKAGE_STRING"</a></div>\n"
@@ -759,7 +905,7 @@ int html_print_page (const char *title, /* {{{ */
 
 int html_print_logo (__attribute__((unused)) void *user_data) /* {{{ */
 {
-  printf ("<a href=\"%s?action=list_graphs\" id=\"logo-canvas\">\n"
+  cgi_printf ("<a href=\"%s?action=list_graphs\" id=\"logo-canvas\">\n"
       "  <h1>C<sub>4</sub></h1>\n"
       "  <div id=\"logo-subscript\">collection&nbsp;4</div>\n"
       "</a>\n", script_name ());
@@ -773,7 +919,7 @@ int html_print_search_box (__attribute__((unused)) void *user_data) /* {{{ */
 
   term_html = html_escape (param ("q"));
 
-  printf ("<form action=\"%s\" method=\"get\" id=\"search-form\">\n"
+  cgi_printf ("<form action=\"%s\" method=\"get\" id=\"search-form\">\n"
       "  <input type=\"hidden\" name=\"action\" value=\"search\" />\n"
       "  <input type=\"text\" name=\"q\" value=\"%s\" id=\"search-input\" />\n"
       "  <input type=\"submit\" name=\"button\" value=\"Search\" />\n"
@@ -26,6 +26,8 @@
 
 #include <time.h>
 
+struct FCGX_Request;
+
 typedef int (*page_callback_t) (void *user_data);
 
 struct page_callbacks_s
@@ -50,6 +52,22 @@ typedef struct param_list_s param_list_t;
   NULL, NULL, NULL, \
   NULL, NULL, NULL }
 
+/* Makes "fcgx" the request handled by the calling thread. Output written
+ * with "cgi_printf" and "cgi_write" goes to this request and the parameters
+ * and environment are read from it. If "fcgx" is NULL, the <fcgi_stdio.h>
+ * streams and the process environment are used. */
+void cgi_request_set (struct FCGX_Request *fcgx);
+
+/* Finishes the current request, so the client doesn't have to wait for any
+ * work done after handling it. */
+void cgi_request_finish (void);
+
+const char *cgi_getenv (const char *name);
+
+int cgi_printf (const char *format, ...)
+  __attribute__((format(printf,1,2)));
+int cgi_write (const void *buffer, size_t buffer_size);
+
 int param_init (void);
 void param_finish (void);
 
@@ -78,6 +96,17 @@ const char *script_name (void);
 
 int time_to_rfc1123 (time_t t, char *buffer, size_t buffer_size);
 
+/* Compares the client's "If-None-Match" header or, if there is none, its
+ * "If-Modified-Since" header with "etag" and "mtime". Returns true if the
+ * client's copy is still current. Either validator may be NULL or zero. */
+_Bool cgi_not_modified (const char *etag, time_t mtime);
+
+/* Prints the "ETag" and "Last-Modified" headers, unless NULL or zero. */
+void cgi_print_validators (const char *etag, time_t mtime);
+
+/* Sends a complete "304 Not Modified" response. */
+void cgi_print_not_modified (const char *etag, time_t mtime, time_t expires);
+
 char *html_escape (const char *string);
 char *html_escape_buffer (char *buffer, size_t buffer_size);
 char *html_escape_copy (char *dest, const char *src, size_t n);
@@ -0,0 +1,555 @@
+/**
+ * collection4 - utils_consolidate.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "utils_consolidate.h"
+
+/* With x87 arithmetic (FLT_EVAL_METHOD != 0) the scalar loop would use
+ * excess precision, so the vector kernels would not be bit-exact. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+  && (FLT_EVAL_METHOD == 0)
+# define HAVE_X86_KERNELS 1
+# include <immintrin.h>
+#endif
+
+/*
+ * The vector kernels process one bucket per lane, so each bucket is summed in
+ * exactly the same order as in the scalar loop. Sums start at -0.0, which is
+ * the identity of addition, and NAN values are replaced by -0.0 so they can
+ * be added unconditionally. Minimum and maximum keep the current value if
+ * the new one is equal, just like "_mm_min_pd" and "_mm_max_pd" do, and NAN
+ * values are replaced by +inf and -inf respectively.
+ */
+typedef void (*consolidate_kernel_t) (const double *values,
+    size_t bucket_size, size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max);
+
+static consolidate_kernel_t kernel = consolidate_scalar;
+static const char *kernel_name = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void store_bucket (size_t index, double num, /* {{{ */
+    double sum, double min, double max,
+    uint32_t *ret_count, double *ret_avg, double *ret_min, double *ret_max)
+{
+  if (ret_count != NULL)
+    ret_count[index] = (uint32_t) num;
+
+  if (num == 0.0)
+  {
+    sum = NAN;
+    min = NAN;
+    max = NAN;
+  }
+
+  if (ret_avg != NULL)
+    ret_avg[index] = sum / num;
+  if (ret_min != NULL)
+    ret_min[index] = min;
+  if (ret_max != NULL)
+    ret_max[index] = max;
+} /* }}} void store_bucket */
+
+void consolidate_scalar (const double *values, /* {{{ */
+    size_t bucket_size, size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max)
+{
+  size_t i;
+
+  for (i = 0; i < buckets_num; i++)
+  {
+    const double *bucket = values + (i * bucket_size);
+    double sum = -0.0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    double num = 0.0;
+    size_t j;
+
+    for (j = 0; j < bucket_size; j++)
+    {
+      double value = bucket[j];
+
+      if (isnan (value))
+        continue;
+
+      sum += value;
+      min = (value < min) ? value : min;
+      max = (value > max) ? value : max;
+      num += 1.0;
+    }
+
+    store_bucket (i, num, sum, min, max,
+        ret_count, ret_avg, ret_min, ret_max);
+  }
+} /* }}} void consolidate_scalar */
+
+#if HAVE_X86_KERNELS
+#define SSE2_STEP(value) do {                                                \
+  __m128d v = (value);                                                       \
+  __m128d valid = _mm_cmpord_pd (v, v);                                      \
+  sum = _mm_add_pd (sum, _mm_or_pd (_mm_and_pd (valid, v),                   \
+        _mm_andnot_pd (valid, neg_zero)));                                   \
+  min = _mm_min_pd (_mm_or_pd (_mm_and_pd (valid, v),                        \
+        _mm_andnot_pd (valid, pos_inf)), min);                               \
+  max = _mm_max_pd (_mm_or_pd (_mm_and_pd (valid, v),                        \
+        _mm_andnot_pd (valid, neg_inf)), max);                               \
+  num = _mm_add_pd (num, _mm_and_pd (valid, one));                           \
+} while (0)
+
+__attribute__ ((target ("sse2")))
+static void consolidate_sse2 (const double *values, /* {{{ */
+    size_t bucket_size, size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max)
+{
+  const __m128d neg_zero = _mm_set1_pd (-0.0);
+  const __m128d pos_inf = _mm_set1_pd (INFINITY);
+  const __m128d neg_inf = _mm_set1_pd (-INFINITY);
+  const __m128d one = _mm_set1_pd (1.0);
+  const __m128d nan = _mm_set1_pd (NAN);
+  size_t i;
+
+  for (i = 0; (i + 2) <= buckets_num; i += 2)
+  {
+    const double *bucket = values + (i * bucket_size);
+    __m128d sum = neg_zero;
+    __m128d min = pos_inf;
+    __m128d max = neg_inf;
+    __m128d num = _mm_setzero_pd ();
+    __m128d empty;
+    size_t j;
+
+    /* Load two consecutive values of each bucket and transpose them, so
+     * that each vector holds one value of both buckets. */
+    for (j = 0; (j + 2) <= bucket_size; j += 2)
+    {
+      __m128d a = _mm_loadu_pd (bucket + j);
+      __m128d b = _mm_loadu_pd (bucket + bucket_size + j);
+
+      SSE2_STEP (_mm_unpacklo_pd (a, b));
+      SSE2_STEP (_mm_unpackhi_pd (a, b));
+    }
+
+    if (j < bucket_size)
+      SSE2_STEP (_mm_set_pd (bucket[bucket_size + j], bucket[j]));
+
+    /* Buckets without values have a count of zero. */
+    empty = _mm_cmpeq_pd (num, _mm_setzero_pd ());
+    if (ret_count != NULL)
+      _mm_storel_epi64 ((__m128i *) (ret_count + i), _mm_cvtpd_epi32 (num));
+    if (ret_avg != NULL)
+      _mm_storeu_pd (ret_avg + i, _mm_or_pd (_mm_and_pd (empty, nan),
+            _mm_andnot_pd (empty, _mm_div_pd (sum, num))));
+    if (ret_min != NULL)
+      _mm_storeu_pd (ret_min + i, _mm_or_pd (_mm_and_pd (empty, nan),
+            _mm_andnot_pd (empty, min)));
+    if (ret_max != NULL)
+      _mm_storeu_pd (ret_max + i, _mm_or_pd (_mm_and_pd (empty, nan),
+            _mm_andnot_pd (empty, max)));
+  }
+
+  if (i < buckets_num)
+    consolidate_scalar (values + (i * bucket_size), bucket_size,
+        buckets_num - i,
+        (ret_count != NULL) ? ret_count + i : NULL,
+        (ret_avg != NULL) ? ret_avg + i : NULL,
+        (ret_min != NULL) ? ret_min + i : NULL,
+        (ret_max != NULL) ? ret_max + i : NULL);
+} /* }}} void consolidate_sse2 */
+
+#define AVX2_STEP(value) do {                                                \
+  __m256d v = (value);                                                       \
+  __m256d valid = _mm256_cmp_pd (v, v, _CMP_ORD_Q);                          \
+  sum = _mm256_add_pd (sum, _mm256_blendv_pd (neg_zero, v, valid));          \
+  min = _mm256_min_pd (_mm256_blendv_pd (pos_inf, v, valid), min);          \
+  max = _mm256_max_pd (_mm256_blendv_pd (neg_inf, v, valid), max);          \
+  num = _mm256_add_pd (num, _mm256_and_pd (valid, one));                     \
+} while (0)
+
+__attribute__ ((target ("avx2")))
+static void consolidate_avx2 (const double *values, /* {{{ */
+    size_t bucket_size, size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max)
+{
+  const __m256d neg_zero = _mm256_set1_pd (-0.0);
+  const __m256d pos_inf = _mm256_set1_pd (INFINITY);
+  const __m256d neg_inf = _mm256_set1_pd (-INFINITY);
+  const __m256d one = _mm256_set1_pd (1.0);
+  const __m256d nan = _mm256_set1_pd (NAN);
+  const __m256i offsets = _mm256_set_epi64x ((long long) (3 * bucket_size),
+      (long long) (2 * bucket_size), (long long) bucket_size, 0);
+  size_t i;
+
+  /* The transpose below needs at least four values per bucket; gathering
+   * single values is slower than the SSE2 kernel. */
+  if (bucket_size < 4)
+  {
+    consolidate_sse2 (values, bucket_size, buckets_num,
+        ret_count, ret_avg, ret_min, ret_max);
+    return;
+  }
+
+  for (i = 0; (i + 4) <= buckets_num; i += 4)
+  {
+    const double *bucket = values + (i * bucket_size);
+    __m256d sum = neg_zero;
+    __m256d min = pos_inf;
+    __m256d max = neg_inf;
+    __m256d num = _mm256_setzero_pd ();
+    __m256d empty;
+    size_t j;
+
+    /* Load four consecutive values of each bucket and transpose the 4x4
+     * block, so that each vector holds one value of all four buckets. */
+    for (j = 0; (j + 4) <= bucket_size; j += 4)
+    {
+      __m256d a = _mm256_loadu_pd (bucket + j);
+      __m256d b = _mm256_loadu_pd (bucket + bucket_size + j);
+      __m256d c = _mm256_loadu_pd (bucket + (2 * bucket_size) + j);
+      __m256d d = _mm256_loadu_pd (bucket + (3 * bucket_size) + j);
+      __m256d ab_lo = _mm256_unpacklo_pd (a, b);
+      __m256d ab_hi = _mm256_unpackhi_pd (a, b);
+      __m256d cd_lo = _mm256_unpacklo_pd (c, d);
+      __m256d cd_hi = _mm256_unpackhi_pd (c, d);
+
+      AVX2_STEP (_mm256_permute2f128_pd (ab_lo, cd_lo, 0x20));
+      AVX2_STEP (_mm256_permute2f128_pd (ab_hi, cd_hi, 0x20));
+      AVX2_STEP (_mm256_permute2f128_pd (ab_lo, cd_lo, 0x31));
+      AVX2_STEP (_mm256_permute2f128_pd (ab_hi, cd_hi, 0x31));
+    }
+
+    for (; j < bucket_size; j++)
+      AVX2_STEP (_mm256_i64gather_pd (bucket + j, offsets, 8));
+
+    empty = _mm256_cmp_pd (num, _mm256_setzero_pd (), _CMP_EQ_OQ);
+    if (ret_count != NULL)
+      _mm_storeu_si128 ((__m128i *) (ret_count + i),
+          _mm256_cvtpd_epi32 (num));
+    if (ret_avg != NULL)
+      _mm256_storeu_pd (ret_avg + i,
+          _mm256_blendv_pd (_mm256_div_pd (sum, num), nan, empty));
+    if (ret_min != NULL)
+      _mm256_storeu_pd (ret_min + i, _mm256_blendv_pd (min, nan, empty));
+    if (ret_max != NULL)
+      _mm256_storeu_pd (ret_max + i, _mm256_blendv_pd (max, nan, empty));
+  }
+
+  if (i < buckets_num)
+    consolidate_sse2 (values + (i * bucket_size), bucket_size,
+        buckets_num - i,
+        (ret_count != NULL) ? ret_count + i : NULL,
+        (ret_avg != NULL) ? ret_avg + i : NULL,
+        (ret_min != NULL) ? ret_min + i : NULL,
+        (ret_max != NULL) ? ret_max + i : NULL);
+} /* }}} void consolidate_avx2 */
+#endif /* HAVE_X86_KERNELS */
+
+static void consolidate_select (void) /* {{{ */
+{
+#if HAVE_X86_KERNELS
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+  {
+    kernel = consolidate_avx2;
+    kernel_name = "avx2";
+  }
+  else if (__builtin_cpu_supports ("sse2"))
+  {
+    kernel = consolidate_sse2;
+    kernel_name = "sse2";
+  }
+#endif
+} /* }}} void consolidate_select */
+
+void consolidate (const double *values, size_t bucket_size, /* {{{ */
+    size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max)
+{
+  if ((values == NULL) || (bucket_size == 0) || (buckets_num == 0))
+    return;
+
+  pthread_once (&kernel_once, consolidate_select);
+  (*kernel) (values, bucket_size, buckets_num,
+      ret_count, ret_avg, ret_min, ret_max);
+} /* }}} void consolidate */
+
+const char *consolidate_impl_name (void) /* {{{ */
+{
+  pthread_once (&kernel_once, consolidate_select);
+  return (kernel_name);
+} /* }}} const char *consolidate_impl_name */
+
+int downsample_from_string (const char *str, /* {{{ */
+    downsample_t *ret_method)
+{
+  if ((str == NULL) || (ret_method == NULL))
+    return (EINVAL);
+
+  if (strcasecmp ("avg", str) == 0)
+    *ret_method = DOWNSAMPLE_AVG;
+  else if (strcasecmp ("lttb", str) == 0)
+    *ret_method = DOWNSAMPLE_LTTB;
+  else if (strcasecmp ("minmax", str) == 0)
+    *ret_method = DOWNSAMPLE_MINMAX;
+  else if (strcasecmp ("m4", str) == 0)
+    *ret_method = DOWNSAMPLE_M4;
+  else
+    return (EINVAL);
+
+  return (0);
+} /* }}} int downsample_from_string */
+
+const char *downsample_to_string (downsample_t method) /* {{{ */
+{
+  if (method == DOWNSAMPLE_LTTB)
+    return ("lttb");
+  else if (method == DOWNSAMPLE_MINMAX)
+    return ("minmax");
+  else if (method == DOWNSAMPLE_M4)
+    return ("m4");
+  return ("avg");
+} /* }}} const char *downsample_to_string */
+
+size_t downsample_max_selected (downsample_t method, /* {{{ */
+    size_t buckets_num)
+{
+  if (method == DOWNSAMPLE_M4)
+    return (4 * buckets_num);
+  else if (method == DOWNSAMPLE_AVG)
+    return (buckets_num);
+  return (2 * buckets_num);
+} /* }}} size_t downsample_max_selected */
+
+/* Selects the first, minimum, maximum and, with "m4", last value of one
+ * bucket. Returns the number of indices stored in "ret_indices". */
+static size_t select_minmax (const double *values, /* {{{ */
+    size_t offset, size_t bucket_size, _Bool m4, size_t *ret_indices)
+{
+  size_t selected[4];
+  size_t selected_num = 0;
+  size_t first = bucket_size;
+  size_t last = 0;
+  size_t min = 0;
+  size_t max = 0;
+  size_t i;
+  size_t j;
+
+  for (i = 0; i < bucket_size; i++)
+  {
+    double value = values[offset + i];
+
+    if (isnan (value))
+      continue;
+
+    if (first == bucket_size)
+    {
+      first = i;
+      min = i;
+      max = i;
+    }
+    else if (value < values[offset + min])
+      min = i;
+    else if (value > values[offset + max])
+      max = i;
+    last = i;
+  }
+
+  /* Keep the gap. */
+  if (first == bucket_size)
+  {
+    ret_indices[0] = offset;
+    return (1);
+  }
+
+  if (m4)
+    selected[selected_num++] = first;
+  selected[selected_num++] = (min < max) ? min : max;
+  selected[selected_num++] = (min < max) ? max : min;
+  if (m4)
+    selected[selected_num++] = last;
+
+  /* "first" <= "min", "max" <= "last", so the indices are sorted and
+   * duplicates are adjacent. */
+  j = 0;
+  for (i = 0; i < selected_num; i++)
+  {
+    if ((j > 0) && (ret_indices[j - 1] == offset + selected[i]))
+      continue;
+    ret_indices[j++] = offset + selected[i];
+  }
+
+  return (j);
+} /* }}} size_t select_minmax */
+
+/* Largest Triangle Three Buckets, see Sveinn Steinarsson, "Downsampling Time
+ * Series for Visual Representation", 2013. The x coordinate is the index,
+ * since the values are equidistant. NAN values are skipped. If the previously
+ * selected value or the average of the next bucket is not available, the
+ * average of the current bucket is used in its place. */
+static size_t select_lttb (const double *values, size_t values_num, /* {{{ */
+    size_t threshold, size_t *ret_indices)
+{
+  double every;
+  size_t selected_num = 0;
+  size_t a = 0;
+  _Bool have_a;
+  size_t i;
+
+  if (threshold >= values_num)
+  {
+    for (i = 0; i < values_num; i++)
+      ret_indices[i] = i;
+    return (values_num);
+  }
+  else if (threshold < 2)
+    return (0);
+
+  ret_indices[selected_num++] = 0;
+  have_a = !isnan (values[0]);
+
+  every = (threshold > 2)
+    ? ((double) (values_num - 2)) / ((double) (threshold - 2))
+    : 0.0;
+  for (i = 0; (i + 2) < threshold; i++)
+  {
+    size_t begin = ((size_t) (((double) i) * every)) + 1;
+    size_t end = ((size_t) (((double) (i + 1)) * every)) + 1;
+    size_t next_end = ((size_t) (((double) (i + 2)) * every)) + 1;
+    double ax, ay;
+    double cx, cy;
+    double sum;
+    size_t num;
+    double max_area = -1.0;
+    size_t max_index = begin;
+    size_t j;
+
+    if (end > (values_num - 1))
+      end = values_num - 1;
+    if (next_end > (values_num - 1))
+      next_end = values_num - 1;
+    if (begin >= end)
+      continue;
+
+    /* The average of the current bucket is the fallback for both A and C. */
+    sum = 0.0;
+    num = 0;
+    for (j = begin; j < end; j++)
+    {
+      if (isnan (values[j]))
+        continue;
+      sum += values[j];
+      num++;
+    }
+
+    /* Keep the gap. */
+    if (num == 0)
+    {
+      ret_indices[selected_num++] = begin;
+      continue;
+    }
+
+    ax = have_a ? (double) a : (double) begin;
+    ay = have_a ? values[a] : (sum / ((double) num));
+    cx = ((double) (begin + end - 1)) / 2.0;
+    cy = sum / ((double) num);
+
+    sum = 0.0;
+    num = 0;
+    for (j = end; j < next_end; j++)
+    {
+      if (isnan (values[j]))
+        continue;
+      sum += values[j];
+      num++;
+    }
+    if (num > 0)
+    {
+      cx = ((double) (end + next_end - 1)) / 2.0;
+      cy = sum / ((double) num);
+    }
+
+    for (j = begin; j < end; j++)
+    {
+      double area;
+
+      if (isnan (values[j]))
+        continue;
+
+      area = fabs ((ax - cx) * (values[j] - ay)
+          - (ax - ((double) j)) * (cy - ay));
+      if (area > max_area)
+      {
+        max_area = area;
+        max_index = j;
+      }
+    }
+
+    ret_indices[selected_num++] = max_index;
+    a = max_index;
+    have_a = 1;
+  }
+
+  ret_indices[selected_num++] = values_num - 1;
+
+  return (selected_num);
+} /* }}} size_t select_lttb */
+
+size_t downsample_select (downsample_t method, /* {{{ */
+    const double *values, size_t values_num, size_t bucket_size,
+    size_t *ret_indices)
+{
+  size_t buckets_num;
+  size_t offset;
+  size_t selected_num;
+  size_t i;
+
+  if ((values == NULL) || (ret_indices == NULL) || (bucket_size == 0))
+    return (0);
+
+  buckets_num = values_num / bucket_size;
+  if (method == DOWNSAMPLE_LTTB)
+    return (select_lttb (values, values_num,
+          downsample_max_selected (method, buckets_num), ret_indices));
+  else if ((method != DOWNSAMPLE_MINMAX) && (method != DOWNSAMPLE_M4))
+    return (0);
+
+  offset = values_num % bucket_size;
+  selected_num = 0;
+  for (i = 0; i < buckets_num; i++)
+    selected_num += select_minmax (values, offset + (i * bucket_size),
+        bucket_size, /* m4 = */ (method == DOWNSAMPLE_M4),
+        ret_indices + selected_num);
+
+  return (selected_num);
+} /* }}} size_t downsample_select */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
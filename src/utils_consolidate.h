@@ -0,0 +1,89 @@
+/**
+ * collection4 - utils_consolidate.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_CONSOLIDATE_H
+#define UTILS_CONSOLIDATE_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Consolidates "buckets_num" buckets of "bucket_size" consecutive values
+ * each, i.e. "values" holds (buckets_num * bucket_size) doubles. NAN values
+ * are skipped. For each bucket, the number of non-NAN values is stored in
+ * "ret_count" and their average, minimum and maximum in "ret_avg", "ret_min"
+ * and "ret_max". If a bucket has no values, all three are NAN. Any of the
+ * output arrays may be NULL.
+ *
+ * Uses SSE2 or AVX2 if the CPU supports it. The results are identical to
+ * those of "consolidate_scalar", bit for bit. */
+void consolidate (const double *values, size_t bucket_size,
+    size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max);
+
+/* The reference implementation of "consolidate". */
+void consolidate_scalar (const double *values, size_t bucket_size,
+    size_t buckets_num, uint32_t *ret_count,
+    double *ret_avg, double *ret_min, double *ret_max);
+
+/* Returns the name of the implementation "consolidate" uses, e.g. "avx2". */
+const char *consolidate_impl_name (void);
+
+/* Downsampling methods. "avg" consolidates each bucket into one value, see
+ * "consolidate". The other methods select existing values, so that peaks
+ * are preserved:
+ *   lttb:   "Largest Triangle Three Buckets", two values per bucket.
+ *   minmax: the minimum and maximum of each bucket.
+ *   m4:     the first, minimum, maximum and last value of each bucket. */
+enum downsample_e
+{
+  DOWNSAMPLE_AVG,
+  DOWNSAMPLE_LTTB,
+  DOWNSAMPLE_MINMAX,
+  DOWNSAMPLE_M4
+};
+typedef enum downsample_e downsample_t;
+
+int downsample_from_string (const char *str, downsample_t *ret_method);
+const char *downsample_to_string (downsample_t method);
+
+/* Returns the maximum number of values "downsample_select" selects from
+ * "buckets_num" buckets. */
+size_t downsample_max_selected (downsample_t method, size_t buckets_num);
+
+/* Selects values from "values_num" values with one of the selecting methods.
+ * For "minmax" and "m4", the values are split into buckets of "bucket_size"
+ * values, starting at the end, and a partial bucket at the beginning is
+ * ignored. "lttb" selects up to twice as many values as there are buckets,
+ * including the first and last value. NAN values are not selected, except
+ * for the first value of a bucket without any other values, so that gaps are
+ * kept.
+ *
+ * The indices of the selected values are stored in ascending order in
+ * "ret_indices", which must have room for "downsample_max_selected" entries.
+ * Returns the number of selected values. */
+size_t downsample_select (downsample_t method,
+    const double *values, size_t values_num, size_t bucket_size,
+    size_t *ret_indices);
+
+#endif /* UTILS_CONSOLIDATE_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
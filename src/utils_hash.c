@@ -0,0 +1,302 @@
+/**
+ * collection4 - utils_hash.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "utils_hash.h"
+
+#define HASH_INITIAL_SIZE 64
+
+struct c4_hash_entry_s;
+typedef struct c4_hash_entry_s c4_hash_entry_t;
+struct c4_hash_entry_s
+{
+  const void *key;
+  void *value;
+  uint32_t hash;
+  c4_hash_entry_t *next;
+};
+
+struct c4_hash_s
+{
+  c4_hash_func_t hash;
+  c4_hash_compare_t compare;
+
+  /* Number of buckets. Always a power of two. */
+  c4_hash_entry_t **buckets;
+  size_t buckets_num;
+
+  size_t entries_num;
+};
+
+/*
+ * Private functions
+ */
+static int hash_grow (c4_hash_t *h) /* {{{ */
+{
+  c4_hash_entry_t **buckets;
+  size_t buckets_num;
+  size_t i;
+
+  buckets_num = 2 * h->buckets_num;
+  buckets = calloc (buckets_num, sizeof (*buckets));
+  if (buckets == NULL)
+    return (ENOMEM);
+
+  for (i = 0; i < h->buckets_num; i++)
+  {
+    c4_hash_entry_t *e = h->buckets[i];
+
+    while (e != NULL)
+    {
+      c4_hash_entry_t *next = e->next;
+      size_t index = (size_t) (e->hash & (buckets_num - 1));
+
+      e->next = buckets[index];
+      buckets[index] = e;
+
+      e = next;
+    }
+  }
+
+  free (h->buckets);
+  h->buckets = buckets;
+  h->buckets_num = buckets_num;
+
+  return (0);
+} /* }}} int hash_grow */
+
+static c4_hash_entry_t **hash_find (c4_hash_t *h, /* {{{ */
+    const void *key, uint32_t hash)
+{
+  c4_hash_entry_t **e;
+
+  e = &h->buckets[hash & (h->buckets_num - 1)];
+  while (*e != NULL)
+  {
+    if (((*e)->hash == hash) && ((*h->compare) ((*e)->key, key) == 0))
+      break;
+    e = &(*e)->next;
+  }
+
+  return (e);
+} /* }}} c4_hash_entry_t **hash_find */
+
+/*
+ * Public functions
+ */
+c4_hash_t *c4_hash_create (c4_hash_func_t hash, /* {{{ */
+    c4_hash_compare_t compare)
+{
+  c4_hash_t *h;
+
+  if ((hash == NULL) || (compare == NULL))
+    return (NULL);
+
+  h = malloc (sizeof (*h));
+  if (h == NULL)
+    return (NULL);
+  memset (h, 0, sizeof (*h));
+
+  h->hash = hash;
+  h->compare = compare;
+
+  h->buckets_num = HASH_INITIAL_SIZE;
+  h->buckets = calloc (h->buckets_num, sizeof (*h->buckets));
+  if (h->buckets == NULL)
+  {
+    free (h);
+    return (NULL);
+  }
+
+  h->entries_num = 0;
+
+  return (h);
+} /* }}} c4_hash_t *c4_hash_create */
+
+void c4_hash_destroy (c4_hash_t *h) /* {{{ */
+{
+  size_t i;
+
+  if (h == NULL)
+    return;
+
+  for (i = 0; i < h->buckets_num; i++)
+  {
+    c4_hash_entry_t *e = h->buckets[i];
+
+    while (e != NULL)
+    {
+      c4_hash_entry_t *next = e->next;
+      free (e);
+      e = next;
+    }
+  }
+
+  free (h->buckets);
+  free (h);
+} /* }}} void c4_hash_destroy */
+
+int c4_hash_insert (c4_hash_t *h, const void *key, void *value) /* {{{ */
+{
+  c4_hash_entry_t **e;
+  uint32_t hash;
+
+  if ((h == NULL) || (key == NULL))
+    return (EINVAL);
+
+  hash = (*h->hash) (key);
+
+  e = hash_find (h, key, hash);
+  if (*e != NULL)
+  {
+    (*e)->key = key;
+    (*e)->value = value;
+    return (0);
+  }
+
+  /* Keep the load factor below one. */
+  if (h->entries_num >= h->buckets_num)
+  {
+    int status;
+
+    status = hash_grow (h);
+    if (status != 0)
+      return (status);
+
+    e = hash_find (h, key, hash);
+  }
+
+  *e = malloc (sizeof (**e));
+  if (*e == NULL)
+    return (ENOMEM);
+
+  (*e)->key = key;
+  (*e)->value = value;
+  (*e)->hash = hash;
+  (*e)->next = NULL;
+
+  h->entries_num++;
+
+  return (0);
+} /* }}} int c4_hash_insert */
+
+void *c4_hash_lookup (c4_hash_t *h, const void *key) /* {{{ */
+{
+  c4_hash_entry_t **e;
+
+  if ((h == NULL) || (key == NULL))
+    return (NULL);
+
+  e = hash_find (h, key, (*h->hash) (key));
+  if (*e == NULL)
+    return (NULL);
+
+  return ((*e)->value);
+} /* }}} void *c4_hash_lookup */
+
+int c4_hash_remove (c4_hash_t *h, const void *key) /* {{{ */
+{
+  c4_hash_entry_t **e;
+  c4_hash_entry_t *tmp;
+
+  if ((h == NULL) || (key == NULL))
+    return (EINVAL);
+
+  e = hash_find (h, key, (*h->hash) (key));
+  if (*e == NULL)
+    return (ENOENT);
+
+  tmp = *e;
+  *e = tmp->next;
+  free (tmp);
+
+  h->entries_num--;
+
+  return (0);
+} /* }}} int c4_hash_remove */
+
+size_t c4_hash_size (c4_hash_t *h) /* {{{ */
+{
+  if (h == NULL)
+    return (0);
+
+  return (h->entries_num);
+} /* }}} size_t c4_hash_size */
+
+int c4_hash_foreach (c4_hash_t *h, /* {{{ */
+    c4_hash_callback_t callback, void *user_data)
+{
+  size_t i;
+
+  if ((h == NULL) || (callback == NULL))
+    return (EINVAL);
+
+  for (i = 0; i < h->buckets_num; i++)
+  {
+    c4_hash_entry_t *e;
+
+    for (e = h->buckets[i]; e != NULL; e = e->next)
+    {
+      int status;
+
+      status = (*callback) (e->key, e->value, user_data);
+      if (status != 0)
+        return (status);
+    }
+  }
+
+  return (0);
+} /* }}} int c4_hash_foreach */
+
+uint32_t c4_hash_update (uint32_t hash, const char *str) /* {{{ */
+{
+  const unsigned char *ptr;
+
+  for (ptr = (const unsigned char *) str; *ptr != 0; ptr++)
+  {
+    hash ^= (uint32_t) *ptr;
+    hash *= 16777619U;
+  }
+
+  /* Hash the terminating null byte, too, so that "ab" + "c" and "a" + "bc"
+   * differ when hashing composite keys. */
+  hash *= 16777619U;
+
+  return (hash);
+} /* }}} uint32_t c4_hash_update */
+
+uint32_t c4_hash_string (const void *key) /* {{{ */
+{
+  return (c4_hash_update (C4_HASH_INIT, key));
+} /* }}} uint32_t c4_hash_string */
+
+int c4_hash_compare_string (const void *k0, const void *k1) /* {{{ */
+{
+  return (strcmp (k0, k1));
+} /* }}} int c4_hash_compare_string */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
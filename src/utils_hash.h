@@ -0,0 +1,69 @@
+/**
+ * collection4 - utils_hash.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_HASH_H
+#define UTILS_HASH_H 1
+
+#include <stdint.h>
+
+/* Simple chained hash table. Keys and values are *not* copied: the caller
+ * must make sure that both outlive the table (or the entry). */
+struct c4_hash_s;
+typedef struct c4_hash_s c4_hash_t;
+
+typedef uint32_t (*c4_hash_func_t) (const void *key);
+typedef int (*c4_hash_compare_t) (const void *k0, const void *k1);
+
+c4_hash_t *c4_hash_create (c4_hash_func_t hash, c4_hash_compare_t compare);
+void c4_hash_destroy (c4_hash_t *h);
+
+/* Inserts "key" into the table. If an equal key already exists, its value is
+ * replaced. */
+int c4_hash_insert (c4_hash_t *h, const void *key, void *value);
+
+/* Returns the value associated with "key" or NULL if the key is unknown. */
+void *c4_hash_lookup (c4_hash_t *h, const void *key);
+
+/* Removes "key" from the table. Returns ENOENT if there is no such key. */
+int c4_hash_remove (c4_hash_t *h, const void *key);
+
+size_t c4_hash_size (c4_hash_t *h);
+
+/* Calls "callback" for each entry in the table, in no particular order. The
+ * table must not be modified from within the callback. Returns the first
+ * non-zero status returned by the callback. */
+typedef int (*c4_hash_callback_t) (const void *key, void *value,
+    void *user_data);
+int c4_hash_foreach (c4_hash_t *h, c4_hash_callback_t callback,
+    void *user_data);
+
+/* Hash and compare functions for NUL-terminated strings. */
+uint32_t c4_hash_string (const void *key);
+int c4_hash_compare_string (const void *k0, const void *k1);
+
+/* FNV-1a building blocks, for hashing composite keys. */
+#define C4_HASH_INIT 2166136261U
+uint32_t c4_hash_update (uint32_t hash, const char *str);
+
+#endif /* UTILS_HASH_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
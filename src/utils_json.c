@@ -0,0 +1,759 @@
+/**
+ * collection4 - utils_json.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "utils_json.h"
+
+#define JSON_MAX_DEPTH 64
+
+struct json_writer_s
+{
+  json_write_callback callback;
+  void *user_data;
+  unsigned int flags;
+  int status;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_used;
+
+  /* Number of tokens written at each level. Inside maps, an even number
+   * means a key is next. */
+  size_t count[JSON_MAX_DEPTH];
+  _Bool in_map[JSON_MAX_DEPTH];
+  size_t depth;
+};
+
+/*
+ * Grisu2
+ */
+struct diy_fp_s
+{
+  uint64_t f;
+  int e;
+};
+typedef struct diy_fp_s diy_fp_t;
+
+#define DP_SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define DP_HIDDEN_BIT       UINT64_C(0x0010000000000000)
+#define DP_EXPONENT_BIAS    (0x3FF + 52)
+
+/* Normalized 10^k for k = -348, -340, ..., 340. */
+static const uint64_t cached_powers_f[] =
+{
+  UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+  UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+  UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+  UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+  UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+  UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+  UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+  UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+  UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+  UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+  UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+  UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+  UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+  UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+  UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+  UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+  UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+  UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+  UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+  UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+  UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+  UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+  UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+  UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+  UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+  UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+  UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+  UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+  UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b)
+};
+
+static const int16_t cached_powers_e[] =
+{
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uint64_t pow10_table[] =
+{
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+  UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+  UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+  UINT64_C(10000000000), UINT64_C(100000000000),
+  UINT64_C(1000000000000), UINT64_C(10000000000000),
+  UINT64_C(100000000000000), UINT64_C(1000000000000000),
+  UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+  UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+static diy_fp_t diy_fp_normalize (diy_fp_t x) /* {{{ */
+{
+#if defined(__GNUC__)
+  int shift = __builtin_clzll ((unsigned long long) x.f);
+
+  x.f <<= shift;
+  x.e -= shift;
+#else
+  while ((x.f & (UINT64_C(1) << 63)) == 0)
+  {
+    x.f <<= 1;
+    x.e--;
+  }
+#endif
+  return (x);
+} /* }}} diy_fp_t diy_fp_normalize */
+
+/* Returns the upper 64 bits of the product, rounded. */
+static diy_fp_t diy_fp_multiply (diy_fp_t x, diy_fp_t y) /* {{{ */
+{
+  const uint64_t mask = UINT64_C(0xFFFFFFFF);
+  uint64_t a = x.f >> 32;
+  uint64_t b = x.f & mask;
+  uint64_t c = y.f >> 32;
+  uint64_t d = y.f & mask;
+  uint64_t ac = a * c;
+  uint64_t bc = b * c;
+  uint64_t ad = a * d;
+  uint64_t bd = b * d;
+  uint64_t tmp;
+  diy_fp_t r;
+
+  tmp = (bd >> 32) + (ad & mask) + (bc & mask);
+  tmp += UINT64_C(1) << 31;
+
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return (r);
+} /* }}} diy_fp_t diy_fp_multiply */
+
+/* Returns the cached power c = 10^-K, so that the exponent of w * c is in
+ * [-60, -32]. */
+static diy_fp_t get_cached_power (int e, int *ret_k) /* {{{ */
+{
+  double dk = ((double) (-61 - e)) * 0.30102999566398114 + 347.0;
+  int k = (int) dk;
+  unsigned int index;
+  diy_fp_t c;
+
+  if ((dk - ((double) k)) > 0.0)
+    k++;
+
+  index = (unsigned int) ((k >> 3) + 1);
+  *ret_k = -(-348 + (int) (index << 3));
+
+  c.f = cached_powers_f[index];
+  c.e = cached_powers_e[index];
+  return (c);
+} /* }}} diy_fp_t get_cached_power */
+
+/* Moves the last digit towards the exact value while staying inside the
+ * interval of values that read back as the same double. */
+static void grisu_round (char *buffer, size_t len, /* {{{ */
+    uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+  while ((rest < wp_w) && ((delta - rest) >= ten_kappa)
+      && (((rest + ten_kappa) < wp_w)
+        || ((wp_w - rest) > (rest + ten_kappa - wp_w))))
+  {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+} /* }}} void grisu_round */
+
+static size_t count_digits (uint32_t n) /* {{{ */
+{
+  size_t i;
+
+  for (i = 1; i < 10; i++)
+    if (n < pow10_table[i])
+      return (i);
+  return (10);
+} /* }}} size_t count_digits */
+
+/* Generates the shortest digits of a value in (low, high), where "high" is
+ * "mp" and "delta" = high - low. */
+static size_t digit_gen (diy_fp_t w, diy_fp_t mp, /* {{{ */
+    uint64_t delta, char *buffer, int *k)
+{
+  diy_fp_t one;
+  uint64_t wp_w = mp.f - w.f;
+  uint32_t p1;
+  uint64_t p2;
+  int kappa;
+  size_t len = 0;
+
+  one.f = UINT64_C(1) << -mp.e;
+  one.e = mp.e;
+
+  p1 = (uint32_t) (mp.f >> -one.e);
+  p2 = mp.f & (one.f - 1);
+  kappa = (int) count_digits (p1);
+
+  while (kappa > 0)
+  {
+    uint32_t div = (uint32_t) pow10_table[kappa - 1];
+    uint32_t d = p1 / div;
+    uint64_t tmp;
+
+    p1 %= div;
+    if ((d != 0) || (len != 0))
+      buffer[len++] = (char) ('0' + d);
+    kappa--;
+
+    tmp = (((uint64_t) p1) << -one.e) + p2;
+    if (tmp <= delta)
+    {
+      *k += kappa;
+      grisu_round (buffer, len, delta, tmp,
+          pow10_table[kappa] << -one.e, wp_w);
+      return (len);
+    }
+  }
+
+  while (42)
+  {
+    int d;
+
+    p2 *= 10;
+    delta *= 10;
+    d = (int) (p2 >> -one.e);
+    if ((d != 0) || (len != 0))
+      buffer[len++] = (char) ('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < delta)
+    {
+      *k += kappa;
+      grisu_round (buffer, len, delta, p2, one.f,
+          (-kappa < 20) ? wp_w * pow10_table[-kappa] : 0);
+      return (len);
+    }
+  }
+} /* }}} size_t digit_gen */
+
+/* Writes the digits of a positive, finite "value" to "buffer". The value is
+ * digits * 10^k. */
+static size_t grisu2 (double value, char *buffer, int *k) /* {{{ */
+{
+  uint64_t bits;
+  diy_fp_t v;
+  diy_fp_t w_m;
+  diy_fp_t w_p;
+  diy_fp_t c_mk;
+  diy_fp_t w;
+  int biased_e;
+
+  memcpy (&bits, &value, sizeof (bits));
+  biased_e = (int) ((bits >> 52) & 0x7FF);
+  v.f = bits & DP_SIGNIFICAND_MASK;
+  if (biased_e != 0)
+  {
+    v.f += DP_HIDDEN_BIT;
+    v.e = biased_e - DP_EXPONENT_BIAS;
+  }
+  else
+  {
+    v.e = 1 - DP_EXPONENT_BIAS;
+  }
+
+  /* The boundaries halfway to the neighbouring doubles. The lower one is
+   * closer if "value" is a power of two. */
+  w_p.f = (v.f << 1) + 1;
+  w_p.e = v.e - 1;
+  w_p = diy_fp_normalize (w_p);
+  if (v.f == DP_HIDDEN_BIT)
+  {
+    w_m.f = (v.f << 2) - 1;
+    w_m.e = v.e - 2;
+  }
+  else
+  {
+    w_m.f = (v.f << 1) - 1;
+    w_m.e = v.e - 1;
+  }
+  w_m.f <<= w_m.e - w_p.e;
+  w_m.e = w_p.e;
+
+  c_mk = get_cached_power (w_p.e, k);
+
+  w = diy_fp_multiply (diy_fp_normalize (v), c_mk);
+  w_p = diy_fp_multiply (w_p, c_mk);
+  w_m = diy_fp_multiply (w_m, c_mk);
+  w_m.f++;
+  w_p.f--;
+
+  return (digit_gen (w, w_p, w_p.f - w_m.f, buffer, k));
+} /* }}} size_t grisu2 */
+
+static size_t write_exponent (int k, char *buffer) /* {{{ */
+{
+  size_t len = 0;
+
+  if (k < 0)
+  {
+    buffer[len++] = '-';
+    k = -k;
+  }
+  else
+  {
+    buffer[len++] = '+';
+  }
+
+  if (k >= 100)
+  {
+    buffer[len++] = (char) ('0' + (k / 100));
+    k %= 100;
+    buffer[len++] = (char) ('0' + (k / 10));
+  }
+  else if (k >= 10)
+  {
+    buffer[len++] = (char) ('0' + (k / 10));
+  }
+  buffer[len++] = (char) ('0' + (k % 10));
+
+  return (len);
+} /* }}} size_t write_exponent */
+
+/* Formats "len" digits times 10^k like JavaScript does: integers up to 21
+ * digits and fractions down to 1e-6 are written without exponent. */
+static size_t prettify (char *buffer, size_t len, int k) /* {{{ */
+{
+  int kk = ((int) len) + k; /* 10^(kk-1) <= value < 10^kk */
+
+  if ((k >= 0) && (kk <= 21))
+  {
+    /* 1234e7 -> 12340000000 */
+    memset (buffer + len, '0', (size_t) k);
+    return ((size_t) kk);
+  }
+  else if ((kk > 0) && (kk <= 21))
+  {
+    /* 1234e-2 -> 12.34 */
+    memmove (buffer + kk + 1, buffer + kk, len - (size_t) kk);
+    buffer[kk] = '.';
+    return (len + 1);
+  }
+  else if ((kk > -6) && (kk <= 0))
+  {
+    /* 1234e-6 -> 0.001234 */
+    char *ptr = buffer + 2;
+
+    memmove (ptr - kk, buffer, len);
+    buffer[0] = '0';
+    buffer[1] = '.';
+    for (; kk < 0; kk++)
+      *(ptr++) = '0';
+    return ((size_t) (ptr - buffer) + len);
+  }
+  else if (len == 1)
+  {
+    /* 1e30 */
+    buffer[1] = 'e';
+    return (2 + write_exponent (kk - 1, buffer + 2));
+  }
+
+  /* 1234e30 -> 1.234e+33 */
+  memmove (buffer + 2, buffer + 1, len - 1);
+  buffer[1] = '.';
+  buffer[len + 1] = 'e';
+  return (len + 2 + write_exponent (kk - 1, buffer + len + 2));
+} /* }}} size_t prettify */
+
+size_t json_format_double (double value, char *buffer) /* {{{ */
+{
+  size_t digits;
+  size_t len = 0;
+  int k = 0;
+
+  if (!isfinite (value))
+  {
+    memcpy (buffer, "null", 5);
+    return (4);
+  }
+
+  if (signbit (value))
+  {
+    buffer[len++] = '-';
+    value = -value;
+  }
+
+  if (value == 0.0)
+  {
+    buffer[len++] = '0';
+    buffer[len] = 0;
+    return (len);
+  }
+
+  digits = grisu2 (value, buffer + len, &k);
+  len += prettify (buffer + len, digits, k);
+  buffer[len] = 0;
+  return (len);
+} /* }}} size_t json_format_double */
+
+/*
+ * Writer
+ */
+static int json_flush_buffer (json_writer_t *w) /* {{{ */
+{
+  int status;
+
+  if ((w->callback == NULL) || (w->buffer_used == 0))
+    return (0);
+
+  status = (*w->callback) (w->user_data, w->buffer, w->buffer_used);
+  w->buffer_used = 0;
+  if (status != 0)
+    w->status = (status > 0) ? status : EIO;
+
+  return (w->status);
+} /* }}} int json_flush_buffer */
+
+/* Makes sure "size" bytes (plus a null byte) can be appended to the
+ * buffer. */
+static int json_reserve (json_writer_t *w, size_t size) /* {{{ */
+{
+  char *tmp;
+  size_t tmp_size;
+
+  if ((w->buffer_used + size) < w->buffer_size)
+    return (0);
+
+  if (w->callback != NULL)
+  {
+    if (json_flush_buffer (w) != 0)
+      return (w->status);
+    if (size < w->buffer_size)
+      return (0);
+  }
+
+  tmp_size = 2 * w->buffer_size;
+  while (tmp_size <= (w->buffer_used + size))
+    tmp_size *= 2;
+
+  tmp = realloc (w->buffer, tmp_size);
+  if (tmp == NULL)
+  {
+    w->status = ENOMEM;
+    return (ENOMEM);
+  }
+  w->buffer = tmp;
+  w->buffer_size = tmp_size;
+
+  return (0);
+} /* }}} int json_reserve */
+
+static int json_put (json_writer_t *w, /* {{{ */
+    const char *data, size_t data_size)
+{
+  if (json_reserve (w, data_size) != 0)
+    return (w->status);
+
+  memcpy (w->buffer + w->buffer_used, data, data_size);
+  w->buffer_used += data_size;
+  return (0);
+} /* }}} int json_put */
+
+static int json_newline (json_writer_t *w, size_t depth) /* {{{ */
+{
+  size_t i;
+
+  if (json_reserve (w, 1 + 2 * depth) != 0)
+    return (w->status);
+
+  w->buffer[w->buffer_used++] = '\n';
+  for (i = 0; i < (2 * depth); i++)
+    w->buffer[w->buffer_used++] = ' ';
+
+  return (0);
+} /* }}} int json_newline */
+
+/* Writes the separator required before the next token. */
+static int json_begin_token (json_writer_t *w) /* {{{ */
+{
+  size_t count;
+  _Bool pretty = (w->flags & JSON_WRITER_PRETTY) ? 1 : 0;
+
+  if (w->status != 0)
+    return (w->status);
+
+  if (w->depth == 0)
+    return (0);
+
+  count = w->count[w->depth - 1]++;
+  if (w->in_map[w->depth - 1] && ((count % 2) == 1))
+    return (pretty ? json_put (w, ": ", 2) : json_put (w, ":", 1));
+
+  if ((count != 0) && (json_put (w, ",", 1) != 0))
+    return (w->status);
+  if (pretty)
+    return (json_newline (w, w->depth));
+
+  return (0);
+} /* }}} int json_begin_token */
+
+static int json_open (json_writer_t *w, _Bool map) /* {{{ */
+{
+  if (json_begin_token (w) != 0)
+    return (w->status);
+
+  if (w->depth >= JSON_MAX_DEPTH)
+  {
+    w->status = EINVAL;
+    return (EINVAL);
+  }
+
+  w->count[w->depth] = 0;
+  w->in_map[w->depth] = map;
+  w->depth++;
+
+  return (json_put (w, map ? "{" : "[", 1));
+} /* }}} int json_open */
+
+static int json_close (json_writer_t *w, _Bool map) /* {{{ */
+{
+  if (w->status != 0)
+    return (w->status);
+
+  if ((w->depth == 0) || (w->in_map[w->depth - 1] != map))
+  {
+    w->status = EINVAL;
+    return (EINVAL);
+  }
+
+  w->depth--;
+  if ((w->flags & JSON_WRITER_PRETTY) && (w->count[w->depth] != 0)
+      && (json_newline (w, w->depth) != 0))
+    return (w->status);
+
+  return (json_put (w, map ? "}" : "]", 1));
+} /* }}} int json_close */
+
+json_writer_t *json_writer_create (json_write_callback callback, /* {{{ */
+    void *user_data, unsigned int flags)
+{
+  json_writer_t *w;
+
+  w = calloc (1, sizeof (*w));
+  if (w == NULL)
+    return (NULL);
+
+  w->buffer_size = JSON_BUFFER_SIZE;
+  w->buffer = malloc (w->buffer_size);
+  if (w->buffer == NULL)
+  {
+    free (w);
+    return (NULL);
+  }
+
+  w->callback = callback;
+  w->user_data = user_data;
+  w->flags = flags;
+
+  return (w);
+} /* }}} json_writer_t *json_writer_create */
+
+void json_writer_destroy (json_writer_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return;
+
+  json_writer_flush (w);
+
+  free (w->buffer);
+  free (w);
+} /* }}} void json_writer_destroy */
+
+int json_writer_flush (json_writer_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return (EINVAL);
+
+  if (w->status != 0)
+    return (w->status);
+
+  return (json_flush_buffer (w));
+} /* }}} int json_writer_flush */
+
+int json_writer_get_buffer (json_writer_t *w, /* {{{ */
+    const char **ret_buffer, size_t *ret_buffer_size)
+{
+  if ((w == NULL) || (w->callback != NULL))
+    return (EINVAL);
+
+  if (w->status != 0)
+    return (w->status);
+
+  w->buffer[w->buffer_used] = 0;
+  *ret_buffer = w->buffer;
+  *ret_buffer_size = w->buffer_used;
+
+  return (0);
+} /* }}} int json_writer_get_buffer */
+
+int json_map_open (json_writer_t *w) /* {{{ */
+{
+  return (json_open (w, /* map = */ 1));
+} /* }}} int json_map_open */
+
+int json_map_close (json_writer_t *w) /* {{{ */
+{
+  return (json_close (w, /* map = */ 1));
+} /* }}} int json_map_close */
+
+int json_array_open (json_writer_t *w) /* {{{ */
+{
+  return (json_open (w, /* map = */ 0));
+} /* }}} int json_array_open */
+
+int json_array_close (json_writer_t *w) /* {{{ */
+{
+  return (json_close (w, /* map = */ 0));
+} /* }}} int json_array_close */
+
+int json_string (json_writer_t *w, const char *str) /* {{{ */
+{
+  static const char hex[] = "0123456789abcdef";
+  const char *begin;
+  const char *ptr;
+
+  if (str == NULL)
+    return (json_null (w));
+
+  if ((json_begin_token (w) != 0)
+      || (json_put (w, "\"", 1) != 0))
+    return (w->status);
+
+  /* Copy runs of characters which need no escaping at once. */
+  begin = str;
+  for (ptr = str; *ptr != 0; ptr++)
+  {
+    unsigned char c = (unsigned char) *ptr;
+    char escape[6];
+    size_t escape_size = 2;
+
+    if ((c >= 0x20) && (c != '"') && (c != '\\'))
+      continue;
+
+    if ((ptr > begin) && (json_put (w, begin, (size_t) (ptr - begin)) != 0))
+      return (w->status);
+    begin = ptr + 1;
+
+    escape[0] = '\\';
+    if ((c == '"') || (c == '\\'))
+      escape[1] = (char) c;
+    else if (c == '\n')
+      escape[1] = 'n';
+    else if (c == '\r')
+      escape[1] = 'r';
+    else if (c == '\t')
+      escape[1] = 't';
+    else
+    {
+      escape[1] = 'u';
+      escape[2] = '0';
+      escape[3] = '0';
+      escape[4] = hex[c >> 4];
+      escape[5] = hex[c & 0x0F];
+      escape_size = 6;
+    }
+
+    if (json_put (w, escape, escape_size) != 0)
+      return (w->status);
+  }
+
+  if ((ptr > begin) && (json_put (w, begin, (size_t) (ptr - begin)) != 0))
+    return (w->status);
+
+  return (json_put (w, "\"", 1));
+} /* }}} int json_string */
+
+int json_token (json_writer_t *w, /* {{{ */
+    const char *token, size_t token_size)
+{
+  if (json_begin_token (w) != 0)
+    return (w->status);
+
+  return (json_put (w, token, token_size));
+} /* }}} int json_token */
+
+int json_double (json_writer_t *w, double value) /* {{{ */
+{
+  if ((json_begin_token (w) != 0)
+      || (json_reserve (w, JSON_DOUBLE_SIZE) != 0))
+    return (w->status);
+
+  w->buffer_used += json_format_double (value, w->buffer + w->buffer_used);
+  return (0);
+} /* }}} int json_double */
+
+int json_integer (json_writer_t *w, int64_t value) /* {{{ */
+{
+  char buffer[24];
+  size_t pos = sizeof (buffer);
+  uint64_t abs_value;
+
+  abs_value = (value < 0)
+    ? ((uint64_t) 0) - ((uint64_t) value) : (uint64_t) value;
+
+  do
+  {
+    buffer[--pos] = (char) ('0' + (abs_value % 10));
+    abs_value /= 10;
+  } while (abs_value != 0);
+
+  if (value < 0)
+    buffer[--pos] = '-';
+
+  return (json_token (w, buffer + pos, sizeof (buffer) - pos));
+} /* }}} int json_integer */
+
+int json_bool (json_writer_t *w, _Bool value) /* {{{ */
+{
+  return (value ? json_token (w, "true", 4) : json_token (w, "false", 5));
+} /* }}} int json_bool */
+
+int json_null (json_writer_t *w) /* {{{ */
+{
+  return (json_token (w, "null", 4));
+} /* }}} int json_null */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,97 @@
+/**
+ * collection4 - utils_json.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_JSON_H
+#define UTILS_JSON_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A streaming JSON writer. Output is collected in a buffer of
+ * JSON_BUFFER_SIZE bytes, which is passed to the callback whenever it is
+ * full and when the writer is flushed or destroyed. Commas and colons are
+ * inserted automatically; inside maps, keys and values alternate.
+ *
+ * All functions return zero on success and an errno value otherwise. Errors
+ * are sticky: once the callback fails, all further calls fail.
+ */
+struct json_writer_s;
+typedef struct json_writer_s json_writer_t;
+
+#define JSON_BUFFER_SIZE 65536
+
+/* Maximum length of a number written by "json_format_double", including the
+ * terminating null byte. */
+#define JSON_DOUBLE_SIZE 32
+
+/* Indent nested maps and arrays, one element per line. */
+#define JSON_WRITER_PRETTY 0x01
+
+typedef int (*json_write_callback) (void *user_data,
+    const char *buffer, size_t buffer_size);
+
+/* If "callback" is NULL, the entire output is kept in memory and can be
+ * retrieved with "json_writer_get_buffer". */
+json_writer_t *json_writer_create (json_write_callback callback,
+    void *user_data, unsigned int flags);
+/* Flushes the writer before freeing it. */
+void json_writer_destroy (json_writer_t *w);
+
+int json_writer_flush (json_writer_t *w);
+/* Returns the output of a writer without callback. The buffer is null
+ * terminated and valid until the writer is destroyed. */
+int json_writer_get_buffer (json_writer_t *w,
+    const char **ret_buffer, size_t *ret_buffer_size);
+
+int json_map_open (json_writer_t *w);
+int json_map_close (json_writer_t *w);
+int json_array_open (json_writer_t *w);
+int json_array_close (json_writer_t *w);
+
+/* Writes a null terminated string, escaped as necessary. */
+int json_string (json_writer_t *w, const char *str);
+/* Writes "token" as is, e.g. a string that has been quoted and escaped
+ * already. */
+int json_token (json_writer_t *w, const char *token, size_t token_size);
+/* Writes a string literal that needs no escaping, typically a key. The length
+ * is computed at compile time. */
+#define JSON_LITERAL(w, str) \
+  json_token ((w), "\"" str "\"", sizeof ("\"" str "\"") - 1)
+
+/* Writes the shortest representation that reads back as the same value.
+ * Infinity and NAN are written as null. */
+int json_double (json_writer_t *w, double value);
+int json_integer (json_writer_t *w, int64_t value);
+int json_bool (json_writer_t *w, _Bool value);
+int json_null (json_writer_t *w);
+
+/* Formats "value" like "json_double", using Grisu2 (Florian Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * PLDI 2010). The result always reads back as "value" and is almost always
+ * the shortest such representation. "buffer" must hold JSON_DOUBLE_SIZE
+ * bytes. Returns the length of the null terminated result. */
+size_t json_format_double (double value, char *buffer);
+
+#endif /* UTILS_JSON_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
@@ -0,0 +1,225 @@
+/**
+ * collection4 - utils_pool.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "utils_pool.h"
+
+struct pool_range_s /* {{{ */
+{
+  pthread_mutex_t lock;
+  size_t begin;
+  size_t end;
+}; /* }}} struct pool_range_s */
+typedef struct pool_range_s pool_range_t;
+
+struct pool_s /* {{{ */
+{
+  pool_range_t *ranges;
+  size_t ranges_num;
+
+  pool_task_t task;
+  void *user_data;
+
+  pthread_mutex_t status_lock;
+  int status;
+  size_t status_index;
+}; /* }}} struct pool_s */
+typedef struct pool_s pool_t;
+
+struct pool_worker_s /* {{{ */
+{
+  pool_t *pool;
+  size_t index;
+}; /* }}} struct pool_worker_s */
+typedef struct pool_worker_s pool_worker_t;
+
+/*
+ * Private functions
+ */
+/* Takes the next index from the worker's own range or, if that is empty,
+ * steals from the other workers. Returns zero if no work is left. */
+static _Bool pool_next (pool_t *pool, size_t self, /* {{{ */
+    size_t *ret_index)
+{
+  pool_range_t *own = pool->ranges + self;
+  size_t i;
+
+  pthread_mutex_lock (&own->lock);
+  if (own->begin < own->end)
+  {
+    *ret_index = own->begin;
+    own->begin++;
+    pthread_mutex_unlock (&own->lock);
+    return (1);
+  }
+  pthread_mutex_unlock (&own->lock);
+
+  for (i = 1; i < pool->ranges_num; i++)
+  {
+    pool_range_t *victim = pool->ranges + ((self + i) % pool->ranges_num);
+    size_t begin;
+    size_t end;
+
+    pthread_mutex_lock (&victim->lock);
+    if (victim->begin >= victim->end)
+    {
+      pthread_mutex_unlock (&victim->lock);
+      continue;
+    }
+
+    end = victim->end;
+    begin = end - ((end - victim->begin + 1) / 2);
+    victim->end = begin;
+    pthread_mutex_unlock (&victim->lock);
+
+    /* Our own range is empty, so thieves leave it alone until it's
+     * refilled here. */
+    pthread_mutex_lock (&own->lock);
+    own->begin = begin + 1;
+    own->end = end;
+    pthread_mutex_unlock (&own->lock);
+
+    *ret_index = begin;
+    return (1);
+  }
+
+  return (0);
+} /* }}} _Bool pool_next */
+
+static void *pool_worker (void *arg) /* {{{ */
+{
+  pool_worker_t *worker = arg;
+  pool_t *pool = worker->pool;
+  size_t index;
+
+  while (pool_next (pool, worker->index, &index))
+  {
+    int status;
+
+    status = (*pool->task) (index, pool->user_data);
+    if (status == 0)
+      continue;
+
+    pthread_mutex_lock (&pool->status_lock);
+    if ((pool->status == 0) || (index < pool->status_index))
+    {
+      pool->status = status;
+      pool->status_index = index;
+    }
+    pthread_mutex_unlock (&pool->status_lock);
+  }
+
+  return (NULL);
+} /* }}} void *pool_worker */
+
+/*
+ * Public functions
+ */
+int pool_run (size_t tasks_num, size_t threads_num, /* {{{ */
+    pool_task_t task, void *user_data)
+{
+  pool_t pool;
+  pool_worker_t *workers;
+  pthread_t *threads;
+  _Bool *started;
+  size_t i;
+
+  if (task == NULL)
+    return (EINVAL);
+
+  if (threads_num > tasks_num)
+    threads_num = tasks_num;
+  if (threads_num < 1)
+    threads_num = 1;
+
+  memset (&pool, 0, sizeof (pool));
+  pool.task = task;
+  pool.user_data = user_data;
+  pool.ranges_num = threads_num;
+  pthread_mutex_init (&pool.status_lock, /* attr = */ NULL);
+
+  pool.ranges = calloc (threads_num, sizeof (*pool.ranges));
+  workers = calloc (threads_num, sizeof (*workers));
+  threads = calloc (threads_num, sizeof (*threads));
+  started = calloc (threads_num, sizeof (*started));
+  if ((pool.ranges == NULL) || (workers == NULL) || (threads == NULL)
+      || (started == NULL))
+  {
+    free (pool.ranges);
+    free (workers);
+    free (threads);
+    free (started);
+    pthread_mutex_destroy (&pool.status_lock);
+    return (ENOMEM);
+  }
+
+  for (i = 0; i < threads_num; i++)
+  {
+    pthread_mutex_init (&pool.ranges[i].lock, /* attr = */ NULL);
+    pool.ranges[i].begin = (tasks_num * i) / threads_num;
+    pool.ranges[i].end = (tasks_num * (i + 1)) / threads_num;
+
+    workers[i].pool = &pool;
+    workers[i].index = i;
+  }
+
+  /* If a thread can't be started, the others steal its range. */
+  for (i = 1; i < threads_num; i++)
+  {
+    int status;
+
+    status = pthread_create (threads + i, /* attr = */ NULL,
+        pool_worker, workers + i);
+    if (status != 0)
+    {
+      fprintf (stderr, "pool_run: pthread_create failed with status %i\n",
+          status);
+      continue;
+    }
+    started[i] = 1;
+  }
+
+  pool_worker (workers + 0);
+
+  for (i = 1; i < threads_num; i++)
+    if (started[i])
+      pthread_join (threads[i], /* return value = */ NULL);
+
+  for (i = 0; i < threads_num; i++)
+    pthread_mutex_destroy (&pool.ranges[i].lock);
+  pthread_mutex_destroy (&pool.status_lock);
+
+  free (pool.ranges);
+  free (workers);
+  free (threads);
+  free (started);
+
+  return (pool.status);
+} /* }}} int pool_run */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
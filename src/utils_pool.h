@@ -0,0 +1,43 @@
+/**
+ * collection4 - utils_pool.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_POOL_H
+#define UTILS_POOL_H 1
+
+#include <stddef.h>
+
+/* Runs "task" for each index in [0, tasks_num) using up to "threads_num"
+ * threads, including the calling thread. Each thread starts out with a
+ * contiguous range of indices. Once its range is exhausted, it steals the
+ * upper half of the remaining range of another thread. Tasks may therefore
+ * run in any order and must not depend on each other.
+ *
+ * Returns the status of the failed task with the lowest index, or zero if all
+ * tasks succeeded. All tasks are run even if some fail. */
+typedef int (*pool_task_t) (size_t index, void *user_data);
+
+int pool_run (size_t tasks_num, size_t threads_num,
+    pool_task_t task, void *user_data);
+
+#endif /* UTILS_POOL_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */
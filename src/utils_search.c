@@ -256,7 +256,7 @@ graph_ident_t *search_to_ident (search_info_t *si) /* {{{ */
   if (si == NULL)
     return (NULL);
 
-  return (ident_create ((si->host == NULL) ? ANY_TOKEN : si->host,
+  return (ident_create_query ((si->host == NULL) ? ANY_TOKEN : si->host,
         (si->plugin == NULL) ? ANY_TOKEN : si->plugin,
         (si->plugin_instance == NULL) ? ANY_TOKEN : si->plugin_instance,
         (si->type == NULL) ? ANY_TOKEN : si->type,
@@ -295,6 +295,21 @@ search_info_t *search_from_ident (const graph_ident_t *ident) /* {{{ */
   return (si);
 } /* }}} search_info_t *search_from_ident */
 
+char **search_get_terms (search_info_t *si, int *ret_terms_num) /* {{{ */
+{
+  if ((si == NULL) || (ret_terms_num == NULL))
+    return (NULL);
+
+  if (si->terms == NULL)
+  {
+    *ret_terms_num = 0;
+    return (NULL);
+  }
+
+  *ret_terms_num = array_argc (si->terms);
+  return (array_argv (si->terms));
+} /* }}} char **search_get_terms */
+
 _Bool search_graph_title_matches (search_info_t *si, /* {{{ */
     const char *title)
 {
@@ -317,15 +332,10 @@ _Bool search_graph_title_matches (search_info_t *si, /* {{{ */
   return (1);
 } /* }}} _Bool search_graph_title_matches */
 
-_Bool search_graph_inst_matches (search_info_t *si, /* {{{ */
-    graph_config_t *cfg, graph_instance_t *inst,
-    const char *title)
+_Bool search_inst_matches_selector (search_info_t *si, /* {{{ */
+    graph_instance_t *inst)
 {
-  char **argv;
-  int argc;
-  int i;
-
-  if ((si == NULL) || (cfg == NULL) || (inst == NULL))
+  if ((si == NULL) || (inst == NULL))
     return (0);
 
   if ((si->host != NULL)
@@ -344,6 +354,23 @@ _Bool search_graph_inst_matches (search_info_t *si, /* {{{ */
       && !inst_matches_field (inst, GIF_TYPE_INSTANCE, si->type_instance))
     return (0);
 
+  return (1);
+} /* }}} _Bool search_inst_matches_selector */
+
+_Bool search_graph_inst_matches (search_info_t *si, /* {{{ */
+    graph_config_t *cfg, graph_instance_t *inst,
+    const char *title)
+{
+  char **argv;
+  int argc;
+  int i;
+
+  if ((si == NULL) || (cfg == NULL) || (inst == NULL))
+    return (0);
+
+  if (!search_inst_matches_selector (si, inst))
+    return (0);
+
   if (si->terms == NULL)
     return (1);
 
@@ -40,12 +40,22 @@ _Bool search_has_selector (search_info_t *si);
 graph_ident_t *search_to_ident (search_info_t *si);
 search_info_t *search_from_ident (const graph_ident_t *ident);
 
+/* Returns the search terms without a "field:" prefix, which are matched
+ * against graph titles and instance descriptions. The array belongs to "si".
+ * Returns NULL and sets "*ret_terms_num" to zero if there are none. */
+char **search_get_terms (search_info_t *si, int *ret_terms_num);
+
 _Bool search_graph_title_matches (search_info_t *si, const char *title);
 
 _Bool search_graph_inst_matches (search_info_t *si,
     graph_config_t *cfg, graph_instance_t *inst,
     const char *title);
 
+/* Like "search_graph_inst_matches" but ignores the search terms, i.e. only
+ * checks the "host:", "plugin:", ... fields. */
+_Bool search_inst_matches_selector (search_info_t *si,
+    graph_instance_t *inst);
+
 #endif /* UTILS_SEARCH_H */
 /* vim: set sw=2 sts=2 et fdm=marker : */
 
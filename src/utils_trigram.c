@@ -0,0 +1,494 @@
+/**
+ * collection4 - utils_trigram.c
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "utils_trigram.h"
+
+#define TRI_INITIAL_SLOTS 1024
+#define TRI_NO_DOC UINT32_MAX
+
+/* Documents don't contain NUL bytes, so the key of a trigram is never zero
+ * and zero marks unused slots. */
+#define TRI_KEY(str) ((((uint32_t) (unsigned char) (str)[0]) << 16)  \
+    | (((uint32_t) (unsigned char) (str)[1]) << 8)                      \
+    | ((uint32_t) (unsigned char) (str)[2]))
+
+struct tri_slot_s /* {{{ */
+{
+  uint32_t key;
+  /* The document seen last, so that a trigram occurring several times in
+   * one document is listed only once. */
+  uint32_t last_doc;
+
+  /* Range of "postings" holding the documents containing this trigram. */
+  size_t postings_offset;
+  size_t postings_num;
+}; /* }}} struct tri_slot_s */
+typedef struct tri_slot_s tri_slot_t;
+
+struct trigram_index_s /* {{{ */
+{
+  /* The documents, each terminated by a NUL byte. */
+  char *text;
+  size_t text_size;
+  size_t text_used;
+
+  /* Offset of each document in "text". */
+  size_t *docs;
+  size_t docs_size;
+  size_t docs_num;
+
+  /* Open addressing hash table. "slots_num" is a power of two. */
+  tri_slot_t *slots;
+  size_t slots_num;
+  size_t slots_used;
+
+  uint32_t *postings;
+  size_t postings_num;
+
+  _Bool finished;
+}; /* }}} struct trigram_index_s */
+
+/* List of one trigram of the search term and the position up to which it
+ * has been searched. */
+struct tri_list_s /* {{{ */
+{
+  const uint32_t *docs;
+  size_t docs_num;
+  size_t pos;
+}; /* }}} struct tri_list_s */
+typedef struct tri_list_s tri_list_t;
+
+/*
+ * Private functions
+ */
+static size_t tri_hash (uint32_t key, size_t slots_num) /* {{{ */
+{
+  uint32_t hash;
+
+  hash = key * 2654435761U;
+  hash ^= hash >> 16;
+
+  return (((size_t) hash) & (slots_num - 1));
+} /* }}} size_t tri_hash */
+
+static tri_slot_t *tri_slot_lookup (const trigram_index_t *idx, /* {{{ */
+    uint32_t key)
+{
+  size_t i;
+
+  if (idx->slots_num == 0)
+    return (NULL);
+
+  for (i = tri_hash (key, idx->slots_num);
+      idx->slots[i].key != 0;
+      i = (i + 1) & (idx->slots_num - 1))
+    if (idx->slots[i].key == key)
+      return (idx->slots + i);
+
+  return (NULL);
+} /* }}} tri_slot_t *tri_slot_lookup */
+
+static int tri_grow (trigram_index_t *idx) /* {{{ */
+{
+  tri_slot_t *slots;
+  size_t slots_num;
+  size_t i;
+
+  slots_num = (idx->slots_num == 0) ? TRI_INITIAL_SLOTS : 2 * idx->slots_num;
+  slots = calloc (slots_num, sizeof (*slots));
+  if (slots == NULL)
+    return (ENOMEM);
+
+  for (i = 0; i < idx->slots_num; i++)
+  {
+    size_t j;
+
+    if (idx->slots[i].key == 0)
+      continue;
+
+    for (j = tri_hash (idx->slots[i].key, slots_num);
+        slots[j].key != 0;
+        j = (j + 1) & (slots_num - 1))
+      /* do nothing */;
+
+    slots[j] = idx->slots[i];
+  }
+
+  free (idx->slots);
+  idx->slots = slots;
+  idx->slots_num = slots_num;
+
+  return (0);
+} /* }}} int tri_grow */
+
+static tri_slot_t *tri_slot_insert (trigram_index_t *idx, /* {{{ */
+    uint32_t key)
+{
+  tri_slot_t *slot;
+  size_t i;
+
+  slot = tri_slot_lookup (idx, key);
+  if (slot != NULL)
+    return (slot);
+
+  /* Keep the table at most half full. */
+  if ((2 * (idx->slots_used + 1)) > idx->slots_num)
+    if (tri_grow (idx) != 0)
+      return (NULL);
+
+  for (i = tri_hash (key, idx->slots_num);
+      idx->slots[i].key != 0;
+      i = (i + 1) & (idx->slots_num - 1))
+    /* do nothing */;
+
+  slot = idx->slots + i;
+  slot->key = key;
+  slot->last_doc = TRI_NO_DOC;
+  idx->slots_used++;
+
+  return (slot);
+} /* }}} tri_slot_t *tri_slot_insert */
+
+/* Returns the position of the first document in "list" that is not less than
+ * "doc". Searches from "list->pos", first in steps doubling in size and then
+ * by bisection, so skipping ahead in a long list is cheap. */
+static size_t tri_list_seek (const tri_list_t *list, uint32_t doc) /* {{{ */
+{
+  size_t lo = list->pos;
+  size_t hi;
+  size_t step = 1;
+
+  if ((lo >= list->docs_num) || (list->docs[lo] >= doc))
+    return (lo);
+
+  /* Invariant: list->docs[lo] < doc */
+  while (((lo + step) < list->docs_num) && (list->docs[lo + step] < doc))
+  {
+    lo += step;
+    step *= 2;
+  }
+
+  hi = lo + step;
+  if (hi > list->docs_num)
+    hi = list->docs_num;
+
+  /* Invariant: list->docs[lo] < doc <= list->docs[hi] */
+  while ((hi - lo) > 1)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (list->docs[mid] < doc)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return (hi);
+} /* }}} size_t tri_list_seek */
+
+static int tri_list_compare (const void *v0, const void *v1) /* {{{ */
+{
+  const tri_list_t *l0 = v0;
+  const tri_list_t *l1 = v1;
+
+  if (l0->docs_num < l1->docs_num)
+    return (-1);
+  else if (l0->docs_num > l1->docs_num)
+    return (1);
+  return (0);
+} /* }}} int tri_list_compare */
+
+/* Terms shorter than a trigram are compared with every document. */
+static int tri_search_all (const trigram_index_t *idx, /* {{{ */
+    const char *term, tri_callback_t callback, void *user_data)
+{
+  size_t i;
+
+  for (i = 0; i < idx->docs_num; i++)
+  {
+    int status;
+
+    if (strstr (idx->text + idx->docs[i], term) == NULL)
+      continue;
+
+    status = (*callback) (i, user_data);
+    if (status != 0)
+      return (status);
+  }
+
+  return (0);
+} /* }}} int tri_search_all */
+
+/*
+ * Public functions
+ */
+trigram_index_t *tri_create (void) /* {{{ */
+{
+  trigram_index_t *idx;
+
+  idx = malloc (sizeof (*idx));
+  if (idx == NULL)
+    return (NULL);
+  memset (idx, 0, sizeof (*idx));
+
+  return (idx);
+} /* }}} trigram_index_t *tri_create */
+
+void tri_destroy (trigram_index_t *idx) /* {{{ */
+{
+  if (idx == NULL)
+    return;
+
+  free (idx->text);
+  free (idx->docs);
+  free (idx->slots);
+  free (idx->postings);
+  free (idx);
+} /* }}} void tri_destroy */
+
+int tri_add (trigram_index_t *idx, const char *text) /* {{{ */
+{
+  size_t text_len;
+  size_t i;
+
+  if ((idx == NULL) || (text == NULL) || idx->finished)
+    return (EINVAL);
+
+  if (idx->docs_num >= TRI_NO_DOC)
+    return (ENOSPC);
+
+  text_len = strlen (text);
+
+  if ((idx->text_used + text_len + 1) > idx->text_size)
+  {
+    size_t size;
+    char *tmp;
+
+    size = (idx->text_size == 0) ? 4096 : idx->text_size;
+    while (size < (idx->text_used + text_len + 1))
+      size *= 2;
+
+    tmp = realloc (idx->text, size);
+    if (tmp == NULL)
+      return (ENOMEM);
+    idx->text = tmp;
+    idx->text_size = size;
+  }
+
+  if (idx->docs_num >= idx->docs_size)
+  {
+    size_t size;
+    size_t *tmp;
+
+    size = (idx->docs_size == 0) ? 256 : 2 * idx->docs_size;
+    tmp = realloc (idx->docs, size * sizeof (*tmp));
+    if (tmp == NULL)
+      return (ENOMEM);
+    idx->docs = tmp;
+    idx->docs_size = size;
+  }
+
+  for (i = 0; i < text_len; i++)
+    idx->text[idx->text_used + i] = (char) tolower ((int) text[i]);
+  idx->text[idx->text_used + text_len] = 0;
+
+  idx->docs[idx->docs_num] = idx->text_used;
+  idx->docs_num++;
+  idx->text_used += text_len + 1;
+
+  return (0);
+} /* }}} int tri_add */
+
+/* Builds the lists in two passes over the documents: the first one counts
+ * the documents per trigram, the second one fills the lists, each of which
+ * then is sorted because documents are visited in order. */
+int tri_finish (trigram_index_t *idx) /* {{{ */
+{
+  size_t offset;
+  size_t doc;
+  size_t i;
+
+  if (idx == NULL)
+    return (EINVAL);
+
+  if (idx->finished)
+    return (0);
+
+  for (doc = 0; doc < idx->docs_num; doc++)
+  {
+    const char *str = idx->text + idx->docs[doc];
+
+    for (i = 0; (str[i] != 0) && (str[i + 1] != 0) && (str[i + 2] != 0); i++)
+    {
+      tri_slot_t *slot;
+
+      slot = tri_slot_insert (idx, TRI_KEY (str + i));
+      if (slot == NULL)
+        return (ENOMEM);
+
+      if (slot->last_doc == (uint32_t) doc)
+        continue;
+      slot->last_doc = (uint32_t) doc;
+      slot->postings_num++;
+    }
+  }
+
+  offset = 0;
+  for (i = 0; i < idx->slots_num; i++)
+  {
+    idx->slots[i].postings_offset = offset;
+    offset += idx->slots[i].postings_num;
+
+    idx->slots[i].postings_num = 0;
+    idx->slots[i].last_doc = TRI_NO_DOC;
+  }
+
+  if (offset > 0)
+  {
+    idx->postings = calloc (offset, sizeof (*idx->postings));
+    if (idx->postings == NULL)
+      return (ENOMEM);
+  }
+  idx->postings_num = offset;
+
+  for (doc = 0; doc < idx->docs_num; doc++)
+  {
+    const char *str = idx->text + idx->docs[doc];
+
+    for (i = 0; (str[i] != 0) && (str[i + 1] != 0) && (str[i + 2] != 0); i++)
+    {
+      tri_slot_t *slot;
+
+      slot = tri_slot_lookup (idx, TRI_KEY (str + i));
+      if (slot->last_doc == (uint32_t) doc)
+        continue;
+      slot->last_doc = (uint32_t) doc;
+
+      idx->postings[slot->postings_offset + slot->postings_num] =
+        (uint32_t) doc;
+      slot->postings_num++;
+    }
+  }
+
+  idx->finished = 1;
+  return (0);
+} /* }}} int tri_finish */
+
+size_t tri_size (const trigram_index_t *idx) /* {{{ */
+{
+  if (idx == NULL)
+    return (0);
+
+  return (idx->docs_num);
+} /* }}} size_t tri_size */
+
+int tri_search (const trigram_index_t *idx, const char *term, /* {{{ */
+    tri_callback_t callback, void *user_data)
+{
+  tri_list_t *lists;
+  size_t lists_num;
+  size_t term_len;
+  size_t i;
+  int status;
+
+  if ((idx == NULL) || (term == NULL) || (callback == NULL)
+      || !idx->finished)
+    return (EINVAL);
+
+  term_len = strlen (term);
+  if (term_len < 3)
+    return (tri_search_all (idx, term, callback, user_data));
+
+  lists_num = term_len - 2;
+  lists = calloc (lists_num, sizeof (*lists));
+  if (lists == NULL)
+    return (ENOMEM);
+
+  for (i = 0; i < lists_num; i++)
+  {
+    const tri_slot_t *slot;
+
+    slot = tri_slot_lookup (idx, TRI_KEY (term + i));
+    if (slot == NULL)
+    {
+      /* No document contains this trigram. */
+      free (lists);
+      return (0);
+    }
+
+    lists[i].docs = idx->postings + slot->postings_offset;
+    lists[i].docs_num = slot->postings_num;
+    lists[i].pos = 0;
+  }
+
+  /* Walk the shortest list and look up its documents in the other lists,
+   * shortest first, so that most candidates are rejected early. */
+  qsort (lists, lists_num, sizeof (*lists), tri_list_compare);
+
+  status = 0;
+  for (lists[0].pos = 0; lists[0].pos < lists[0].docs_num; lists[0].pos++)
+  {
+    uint32_t doc = lists[0].docs[lists[0].pos];
+    _Bool found = 1;
+
+    for (i = 1; i < lists_num; i++)
+    {
+      lists[i].pos = tri_list_seek (lists + i, doc);
+      if (lists[i].pos >= lists[i].docs_num)
+      {
+        /* No more candidates. */
+        lists[0].pos = lists[0].docs_num;
+        found = 0;
+        break;
+      }
+      else if (lists[i].docs[lists[i].pos] != doc)
+      {
+        found = 0;
+        break;
+      }
+    }
+
+    if (!found)
+      continue;
+
+    /* The document contains all trigrams of the term, but not necessarily
+     * in the right order. */
+    if (strstr (idx->text + idx->docs[doc], term) == NULL)
+      continue;
+
+    status = (*callback) ((size_t) doc, user_data);
+    if (status != 0)
+      break;
+  }
+
+  free (lists);
+  return (status);
+} /* }}} int tri_search */
+
+/* vim: set sw=2 sts=2 et fdm=marker : */
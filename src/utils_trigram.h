@@ -0,0 +1,58 @@
+/**
+ * collection4 - utils_trigram.h
+ * Copyright (C) 2010  Florian octo Forster
+ * 
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ *
+ * Authors:
+ *   Florian octo Forster <ff at octo.it>
+ **/
+
+#ifndef UTILS_TRIGRAM_H
+#define UTILS_TRIGRAM_H 1
+
+#include <stddef.h>
+
+/* Index for substring searches in a fixed set of strings, called documents.
+ * For each sequence of three characters, the index holds the (sorted) list of
+ * documents containing it. A search intersects the lists of the search
+ * term's trigrams and only compares the term with the remaining documents.
+ *
+ * Documents are added with "tri_add", which numbers them starting at zero.
+ * "tri_finish" then builds the lists, after which the index is read-only and
+ * may be searched by several threads at once. */
+struct trigram_index_s;
+typedef struct trigram_index_s trigram_index_t;
+
+trigram_index_t *tri_create (void);
+void tri_destroy (trigram_index_t *idx);
+
+/* Adds a copy of "text", converted to lower case, as the next document. */
+int tri_add (trigram_index_t *idx, const char *text);
+int tri_finish (trigram_index_t *idx);
+
+size_t tri_size (const trigram_index_t *idx);
+
+/* Calls "callback" with the number of each document containing "term", in
+ * ascending order. Since the documents are stored in lower case, "term"
+ * should be, too. Returns the first non-zero status returned by the
+ * callback. */
+typedef int (*tri_callback_t) (size_t doc, void *user_data);
+int tri_search (const trigram_index_t *idx, const char *term,
+    tri_callback_t callback, void *user_data);
+
+#endif /* UTILS_TRIGRAM_H */
+/* vim: set sw=2 sts=2 et fdm=marker : */